@@ -3,31 +3,58 @@
 import hashlib
 import os
 import sys
-COMPILER_PATH = os.environ.get("VK_SDK_PATH") + "\\Bin\\glslangValidator.exe"
 FORCE_COMPILE = True
+# --check only tells if spir-v is missing or older than the glsl, the pre-build step runs it so stale shaders fail the build
+CHECK_ONLY = "--check" in sys.argv
+
+# spir-v file name of a shader source, None for headers
+def SpirvName(names):
+    pos = max(names.rfind(".frag"), names.rfind(".vert"), names.rfind(".mesh"), names.rfind(".comp"), names.rfind(".task"))
+    if names.find(".spv") != -1 or names.find(".bak") != -1 or pos <= 0:
+        return None
+    return names[:pos] + "." + names[pos + 1:] + ".spv"
+
+# compact vertices are a compile time switch on both sides and change the DrawData stride, so everything gets built a second time with it on.
+# The engine loads that variant when it's built with COMPACT_VERTICES=1
+COMPACT_DIR = "spir-v\\compact"
+
+def CompileDir(directory, output, defines):
+    sdk = os.environ.get("VK_SDK_PATH")
+    if sdk is None:
+      print("VK_SDK_PATH isn't set, can't find glslangValidator")
+      return ["everything"]
+    compiler = sdk + "\\Bin\\glslangValidator.exe"
 
-def CompileDir(directory):
-    
     additional_args = ""
     if len(sys.argv) > 1:
       additional_args = ' '.join(sys.argv[1:])
-      print("Aditional compiler cli args: " + additional_args)
+    if not os.path.exists(directory + "\\" + output):
+      os.makedirs(directory + "\\" + output)
 
     #gather all .frag, .vert files
     #compile them all
-    for root, dirs, files in os.walk(directory):
-        for names in files:
-            pos = max(names.rfind(".frag"), names.rfind(".vert"), names.rfind(".mesh"), names.rfind(".comp"), names.rfind(".task"))
+    failed = []
+    for names in os.listdir(directory + "\\glsl"):
+        spirv = SpirvName(names)
+        if spirv is not None:
+            renamed = directory + "\\" + output + "\\" + spirv
+            args = compiler + " -V --target-env vulkan1.2" + " " + additional_args + defines + " -o" + " " + renamed + " " + directory + "\\glsl\\" + names
+            #print(args)
+            if os.system(args) != 0:
+                failed.append(output + "\\" + spirv)
+    return failed
+
+# spir-v the engine loads, --check wants these even if their glsl goes missing
+REQUIRED_SPIRV = ["basic.vert.spv", "basic.ind.vert.spv", "basic.mesh.spv", "basic.task.spv", "basic.frag.spv",
+                  "drawGen.comp.glsl.spv", "ms_drawGen.comp.glsl.spv", "depthPyramid.comp.glsl.spv"]
 
-            if names.find(".spv") != -1 or names.find(".bak") != -1:
-              continue
-            if pos > 0:
-                fn = names[:pos]
-                ft = names[pos + 1:]
-                renamed = directory + "\\spir-v\\" + fn + "." + ft + ".spv"
-                args = COMPILER_PATH + " -V --target-env vulkan1.2" + " " + additional_args + " -o" + " " + renamed + " " + directory + "\\glsl\\" + names
-                #print(args)
-                os.system(args)
+def MissingSpirv(directory, output):
+    missing = [spirv for spirv in REQUIRED_SPIRV if not os.path.exists(directory + "\\" + output + "\\" + spirv)]
+    for names in os.listdir(directory + "\\glsl"):
+        spirv = SpirvName(names)
+        if spirv is not None and spirv not in missing and not os.path.exists(directory + "\\" + output + "\\" + spirv):
+            missing.append(spirv)
+    return [output + "\\" + spirv for spirv in missing]
 
 
 def GetHashofDirs(directory, verbose=0):
@@ -36,8 +63,10 @@ def GetHashofDirs(directory, verbose=0):
     return -1
 
   try:
+    # name order and no carriage returns, so every checkout of the same glsl gets the same hash
     for root, dirs, files in os.walk(directory):
-      for names in files:
+      dirs.sort()
+      for names in sorted(files):
         if names == ".dirhash":
             continue
         if verbose == 1:
@@ -50,11 +79,7 @@ def GetHashofDirs(directory, verbose=0):
           f1.close()
           continue
 
-        while 1:
-          # Read file in as little chunks
-          buf = f1.read(4096)
-          if not buf : break
-          SHAhash.update(hashlib.md5(buf).hexdigest().encode("utf-8"))
+        SHAhash.update(hashlib.md5(f1.read().replace(b"\r", b"")).hexdigest().encode("utf-8"))
         f1.close()
 
   except:
@@ -71,13 +96,32 @@ curdir = os.getcwd()
 if curdir.rfind("Shaders") < 0:
     os.chdir("Shaders")
     #changeback = Trues
-hash = GetHashofDirs(os.getcwd())
+hash = GetHashofDirs(os.getcwd() + "\\glsl")
 f = open(".dirhash", "r+")
 oldhash = f.read(32)
+if CHECK_ONLY:
+  f.close()
+  missing = MissingSpirv(os.getcwd(), "spir-v") + MissingSpirv(os.getcwd(), COMPACT_DIR)
+  if len(missing) > 0:
+    print("error: spir-v is missing for " + ' '.join(missing) + ", run Shaders/compile_shaders.py")
+    sys.exit(1)
+  if hash != oldhash:
+    print("error: spir-v is older than the glsl, run Shaders/compile_shaders.py")
+    sys.exit(1)
+  sys.exit(0)
 if hash != oldhash or FORCE_COMPILE:
   print("Compiling shaders..")
-  CompileDir(os.getcwd())
-  hash = GetHashofDirs(os.getcwd())
+  if len(sys.argv) > 1:
+    print("Aditional compiler cli args: " + ' '.join(sys.argv[1:]))
+  failed = CompileDir(os.getcwd(), "spir-v", "")
+  if len(failed) == 0:
+    failed = CompileDir(os.getcwd(), COMPACT_DIR, " -DCOMPACT_VERTICES=1")
+  # a failed compile keeps the old hash so the check keeps failing until it's fixed
+  if len(failed) > 0:
+    f.close()
+    print("Failed to compile: " + ' '.join(failed))
+    sys.exit(1)
+  hash = GetHashofDirs(os.getcwd() + "\\glsl")
   f.seek(0)
   f.write(hash)
   f.truncate()
@@ -4,14 +4,25 @@ layout(set = 0, binding = 0) uniform Globals
 	mat4 View;
 	mat4 cameraModel;
 	vec4 frustum[6];
+	vec4 lodParams;	// x pixels per unit at distance 1, y error threshold px, z hysteresis, w min projected size px, see Lod.h
 } globals;
 
+#if COMPACT_VERTICES
+// PackedVertex, positions are unorm16 in the mesh bounds and go back through the draw's positionOffset and positionScale
+struct Vertex
+{
+	uint16_t px, py, pz;
+	uint16_t n;		// octahedral normal, snorm8 x in the low byte and y in the high one
+	float16_t tu, tv;
+};
+#else
 struct Vertex
 {
 	float vx, vy, vz;
 	float16_t nx, ny, nz, nw;
 	float16_t tu, tv;
 };
+#endif
 
 layout(set = 0, binding = 1) readonly buffer Vertices
 {
@@ -35,4 +46,35 @@ layout(set = 0, binding = 131) buffer DrawData
 	mat4 Transform;
 	uint materialIdx;
 	uint vertexBufferOffset;
-} drawData[];
\ No newline at end of file
+	vec4 boundingSphere; // world space, xyz center w radius
+#if COMPACT_VERTICES
+	vec4 positionOffset; // of the mesh, model space position = offset + unorm position * scale
+	vec4 positionScale;
+#endif
+} drawData[];
+
+// Model space position and normal of a vertex whatever the vertex format is
+vec3 vertex_position(uint vi, uint drawIdx)
+{
+#if COMPACT_VERTICES
+	vec3 unorm = vec3(uint(vertices[vi].px), uint(vertices[vi].py), uint(vertices[vi].pz)) / 65535.0;
+	return drawData[drawIdx].positionOffset.xyz + unorm * drawData[drawIdx].positionScale.xyz;
+#else
+	return vec3(vertices[vi].vx, vertices[vi].vy, vertices[vi].vz);
+#endif
+}
+
+vec3 vertex_normal(uint vi)
+{
+#if COMPACT_VERTICES
+	uint bits = uint(vertices[vi].n);
+	vec2 e = clamp(vec2(int(bits << 24) >> 24, int(bits << 16) >> 24) / 127.0, -1.0, 1.0);
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+#else
+	return vec3(vertices[vi].nx, vertices[vi].ny, vertices[vi].nz);
+#endif
+}
\ No newline at end of file
@@ -17,6 +17,12 @@ struct ms_IndirectDrawCommand
     uint    meshTaskCount;
 };
 
+struct InstanceBucket
+{
+    uint instanceCount;
+    uint firstInstance;
+};
+
 struct IndirectDraw
 {
     uint meshDataIndex;
@@ -32,12 +38,14 @@ struct MeshLOD
 {
     uint indexCount;
     uint firstIndex;
+    float error;    // model space, see Lod.h
 };
 
 struct ms_MeshLOD
 {
     uint meshletBufferOffset;
     uint taskCount;
+    float error;
 };
 
 struct MeshData
@@ -119,4 +127,36 @@ layout(set = 1, binding = 7) readonly buffer ms_MeshletTriangleData
 layout(set = 1, binding = 8) readonly buffer ms_MeshletConeData
 {
     NormalCone normalCone[];
-};
\ No newline at end of file
+};
+
+// instancing, see drawGen.comp
+layout(set = 1, binding = 9) buffer InstanceBuckets
+{
+    uint instanceTotal;
+    uint pad;
+    InstanceBucket buckets[];
+};
+
+layout(set = 1, binding = 10) buffer DrawInstances
+{
+    uint drawInstances[];
+};
+// Hi-Z occlusion culling, see Occlusion.h. Non-zero when the draw was visible at the end of last frame
+layout(set = 1, binding = 11) buffer DrawVisibility
+{
+    uint drawVisibility[];
+};
+
+// model space, same order as meshlets
+layout(set = 1, binding = 12) readonly buffer MeshletBounds
+{
+    BoundingVolume meshletBounds[];
+};
+
+layout(set = 1, binding = 13) uniform sampler2D depthPyramid;
+
+// lod every draw was last drawn with, LOD_NONE if it wasn't. See Lod.h
+layout(set = 1, binding = 14) buffer DrawLods
+{
+    uint drawLods[];
+};
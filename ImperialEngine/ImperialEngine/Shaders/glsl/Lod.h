@@ -0,0 +1,45 @@
+// Screen-space error lod selection, needs DescriptorSet0.h and DescriptorSet1.h.
+// Same math as utils::SelectMeshLod on the CPU, the camera and settings part comes in globals.lodParams
+#define LOD_NONE    0xFFFFFFFF
+#define LOD_CULLED  0xFFFFFFFE
+
+// Lod errors only go up, so the coarsest lod under maxError is one past the last that fits
+uint coarsest_lod(vec4 lodErrors, float maxError)
+{
+    uint lod = 0;
+    for(uint i = 1; i < MESH_LOD_COUNT; i++)
+        if(lodErrors[i] <= maxError)
+            lod = i;
+    return lod;
+}
+
+// Coarsest lod of the draw whose simplification error projects under globals.lodParams.y pixels at the nearest point
+// of its sphere, or LOD_CULLED when the sphere projects under globals.lodParams.w pixels.
+// The lod the draw had last time is kept until the error moves past the threshold * (1 -+ hysteresis)
+uint select_lod(uint drawIdx, float modelRadius, vec4 lodErrors)
+{
+    vec4 sphere = drawData[drawIdx].boundingSphere;
+    float distance = dot(globals.frustum[4], vec4(sphere.xyz, 1.0)) - sphere.w;
+    // touches the near plane, nothing to project. Still the lod to stick to next time, like on the CPU
+    if(distance <= 0.0)
+    {
+        drawLods[drawIdx] = 0;
+        return 0;
+    }
+
+    float pixelsPerUnit = globals.lodParams.x / distance;
+    if(2.0 * sphere.w * pixelsPerUnit < globals.lodParams.w)
+        return LOD_CULLED;
+
+    float errorScale = modelRadius > 0.0 ? sphere.w / modelRadius : 1.0;
+    float maxError = globals.lodParams.y / (pixelsPerUnit * errorScale);
+    uint prevLod = drawLods[drawIdx];
+    uint lod;
+    if(prevLod == LOD_NONE)
+        lod = coarsest_lod(lodErrors, maxError);
+    else
+        lod = clamp(prevLod, coarsest_lod(lodErrors, maxError * (1.0 - globals.lodParams.z)), coarsest_lod(lodErrors, maxError * (1.0 + globals.lodParams.z)));
+
+    drawLods[drawIdx] = lod;
+    return lod;
+}
@@ -0,0 +1,63 @@
+// Two-phase Hi-Z occlusion culling, needs DescriptorSet0.h and DescriptorSet1.h.
+// Early phase draws only what was visible last frame, depthPyramid.comp reduces its depth and the late phase tests
+// everything against that, remembers what's visible for the next frame and draws what the early phase didn't
+#define OCCLUSION_PHASE_NONE    0
+#define OCCLUSION_PHASE_EARLY   1
+#define OCCLUSION_PHASE_LATE    2
+
+// World space sphere against the depth pyramid of the camera that rendered it (globals.PV).
+// Every row of PV can move by at most radius * |row.xyz| over the sphere, so clip x, y, z and w get intervals and
+// the screen rect and nearest depth come out of them. Conservative, the rect always covers the whole sphere
+bool is_occluded(vec4 sphere)
+{
+    mat4 rows = transpose(globals.PV);
+    vec4 clip = globals.PV * vec4(sphere.xyz, 1.0);
+    vec4 extent = sphere.w * vec4(length(rows[0].xyz), length(rows[1].xyz), length(rows[2].xyz), length(rows[3].xyz));
+    vec4 lo = clip - extent;
+    vec4 hi = clip + extent;
+
+    // touches the near plane
+    if(lo.w <= 0.0 || lo.z <= 0.0)
+        return false;
+
+    vec2 ndcMin = min(lo.xy / lo.w, lo.xy / hi.w);
+    vec2 ndcMax = max(hi.xy / lo.w, hi.xy / hi.w);
+    // lo.z is positive, biggest w gives the smallest depth
+    float nearestDepth = lo.z / hi.w;
+
+    // level 0 is the size of the depth buffer
+    vec2 size = vec2(textureSize(depthPyramid, 0));
+    ivec2 pixMin = ivec2(clamp((ndcMin * 0.5 + 0.5) * size, vec2(0.0), size - 1.0));
+    ivec2 pixMax = ivec2(clamp((ndcMax * 0.5 + 0.5) * size, vec2(0.0), size - 1.0));
+
+    // a texel of level n covers 2^n pixels each way, so a rect up to that size touches at most 2x2 texels
+    ivec2 span = pixMax - pixMin + 1;
+    int level = clamp(int(ceil(log2(float(max(span.x, span.y))))), 0, textureQueryLevels(depthPyramid) - 1);
+    // last row and column of odd sized levels cover the leftover pixels
+    ivec2 lastTexel = textureSize(depthPyramid, level) - 1;
+    ivec2 texMin = min(pixMin >> level, lastTexel);
+    ivec2 texMax = min(pixMax >> level, lastTexel);
+
+    float farthest = 0.0;
+    for(int y = texMin.y; y <= texMax.y; y++)
+        for(int x = texMin.x; x <= texMax.x; x++)
+            farthest = max(farthest, texelFetch(depthPyramid, ivec2(x, y), level).x);
+
+    return nearestDepth > farthest;
+}
+
+// Whether a draw that did or didn't pass frustum culling gets drawn in this phase
+bool occlusion_cull(uint drawIdx, bool inFrustum, uint phase)
+{
+    if(phase == OCCLUSION_PHASE_NONE)
+        return inFrustum;
+
+    bool visibleLastFrame = drawVisibility[drawIdx] != 0;
+    if(phase == OCCLUSION_PHASE_EARLY)
+        return inFrustum && visibleLastFrame;
+
+    bool visible = inFrustum && !is_occluded(drawData[drawIdx].boundingSphere);
+    drawVisibility[drawIdx] = visible ? 1 : 0;
+    // anything visible last frame was already drawn
+    return visible && !visibleLastFrame;
+}
@@ -20,15 +20,16 @@ layout(push_constant) uniform PushModel{
 	
 void main()
 {
-    vec3 pos = vec3(vertices[gl_VertexIndex].vx, vertices[gl_VertexIndex].vy, vertices[gl_VertexIndex].vz);
-    vec3 norm = vec3(vertices[gl_VertexIndex].nx, vertices[gl_VertexIndex].ny, vertices[gl_VertexIndex].nz);
-    vec2 tex = vec2(vertices[gl_VertexIndex].tu, vertices[gl_VertexIndex].tv);
-
 #if CULLING_ENABLED
-    uint ddi = drawDataIndices[gl_DrawIDARB];
+    // drawGen.comp points firstInstance at where the draw's draw data indices start
+    uint ddi = drawDataIndices[gl_InstanceIndex];
 #else
     uint ddi = gl_DrawIDARB;
 #endif
+    vec3 pos = vertex_position(uint(gl_VertexIndex), ddi);
+    vec3 norm = vertex_normal(uint(gl_VertexIndex));
+    vec2 tex = vec2(vertices[gl_VertexIndex].tu, vertices[gl_VertexIndex].tv);
+
     vec3 color = vec3(materialData[drawData[ddi].materialIdx].color);
 	mat4 model = drawData[ddi].Transform;
     vec3 ecPos      = vec3(model * vec4(pos, 1.0));
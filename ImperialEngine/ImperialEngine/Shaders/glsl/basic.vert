@@ -1,5 +1,6 @@
 #version 450 //glsl 4.5
 #extension GL_EXT_nonuniform_qualifier : require
+#extension GL_ARB_shader_draw_parameters: require
 #extension GL_GOOGLE_include_directive: require
 #extension GL_EXT_shader_16bit_storage: require
 
@@ -14,18 +15,22 @@ layout(location = 3) out vec3 SurfaceColor;
 #endif
 
 
+// First draw data of the draw, instanced draws have the rest right after it.
+// Only used with kEngineDrawIdPushConstant, otherwise it's 0 and the draw index comes in through firstInstance
+// (and gl_DrawID for multi draws)
 layout(push_constant) uniform PushModel{
 	uint idx;
 } pushModel;
 	
 void main()
 {
-    vec3 pos = vec3(vertices[gl_VertexIndex].vx, vertices[gl_VertexIndex].vy, vertices[gl_VertexIndex].vz);
-    vec3 norm = vec3(vertices[gl_VertexIndex].nx, vertices[gl_VertexIndex].ny, vertices[gl_VertexIndex].nz);
+	uint ddi = pushModel.idx + gl_InstanceIndex + gl_DrawIDARB;
+    vec3 pos = vertex_position(uint(gl_VertexIndex), ddi);
+    vec3 norm = vertex_normal(uint(gl_VertexIndex));
     vec2 tex = vec2(vertices[gl_VertexIndex].tu, vertices[gl_VertexIndex].tv);
 
-	vec3 color = vec3(materialData[drawData[pushModel.idx].materialIdx].color);
-	mat4 model = drawData[pushModel.idx].Transform;
+	vec3 color = vec3(materialData[drawData[ddi].materialIdx].color);
+	mat4 model = drawData[ddi].Transform;
     vec3 ecPos      = vec3(model * vec4(pos, 1.0));
     vec3 tnorm      = norm;
     vec3 lightVec   = normalize(color  - ecPos);
@@ -0,0 +1,44 @@
+#version 450
+#extension GL_GOOGLE_include_directive: require
+
+// Builds the depth pyramid Occlusion.h tests against, a dispatch per level.
+// Level 0 is a copy of the depth buffer, every other level keeps the farthest depth of the texels under it.
+// Only core compute features, no sampler reduction modes or subgroup ops, so it also runs on software implementations
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+#define DEPTH_PYRAMID_MAX_LEVELS 16
+
+layout(set = 2, binding = 0) uniform sampler2D depthSource;
+layout(set = 2, binding = 1, r32f) uniform image2D pyramidLevels[DEPTH_PYRAMID_MAX_LEVELS];
+
+layout(push_constant) uniform Level
+{
+    uint level;
+};
+
+void main()
+{
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(pyramidLevels[level]);
+    if(any(greaterThanEqual(pos, size)))
+        return;
+
+    if(level == 0)
+    {
+        imageStore(pyramidLevels[0], pos, vec4(texelFetch(depthSource, pos, 0).x));
+        return;
+    }
+
+    // levels are rounded down, the last row and column of an odd sized level below take the leftover texel
+    ivec2 srcSize = imageSize(pyramidLevels[level - 1]);
+    ivec2 first = pos * 2;
+    ivec2 last = first + 1 + ivec2(equal(pos, size - 1)) * (srcSize & 1);
+    last = min(last, srcSize - 1);
+
+    float farthest = 0.0;
+    for(int y = first.y; y <= last.y; y++)
+        for(int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, imageLoad(pyramidLevels[level - 1], ivec2(x, y)).x);
+
+    imageStore(pyramidLevels[level], pos, vec4(farthest));
+}
@@ -9,48 +9,61 @@ layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
 #include "prefix.h"
 #include "DescriptorSet0.h"
 #include "DescriptorSet1.h"
+#include "Occlusion.h"
+#include "Lod.h"
 
 layout(push_constant) uniform ViewFrustum
 {
     uint numDraws;
+    uint pass;
+    uint numBuckets;    // mesh count * MESH_LOD_COUNT
+    uint occlusionPhase;
 };
 
-float distFromCamera = 0.0;
+// Without instancing a single pass writes a draw command per visible object.
+// With it visible objects are bucketed by (mesh, lod) over three passes and each bucket becomes one instanced draw
+#define PASS_SINGLE     0
+#define PASS_COUNT      1   // cull, count instances of every bucket
+#define PASS_BUCKETS    2   // one draw command per bucket that got instances
+#define PASS_SCATTER    3   // draw data indices of a bucket's instances go next to each other
 
-void copy_draw_command(uint idx, uint newIdx)
-{
-    drawDataIndices[newIdx] = idx;
+#define INVISIBLE 0xFFFFFFFF
 
-    MeshData meshdata = md[drawsSrc[idx].meshDataIndex];
-
-    uint lodIdx = 0;
-#if LOD_ENABLED
-    if(distFromCamera >= 250)
-        lodIdx = 3;
-    else if(distFromCamera >= 100)
-        lodIdx = 2;
-    else if(distFromCamera >= 25)
-        lodIdx = 1;
-#endif
+// LOD_CULLED when it's too small to draw
+uint pick_lod(uint drawIdx)
+{
+    MeshData meshdata = md[drawsSrc[drawIdx].meshDataIndex];
+    vec4 lodErrors = vec4(0.0);
+    for(uint i = 0; i < MESH_LOD_COUNT; i++)
+        lodErrors[i] = meshdata.LODData[i].error;
+    return select_lod(drawIdx, meshdata.boundingVolume.radius, lodErrors);
+}
 
+void write_draw_command(uint cmdIdx, uint meshDataIndex, uint lodIdx, uint instanceCount, uint firstInstance)
+{
+    MeshData meshdata = md[meshDataIndex];
     MeshLOD lod = meshdata.LODData[lodIdx];
 
-    drawsDst[newIdx].indexCount    = lod.indexCount;
-    drawsDst[newIdx].instanceCount = 1;
-    drawsDst[newIdx].firstIndex    = lod.firstIndex;
-    drawsDst[newIdx].vertexOffset  = meshdata.vertexOffset;
-    drawsDst[newIdx].firstInstance = 0;
+    drawsDst[cmdIdx].indexCount    = lod.indexCount;
+    drawsDst[cmdIdx].instanceCount = instanceCount;
+    drawsDst[cmdIdx].firstIndex    = lod.firstIndex;
+    drawsDst[cmdIdx].vertexOffset  = meshdata.vertexOffset;
+    // basic.ind.vert finds draw data through gl_InstanceIndex, which starts at firstInstance
+    drawsDst[cmdIdx].firstInstance = firstInstance;
 }
 
-bool is_inside_view_frustum(uint idx)
+void copy_draw_command(uint idx, uint newIdx, uint lodIdx)
 {
-    BoundingVolume bv = md[drawsSrc[idx].meshDataIndex].boundingVolume;
-
-    vec4 mCenter = vec4(bv.center, 1.0); // BV center in Model space
-    vec4 wCenter = drawData[idx].Transform * mCenter;           // BV center in World space
+    drawDataIndices[newIdx] = idx;
+    write_draw_command(newIdx, drawsSrc[idx].meshDataIndex, lodIdx, 1, newIdx);
+}
 
-    float scale = length(drawData[idx].Transform[0].xyz);
-    float radius = bv.radius * scale;
+bool is_inside_view_frustum(uint idx)
+{
+    // World space BV cached on the CPU, radius is already scaled by the biggest axis scale
+    vec4 sphere = drawData[idx].boundingSphere;
+    vec4 wCenter = vec4(sphere.xyz, 1.0);
+    float radius = sphere.w;
 
     for (int i = 0; i < 6; i++)
     {
@@ -63,28 +76,69 @@ bool is_inside_view_frustum(uint idx)
         // If it's less than 0 + (-radius) then BV is outside VF
         if(signedDistance < -radius)
             return false;
-#if LOD_ENABLED
-        // Temporary solution to saving distance from near plane for LOD picking
-        // TODO: avoid global variables
-        if(i == 4)
-            distFromCamera = signedDistance - radius;
-#endif
     }
     return true;
 }
 
+void emit_bucket(uint bucket)
+{
+    uint instanceCount = buckets[bucket].instanceCount;
+    if(instanceCount == 0)
+        return;
+
+    // buckets can go in any order, so no need for a prefix sum
+    uint firstInstance = atomicAdd(instanceTotal, instanceCount);
+    buckets[bucket].firstInstance = firstInstance;
+
+    uint cmdIdx = atomicAdd(drawCommandCount, 1);
+    write_draw_command(cmdIdx, bucket / MESH_LOD_COUNT, bucket % MESH_LOD_COUNT, instanceCount, firstInstance);
+}
+
 void main()
 {
-	uint drawIdx = gl_WorkGroupID.x * 32 + gl_LocalInvocationID.x;
+	uint threadIdx = gl_WorkGroupID.x * 32 + gl_LocalInvocationID.x;
+
+    if(pass == PASS_BUCKETS)
+    {
+        if(threadIdx < numBuckets)
+            emit_bucket(threadIdx);
+        return;
+    }
 
+    uint drawIdx = threadIdx;
     if(drawIdx >= numDraws)
         return;
 
-    bool isVisible = is_inside_view_frustum(drawIdx);
+    if(pass == PASS_SCATTER)
+    {
+        // instance slot in the bucket * MESH_LOD_COUNT + lod
+        uint instance = drawInstances[drawIdx];
+        if(instance == INVISIBLE)
+            return;
+
+        uint bucket = drawsSrc[drawIdx].meshDataIndex * MESH_LOD_COUNT + instance % MESH_LOD_COUNT;
+        drawDataIndices[buckets[bucket].firstInstance + instance / MESH_LOD_COUNT] = drawIdx;
+        return;
+    }
 
-    if(isVisible)
+    // buckets and scatter go by what count decided, so culling and lod picking only happen here
+    bool isVisible = occlusion_cull(drawIdx, is_inside_view_frustum(drawIdx), occlusionPhase);
+    uint lodIdx = isVisible ? pick_lod(drawIdx) : LOD_CULLED;
+    isVisible = lodIdx != LOD_CULLED;
+
+    if(pass == PASS_COUNT)
+    {
+        uint instance = INVISIBLE;
+        if(isVisible)
+        {
+            uint bucket = drawsSrc[drawIdx].meshDataIndex * MESH_LOD_COUNT + lodIdx;
+            instance = atomicAdd(buckets[bucket].instanceCount, 1) * MESH_LOD_COUNT + lodIdx;
+        }
+        drawInstances[drawIdx] = instance;
+    }
+    else if(isVisible)
     {
         uint newDrawIndex = atomicAdd(drawCommandCount, 1);
-        copy_draw_command(drawIdx, newDrawIndex);
+        copy_draw_command(drawIdx, newDrawIndex, lodIdx);
     }
 }
\ No newline at end of file
@@ -10,32 +10,34 @@ layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
 #include "prefix.h"
 #include "DescriptorSet0.h"
 #include "DescriptorSet1.h"
+#include "Occlusion.h"
+#include "Lod.h"
 
 // TODO mesh: remove .glsl postfix of compute files
 
 layout(push_constant) uniform ViewFrustum
 {
     uint numDraws;
+    uint pass;          // drawGen.comp's, unused
+    uint numBuckets;    // drawGen.comp's, unused
+    uint occlusionPhase;
 };
 
-float distFromCamera = 0.0;
+// LOD_CULLED when it's too small to draw
+uint pick_lod(uint drawIdx)
+{
+    ms_MeshData meshdata = ms_md[drawsSrc[drawIdx].meshDataIndex];
+    vec4 lodErrors = vec4(0.0);
+    for(uint i = 0; i < MESH_LOD_COUNT; i++)
+        lodErrors[i] = meshdata.LODData[i].error;
+    return select_lod(drawIdx, meshdata.boundingVolume.radius, lodErrors);
+}
 
-void copy_draw_command(uint idx, uint newIdx)
+void copy_draw_command(uint idx, uint newIdx, uint lodIdx)
 {
     drawDataIndices[newIdx] = idx;
     
     ms_MeshData meshdata = ms_md[drawsSrc[idx].meshDataIndex];
-
-    uint lodIdx = 0;
-#if LOD_ENABLED
-    if(distFromCamera >= 250)
-        lodIdx = 3;
-    else if(distFromCamera >= 100)
-        lodIdx = 2;
-    else if(distFromCamera >= 25)
-        lodIdx = 1;
-#endif
-    
     ms_MeshLOD lod = meshdata.LODData[lodIdx];
     
 #if CONE_CULLING_ENABLED
@@ -52,14 +54,10 @@ void copy_draw_command(uint idx, uint newIdx)
 
 bool is_inside_view_frustum(uint idx)
 {
-    BoundingVolume bv = ms_md[drawsSrc[idx].meshDataIndex].boundingVolume;
-
-    vec4 mCenter = vec4(bv.center, 1.0); // BV center in Model space
-    vec4 wCenter = drawData[idx].Transform * mCenter;           // BV center in World space
-
-    float scale = length(drawData[idx].Transform[0].xyz);
-
-    float radius = bv.radius * scale;
+    // World space BV cached on the CPU, radius is already scaled by the biggest axis scale
+    vec4 sphere = drawData[idx].boundingSphere;
+    vec4 wCenter = vec4(sphere.xyz, 1.0);
+    float radius = sphere.w;
 
     for (int i = 0; i < 6; i++)
     {
@@ -72,12 +70,6 @@ bool is_inside_view_frustum(uint idx)
         // If it's less than 0 + (-radius) then BV is outside VF
         if(signedDistance < -radius)
             return false;
-        
-#if LOD_ENABLED
-        // Temporary solution to saving distance from near plane for LOD picking
-        if(i == 4)
-            distFromCamera = signedDistance - radius;
-#endif
     }
     return true;
 }
@@ -89,11 +81,12 @@ void main()
     if(drawIdx >= numDraws)
         return;
 
-    bool isVisible = is_inside_view_frustum(drawIdx);
+    bool isVisible = occlusion_cull(drawIdx, is_inside_view_frustum(drawIdx), occlusionPhase);
+    uint lodIdx = isVisible ? pick_lod(drawIdx) : LOD_CULLED;
 
-    if(isVisible)
+    if(lodIdx != LOD_CULLED)
     {
         uint newDrawIndex = atomicAdd(drawCommandCount, 1);
-        copy_draw_command(drawIdx, newDrawIndex);
+        copy_draw_command(drawIdx, newDrawIndex, lodIdx);
     }
 }
\ No newline at end of file
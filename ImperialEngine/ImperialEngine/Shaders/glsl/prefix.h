@@ -31,4 +31,9 @@
 
 #ifndef MESH_WGROUP
 #define MESH_WGROUP 32
+#endif
+
+// same as EngineStaticConfig.h
+#ifndef COMPACT_VERTICES
+#define COMPACT_VERTICES 0
 #endif
\ No newline at end of file
@@ -30,7 +30,10 @@ translation = {
     "CPU Main Thread" : "CPU Pagrindinė Gija",
     "CPU Render Thread" : "CPU Vaizdavimo Gija",
     "GPU Frame" : "GPU Pilnas Darbas",
-    "Triangles" : "Apdoroti trikampiai"
+    "Triangles" : "Apdoroti trikampiai",
+    "Sync Wait" : "Pagrindinės gijos laukimas sinchronizuojant",
+    "Occlusion Culling" : "Užstotų objektų atmetimas",
+    "Occluded" : "Užstoti objektai"
     }
 
 ## -- data structures --
@@ -84,7 +87,7 @@ def read_all(filepath):
 
 def smoothing(df):
     if smooth_data == True:
-        exclude = ["Triangles"]
+        exclude = ["Triangles", "Occluded"]
         df_dropped = df.drop(columns=exclude)
         smoothed = df_dropped.rolling(5, center=True).mean()
         smoothed[exclude] = df[exclude]
@@ -556,6 +559,219 @@ def test_suite_object_count():
 
     process_results_obj_count(results)
 
+# Barrier lockstep vs pipelined frames, shows how much of the main thread wait is removed
+def test_suite_frames_in_flight():
+    run_count = " --run-for=250"
+
+    defines = "BENCHMARK_MODE#1"
+    compile_shaders("DEBUG_MESH=0")
+    result = compile_engine(defines)
+    if result > 0:
+        print("Failed to successfully compile engine")
+        return
+
+    scene = "--file-count=2 --load-files Scene/Donut.obj Scene/Suzanne.obj --distribute=random --entity-count=100000"
+    results = []
+    for frames_in_flight in [0, 1, 2, 3]:
+        result = run_test(scene + " --frames-in-flight=" + str(frames_in_flight) + run_count)
+        desc = "Barjeras" if frames_in_flight == 0 else "Kadrai eilėje: {}".format(frames_in_flight)
+        results.append(TestResult(result, desc))
+
+    last_test_id_str = test_id_to_filename(results[-1].test_id)
+    for col in ["Sync Wait", "Frame Time"]:
+        data_cpu = []
+        data_gpu = []
+        data_mesh = []
+        for result in results:
+            df_cpu, df_gpu, df_mesh = read_all(cwd + "Testing/TestData/" + test_id_to_filename(result.test_id) + "/")
+            data_cpu.append(df_cpu[col].mean())
+            data_gpu.append(df_gpu[col].mean())
+            data_mesh.append(df_mesh[col].mean())
+        plot_bar3(data_cpu, data_gpu, data_mesh, [result.desc for result in results], translation[col], last_test_id_str)
+
+        barrier_wait = data_cpu[0]
+        for result, wait in zip(results[1:], data_cpu[1:]):
+            print("[Frames in flight] {}: {} {:.3f} ms -> {:.3f} ms (Tradicinis)".format(result.desc, col, barrier_wait, wait))
+
+# Same scene drawn draw per object vs one instanced draw per mesh and lod, at growing object counts
+def test_suite_instancing():
+    run_count = " --run-for=250"
+
+    defines = "BENCHMARK_MODE#1"
+    compile_shaders("DEBUG_MESH=0")
+    result = compile_engine(defines)
+    if result > 0:
+        print("Failed to successfully compile engine")
+        return
+
+    entity_counts = [100000, 250000, 500000, 1000000]
+    results = []
+    for count in entity_counts:
+        scene = "--file-count=2 --load-files Scene/Donut.obj Scene/Suzanne.obj --distribute=random --entity-count=" + str(count)
+        for instancing in [False, True]:
+            result = run_test(scene + (" --instancing" if instancing else "") + run_count)
+            desc = "{} obj.{}".format(count, " instancijuojant" if instancing else "")
+            results.append(TestResult(result, desc))
+
+    last_test_id_str = test_id_to_filename(results[-1].test_id)
+    for col in ["CPU Render Thread", "GPU Frame", "Frame Time"]:
+        data_cpu = []
+        data_gpu = []
+        data_mesh = []
+        for result in results:
+            df_cpu, df_gpu, df_mesh = read_all(cwd + "Testing/TestData/" + test_id_to_filename(result.test_id) + "/")
+            data_cpu.append(df_cpu[col].mean())
+            data_gpu.append(df_gpu[col].mean())
+            data_mesh.append(df_mesh[col].mean())
+        plot_bar3(data_cpu, data_gpu, data_mesh, [result.desc for result in results], translation[col], last_test_id_str)
+
+        for i, count in enumerate(entity_counts):
+            plain = 2 * i
+            instanced = plain + 1
+            print("[Instancing] {} objects: {} {:.3f} ms -> {:.3f} ms (Tradicinis), {:.3f} ms -> {:.3f} ms (GPU)".format(
+                count, col, data_cpu[plain], data_cpu[instanced], data_gpu[plain], data_gpu[instanced]))
+
+# Traditional draws get recorded in secondary command buffers on job system threads, render thread time should go down with more workers
+def test_suite_parallel_recording():
+    run_count = " --run-for=250"
+
+    defines = "BENCHMARK_MODE#1"
+    compile_shaders("DEBUG_MESH=0")
+    result = compile_engine(defines)
+    if result > 0:
+        print("Failed to successfully compile engine")
+        return
+
+    scene = "--file-count=2 --load-files Scene/Donut.obj Scene/Suzanne.obj --distribute=random --entity-count=250000"
+    worker_counts = [0, 1, 3, 7]
+    results = []
+    for workers in worker_counts:
+        result = run_test(scene + " --job-workers=" + str(workers) + run_count)
+        results.append(TestResult(result, "Gijos: {}".format(workers + 1)))
+
+    last_test_id_str = test_id_to_filename(results[-1].test_id)
+    for col in ["CPU Render Thread", "Frame Time"]:
+        data_cpu = []
+        data_gpu = []
+        data_mesh = []
+        for result in results:
+            df_cpu, df_gpu, df_mesh = read_all(cwd + "Testing/TestData/" + test_id_to_filename(result.test_id) + "/")
+            data_cpu.append(df_cpu[col].mean())
+            data_gpu.append(df_gpu[col].mean())
+            data_mesh.append(df_mesh[col].mean())
+        plot_bar3(data_cpu, data_gpu, data_mesh, [result.desc for result in results], translation[col], last_test_id_str)
+
+        for result, time in zip(results, data_cpu):
+            print("[Parallel recording] {}: {} {:.3f} ms (Tradicinis)".format(result.desc, col, time))
+
+# Traditional draws telling the vertex shader their draw index through push constants, firstInstance or multi draw
+def test_suite_draw_id():
+    run_count = " --run-for=250"
+
+    defines = "BENCHMARK_MODE#1"
+    compile_shaders("DEBUG_MESH=0")
+    result = compile_engine(defines)
+    if result > 0:
+        print("Failed to successfully compile engine")
+        return
+
+    scene = "--file-count=2 --load-files Scene/Donut.obj Scene/Suzanne.obj --distribute=random --entity-count=250000"
+    results = []
+    for draw_id in ["push", "instance", "multi"]:
+        result = run_test(scene + " --draw-id=" + draw_id + run_count)
+        results.append(TestResult(result, draw_id))
+
+    last_test_id_str = test_id_to_filename(results[-1].test_id)
+    for col in ["CPU Render Thread", "Frame Time"]:
+        data_cpu = []
+        data_gpu = []
+        data_mesh = []
+        for result in results:
+            df_cpu, df_gpu, df_mesh = read_all(cwd + "Testing/TestData/" + test_id_to_filename(result.test_id) + "/")
+            data_cpu.append(df_cpu[col].mean())
+            data_gpu.append(df_gpu[col].mean())
+            data_mesh.append(df_mesh[col].mean())
+        plot_bar3(data_cpu, data_gpu, data_mesh, [result.desc for result in results], translation[col], last_test_id_str)
+
+        push_time = data_cpu[0]
+        for result, time in zip(results[1:], data_cpu[1:]):
+            print("[Draw id] {}: {} {:.3f} ms -> {:.3f} ms (Tradicinis)".format(result.desc, col, push_time, time))
+
+# CPU occlusion culling after frustum culling in Traditional mode, what it costs on the main thread and what it saves
+def test_suite_occlusion():
+    run_count = " --run-for=250"
+
+    defines = "BENCHMARK_MODE#1"
+    compile_shaders("DEBUG_MESH=0")
+    result = compile_engine(defines)
+    if result > 0:
+        print("Failed to successfully compile engine")
+        return
+
+    entity_counts = [100000, 250000, 500000]
+    results = []
+    for count in entity_counts:
+        scene = "--file-count=2 --load-files Scene/Donut.obj Scene/Suzanne.obj --distribute=random --entity-count=" + str(count)
+        for occlusion in [False, True]:
+            result = run_test(scene + (" --occlusion-cull" if occlusion else "") + run_count)
+            desc = "{} obj.{}".format(count, " užstojimas" if occlusion else "")
+            results.append(TestResult(result, desc))
+
+    last_test_id_str = test_id_to_filename(results[-1].test_id)
+    for col in ["Culling", "Occlusion Culling", "Occluded", "Triangles", "CPU Render Thread", "Frame Time"]:
+        data_cpu = []
+        data_gpu = []
+        data_mesh = []
+        for result in results:
+            df_cpu, df_gpu, df_mesh = read_all(cwd + "Testing/TestData/" + test_id_to_filename(result.test_id) + "/")
+            data_cpu.append(df_cpu[col].mean())
+            data_gpu.append(df_gpu[col].mean())
+            data_mesh.append(df_mesh[col].mean())
+        plot_bar3(data_cpu, data_gpu, data_mesh, [result.desc for result in results], translation[col], last_test_id_str)
+
+        for i, count in enumerate(entity_counts):
+            plain = 2 * i
+            occluded = plain + 1
+            print("[Occlusion] {} objects: {} {:.3f} -> {:.3f} (Tradicinis)".format(count, col, data_cpu[plain], data_cpu[occluded]))
+
+# Two-phase Hi-Z occlusion culling in the GPU-Driven modes, what the depth pyramid and late cull cost on the GPU and what
+# they save
+def test_suite_hiz():
+    run_count = " --run-for=250"
+
+    defines = "BENCHMARK_MODE#1"
+    compile_shaders("DEBUG_MESH=0")
+    result = compile_engine(defines)
+    if result > 0:
+        print("Failed to successfully compile engine")
+        return
+
+    entity_counts = [100000, 250000, 500000]
+    results = []
+    for count in entity_counts:
+        scene = "--file-count=2 --load-files Scene/Donut.obj Scene/Suzanne.obj --distribute=random --entity-count=" + str(count)
+        for hiz in [False, True]:
+            result = run_test(scene + (" --hiz-cull" if hiz else "") + run_count)
+            desc = "{} obj.{}".format(count, " Hi-Z" if hiz else "")
+            results.append(TestResult(result, desc))
+
+    last_test_id_str = test_id_to_filename(results[-1].test_id)
+    for col in ["Culling", "Occlusion Culling", "Triangles", "GPU Frame", "Frame Time"]:
+        data_cpu = []
+        data_gpu = []
+        data_mesh = []
+        for result in results:
+            df_cpu, df_gpu, df_mesh = read_all(cwd + "Testing/TestData/" + test_id_to_filename(result.test_id) + "/")
+            data_cpu.append(df_cpu[col].mean())
+            data_gpu.append(df_gpu[col].mean())
+            data_mesh.append(df_mesh[col].mean())
+        plot_bar3(data_cpu, data_gpu, data_mesh, [result.desc for result in results], translation[col], last_test_id_str)
+
+        for i, count in enumerate(entity_counts):
+            plain = 2 * i
+            hiz = plain + 1
+            print("[Hi-Z] {} objects: {} {:.3f} -> {:.3f} (GPU), {:.3f} -> {:.3f} (Mesh)".format(count, col, data_gpu[plain], data_gpu[hiz], data_mesh[plain], data_mesh[hiz]))
+
 def test_suite_mesh():
     if supports_mesh_shading == False:
         return
@@ -601,6 +817,12 @@ def main():
      "--file-count=1 --load-files Scene/sponza_wc_v_cameranear.glb"]
     test_suite_optimization(args)
     test_suite_object_count()
+    test_suite_frames_in_flight()
+    test_suite_instancing()
+    test_suite_parallel_recording()
+    test_suite_draw_id()
+    test_suite_occlusion()
+    test_suite_hiz()
     test_suite_mesh()
 
     for result in test_results:
@@ -1,4 +1,11 @@
 #include "frontend/Engine.h"
+#include "backend/parallel/QueueBenchmark.h"
+#include "backend/parallel/JobBenchmark.h"
+#include "Utils/FrustumCullKernels.h"
+#include "Utils/MeshletCulling.h"
+#include "Utils/ObjLoader.h"
+#include "Utils/VertexConversion.h"
+#include "Utils/VertexPacking.h"
 #include "Utils/EngineStaticConfig.h"
 #include "extern/ARGH/argh.h"
 #include <iostream>
@@ -16,6 +23,21 @@ struct CLI
 	std::string entityCount;
 	std::string cameraMovement;
 	std::string growthStep;
+	bool benchmarkQueues = false;
+	bool benchmarkJobs = false;
+	bool benchmarkCullKernels = false;
+	bool benchmarkMeshletCulling = false;
+	bool benchmarkMeshProcessing = false;
+	bool benchmarkVertexConversion = false;
+	bool benchmarkObjLoad = false;
+	bool benchmarkVertexFormat = false;
+	bool cookMeshes = false;
+	int64_t dumpFrameGraphFrame = -1;
+	int64_t benchmarkCullFrame = -1;
+	bool cullWithBVH = false;
+	bool occlusionCulling = false;
+	bool hizCulling = false;
+	bool instancing = false;
 };
 
 bool ConfigureEngineWithArgs(char** argv, CLI& cli, EngineSettings& settings);
@@ -50,15 +72,66 @@ int main(int argc, char** argv)
 	if (!ConfigureEngineWithArgs(argv, cli, settings))
 		return 1;
 
+	if (cli.benchmarkQueues)
+	{
+		prl::RunQueueBenchmark();
+		return 0;
+	}
+
+	if (cli.benchmarkJobs)
+	{
+		prl::RunJobSystemBenchmark();
+		return 0;
+	}
+
+	if (cli.benchmarkCullKernels)
+	{
+		imp::utils::RunFrustumCullKernelBenchmark();
+		return 0;
+	}
+
+	if (cli.benchmarkMeshletCulling)
+	{
+		imp::utils::RunMeshletCullBenchmark();
+		return 0;
+	}
+
+	if (cli.benchmarkVertexConversion)
+	{
+		imp::utils::RunVertexConversionBenchmark();
+		return 0;
+	}
+
+	if (cli.benchmarkObjLoad)
+	{
+		imp::utils::RunObjLoadBenchmark(cli.scenesToLoad);
+		return 0;
+	}
+
+	if (cli.benchmarkVertexFormat)
+	{
+		imp::utils::RunVertexFormatBenchmark();
+		return 0;
+	}
+
 	if (!engine.Initialize(settings))
 		return 1;
 
+	if (cli.benchmarkMeshProcessing)
+		engine.RequestMeshProcessingBenchmark();
+	engine.SetMeshCookingEnabled(cli.cookMeshes);
+
 	engine.LoadScenes(cli.scenesToLoad);
 	engine.LoadAssets();
 
 	if (cli.distribution.size() && cli.entityCount.size())
 		engine.DistributeEntities(cli.distribution, cli.entityCount);
 
+	engine.SetCullingBVHEnabled(cli.cullWithBVH);
+	engine.SetOcclusionCullingEnabled(cli.occlusionCulling);
+	engine.SetGPUOcclusionCullingEnabled(cli.hizCulling);
+	engine.SetInstancingEnabled(cli.instancing);
+
 	engine.SyncRenderThread();
 
 #if BENCHMARK_MODE
@@ -71,11 +144,17 @@ int main(int argc, char** argv)
 #endif
 
 	// update - sync - render - update
+	int64_t frame = 0;
 	while (!engine.ShouldClose())
 	{
 #if BENCHMARK_MODE
 		if (Benchmark(engine, cli, settings, warmupFrames, benchmarkFrames, currRenderModeIdx)) break;
 #endif
+		if (frame == cli.dumpFrameGraphFrame)
+			engine.RequestFrameGraphDump();
+		if (frame == cli.benchmarkCullFrame)
+			engine.RequestCullBenchmark();
+		frame++;
 		engine.StartFrame();
 #if BENCHMARK_MODE
 		CustomUpdates(engine, cli);
@@ -100,7 +179,7 @@ int main(int argc, char** argv)
 
 static void PrintCorrectCLI()
 {
-	printf("ImperialEngine.exe [--wait-for-debugger] [--file-count=<count>] [--load-files <file names>] [--entity-count=<count>] [--distribute=<distribution>]\n");
+	printf("ImperialEngine.exe [--wait-for-debugger] [--file-count=<count>] [--load-files <file names>] [--entity-count=<count>] [--distribute=<distribution>] [--frames-in-flight=<count>] [--benchmark-queues] [--benchmark-jobs] [--benchmark-cull-kernels] [--benchmark-meshlet-cull] [--benchmark-mesh-processing] [--benchmark-vertex-conversion] [--benchmark-obj-load] [--benchmark-vertex-format] [--cook] [--dump-frame-graph=<frame>] [--benchmark-cull=<frame>] [--cull-bvh] [--occlusion-cull] [--hiz-cull] [--instancing] [--job-workers=<count>] [--draw-id=<push|instance|multi>] [--lod-error=<px>] [--lod-hysteresis=<fraction>] [--min-projected-size=<px>]\n");
 }
 
 bool ConfigureEngineWithArgs(char** argv, CLI& cli, EngineSettings& settings)
@@ -145,6 +224,75 @@ bool ConfigureEngineWithArgs(char** argv, CLI& cli, EngineSettings& settings)
 		}
 	}
 
+	cli.benchmarkQueues = cmdl["--benchmark-queues"];
+	cli.benchmarkJobs = cmdl["--benchmark-jobs"];
+	cli.benchmarkCullKernels = cmdl["--benchmark-cull-kernels"];
+	cli.benchmarkMeshletCulling = cmdl["--benchmark-meshlet-cull"];
+	cli.benchmarkMeshProcessing = cmdl["--benchmark-mesh-processing"];
+	cli.benchmarkVertexConversion = cmdl["--benchmark-vertex-conversion"];
+	cli.benchmarkObjLoad = cmdl["--benchmark-obj-load"];
+	cli.benchmarkVertexFormat = cmdl["--benchmark-vertex-format"];
+	cli.cookMeshes = cmdl["--cook"];
+	cmdl("--dump-frame-graph", -1) >> cli.dumpFrameGraphFrame;
+	cmdl("--benchmark-cull", -1) >> cli.benchmarkCullFrame;
+	cli.cullWithBVH = cmdl["--cull-bvh"];
+	cli.occlusionCulling = cmdl["--occlusion-cull"];
+	cli.hizCulling = cmdl["--hiz-cull"];
+	cli.instancing = cmdl["--instancing"];
+
+	if (cmdl("--draw-id"))
+	{
+		const auto drawId = cmdl("--draw-id").str();
+		if (drawId == "push")
+			settings.gfxSettings.drawIdMode = kEngineDrawIdPushConstant;
+		else if (drawId == "instance")
+			settings.gfxSettings.drawIdMode = kEngineDrawIdFirstInstance;
+		else if (drawId == "multi")
+			settings.gfxSettings.drawIdMode = kEngineDrawIdMultiDraw;
+		else
+		{
+			printf("[CLI]: Error! draw-id must be 'push', 'instance' or 'multi'\n");
+			PrintCorrectCLI();
+			return false;
+		}
+	}
+
+	cmdl("--lod-error", settings.gfxSettings.lod.errorThreshold) >> settings.gfxSettings.lod.errorThreshold;
+	cmdl("--lod-hysteresis", settings.gfxSettings.lod.hysteresis) >> settings.gfxSettings.lod.hysteresis;
+	cmdl("--min-projected-size", settings.gfxSettings.lod.minProjectedSize) >> settings.gfxSettings.lod.minProjectedSize;
+	if (settings.gfxSettings.lod.errorThreshold <= 0.0f || settings.gfxSettings.lod.hysteresis < 0.0f || settings.gfxSettings.lod.hysteresis >= 1.0f)
+	{
+		printf("[CLI]: Error! lod-error must be positive and lod-hysteresis in [0, 1)\n");
+		PrintCorrectCLI();
+		return false;
+	}
+
+	if (cmdl("--job-workers"))
+	{
+		int jobWorkers = 0;
+		cmdl("--job-workers") >> jobWorkers;
+		if (jobWorkers < 0)
+		{
+			printf("[CLI]: Error! job-workers must be 0 or a positive integer\n");
+			PrintCorrectCLI();
+			return false;
+		}
+		settings.jobWorkerCount = static_cast<uint32_t>(jobWorkers);
+	}
+
+	if (cmdl("--frames-in-flight"))
+	{
+		int framesInFlight = 0;
+		cmdl("--frames-in-flight") >> framesInFlight;
+		if (framesInFlight < 0)
+		{
+			printf("[CLI]: Error! frames-in-flight must be 0 (barrier) or a positive integer\n");
+			PrintCorrectCLI();
+			return false;
+		}
+		settings.framesInFlight = static_cast<uint32_t>(framesInFlight);
+	}
+
 	if (cmdl("--camera-movement"))
 		cli.cameraMovement = cmdl("--camera-movement").str();
 
@@ -293,7 +441,7 @@ int MergeTimingsAndOutput(imp::Engine& engine)
 		}
 
 		static constexpr char c = ';';
-		file << "Culling" << c << "Frame Time" << c << "CPU Main Thread" << c << "CPU Render Thread" << c << "GPU Frame" << c << "Triangles" << std::endl;
+		file << "Culling" << c << "Frame Time" << c << "CPU Main Thread" << c << "CPU Render Thread" << c << "GPU Frame" << c << "Triangles" << c << "Sync Wait" << c << "Occlusion Culling" << c << "Occluded" << std::endl;
 
 		for (uint32_t row = 0; row < mainTable.table_rows.size(); row++)
 		{
@@ -306,8 +454,11 @@ int MergeTimingsAndOutput(imp::Engine& engine)
 			double frameRenderCPU = mainRow.frameRenderCPU >= 0.0 ? mainRow.frameRenderCPU : renderRow.frameRenderCPU;
 			double frameGPU = mainRow.frameGPU >= 0.0 ? mainRow.frameGPU : renderRow.frameGPU;
 			int64_t triangles = renderRow.triangles;
+			double syncWait = mainRow.syncWait;
+			double occlusionCull = mainRow.occlusionCull >= 0.0 ? mainRow.occlusionCull : renderRow.occlusionCull;
+			int64_t occluded = mainRow.occluded;
 
-			file << cull << c << draw << c << frameMainCPU << c << frameRenderCPU << c << frameGPU << c << triangles << std::endl;
+			file << cull << c << draw << c << frameMainCPU << c << frameRenderCPU << c << frameGPU << c << triangles << c << syncWait << c << occlusionCull << c << occluded << std::endl;
 		}
 
 		file.close();
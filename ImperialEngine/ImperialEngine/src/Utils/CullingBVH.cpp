@@ -0,0 +1,491 @@
+#include "CullingBVH.h"
+#include "EngineStaticConfig.h"
+#include "FrustumCullKernels.h"
+#include "GfxUtilities.h"
+#include "RenderProxies.h"
+#include "backend/parallel/JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+
+namespace imp
+{
+	static constexpr uint32_t kLeafSize = 32;
+	static constexpr uint32_t kAllPlanes = 0x3F;
+	static constexpr uint32_t kNearPlane = 4;
+	// Node bounds are grown a tiny bit so float rounding can't make a node look fully inside or outside while
+	// a sphere in it would be classified differently by the exact test
+	static constexpr float kBoundsPadding = 1e-5f;
+
+	static uint32_t ExpandBits(uint32_t v)
+	{
+		// 10 bits spread out to every third bit
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	// position normalized to [0, 1]
+	static uint32_t MortonCode(const glm::vec3& position)
+	{
+		const glm::vec3 quantized = glm::clamp(position * 1024.0f, 0.0f, 1023.0f);
+		return (ExpandBits(static_cast<uint32_t>(quantized.x)) << 2) | (ExpandBits(static_cast<uint32_t>(quantized.y)) << 1) | ExpandBits(static_cast<uint32_t>(quantized.z));
+	}
+
+	// Chunks get sorted in parallel, then merged pairwise, also in parallel while there's more than one pair
+	static void ParallelSort(std::vector<uint64_t>& keys, prl::JobSystem& jobSystem)
+	{
+		const size_t count = keys.size();
+		size_t chunkCount = 1;
+		while (chunkCount < jobSystem.GetConcurrency() * 2 && count / (chunkCount * 2) >= 4096)
+			chunkCount *= 2;
+
+		const auto chunkBegin = [&keys, count, chunkCount](size_t chunk) { return keys.begin() + count * chunk / chunkCount; };
+		jobSystem.ParallelFor(chunkCount, [&](size_t st, size_t en)
+			{
+				for (size_t chunk = st; chunk < en; chunk++)
+					std::sort(chunkBegin(chunk), chunkBegin(chunk + 1));
+			}, 1);
+
+		for (size_t width = 1; width < chunkCount; width *= 2)
+		{
+			jobSystem.ParallelFor(chunkCount / (width * 2), [&](size_t st, size_t en)
+				{
+					for (size_t pair = st; pair < en; pair++)
+					{
+						const size_t first = pair * width * 2;
+						std::inplace_merge(chunkBegin(first), chunkBegin(first + width), chunkBegin(first + width * 2));
+					}
+				}, 1);
+		}
+	}
+
+	// LSD radix sort on the proxy index part of (proxy index << 8 | lod), passes where all keys share the digit are skipped
+	static void RadixSortVisible(std::vector<uint64_t>& keys, std::vector<uint64_t>& scratch, uint32_t proxyCount)
+	{
+		if (keys.empty())
+			return;
+
+		scratch.resize(keys.size());
+		for (uint32_t shift = 8; shift < 40 && (static_cast<uint64_t>(proxyCount) << 8) >> shift; shift += 8)
+		{
+			std::array<uint32_t, 256> offsets = {};
+			for (const auto key : keys)
+				offsets[(key >> shift) & 0xFF]++;
+			if (offsets[(keys[0] >> shift) & 0xFF] == keys.size())
+				continue;
+
+			uint32_t sum = 0;
+			for (auto& offset : offsets)
+			{
+				const uint32_t bucketSize = offset;
+				offset = sum;
+				sum += bucketSize;
+			}
+			for (const auto key : keys)
+				scratch[offsets[(key >> shift) & 0xFF]++] = key;
+			keys.swap(scratch);
+		}
+	}
+
+	CullingBVH::CullingBVH()
+		: m_Enabled(false), m_NeedsBuild(true), m_ProxiesVersion(0), m_X(), m_Y(), m_Z(), m_Radius()
+		, m_ProxyIndices(), m_PrimitiveOfProxy(), m_Nodes(), m_FirstLeaf(0), m_LeafCount(0), m_TraversalItems()
+		, m_TraversalResults(), m_Visible(), m_SortScratch(), m_Stats()
+	{
+	}
+
+	CullingBVH::~CullingBVH()
+	{
+	}
+
+	void CullingBVH::Enable()
+	{
+		m_Enabled = true;
+		m_NeedsBuild = true;
+	}
+
+	void CullingBVH::Disable()
+	{
+		m_Enabled = false;
+	}
+
+	void CullingBVH::Update(const RenderProxies& proxies, prl::JobSystem& jobSystem)
+	{
+		if (!m_Enabled || (!m_NeedsBuild && proxies.GetVersion() == m_ProxiesVersion))
+			return;
+
+		// a proxy is a primitive no matter what's in it, only a different count changes the tree
+		const bool missedChanges = proxies.GetVersion() != m_ProxiesVersion + 1;
+		if (m_NeedsBuild || missedChanges || proxies.WasRebuilt() || proxies.GetCount() != m_ProxyIndices.size())
+			Build(proxies, jobSystem);
+		else
+			Refit(proxies, jobSystem);
+		m_ProxiesVersion = proxies.GetVersion();
+	}
+
+	void CullingBVH::Build(const RenderProxies& proxies, prl::JobSystem& jobSystem)
+	{
+		SimpleTimer timer;
+		timer.start();
+
+		const uint32_t count = static_cast<uint32_t>(proxies.GetCount());
+		const auto spheres = proxies.GetSpheres();
+
+		// bounds of the centers to quantize morton codes in, partial bounds per block then combined
+		static constexpr size_t kBoundsBlockSize = 16384;
+		const size_t blockCount = (count + kBoundsBlockSize - 1) / kBoundsBlockSize;
+		std::vector<glm::vec3> blockMin(blockCount, glm::vec3(FLT_MAX));
+		std::vector<glm::vec3> blockMax(blockCount, glm::vec3(-FLT_MAX));
+		jobSystem.ParallelFor(blockCount, [&](size_t st, size_t en)
+			{
+				for (size_t block = st; block < en; block++)
+					for (size_t i = block * kBoundsBlockSize; i < std::min<size_t>((block + 1) * kBoundsBlockSize, count); i++)
+					{
+						const glm::vec3 center(spheres.x[i], spheres.y[i], spheres.z[i]);
+						blockMin[block] = glm::min(blockMin[block], center);
+						blockMax[block] = glm::max(blockMax[block], center);
+					}
+			}, 1);
+		glm::vec3 sceneMin(FLT_MAX), sceneMax(-FLT_MAX);
+		for (size_t block = 0; block < blockCount; block++)
+		{
+			sceneMin = glm::min(sceneMin, blockMin[block]);
+			sceneMax = glm::max(sceneMax, blockMax[block]);
+		}
+		const glm::vec3 invExtent = 1.0f / glm::max(sceneMax - sceneMin, glm::vec3(1e-6f));
+
+		// proxy index in the low bits keeps the order deterministic for equal codes
+		std::vector<uint64_t> keys(count);
+		jobSystem.ParallelFor(count, [&](size_t st, size_t en)
+			{
+				for (size_t i = st; i < en; i++)
+					keys[i] = (static_cast<uint64_t>(MortonCode((glm::vec3(spheres.x[i], spheres.y[i], spheres.z[i]) - sceneMin) * invExtent)) << 32) | i;
+			});
+		ParallelSort(keys, jobSystem);
+
+		m_X.resize(count);
+		m_Y.resize(count);
+		m_Z.resize(count);
+		m_Radius.resize(count);
+		m_ProxyIndices.resize(count);
+		m_PrimitiveOfProxy.resize(count);
+		jobSystem.ParallelFor(count, [&](size_t st, size_t en)
+			{
+				for (size_t i = st; i < en; i++)
+				{
+					const uint32_t src = static_cast<uint32_t>(keys[i]);
+					m_X[i] = spheres.x[src];
+					m_Y[i] = spheres.y[src];
+					m_Z[i] = spheres.z[src];
+					m_Radius[i] = spheres.radius[src];
+					m_ProxyIndices[i] = src;
+					m_PrimitiveOfProxy[src] = static_cast<uint32_t>(i);
+				}
+			});
+
+		m_LeafCount = (count + kLeafSize - 1) / kLeafSize;
+		uint32_t leafSlots = 1;
+		while (leafSlots < m_LeafCount)
+			leafSlots *= 2;
+		m_FirstLeaf = leafSlots - 1;
+		m_Nodes.assign(leafSlots * 2 - 1, Node{});
+		ComputeAllBounds(jobSystem);
+
+		m_NeedsBuild = false;
+
+		timer.stop();
+		m_Stats.buildTime = timer.miliseconds();
+	}
+
+	void CullingBVH::Refit(const RenderProxies& proxies, prl::JobSystem& jobSystem)
+	{
+		SimpleTimer timer;
+		timer.start();
+
+		const auto& changed = proxies.GetChangedIndices();
+		std::vector<uint32_t> prims(changed.size());
+		jobSystem.ParallelFor(changed.size(), [&](size_t st, size_t en)
+			{
+				for (size_t i = st; i < en; i++)
+				{
+					const uint32_t prim = m_PrimitiveOfProxy[changed[i]];
+					const auto sphere = proxies.GetSphere(changed[i]);
+					m_X[prim] = sphere.x;
+					m_Y[prim] = sphere.y;
+					m_Z[prim] = sphere.z;
+					m_Radius[prim] = sphere.w;
+					prims[i] = prim;
+				}
+			});
+
+		std::vector<uint32_t> dirtyNodes;
+		dirtyNodes.reserve(prims.size());
+		for (const auto prim : prims)
+			dirtyNodes.push_back(m_FirstLeaf + prim / kLeafSize);
+		std::sort(dirtyNodes.begin(), dirtyNodes.end());
+		dirtyNodes.erase(std::unique(dirtyNodes.begin(), dirtyNodes.end()), dirtyNodes.end());
+
+		// lots of leaves moved, cheaper to redo every node in parallel
+		if (dirtyNodes.size() > m_LeafCount / 4)
+			ComputeAllBounds(jobSystem);
+		else if (!dirtyNodes.empty())
+		{
+			for (const auto node : dirtyNodes)
+				ComputeLeafBounds(node - m_FirstLeaf);
+
+			// all dirty nodes are on the same level, walk up until we're at the root
+			while (dirtyNodes.front() != 0)
+			{
+				for (auto& node : dirtyNodes)
+					node = (node - 1) / 2;
+				dirtyNodes.erase(std::unique(dirtyNodes.begin(), dirtyNodes.end()), dirtyNodes.end());
+				for (const auto node : dirtyNodes)
+					ComputeParentBounds(node);
+			}
+		}
+
+		timer.stop();
+		m_Stats.refitTime = timer.miliseconds();
+		m_Stats.refitPrimitives = static_cast<uint32_t>(prims.size());
+	}
+
+	void CullingBVH::ComputeLeafBounds(uint32_t leaf)
+	{
+		auto& node = m_Nodes[m_FirstLeaf + leaf];
+		const uint32_t first = leaf * kLeafSize;
+		const uint32_t end = std::min<uint32_t>(first + kLeafSize, static_cast<uint32_t>(m_ProxyIndices.size()));
+		if (first >= end)
+		{
+			node = {};
+			return;
+		}
+
+		glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+		for (uint32_t i = first; i < end; i++)
+		{
+			const glm::vec3 center(m_X[i], m_Y[i], m_Z[i]);
+			min = glm::min(min, center - m_Radius[i]);
+			max = glm::max(max, center + m_Radius[i]);
+		}
+
+		const glm::vec3 padding = (glm::max(glm::abs(min), glm::abs(max)) + 1.0f) * kBoundsPadding;
+		node.min = min - padding;
+		node.max = max + padding;
+		node.count = end - first;
+	}
+
+	void CullingBVH::ComputeParentBounds(uint32_t nodeIdx)
+	{
+		const auto& left = m_Nodes[nodeIdx * 2 + 1];
+		const auto& right = m_Nodes[nodeIdx * 2 + 2];
+		auto& node = m_Nodes[nodeIdx];
+
+		node.count = left.count + right.count;
+		if (left.count && right.count)
+		{
+			node.min = glm::min(left.min, right.min);
+			node.max = glm::max(left.max, right.max);
+		}
+		else if (left.count)
+		{
+			node.min = left.min;
+			node.max = left.max;
+		}
+		else
+		{
+			node.min = right.min;
+			node.max = right.max;
+		}
+	}
+
+	void CullingBVH::ComputeAllBounds(prl::JobSystem& jobSystem)
+	{
+		const uint32_t leafSlots = m_FirstLeaf + 1;
+		jobSystem.ParallelFor(leafSlots, [this](size_t st, size_t en)
+			{
+				for (size_t leaf = st; leaf < en; leaf++)
+					ComputeLeafBounds(static_cast<uint32_t>(leaf));
+			});
+
+		// level by level bottom up, level with n nodes starts at n - 1
+		for (uint32_t levelSize = leafSlots / 2; levelSize > 0; levelSize /= 2)
+		{
+			jobSystem.ParallelFor(levelSize, [this, levelSize](size_t st, size_t en)
+				{
+					for (size_t i = st; i < en; i++)
+						ComputeParentBounds(static_cast<uint32_t>(levelSize - 1 + i));
+				});
+		}
+	}
+
+	// Returns false when the box is fully outside one of the planes. Planes the box is fully in front of are cleared from
+	// planeMask, children don't need to test them again.
+	static bool ClassifyBox(const glm::vec3& min, const glm::vec3& max, const std::array<glm::vec4, 6>& frustumPlanes, uint32_t& planeMask)
+	{
+		const glm::vec3 center = (min + max) * 0.5f;
+		const glm::vec3 extents = (max - min) * 0.5f;
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			if (!(planeMask & (1u << p)))
+				continue;
+
+			const glm::vec3 normal(frustumPlanes[p]);
+			const float distance = glm::dot(normal, center) + frustumPlanes[p].w;
+			const float radius = glm::dot(glm::abs(normal), extents);
+			if (distance + radius < 0.0f)
+				return false;
+			if (distance - radius >= 0.0f)
+				planeMask &= ~(1u << p);
+		}
+		return true;
+	}
+
+	void CullingBVH::Traverse(const CullContext& context, TraversalItem item, TraversalResult& result) const
+	{
+		// depth is at most 32 so is the stack
+		TraversalItem stack[64];
+		uint32_t stackSize = 0;
+		stack[stackSize++] = item;
+
+		while (stackSize)
+		{
+			const auto current = stack[--stackSize];
+			const auto& node = m_Nodes[current.node];
+			if (!node.count)
+				continue;
+
+			result.nodesVisited++;
+			uint32_t planeMask = current.planeMask;
+			if (planeMask && !ClassifyBox(node.min, node.max, context.frustumPlanes, planeMask))
+				continue;
+
+			if (current.node >= m_FirstLeaf)
+			{
+				CullLeaf(context, current.node - m_FirstLeaf, planeMask, result);
+				continue;
+			}
+
+			stack[stackSize++] = { current.node * 2 + 2, planeMask };
+			stack[stackSize++] = { current.node * 2 + 1, planeMask };
+		}
+	}
+
+	void CullingBVH::CullLeaf(const CullContext& context, uint32_t leaf, uint32_t planeMask, TraversalResult& result) const
+	{
+		const uint32_t first = leaf * kLeafSize;
+		const uint32_t count = std::min<uint32_t>(kLeafSize, static_cast<uint32_t>(m_ProxyIndices.size()) - first);
+		const auto addVisible = [&](uint32_t proxy, float nearDistance)
+		{
+			const uint8_t lod = utils::ChooseMeshLOD(context.lodSelection, context.proxies, context.meshes, proxy, nearDistance);
+			if (lod != utils::kLodCulled)
+				result.visible.push_back((static_cast<uint64_t>(proxy) << 8) | lod);
+		};
+
+		// fully inside, only the near plane distance is needed for lod
+		if (!planeMask)
+		{
+			for (uint32_t i = first; i < first + count; i++)
+				addVisible(m_ProxyIndices[i], glm::dot(context.frustumPlanes[kNearPlane], glm::vec4(m_X[i], m_Y[i], m_Z[i], 1.0f)));
+			result.primitivesAccepted += count;
+			return;
+		}
+
+		uint8_t visible[kLeafSize];
+		float nearDistance[kLeafSize];
+		const utils::SphereStreamSoA spheres = { m_X.data() + first, m_Y.data() + first, m_Z.data() + first, m_Radius.data() + first };
+		utils::FrustumCullSpheres(context.frustumPlanes, spheres, count, visible, nearDistance);
+		result.primitivesTested += count;
+
+		for (uint32_t i = 0; i < count; i++)
+			if (visible[i])
+				addVisible(m_ProxyIndices[first + i], nearDistance[i]);
+	}
+
+	void CullingBVH::Cull(const std::array<glm::vec4, 6>& frustumPlanes, RenderProxies& proxies, const utils::LodSelection& lodSelection, const MeshRegistry& meshes, std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem)
+	{
+		m_Stats.nodesVisited = 0;
+		m_Stats.primitivesTested = 0;
+		m_Stats.primitivesAccepted = 0;
+		if (m_Nodes.empty())
+		{
+			visibleData.clear();
+			return;
+		}
+
+		// walk the first levels here until there are enough subtrees for everyone to steal
+		const size_t targetItemCount = jobSystem.GetConcurrency() * 4;
+		std::vector<TraversalItem> next;
+		m_TraversalItems.assign(1, { 0, kAllPlanes });
+		while (m_TraversalItems.size() < targetItemCount)
+		{
+			next.clear();
+			bool expanded = false;
+			for (const auto item : m_TraversalItems)
+			{
+				const auto& node = m_Nodes[item.node];
+				if (item.node >= m_FirstLeaf || !node.count)
+				{
+					next.push_back(item);
+					continue;
+				}
+
+				m_Stats.nodesVisited++;
+				uint32_t planeMask = item.planeMask;
+				if (planeMask && !ClassifyBox(node.min, node.max, frustumPlanes, planeMask))
+					continue;
+
+				next.push_back({ item.node * 2 + 1, planeMask });
+				next.push_back({ item.node * 2 + 2, planeMask });
+				expanded = true;
+			}
+			m_TraversalItems.swap(next);
+			if (!expanded)
+				break;
+		}
+
+		const CullContext context = { frustumPlanes, lodSelection, proxies, meshes };
+		m_TraversalResults.resize(m_TraversalItems.size());
+		jobSystem.ParallelFor(m_TraversalItems.size(), [&](size_t st, size_t en)
+			{
+				for (size_t i = st; i < en; i++)
+				{
+					auto& result = m_TraversalResults[i];
+					result.visible.clear();
+					result.nodesVisited = 0;
+					result.primitivesTested = 0;
+					result.primitivesAccepted = 0;
+					Traverse(context, m_TraversalItems[i], result);
+				}
+			}, 1);
+
+		m_Visible.clear();
+		for (const auto& result : m_TraversalResults)
+		{
+			m_Visible.insert(m_Visible.end(), result.visible.begin(), result.visible.end());
+			m_Stats.nodesVisited += result.nodesVisited;
+			m_Stats.primitivesTested += result.primitivesTested;
+			m_Stats.primitivesAccepted += result.primitivesAccepted;
+		}
+
+		// back to proxy order so the draw data is the same as the linear path gives
+		RadixSortVisible(m_Visible, m_SortScratch, static_cast<uint32_t>(m_ProxyIndices.size()));
+
+		visibleData.resize(m_Visible.size());
+		jobSystem.ParallelFor(m_Visible.size(), [&](size_t st, size_t en)
+			{
+				for (size_t i = st; i < en; i++)
+				{
+					const size_t proxy = static_cast<size_t>(m_Visible[i] >> 8);
+					const uint8_t lod = static_cast<uint8_t>(m_Visible[i] & 0xFF);
+
+					auto& dds = visibleData[i];
+					dds.Transform = proxies.GetTransform(proxy);
+					dds.VertexBufferId = proxies.GetMeshId(proxy);
+					dds.LodIdx = lod;
+					proxies.SetLod(proxy, lod);
+				}
+			});
+	}
+}
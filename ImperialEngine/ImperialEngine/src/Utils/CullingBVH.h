@@ -0,0 +1,114 @@
+#pragma once
+#include "backend/graphics/Graphics.h"
+#include "Utils/LodSelection.h"
+#include "Utils/NonCopyable.h"
+#include <array>
+#include <vector>
+
+namespace prl { class JobSystem; }
+
+namespace imp
+{
+	class RenderProxies;
+
+	// Optional acceleration structure for CPU culling of mostly static scenes. Loose BVH over world-space spheres of the
+	// renderables: primitives are sorted by morton code of their centers, every kLeafSize consecutive ones make a leaf and
+	// leaves are the bottom level of an implicit complete binary tree. Nodes fully outside the frustum skip their whole
+	// subtree, nodes fully inside skip the plane tests. Gives the same draw data in the same order as utils::Cull.
+	// Primitives are render proxies, rebuilt when their count changes, refit for proxies that changed otherwise.
+	class CullingBVH : NonCopyable
+	{
+	public:
+		struct Stats
+		{
+			double buildTime;			// ms, last full build
+			double refitTime;			// ms, last refit
+			uint32_t refitPrimitives;
+			uint32_t nodesVisited;		// last Cull
+			uint32_t primitivesTested;	// went through the sphere kernel
+			uint32_t primitivesAccepted;// were in nodes fully inside the frustum, no plane tests
+		};
+
+		CullingBVH();
+		~CullingBVH();
+
+		// Enabling marks for a full build
+		void Enable();
+		void Disable();
+		bool IsEnabled() const { return m_Enabled; }
+
+		// Builds or refits whatever changed since the last call, proxies have to be updated first
+		void Update(const RenderProxies& proxies, prl::JobSystem& jobSystem);
+		// lods of visible proxies get stored in them, ones that project too small are culled like in utils::Cull
+		void Cull(const std::array<glm::vec4, 6>& frustumPlanes, RenderProxies& proxies, const utils::LodSelection& lodSelection, const MeshRegistry& meshes, std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem);
+
+		const Stats& GetStats() const { return m_Stats; }
+		size_t GetPrimitiveCount() const { return m_ProxyIndices.size(); }
+
+	private:
+		struct Node
+		{
+			glm::vec3 min;
+			uint32_t count;		// primitives under this node, 0 for padding nodes
+			glm::vec3 max;
+			uint32_t pad;
+		};
+
+		// Subtree of the frustum traversal that runs as one job
+		struct TraversalItem
+		{
+			uint32_t node;
+			uint32_t planeMask;
+		};
+
+		// what leaves need to pick lods
+		struct CullContext
+		{
+			const std::array<glm::vec4, 6>& frustumPlanes;
+			const utils::LodSelection& lodSelection;
+			const RenderProxies& proxies;
+			const MeshRegistry& meshes;
+		};
+
+		struct TraversalResult
+		{
+			std::vector<uint64_t> visible;	// proxy index << 8 | lod
+			uint32_t nodesVisited;
+			uint32_t primitivesTested;
+			uint32_t primitivesAccepted;
+		};
+
+		void Build(const RenderProxies& proxies, prl::JobSystem& jobSystem);
+		void Refit(const RenderProxies& proxies, prl::JobSystem& jobSystem);
+		void ComputeLeafBounds(uint32_t leaf);
+		void ComputeParentBounds(uint32_t node);
+		void ComputeAllBounds(prl::JobSystem& jobSystem);
+		void Traverse(const CullContext& context, TraversalItem item, TraversalResult& result) const;
+		void CullLeaf(const CullContext& context, uint32_t leaf, uint32_t planeMask, TraversalResult& result) const;
+
+		bool m_Enabled;
+		bool m_NeedsBuild;
+		// RenderProxies version the primitives are up to date with
+		uint64_t m_ProxiesVersion;
+
+		// primitives in morton order, SoA so leaves can go straight into the SIMD kernel
+		std::vector<float> m_X;
+		std::vector<float> m_Y;
+		std::vector<float> m_Z;
+		std::vector<float> m_Radius;
+		std::vector<uint32_t> m_ProxyIndices;
+		std::vector<uint32_t> m_PrimitiveOfProxy;
+
+		// nodes[0] is the root, children of i are 2i+1 and 2i+2, leaves start at m_FirstLeaf
+		std::vector<Node> m_Nodes;
+		uint32_t m_FirstLeaf;
+		uint32_t m_LeafCount;
+
+		std::vector<TraversalItem> m_TraversalItems;
+		std::vector<TraversalResult> m_TraversalResults;
+		std::vector<uint64_t> m_Visible;
+		std::vector<uint64_t> m_SortScratch;
+
+		Stats m_Stats;
+	};
+}
@@ -1,8 +1,8 @@
 #pragma once
 
-// CPU culling
+// CPU culling, multithreaded by default. Both paths produce the same draw data
 #ifndef CPU_CULL_ST
-#define CPU_CULL_ST 1
+#define CPU_CULL_ST 0
 #endif
 
 // Benchmarking mode. Engine will run test scene with each available rendering mode, collect data and output it, then shut down.
@@ -44,10 +44,30 @@
 #define MESHLET_MAX_VERTS 32
 #endif
 
+// every lod is simplified to this fraction of the one before, giving up past this error relative to the mesh extents
+#ifndef LOD_TARGET_FACTOR
+#define LOD_TARGET_FACTOR 0.75
+#endif
+
+#ifndef LOD_TARGET_ERROR
+#define LOD_TARGET_ERROR 0.75f
+#endif
+
+// how much meshlet building favors tight normal cones over fewer meshlets
+#ifndef MESHLET_CONE_WEIGHT
+#define MESHLET_CONE_WEIGHT 0.5f
+#endif
+
 #ifndef MESH_WGROUP
 #define MESH_WGROUP 32
 #endif
 
+// 12 byte PackedVertex in the vertex buffer instead of the 24 byte Vertex: positions quantized to 16 bits in the mesh
+// bounds, octahedral normals. Shaders decode with the draw's VertexQuantization. Needs the same define in prefix.h
+#ifndef COMPACT_VERTICES
+#define COMPACT_VERTICES 0
+#endif
+
 // Synch issue on my laptop with NVIDIA GTX 1050
 // TODO: fix me!
 #ifndef GTX_WORKAROUND
@@ -15,6 +15,9 @@ namespace imp
             , frameGPU(-1.0)
             , frame(-1.0)
             , triangles(-1)
+            , syncWait(-1.0)
+            , occlusionCull(-1.0)
+            , occluded(-1)
         {}
 
 #if BENCHMARK_MODE
@@ -24,6 +27,9 @@ namespace imp
 		double frameGPU;
 		double frame;
 		int64_t triangles;
+		double syncWait;	// main thread blocked on the render thread (barrier or snapshot fence)
+		double occlusionCull;	// CPU occlusion culling, part of cull. Or the GPU-Driven modes' depth pyramid and late cull
+		int64_t occluded;
 #else
         float cull;
         float frameMainCPU;
@@ -31,6 +37,9 @@ namespace imp
         float frameGPU;
         float frame;
         float triangles;
+        float syncWait;
+        float occlusionCull;
+        float occluded;
 #endif
 	};
 
@@ -64,6 +73,9 @@ namespace imp
                 maxValues.frameGPU = std::max(maxValues.frameGPU, row.frameGPU);
                 maxValues.frame = std::max(maxValues.frame, row.frame);
                 maxValues.triangles = std::max(maxValues.triangles, row.triangles);
+                maxValues.syncWait = std::max(maxValues.syncWait, row.syncWait);
+                maxValues.occlusionCull = std::max(maxValues.occlusionCull, row.occlusionCull);
+                maxValues.occluded = std::max(maxValues.occluded, row.occluded);
             }
 
             return maxValues;
@@ -85,6 +97,9 @@ namespace imp
                 avgValues.frameGPU += row.frameGPU > 0.0f ? row.frameGPU : avgValues.frameGPU / i + 1;
                 avgValues.frame += row.frame;
                 avgValues.triangles += row.triangles > 0.0f ? row.triangles : avgValues.triangles / i + 1;
+                avgValues.syncWait += row.syncWait;
+                avgValues.occlusionCull += row.occlusionCull;
+                avgValues.occluded += row.occluded;
             }
 
             avgValues.cull /= m_Size;
@@ -93,6 +108,9 @@ namespace imp
             avgValues.frameGPU /= m_Size;
             avgValues.frame /= m_Size;
             avgValues.triangles /= m_Size;
+            avgValues.syncWait /= m_Size;
+            avgValues.occlusionCull /= m_Size;
+            avgValues.occluded /= m_Size;
 
             return avgValues;
         }
@@ -0,0 +1,369 @@
+#include "FrustumCullKernels.h"
+#include "Utils/SimpleTimer.h"
+#include <GLM/glm.hpp>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IMP_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define IMP_X86 0
+#endif
+
+// msvc lets any function use any intrinsic, gcc and clang want to be told per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define IMP_TARGET(isa)
+#else
+#define IMP_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace imp
+{
+	namespace utils
+	{
+		static constexpr uint32_t kNearPlane = 4;
+
+		// Also used for the tails of the wide kernels
+		static void CullScalarRange(const std::array<glm::vec4, 6>& planes, const SphereStreamSoA& spheres, size_t begin, size_t end, uint8_t* visible, float* nearDistance)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const glm::vec4 center(spheres.x[i], spheres.y[i], spheres.z[i], 1.0f);
+				const float negRadius = -spheres.radius[i];
+
+				uint8_t isVisible = 1;
+				for (uint32_t p = 0; p < 6; p++)
+				{
+					const float dotProd = glm::dot(planes[p], center);
+					isVisible &= !(dotProd < negRadius);
+					if (p == kNearPlane)
+						nearDistance[i] = dotProd;
+				}
+				visible[i] = isVisible;
+			}
+		}
+
+		static void CullScalar(const std::array<glm::vec4, 6>& planes, const SphereStreamSoA& spheres, size_t count, uint8_t* visible, float* nearDistance)
+		{
+			CullScalarRange(planes, spheres, 0, count, visible, nearDistance);
+		}
+
+#if IMP_X86
+		// glm::dot is (x*px + y*py) + (z*pz + w*pw) and w is 1. Keep it as separate mul and add, an fma would round differently.
+		// 'not less than' instead of 'greater or equal' so NaNs come out visible like in the scalar loop.
+
+		IMP_TARGET("sse4.1")
+		static void CullSSE4(const std::array<glm::vec4, 6>& planes, const SphereStreamSoA& spheres, size_t count, uint8_t* visible, float* nearDistance)
+		{
+			__m128 px[6], py[6], pz[6], pw[6];
+			for (uint32_t p = 0; p < 6; p++)
+			{
+				px[p] = _mm_set1_ps(planes[p].x);
+				py[p] = _mm_set1_ps(planes[p].y);
+				pz[p] = _mm_set1_ps(planes[p].z);
+				pw[p] = _mm_set1_ps(planes[p].w);
+			}
+			const __m128 signMask = _mm_set1_ps(-0.0f);
+
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128 x = _mm_loadu_ps(spheres.x + i);
+				const __m128 y = _mm_loadu_ps(spheres.y + i);
+				const __m128 z = _mm_loadu_ps(spheres.z + i);
+				const __m128 negRadius = _mm_xor_ps(_mm_loadu_ps(spheres.radius + i), signMask);
+
+				__m128 isVisible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (uint32_t p = 0; p < 6; p++)
+				{
+					const __m128 dotProd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, px[p]), _mm_mul_ps(y, py[p])), _mm_add_ps(_mm_mul_ps(z, pz[p]), pw[p]));
+					isVisible = _mm_and_ps(isVisible, _mm_cmpnlt_ps(dotProd, negRadius));
+					if (p == kNearPlane)
+						_mm_storeu_ps(nearDistance + i, dotProd);
+				}
+
+				const uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(isVisible));
+				for (uint32_t k = 0; k < 4; k++)
+					visible[i + k] = (mask >> k) & 1;
+			}
+			CullScalarRange(planes, spheres, i, count, visible, nearDistance);
+		}
+
+		IMP_TARGET("avx2")
+		static void CullAVX2(const std::array<glm::vec4, 6>& planes, const SphereStreamSoA& spheres, size_t count, uint8_t* visible, float* nearDistance)
+		{
+			__m256 px[6], py[6], pz[6], pw[6];
+			for (uint32_t p = 0; p < 6; p++)
+			{
+				px[p] = _mm256_set1_ps(planes[p].x);
+				py[p] = _mm256_set1_ps(planes[p].y);
+				pz[p] = _mm256_set1_ps(planes[p].z);
+				pw[p] = _mm256_set1_ps(planes[p].w);
+			}
+			const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256 x = _mm256_loadu_ps(spheres.x + i);
+				const __m256 y = _mm256_loadu_ps(spheres.y + i);
+				const __m256 z = _mm256_loadu_ps(spheres.z + i);
+				const __m256 negRadius = _mm256_xor_ps(_mm256_loadu_ps(spheres.radius + i), signMask);
+
+				__m256 isVisible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (uint32_t p = 0; p < 6; p++)
+				{
+					const __m256 dotProd = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, px[p]), _mm256_mul_ps(y, py[p])), _mm256_add_ps(_mm256_mul_ps(z, pz[p]), pw[p]));
+					isVisible = _mm256_and_ps(isVisible, _mm256_cmp_ps(dotProd, negRadius, _CMP_NLT_UQ));
+					if (p == kNearPlane)
+						_mm256_storeu_ps(nearDistance + i, dotProd);
+				}
+
+				const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(isVisible));
+				for (uint32_t k = 0; k < 8; k++)
+					visible[i + k] = (mask >> k) & 1;
+			}
+			CullScalarRange(planes, spheres, i, count, visible, nearDistance);
+		}
+
+		IMP_TARGET("avx512f")
+		static void CullAVX512(const std::array<glm::vec4, 6>& planes, const SphereStreamSoA& spheres, size_t count, uint8_t* visible, float* nearDistance)
+		{
+			__m512 px[6], py[6], pz[6], pw[6];
+			for (uint32_t p = 0; p < 6; p++)
+			{
+				px[p] = _mm512_set1_ps(planes[p].x);
+				py[p] = _mm512_set1_ps(planes[p].y);
+				pz[p] = _mm512_set1_ps(planes[p].z);
+				pw[p] = _mm512_set1_ps(planes[p].w);
+			}
+			const __m512i signMask = _mm512_set1_epi32(static_cast<int>(0x80000000u));
+
+			size_t i = 0;
+			for (; i + 16 <= count; i += 16)
+			{
+				const __m512 x = _mm512_loadu_ps(spheres.x + i);
+				const __m512 y = _mm512_loadu_ps(spheres.y + i);
+				const __m512 z = _mm512_loadu_ps(spheres.z + i);
+				const __m512 negRadius = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_loadu_ps(spheres.radius + i)), signMask));
+
+				__mmask16 isVisible = 0xFFFF;
+				for (uint32_t p = 0; p < 6; p++)
+				{
+					const __m512 dotProd = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, px[p]), _mm512_mul_ps(y, py[p])), _mm512_add_ps(_mm512_mul_ps(z, pz[p]), pw[p]));
+					isVisible &= _mm512_cmp_ps_mask(dotProd, negRadius, _CMP_NLT_UQ);
+					if (p == kNearPlane)
+						_mm512_storeu_ps(nearDistance + i, dotProd);
+				}
+
+				const uint32_t mask = static_cast<uint32_t>(isVisible);
+				for (uint32_t k = 0; k < 16; k++)
+					visible[i + k] = (mask >> k) & 1;
+			}
+			CullScalarRange(planes, spheres, i, count, visible, nearDistance);
+		}
+#endif
+
+		static bool QueryISASupport(FrustumCullISA isa)
+		{
+#if IMP_X86 && defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+			__cpuid(info, 1);
+			const bool sse41 = info[2] & (1 << 19);
+			const bool osxsave = info[2] & (1 << 27);
+			const bool avx = info[2] & (1 << 28);
+			int ext[4] = {};
+			if (maxLeaf >= 7)
+				__cpuidex(ext, 7, 0);
+			const bool avx2 = ext[1] & (1 << 5);
+			const bool avx512f = ext[1] & (1 << 16);
+
+			// cpu support isn't enough, os has to save the wide registers too
+			const uint64_t xcr0 = osxsave ? _xgetbv(0) : 0;
+			const bool ymmSaved = (xcr0 & 0x6) == 0x6;
+			const bool zmmSaved = (xcr0 & 0xE6) == 0xE6;
+
+			switch (isa)
+			{
+			case kFrustumCullScalar: return true;
+			case kFrustumCullSSE4: return sse41;
+			case kFrustumCullAVX2: return avx && avx2 && ymmSaved;
+			case kFrustumCullAVX512: return avx512f && zmmSaved;
+			default: return false;
+			}
+#elif IMP_X86
+			__builtin_cpu_init();
+			switch (isa)
+			{
+			case kFrustumCullScalar: return true;
+			case kFrustumCullSSE4: return __builtin_cpu_supports("sse4.1");
+			case kFrustumCullAVX2: return __builtin_cpu_supports("avx2");
+			case kFrustumCullAVX512: return __builtin_cpu_supports("avx512f");
+			default: return false;
+			}
+#else
+			return isa == kFrustumCullScalar;
+#endif
+		}
+
+		bool IsFrustumCullISASupported(FrustumCullISA isa)
+		{
+			static const std::array<bool, kFrustumCullISACount> supported = []()
+			{
+				std::array<bool, kFrustumCullISACount> result;
+				for (uint32_t i = 0; i < kFrustumCullISACount; i++)
+					result[i] = QueryISASupport(static_cast<FrustumCullISA>(i));
+				return result;
+			}();
+			return isa < kFrustumCullISACount && supported[isa];
+		}
+
+		FrustumCullISA GetBestFrustumCullISA()
+		{
+			static const FrustumCullISA best = []()
+			{
+				for (uint32_t i = kFrustumCullISACount; i-- > 0;)
+					if (IsFrustumCullISASupported(static_cast<FrustumCullISA>(i)))
+						return static_cast<FrustumCullISA>(i);
+				return kFrustumCullScalar;
+			}();
+			return best;
+		}
+
+		FrustumCullKernel GetFrustumCullKernel(FrustumCullISA isa)
+		{
+			if (!IsFrustumCullISASupported(isa))
+				return nullptr;
+
+			switch (isa)
+			{
+#if IMP_X86
+			case kFrustumCullSSE4: return CullSSE4;
+			case kFrustumCullAVX2: return CullAVX2;
+			case kFrustumCullAVX512: return CullAVX512;
+#endif
+			default: return CullScalar;
+			}
+		}
+
+		const char* FrustumCullISAToString(FrustumCullISA isa)
+		{
+			switch (isa)
+			{
+			case kFrustumCullScalar: return "Scalar";
+			case kFrustumCullSSE4: return "SSE4";
+			case kFrustumCullAVX2: return "AVX2";
+			case kFrustumCullAVX512: return "AVX-512";
+			default: return "Unknown";
+			}
+		}
+
+		void FrustumCullSpheres(const std::array<glm::vec4, 6>& planes, const SphereStreamSoA& spheres, size_t count, uint8_t* visible, float* nearDistance)
+		{
+			static const FrustumCullKernel kernel = GetFrustumCullKernel(GetBestFrustumCullISA());
+			kernel(planes, spheres, count, visible, nearDistance);
+		}
+
+		// What Cull did before, one sphere at a time with an early-out per plane
+		static void CullReference(const std::array<glm::vec4, 6>& planes, const SphereStreamSoA& spheres, size_t count, uint8_t* visible, float* nearDistance)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				const glm::vec4 center(spheres.x[i], spheres.y[i], spheres.z[i], 1.0f);
+
+				bool isVisible = true;
+				for (auto p = 0; p < 6; p++)
+				{
+					const float dotProd = glm::dot(planes[p], center);
+					if (dotProd < -spheres.radius[i])
+					{
+						isVisible = false;
+						break;
+					}
+					if (p == kNearPlane)
+						nearDistance[i] = dotProd;
+				}
+				visible[i] = isVisible;
+			}
+		}
+
+		void RunFrustumCullKernelBenchmark()
+		{
+			static constexpr size_t kSphereCount = 1 << 20;
+			static constexpr uint32_t kIterations = 20;
+
+			// deterministic so runs are comparable, count isn't a multiple of 16 so the tails get tested too
+			const size_t count = kSphereCount - 3;
+			std::vector<float> x(count), y(count), z(count), radius(count);
+			uint32_t seed = 12345;
+			const auto rand01 = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / 16777216.0f); };
+			for (size_t i = 0; i < count; i++)
+			{
+				x[i] = rand01() * 400.0f - 200.0f;
+				y[i] = rand01() * 400.0f - 200.0f;
+				z[i] = rand01() * 400.0f - 200.0f;
+				radius[i] = rand01() * 4.0f;
+			}
+			const SphereStreamSoA spheres = { x.data(), y.data(), z.data(), radius.data() };
+
+			// 90 degree frustum looking down -z with the near plane at 0.1 and far at 150, same plane order as FindViewFrustumPlanes
+			std::array<glm::vec4, 6> planes;
+			const float d = 1.0f / std::sqrt(2.0f);
+			planes[0] = { d, 0.0f, -d, 0.0f };
+			planes[1] = { -d, 0.0f, -d, 0.0f };
+			planes[2] = { 0.0f, d, -d, 0.0f };
+			planes[3] = { 0.0f, -d, -d, 0.0f };
+			planes[4] = { 0.0f, 0.0f, -1.0f, -0.1f };
+			planes[5] = { 0.0f, 0.0f, 1.0f, 150.0f };
+
+			std::vector<uint8_t> refVisible(count), visible(count);
+			std::vector<float> refNear(count), nearDistance(count);
+
+			const auto timeKernel = [&](FrustumCullKernel kernel, uint8_t* vis, float* dist)
+			{
+				SimpleTimer timer;
+				kernel(planes, spheres, count, vis, dist);
+				timer.start();
+				for (uint32_t it = 0; it < kIterations; it++)
+					kernel(planes, spheres, count, vis, dist);
+				timer.stop();
+				return timer.miliseconds() / kIterations;
+			};
+
+			const double reference = timeKernel(CullReference, refVisible.data(), refNear.data());
+			size_t visibleCount = 0;
+			for (const auto v : refVisible)
+				visibleCount += v;
+
+			printf("[Cull Kernel Benchmark] %zu spheres, %zu visible, avg of %u iterations, dispatch picks %s\n", count, visibleCount, kIterations, FrustumCullISAToString(GetBestFrustumCullISA()));
+			printf("[Cull Kernel Benchmark] %-10s %10s %10s\n", "kernel", "time ms", "speedup");
+			printf("[Cull Kernel Benchmark] %-10s %10.3f %10.2f\n", "Reference", reference, 1.0);
+
+			for (uint32_t i = 0; i < kFrustumCullISACount; i++)
+			{
+				const auto isa = static_cast<FrustumCullISA>(i);
+				if (!IsFrustumCullISASupported(isa))
+				{
+					printf("[Cull Kernel Benchmark] %-10s not supported\n", FrustumCullISAToString(isa));
+					continue;
+				}
+
+				const double time = timeKernel(GetFrustumCullKernel(isa), visible.data(), nearDistance.data());
+
+				// reference only knows the near plane distance of spheres that made it past the first planes
+				bool exact = visible == refVisible;
+				for (size_t s = 0; exact && s < count; s++)
+					exact = !visible[s] || nearDistance[s] == refNear[s];
+
+				printf("[Cull Kernel Benchmark] %-10s %10.3f %10.2f  %s\n", FrustumCullISAToString(isa), time, reference / time, exact ? "exact" : "MISMATCH");
+			}
+		}
+	}
+}
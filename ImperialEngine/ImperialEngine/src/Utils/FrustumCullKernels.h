@@ -0,0 +1,48 @@
+#pragma once
+#include <GLM/vec4.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace imp
+{
+	namespace utils
+	{
+		enum FrustumCullISA : uint32_t
+		{
+			kFrustumCullScalar,
+			kFrustumCullSSE4,	// 4 spheres per iteration
+			kFrustumCullAVX2,	// 8
+			kFrustumCullAVX512,	// 16
+			kFrustumCullISACount
+		};
+
+		// World-space spheres, radius already scaled by the transform
+		struct SphereStreamSoA
+		{
+			const float* x;
+			const float* y;
+			const float* z;
+			const float* radius;
+		};
+
+		// Tests every sphere against all six planes from FindViewFrustumPlanes, no early-outs.
+		// visible[i] is 1 when the sphere isn't fully behind any plane, nearDistance[i] is the signed distance of the center
+		// to the near plane (plane 4) for picking LOD. Same float ops in the same order as the scalar glm loop, so results
+		// are bit-exact with it.
+		using FrustumCullKernel = void(*)(const std::array<glm::vec4, 6>& planes, const SphereStreamSoA& spheres, size_t count, uint8_t* visible, float* nearDistance);
+
+		bool IsFrustumCullISASupported(FrustumCullISA isa);
+		// widest one the cpu and os support, queried once
+		FrustumCullISA GetBestFrustumCullISA();
+		FrustumCullKernel GetFrustumCullKernel(FrustumCullISA isa);
+		const char* FrustumCullISAToString(FrustumCullISA isa);
+
+		// Runs the best kernel
+		void FrustumCullSpheres(const std::array<glm::vec4, 6>& planes, const SphereStreamSoA& spheres, size_t count, uint8_t* visible, float* nearDistance);
+
+		// Times every supported kernel against the per-sphere glm loop culling used before on 1M random spheres and
+		// checks the output is exactly the same. Run with 'ImperialEngine.exe --benchmark-cull-kernels'
+		void RunFrustumCullKernelBenchmark();
+	}
+}
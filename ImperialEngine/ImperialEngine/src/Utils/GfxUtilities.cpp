@@ -1,9 +1,14 @@
 #include "GfxUtilities.h"
 #include "EngineStaticConfig.h"
 #include "extern/MESHOPTIMIZER/meshoptimizer.h"
-#include "extern/THREAD-POOL/BS_thread_pool.hpp"
+#include "backend/parallel/JobSystem.h"
+#include "FrustumCullKernels.h"
+#include "CullingBVH.h"
+#include "OcclusionCuller.h"
+#include "RenderProxies.h"
 #include "GLM/gtc/matrix_access.hpp"
 #include <glm/gtx/matrix_decompose.hpp>
+#include <algorithm>
 
 namespace imp
 {
@@ -84,6 +89,30 @@ namespace imp
 			vkCmdPipelineBarrier(cb.cmb, srcFlags, dstFlags, 0, 0, 0, bmbCount, bmbs, 0, 0);
 		}
 
+		void InsertImageBarrier(CommandBuffer& cb, VkPipelineStageFlags srcFlags, VkPipelineStageFlags dstFlags, const VkImageMemoryBarrier* imbs, uint32_t imbCount)
+		{
+			assert(imbs);
+			vkCmdPipelineBarrier(cb.cmb, srcFlags, dstFlags, 0, 0, 0, 0, 0, imbCount, imbs);
+		}
+
+		VkImageMemoryBarrier CreateImageMemoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkImageLayout oldLayout, VkImageLayout newLayout, VkImage image, VkImageAspectFlags aspect, uint32_t baseMipLevel, uint32_t levelCount)
+		{
+			VkImageMemoryBarrier imb = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+			imb.srcAccessMask = srcAccessMask;
+			imb.dstAccessMask = dstAccessMask;
+			imb.oldLayout = oldLayout;
+			imb.newLayout = newLayout;
+			imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imb.image = image;
+			imb.subresourceRange.aspectMask = aspect;
+			imb.subresourceRange.baseMipLevel = baseMipLevel;
+			imb.subresourceRange.levelCount = levelCount;
+			imb.subresourceRange.baseArrayLayer = 0;
+			imb.subresourceRange.layerCount = 1;
+			return imb;
+		}
+
 		VkBufferMemoryBarrier CreateBufferMemoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
 		{
 			return CreateBufferMemoryBarrier(srcAccessMask, dstAccessMask, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, buffer, offset, size);
@@ -104,26 +133,24 @@ namespace imp
 			return bmb;
 		}
 
-		uint32_t ChooseMeshLODByNearPlaneDistance(float distFromCamera)
+		uint8_t ChooseMeshLOD(const LodSelection& selection, const RenderProxies& proxies, const MeshRegistry& meshes, size_t proxy, float nearDistance)
 		{
-			uint32_t idx = 0;
-			
-			if (distFromCamera >= 250)
-				idx = 3;
-			else if (distFromCamera >= 100)
-				idx = 2;
-			else if (distFromCamera >= 25)
-				idx = 1;
-			return idx;
+			// nothing to draw until the render thread has uploaded it
+			if (!meshes.IsUploaded(proxies.GetMeshId(proxy)))
+				return kLodCulled;
+
+			const float* lodErrors = meshes.GetGeometry(proxies.GetMeshId(proxy)).lodErrors;
+			return SelectMeshLod(selection, lodErrors, nearDistance, proxies.GetSphere(proxy).w, proxies.GetLodRadius(proxy), proxies.GetLod(proxy));
 		}
 
-		void GenerateMeshLODS(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, VulkanSubBuffer* dstSubBuffers, uint32_t numLODs, double factor, float error)
+		void GenerateMeshLODS(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, VulkanSubBuffer* dstSubBuffers, float* dstErrors, uint32_t numLODs, double factor, float error)
 		{
-			const auto FillRestOfBuffers = [&](size_t currIndexBuffOffset, uint32_t idx, uint32_t newIndexCount)
+			const auto FillRestOfBuffers = [&](size_t currIndexBuffOffset, uint32_t idx, uint32_t newIndexCount, float lodError)
 			{
 				for (auto i = idx; i < numLODs; i++)
 				{
 					dstSubBuffers[i] = VulkanSubBuffer(currIndexBuffOffset, newIndexCount);
+					dstErrors[i] = lodError;
 				}
 			};
 
@@ -131,6 +158,10 @@ namespace imp
 			size_t currIndexCount = indices.size();
 			size_t currIndexBuffOffset = 0;
 			uint32_t* dst = new uint32_t[currIndexCount];
+			// meshopt gives errors relative to the mesh extents
+			const float errorScale = meshopt_simplifyScale(&vertices.front().vx, vertices.size(), sizeof(Vertex));
+			// every lod is simplified from the one before, so their errors add up
+			float lodError = 0.0f;
 
 			for (uint32_t i = 0; i < numLODs; i++)
 			{
@@ -139,13 +170,16 @@ namespace imp
 				size_t newIndexCount = meshopt_simplify(dst, currIndices, currIndexCount, (float*)(&vertices.front().vx), vertices.size(), sizeof(Vertex), indicesTarget, error, 0, &err);
 
 				// Didn't change the number of indices, means won't go anymore.
-				// Setting rest of LODs to last successful
+				// Setting rest of LODs to last successful. Not to an empty one, lods with the same error go for the coarsest
 				if (newIndexCount == currIndexCount || newIndexCount == 0)
 				{
-					FillRestOfBuffers(currIndexBuffOffset, i, (uint32_t)newIndexCount);
+					FillRestOfBuffers(currIndexBuffOffset, i, (uint32_t)currIndexCount, lodError);
 					break;
 				}
 
+				lodError += err * errorScale;
+				dstErrors[i] = lodError;
+
 				meshopt_optimizeVertexCache(dst, dst, newIndexCount, vertices.size());
 
 				currIndexBuffOffset = indices.size();
@@ -169,11 +203,42 @@ namespace imp
 			meshopt_optimizeVertexFetch(vertices.data(), indices.data(), indices.size(), vertices.data(), vertices.size(), sizeof(Vertex));
 		}
 
-		std::vector<Meshlet> GenerateMeshlets(std::vector<Vertex>& verts, std::vector<uint32_t>& indices, std::vector<uint32_t>& meshletVertexData, std::vector<uint8_t>& meshletTriangleData, std::vector<NormalCone>& normalCones, const Comp::MeshGeometry& geometry, ms_MeshData& meshData)
+		std::unique_ptr<OccluderMesh> BuildOccluderMesh(std::span<const Vertex> vertices, std::span<const uint32_t> indices, const VulkanSubBuffer* lodIndices)
+		{
+			// lowest lod that has anything, simplification can give up with 0 indices
+			uint32_t lod = kMaxLODCount - 1;
+			while (lod > 0 && lodIndices[lod].GetCount() == 0)
+				lod--;
+
+			const uint32_t first = lodIndices[lod].GetOffset();
+			const uint32_t count = lodIndices[lod].GetCount();
+			if (count == 0 || count / 3 > OcclusionCuller::kMaxOccluderTriangles)
+				return nullptr;
+
+			// only keep vertices this lod uses
+			static constexpr uint32_t kUnused = ~0u;
+			std::vector<uint32_t> remap(vertices.size(), kUnused);
+			auto occluder = std::make_unique<OccluderMesh>();
+			occluder->indices.reserve(count);
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				auto& newIndex = remap[indices[i]];
+				if (newIndex == kUnused)
+				{
+					const auto& v = vertices[indices[i]];
+					newIndex = static_cast<uint32_t>(occluder->positions.size());
+					occluder->positions.emplace_back(v.vx, v.vy, v.vz);
+				}
+				occluder->indices.push_back(newIndex);
+			}
+			return occluder;
+		}
+
+		std::vector<Meshlet> GenerateMeshlets(std::vector<Vertex>& verts, std::vector<uint32_t>& indices, std::vector<uint32_t>& meshletVertexData, std::vector<uint8_t>& meshletTriangleData, std::vector<NormalCone>& normalCones, std::vector<BoundingVolumeSphere>& meshletBounds, const Comp::MeshGeometry& geometry, ms_MeshData& meshData)
 		{
 			std::vector<Meshlet> meshletsDst;
 			const size_t index_count = kMaxMeshletTriangles * 3;
-			const float cone_weight = 0.5f;
+			const float cone_weight = MESHLET_CONE_WEIGHT;
 
 			size_t meshletBound = meshopt_buildMeshletsBound(indices.size(), kMaxMeshletVertices, kMaxMeshletTriangles);
 			assert(meshletBound);
@@ -249,15 +314,20 @@ namespace imp
 					const uint32_t* meshletVertexPtr = &vertices[meshlets[i].vertex_offset];
 					const uint8_t* meshletTrianglePtr = &triangles[meshlets[i].triangle_offset];
 
+					meshopt_Bounds bounds = meshopt_computeMeshletBounds(meshletVertexPtr, meshletTrianglePtr, meshlet.triangleCount, (float*)verts.data(), verts.size(), sizeof(Vertex));
+					// basic.task culls with these against the frustum, by projected size and against the depth pyramid
+					BoundingVolumeSphere meshletBV;
+					std::memcpy(&meshletBV.center.x, bounds.center, sizeof(meshletBV.center));
+					meshletBV.radius = bounds.radius;
+					meshletBounds.push_back(meshletBV);
+
 					NormalCone cone;
 #if CONE_CULLING_ENABLED
-					meshopt_Bounds bounds = meshopt_computeMeshletBounds(meshletVertexPtr, meshletTrianglePtr, meshlet.triangleCount, (float*)verts.data(), verts.size(), sizeof(Vertex));
 					cone.cone[0] = bounds.cone_axis_s8[0];
 					cone.cone[1] = bounds.cone_axis_s8[1];
 					cone.cone[2] = bounds.cone_axis_s8[2];
 					cone.cone[3] = bounds.cone_cutoff_s8;
-					// I chose not to do per-meshlet VF culling so I wont be needing meshlet BV so it makes a lot more sense to use
-					// cone apex instead of BV for cone culling
+					// cone apex is closer to the actual cone than the meshlet BV center, so cone culling still uses the apex
 					static_assert(sizeof(cone.apex) == sizeof(bounds.cone_apex));
 					std::memcpy(&cone.apex.x, bounds.cone_apex, sizeof(cone.apex));
 #endif
@@ -270,137 +340,407 @@ namespace imp
 			return meshletsDst;
 		}
 
-		static float GetScale(const glm::mat4& transformMatrix)
+		float GetScale(const glm::mat4& transformMatrix)
 		{
-			return glm::length(transformMatrix[0]);
+			const float x = glm::dot(glm::vec3(transformMatrix[0]), glm::vec3(transformMatrix[0]));
+			const float y = glm::dot(glm::vec3(transformMatrix[1]), glm::vec3(transformMatrix[1]));
+			const float z = glm::dot(glm::vec3(transformMatrix[2]), glm::vec3(transformMatrix[2]));
+			return std::sqrt(std::max(x, std::max(y, z)));
 		};
 
-		void Cull(entt::registry& registry, std::vector<DrawDataSingle>& visibleData, const Graphics& gfx, BS::thread_pool& tp)
+		static constexpr uint8_t kCulled = kLodCulled;
+		// Entities are split into blocks of fixed size so the output doesn't depend on how the job system split the loop
+		static constexpr size_t kCullBlockSize = 1024;
+
+		std::array<glm::vec4, 6> FindCullingFrustum(entt::registry& registry)
 		{
-			AUTO_TIMER("[CPU CULL]: ");
+			return utils::FindViewFrustumPlanes(FindCullingViewProjection(registry));
+		}
 
+		glm::mat4 FindCullingViewProjection(entt::registry& registry)
+		{
 			const auto cameras = registry.view<Comp::Transform, Comp::Camera>();
 			const auto& cam = cameras.get<Comp::Camera>(cameras.back());
-			const glm::mat4x4 VP = cam.projection * cam.view;
+			return cam.projection * cam.view;
+		}
 
-			const auto frustumPlanes = utils::FindViewFrustumPlanes(VP);
+		LodSelection FindCullingLodSelection(entt::registry& registry, uint32_t viewportHeight, const EngineLodSettings& settings)
+		{
+			const auto cameras = registry.view<Comp::Transform, Comp::Camera>();
+			return MakeLodSelection(cameras.get<Comp::Camera>(cameras.back()).projection, viewportHeight, settings);
+		}
 
-			const auto transforms = registry.view<Comp::Transform>();
-			uint32_t totalMeshes = 0;
+		BoundingVolumeSphere TransformBoundingVolume(const glm::mat4& transform, const BoundingVolumeSphere& BV)
+		{
+			// transforms are affine so w of the center stays 1
+			const glm::vec4 wCenter = transform * glm::vec4(BV.center, 1.0f);
+			return { glm::vec3(wCenter), BV.radius * GetScale(transform) };
+		}
+
+		// Culling as it was before the SIMD kernels, one entity at a time. Kept as the reference for RunCullBenchmark
+		static uint8_t CullSphere(const std::array<glm::vec4, 6>& frustumPlanes, const glm::mat4& transform, const BoundingVolumeSphere& BV, const LodSelection& lodSelection, const float* lodErrors)
+		{
+			const glm::vec4 wCenter = transform * glm::vec4(BV.center, 1.0f);
+			const float scale = GetScale(transform);
+			float nearDistance = 0.0f;
 
+			for (auto i = 0; i < 6; i++)
+			{
+				const float dotProd = glm::dot(frustumPlanes[i], wCenter);
+				if (dotProd < -BV.radius * scale)
+					return kCulled;
+
+				if (i == 4)
+					nearDistance = dotProd;
+			}
+
+			// no lod history here
+			return SelectMeshLod(lodSelection, lodErrors, nearDistance, BV.radius * scale, BV.radius, kLodNone);
+		}
+
+		static void CullReference(entt::registry& registry, std::vector<DrawDataSingle>& visibleData, const Graphics& gfx, const LodSelection& lodSelection)
+		{
+			const auto frustumPlanes = FindCullingFrustum(registry);
+			const auto transforms = registry.view<Comp::Transform>();
 			const auto group = registry.group<Comp::ChildComponent, Comp::Mesh, Comp::Material>();
-			const auto groupSize = group.size();
 
-#if CPU_CULL_ST
 			visibleData.resize(0);
-
-			for (auto i = 0; const auto ent : group)
+			for (size_t i = 0; i < group.size(); i++)
 			{
+				const auto ent = GetRenderable(group, i);
 				const auto& mesh = group.get<Comp::Mesh>(ent);
 				const auto& parent = group.get<Comp::ChildComponent>(ent).parent;
 				const auto& transform = transforms.get<Comp::Transform>(parent);
-				const auto& BV = gfx.m_BVs.at(mesh.meshId);
+				if (!gfx.m_Meshes.IsUploaded(mesh.meshId))
+					continue;
+
+				const auto lodIdx = CullSphere(frustumPlanes, transform.transform, gfx.m_Meshes.GetBounds(mesh.meshId), lodSelection, gfx.m_Meshes.GetGeometry(mesh.meshId).lodErrors);
+				if (lodIdx == kCulled)
+					continue;
+
+				DrawDataSingle dds;
+				dds.Transform = transform.transform;
+				dds.VertexBufferId = mesh.meshId;
+				dds.LodIdx = lodIdx;
+				visibleData.push_back(dds);
+			}
+		}
 
-				glm::vec4 mCenter = glm::vec4(BV.center, 1.0f);
-				glm::vec4 wCenter = transform.transform * glm::vec4(BV.center, 1.0f);
+		// Runs world-space spheres of proxies [begin, end) through the SIMD kernel and writes lod (or kCulled) of
+		// each into lods. Both culling paths go through this so they can't drift apart.
+		static uint32_t CullBlock(const std::array<glm::vec4, 6>& frustumPlanes, const RenderProxies& proxies, const LodSelection& lodSelection, const MeshRegistry& meshes, size_t begin, size_t end, uint8_t* lods)
+		{
+			alignas(64) float nearDistance[kCullBlockSize];
+			alignas(64) uint8_t visible[kCullBlockSize];
 
-				float scale = GetScale(transform.transform);
-				float distFromCamera = 0.0f;
+			const size_t count = end - begin;
+			const auto spheres = proxies.GetSpheres();
+			FrustumCullSpheres(frustumPlanes, { spheres.x + begin, spheres.y + begin, spheres.z + begin, spheres.radius + begin }, count, visible, nearDistance);
 
-				bool isVisible = true;
-				for (auto i = 0; i < 6; i++)
-				{
-					float dotProd = glm::dot(frustumPlanes[i], wCenter);
-					float radius = -BV.radius;
-					//printf("%.3f %.3f %.3f %.3f \n", dotProd, radius, scale, -BV.radius * scale);
-					if (dotProd < -BV.radius * scale)
-					{
-						isVisible = false;
-						break;
-					}
+			uint32_t visibleCount = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				lods[i] = visible[i] ? ChooseMeshLOD(lodSelection, proxies, meshes, begin + i, nearDistance[i]) : kCulled;
+				if (lods[i] != kCulled)
+					visibleCount++;
+			}
+			return visibleCount;
+		}
 
-#if LOD_ENABLED
-					if (i == 4)
-						distFromCamera = dotProd - BV.radius;
-#endif
-				}
+		static void CullSingleThreaded(entt::registry& registry, RenderProxies& proxies, const LodSelection& lodSelection, const MeshRegistry& meshes, std::vector<DrawDataSingle>& visibleData)
+		{
+			const auto frustumPlanes = FindCullingFrustum(registry);
+			const size_t count = proxies.GetCount();
 
-				if (isVisible)
+			visibleData.resize(0);
+			uint8_t lods[kCullBlockSize];
+			for (size_t begin = 0; begin < count; begin += kCullBlockSize)
+			{
+				const size_t end = std::min(begin + kCullBlockSize, count);
+				CullBlock(frustumPlanes, proxies, lodSelection, meshes, begin, end, lods);
+
+				for (size_t i = begin; i < end; i++)
 				{
-#if LOD_ENABLED
-					auto lodIdx = utils::ChooseMeshLODByNearPlaneDistance(distFromCamera);
-#else
-					auto lodIdx = 0;
-#endif
+					const uint8_t lod = lods[i - begin];
+					if (lod == kCulled)
+						continue;
 
 					DrawDataSingle dds;
-					dds.Transform = transform.transform;
-					dds.VertexBufferId = mesh.meshId;
-					dds.LodIdx = lodIdx;
-
+					dds.Transform = proxies.GetTransform(i);
+					dds.VertexBufferId = proxies.GetMeshId(i);
+					dds.LodIdx = lod;
 					visibleData.push_back(dds);
+					proxies.SetLod(i, lod);
 				}
 			}
-#else
-			visibleData.resize(groupSize);
-
-			std::atomic_uint32_t drawDataIndex = 0;
+		}
 
-			const auto gfxPtr = &gfx;
-			const auto ddPtr = &visibleData;
-			const auto loop = [&group, &transforms, gfxPtr, &frustumPlanes, &VP, &drawDataIndex, ddPtr](const auto st, const auto end)
+		// Two passes over fixed blocks. First one stores lod (or kCulled) of every entity and how many survived in each block,
+		// exclusive prefix sum over the block counts gives every block its offset in the output and the second pass writes
+		// the draw data there. No shared push_back or atomics and the order is exactly the same as single threaded.
+		static void CullMultiThreaded(entt::registry& registry, RenderProxies& proxies, const LodSelection& lodSelection, const MeshRegistry& meshes, std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem)
+		{
+			struct CullScratch
 			{
-				for (auto i = st; i < end; i++)
-				{
-					const auto ent = group[i];
-					const auto& mesh = group.get<Comp::Mesh>(ent);
-					const auto& parent = group.get<Comp::ChildComponent>(ent).parent;
-					const auto& transform = transforms.get<Comp::Transform>(parent);
-					const auto& BV = gfxPtr->m_BVs.at(mesh.meshId);
+				std::vector<uint8_t> lods;
+				std::vector<uint32_t> blockOffsets;
+			};
+			// reused between frames. Grab a reference, workers would see their own thread_local otherwise
+			static thread_local CullScratch tlsScratch;
+			auto& scratch = tlsScratch;
 
-					glm::vec4 mCenter = glm::vec4(BV.center, 1.0f);
-					glm::vec4 wCenter = transform.transform * glm::vec4(BV.center, 1.0f);
+			const auto frustumPlanes = FindCullingFrustum(registry);
+			const size_t count = proxies.GetCount();
+			const size_t blockCount = (count + kCullBlockSize - 1) / kCullBlockSize;
+			scratch.lods.resize(count);
+			scratch.blockOffsets.resize(blockCount + 1);
+
+			jobSystem.ParallelFor(blockCount, [&](size_t firstBlock, size_t lastBlock)
+				{
+					for (size_t block = firstBlock; block < lastBlock; block++)
+					{
+						const size_t begin = block * kCullBlockSize;
+						const size_t end = std::min(begin + kCullBlockSize, count);
+						scratch.blockOffsets[block + 1] = CullBlock(frustumPlanes, proxies, lodSelection, meshes, begin, end, scratch.lods.data() + begin);
+					}
+				}, 1);
 
-					float scale = glm::length(glm::vec3(transform.transform[0].x, transform.transform[0].y, transform.transform[0].z));
+			scratch.blockOffsets[0] = 0;
+			for (size_t block = 0; block < blockCount; block++)
+				scratch.blockOffsets[block + 1] += scratch.blockOffsets[block];
+			visibleData.resize(scratch.blockOffsets[blockCount]);
 
-					bool isVisible = true;
-					for (auto i = 0; i < 6; i++)
+			jobSystem.ParallelFor(blockCount, [&](size_t firstBlock, size_t lastBlock)
+				{
+					for (size_t block = firstBlock; block < lastBlock; block++)
 					{
-						float dotProd = glm::dot(frustumPlanes[i], wCenter);
-						if (dotProd < -BV.radius * scale)
+						uint32_t dst = scratch.blockOffsets[block];
+						if (dst == scratch.blockOffsets[block + 1])
+							continue;
+
+						const size_t begin = block * kCullBlockSize;
+						const size_t end = std::min(begin + kCullBlockSize, count);
+						for (size_t i = begin; i < end; i++)
 						{
-							isVisible = false;
-							break;
+							const uint8_t lod = scratch.lods[i];
+							if (lod == kCulled)
+								continue;
+
+							auto& dds = visibleData[dst++];
+							dds.Transform = proxies.GetTransform(i);
+							dds.VertexBufferId = proxies.GetMeshId(i);
+							dds.LodIdx = lod;
+							proxies.SetLod(i, lod);
 						}
+					}
+				}, 1);
+		}
 
-#if LOD_ENABLED
-						if (i == 4)
-							distFromCamera = dotProd - BV.radius;
+		void Cull(entt::registry& registry, RenderProxies& proxies, const LodSelection& lodSelection, const MeshRegistry& meshes, std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem)
+		{
+			AUTO_TIMER("[CPU CULL]: ");
+#if CPU_CULL_ST
+			CullSingleThreaded(registry, proxies, lodSelection, meshes, visibleData);
+#else
+			CullMultiThreaded(registry, proxies, lodSelection, meshes, visibleData, jobSystem);
 #endif
+		}
+
+		void SortDrawsForInstancing(std::vector<DrawDataSingle>& drawData, uint32_t meshCount, prl::JobSystem& jobSystem)
+		{
+			AUTO_TIMER("[INSTANCING SORT]: ");
+			static constexpr size_t kMinChunkSize = 16 * 1024;
+
+			struct SortScratch
+			{
+				std::vector<DrawDataSingle> sorted;
+				std::vector<uint32_t> offsets;
+			};
+			// reused between frames. Grab a reference, workers would see their own thread_local otherwise
+			static thread_local SortScratch tlsScratch;
+			auto& scratch = tlsScratch;
+
+			const size_t count = drawData.size();
+			const size_t keyCount = static_cast<size_t>(meshCount) * kMaxLODCount;
+			if (count < 2 || keyCount == 0)
+				return;
+
+			const auto key = [](const DrawDataSingle& dds) { return dds.VertexBufferId * kMaxLODCount + dds.LodIdx; };
+
+			// a histogram per chunk would be bigger than what's sorted with a lot of meshes and few draws
+			if (keyCount > count)
+			{
+				std::stable_sort(drawData.begin(), drawData.end(), [&](const DrawDataSingle& a, const DrawDataSingle& b) { return key(a) < key(b); });
+				return;
+			}
+
+			const size_t chunkCount = std::clamp<size_t>(count / kMinChunkSize, 1, jobSystem.GetConcurrency());
+			const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+			scratch.sorted.resize(count);
+			scratch.offsets.assign(chunkCount * keyCount, 0);
+
+			// every chunk counts its keys
+			jobSystem.ParallelFor(chunkCount, [&](size_t firstChunk, size_t lastChunk)
+				{
+					for (size_t chunk = firstChunk; chunk < lastChunk; chunk++)
+					{
+						uint32_t* histogram = scratch.offsets.data() + chunk * keyCount;
+						const size_t end = std::min((chunk + 1) * chunkSize, count);
+						for (size_t i = chunk * chunkSize; i < end; i++)
+							histogram[key(drawData[i])]++;
 					}
+				}, 1);
 
-					if (isVisible)
+			// key major, chunk minor so the sort stays stable
+			uint32_t offset = 0;
+			for (size_t k = 0; k < keyCount; k++)
+			{
+				for (size_t chunk = 0; chunk < chunkCount; chunk++)
+				{
+					auto& slot = scratch.offsets[chunk * keyCount + k];
+					const uint32_t n = slot;
+					slot = offset;
+					offset += n;
+				}
+			}
+
+			jobSystem.ParallelFor(chunkCount, [&](size_t firstChunk, size_t lastChunk)
+				{
+					for (size_t chunk = firstChunk; chunk < lastChunk; chunk++)
 					{
-#if LOD_ENABLED
-						auto lodIdx = utils::ChooseMeshLODByNearPlaneDistance(distFromCamera);
-#else
-						auto lodIdx = 0;
-#endif
+						uint32_t* offsets = scratch.offsets.data() + chunk * keyCount;
+						const size_t end = std::min((chunk + 1) * chunkSize, count);
+						for (size_t i = chunk * chunkSize; i < end; i++)
+							scratch.sorted[offsets[key(drawData[i])]++] = drawData[i];
+					}
+				}, 1);
 
-						DrawDataSingle dds;
-						dds.Transform = transform.transform;
-						dds.VertexBufferId = mesh.meshId;
-						dds.LodIdx = lodIdx;
+			drawData.swap(scratch.sorted);
+		}
 
-						visibleData.push_back(dds);
+		static bool SameDrawData(const std::vector<DrawDataSingle>& a, const std::vector<DrawDataSingle>& b)
+		{
+			if (a.size() != b.size())
+				return false;
+			for (size_t i = 0; i < a.size(); i++)
+				if (a[i].Transform != b[i].Transform || a[i].VertexBufferId != b[i].VertexBufferId || a[i].LodIdx != b[i].LodIdx)
+					return false;
+			return true;
 		}
-				}
+
+		void RunCullBenchmark(entt::registry& registry, const Graphics& gfx, const LodSelection& lodSelection)
+		{
+			static constexpr uint32_t kIterations = 20;
+			// the reference has no lod history, without hysteresis the others can't pick anything else
+			LodSelection lods = lodSelection;
+			lods.hysteresis = 0.0f;
+
+			const auto group = registry.group<Comp::ChildComponent, Comp::Mesh, Comp::Material>();
+			const size_t renderableCount = group.size();
+			std::vector<DrawDataSingle> reference;
+			std::vector<DrawDataSingle> visibleData;
+
+			const auto timeCull = [](const auto& cull)
+			{
+				SimpleTimer timer;
+				cull(); // warm up
+				timer.start();
+				for (uint32_t it = 0; it < kIterations; it++)
+					cull();
+				timer.stop();
+				return timer.miliseconds() / kIterations;
 			};
 
-			tp.parallelize_loop(groupSize, loop).wait();
-			visibleData.resize(drawDataIndex);
-#endif
-			//printf("[CPU CULL] Total Renderable Meshes: %u; Renderable Meshes after culling: %llu\n", totalMeshes, visibleData.size());
+			// per-entity scalar loop is what everything gets compared against
+			const double referenceTime = timeCull([&]() { CullReference(registry, reference, gfx, lods); });
+			const auto printRow = [&](const char* name, double time, bool exact)
+			{
+				printf("[Cull Benchmark] %-12s %10.3f %10.2f %12.0f  %s\n", name, time, referenceTime / time, renderableCount / time, exact ? "" : "MISMATCH");
+			};
+
+			const auto topology = prl::CpuTopology::Query();
+			printf("[Cull Benchmark] %zu renderables, %zu visible, avg of %u iterations, %s kernel\n", renderableCount, reference.size(), kIterations, FrustumCullISAToString(GetBestFrustumCullISA()));
+			printf("[Cull Benchmark] %-12s %10s %10s %12s\n", "threads", "time ms", "speedup", "culled/ms");
+			printRow("reference", referenceTime, true);
+
+			// proxies are synced before the culling gets timed, in a frame that's a no-op when nothing moved
+			prl::JobSystemSettings serialSettings;
+			serialSettings.workerCount = 0;
+			prl::JobSystem serialJobs(serialSettings);
+			RenderProxies proxies;
+			proxies.Connect(registry);
+			proxies.Update(gfx, serialJobs);
+
+			const double singleThreaded = timeCull([&]() { CullSingleThreaded(registry, proxies, lods, gfx.m_Meshes, visibleData); });
+			printRow("ST", singleThreaded, SameDrawData(reference, visibleData));
+
+			// thread count includes the thread that calls Cull
+			std::vector<uint32_t> threadCounts;
+			for (uint32_t threads = 1; threads < topology.logicalProcessorCount; threads *= 2)
+				threadCounts.push_back(threads);
+			threadCounts.push_back(topology.logicalProcessorCount);
+
+			const auto frustumPlanes = FindCullingFrustum(registry);
+			for (const auto threads : threadCounts)
+			{
+				prl::JobSystemSettings settings;
+				settings.workerCount = threads - 1;
+				settings.pinWorkers = false;
+				prl::JobSystem jobs(settings);
+
+				char name[32];
+				// reconnecting forces a full rebuild
+				proxies.Disconnect();
+				proxies.Connect(registry);
+				proxies.Update(gfx, jobs);
+				const double proxiesRebuildTime = proxies.GetStats().rebuildTime;
+
+				const double multiThreaded = timeCull([&]() { CullMultiThreaded(registry, proxies, lods, gfx.m_Meshes, visibleData, jobs); });
+				snprintf(name, sizeof(name), "%u", threads);
+				printRow(name, multiThreaded, SameDrawData(reference, visibleData));
+
+				CullingBVH bvh;
+				bvh.Enable();
+				bvh.Update(proxies, jobs);
+				const double bvhTime = timeCull([&]() { bvh.Cull(frustumPlanes, proxies, lods, gfx.m_Meshes, visibleData, jobs); });
+				const bool bvhExact = SameDrawData(reference, visibleData);
+				const auto stats = bvh.GetStats();
+
+				// refit after 1% of the renderables moved, patch without changes so the scene stays the same
+				for (size_t i = 0; i < renderableCount; i += 100)
+					registry.patch<Comp::Transform>(group.get<Comp::ChildComponent>(group[i]).parent);
+				proxies.Update(gfx, jobs);
+				bvh.Update(proxies, jobs);
+
+				snprintf(name, sizeof(name), "BVH %u", threads);
+				printRow(name, bvhTime, bvhExact);
+				printf("[Cull Benchmark]     render proxies rebuild %.3f ms, update of %u proxies %.3f ms\n", proxiesRebuildTime, proxies.GetStats().updatedProxies, proxies.GetStats().updateTime);
+				printf("[Cull Benchmark]     build %.3f ms, refit of %u primitives %.3f ms, %u nodes visited, %u spheres tested, %u accepted without tests\n",
+					stats.buildTime, bvh.GetStats().refitPrimitives, bvh.GetStats().refitTime, stats.nodesVisited, stats.primitivesTested, stats.primitivesAccepted);
+			}
+
+			// What every renderable costs to turn into draw data when it has to be looked up through the registry
+			// (child -> parent -> Transform) compared to walking the proxies. Single threaded, no culling
+			std::vector<DrawDataSingle> gathered;
+			const auto transforms = registry.view<Comp::Transform>();
+			const double registryGatherTime = timeCull([&]()
+				{
+					reference.resize(renderableCount);
+					for (size_t i = 0; i < renderableCount; i++)
+					{
+						const auto ent = GetRenderable(group, i);
+						reference[i] = { transforms.get<Comp::Transform>(group.get<Comp::ChildComponent>(ent).parent).transform, group.get<Comp::Mesh>(ent).meshId, 0 };
+					}
+				});
+			const double proxyGatherTime = timeCull([&]()
+				{
+					gathered.resize(proxies.GetCount());
+					for (size_t i = 0; i < proxies.GetCount(); i++)
+						gathered[i] = { proxies.GetTransform(i), proxies.GetMeshId(i), 0 };
+				});
+			printf("[Cull Benchmark] draw data of every renderable: registry %.3f ms (%.1f ns each), proxies %.3f ms (%.1f ns each), %.2fx %s\n",
+				registryGatherTime, registryGatherTime * 1e6 / renderableCount, proxyGatherTime, proxyGatherTime * 1e6 / renderableCount, registryGatherTime / proxyGatherTime,
+				SameDrawData(reference, gathered) ? "" : "MISMATCH");
 		}
 	}
 }
\ No newline at end of file
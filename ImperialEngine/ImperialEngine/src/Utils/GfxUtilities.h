@@ -1,8 +1,11 @@
 #pragma once
 #include "backend/graphics/Graphics.h"
+#include "Utils/LodSelection.h"
+#include <span>
 
 namespace imp
 {
+	class RenderProxies;
 
 	namespace utils
 	{
@@ -12,12 +15,43 @@ namespace imp
 		void InsertBufferBarrier(CommandBuffer& cb, VkPipelineStageFlags srcFlags, VkPipelineStageFlags dstFlags, const VkBufferMemoryBarrier* bmbs, uint32_t bmbCount);
 		VkBufferMemoryBarrier CreateBufferMemoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
 		VkBufferMemoryBarrier CreateBufferMemoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcQFIndex, uint32_t dstQFIndex, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		void InsertImageBarrier(CommandBuffer& cb, VkPipelineStageFlags srcFlags, VkPipelineStageFlags dstFlags, const VkImageMemoryBarrier* imbs, uint32_t imbCount);
+		VkImageMemoryBarrier CreateImageMemoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkImageLayout oldLayout, VkImageLayout newLayout, VkImage image, VkImageAspectFlags aspect, uint32_t baseMipLevel = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS);
 	
-		uint32_t ChooseMeshLODByNearPlaneDistance(float distFromCamera);
-		void GenerateMeshLODS(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, VulkanSubBuffer* dstSubBuffers, uint32_t numLODs, double factor, float error);
+		// SelectMeshLod for a proxy, with the lod it was last drawn with as the one to stick to
+		uint8_t ChooseMeshLOD(const LodSelection& selection, const RenderProxies& proxies, const MeshRegistry& meshes, size_t proxy, float nearDistance);
+		// Every lod is simplified from the one before, dstErrors gets their model space error (accumulated, lod 0 has none)
+		void GenerateMeshLODS(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, VulkanSubBuffer* dstSubBuffers, float* dstErrors, uint32_t numLODs, double factor, float error);
 		void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
-		std::vector<Meshlet> GenerateMeshlets(std::vector<Vertex>& verts, std::vector<uint32_t>& indices, std::vector<uint32_t>& meshletVertexData, std::vector<uint8_t>& meshletTriangleData, std::vector<NormalCone>& normalCones, const Comp::MeshGeometry& geometry, ms_MeshData& meshData);
+		// Occluder for CPU occlusion culling out of the lowest of kMaxLODCount lodIndices (offsets into indices, before they're
+		// moved into the big index buffer). Null when that's still over OcclusionCuller::kMaxOccluderTriangles
+		std::unique_ptr<OccluderMesh> BuildOccluderMesh(std::span<const Vertex> vertices, std::span<const uint32_t> indices, const VulkanSubBuffer* lodIndices);
+		std::vector<Meshlet> GenerateMeshlets(std::vector<Vertex>& verts, std::vector<uint32_t>& indices, std::vector<uint32_t>& meshletVertexData, std::vector<uint8_t>& meshletTriangleData, std::vector<NormalCone>& normalCones, std::vector<BoundingVolumeSphere>& meshletBounds, const Comp::MeshGeometry& geometry, ms_MeshData& meshData);
 
-		void Cull(entt::registry& registry, std::vector<DrawDataSingle>& visibleData, const Graphics& gfx, BS::thread_pool& tp);
+		// Renderables are indexed by where they are in the storage of the group, not by group[i]. Entities joining the
+		// group end up at the front of it but at the back of the storage, so this way existing indices don't move.
+		template <typename Group>
+		inline entt::entity GetRenderable(const Group& group, size_t idx) { return group[group.size() - 1 - idx]; }
+
+		// Frustum planes of the camera culling is done for
+		std::array<glm::vec4, 6> FindCullingFrustum(entt::registry& registry);
+		// and its view projection
+		glm::mat4 FindCullingViewProjection(entt::registry& registry);
+		// lod selection for its projection
+		LodSelection FindCullingLodSelection(entt::registry& registry, uint32_t viewportHeight, const EngineLodSettings& settings);
+		// Biggest axis scale, so the scaled sphere still covers the mesh when scale isn't uniform
+		float GetScale(const glm::mat4& transformMatrix);
+		// World-space sphere culling tests against, radius scaled by the biggest axis scale
+		BoundingVolumeSphere TransformBoundingVolume(const glm::mat4& transform, const BoundingVolumeSphere& BV);
+		// Single or multithreaded depending on CPU_CULL_ST, both give the same draw data in the same order (proxy order).
+		// proxies have to be up to date with the registry, lods of visible ones get stored in them. Whatever projects under
+		// LodSelection::minProjectedSize gets culled too
+		void Cull(entt::registry& registry, RenderProxies& proxies, const LodSelection& lodSelection, const MeshRegistry& meshes, std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem);
+		// Stable sort of draw data by (mesh, lod) so draws of the same one are next to each other and can go out as a single
+		// instanced draw. Counting sort, meshCount is how many mesh slots there are (MeshRegistry::GetSlotCount)
+		void SortDrawsForInstancing(std::vector<DrawDataSingle>& drawData, uint32_t meshCount, prl::JobSystem& jobSystem);
+		// Times the SIMD culling single threaded, at 1, 2, 4.. threads and with the BVH against the old per-entity loop on the
+		// loaded scene and checks they all match. Also times gathering draw data through the registry vs render proxies
+		void RunCullBenchmark(entt::registry& registry, const Graphics& gfx, const LodSelection& lodSelection);
 	}
 }
\ No newline at end of file
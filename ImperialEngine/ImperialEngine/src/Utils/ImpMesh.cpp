@@ -0,0 +1,224 @@
+#include "ImpMesh.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace imp
+{
+	static constexpr uint64_t kImpMeshAlignment = 16;
+
+	static uint64_t AlignUp(uint64_t value)
+	{
+		return (value + kImpMeshAlignment - 1) & ~(kImpMeshAlignment - 1);
+	}
+
+	// Lays arrays out one after another, the data gets copied in once the size is known
+	struct ImpMeshLayout
+	{
+		uint64_t size = 0;
+
+		template<typename T>
+		ImpMeshArray Add(std::span<const T> data)
+		{
+			ImpMeshArray array = { AlignUp(size), data.size() };
+			size = array.offset + data.size_bytes();
+			return array;
+		}
+	};
+
+	template<typename T>
+	static void CopyArray(std::vector<uint8_t>& file, const ImpMeshArray& array, std::span<const T> data)
+	{
+		if (data.size())
+			std::memcpy(file.data() + array.offset, data.data(), data.size_bytes());
+	}
+
+	std::shared_ptr<const ImpMeshFile> ImpMeshFile::Open(const std::filesystem::path& path, uint64_t key)
+	{
+		std::shared_ptr<ImpMeshFile> file(new ImpMeshFile());
+		if (!file->m_File.Open(path))
+			return nullptr;
+
+		if (!file->Validate() || file->GetHeader().key != key)
+		{
+			printf("[Asset Importer] '%s' is stale or broken, ignoring it\n", path.string().c_str());
+			return nullptr;
+		}
+		return file;
+	}
+
+	bool ImpMeshFile::Write(const std::filesystem::path& path, uint64_t key, float processingMilliseconds, std::span<const utils::MeshPayload> meshes,
+		std::span<const ImpMeshInstance> instances, const glm::mat4* camera)
+	{
+		ImpMeshHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = kImpMeshMagic;
+		header.version = kImpMeshVersion;
+		header.vertexSize = sizeof(Vertex);
+		header.lodCount = kMaxLODCount;
+		header.maxMeshletVertices = kMaxMeshletVertices;
+		header.maxMeshletTriangles = kMaxMeshletTriangles;
+		header.hasCamera = camera != nullptr;
+		header.camera = camera ? *camera : glm::mat4(1.0f);
+		header.key = key;
+		header.processingMilliseconds = processingMilliseconds;
+
+		ImpMeshLayout layout;
+		layout.size = sizeof(header);
+		std::vector<ImpMeshEntry> entries(meshes.size());
+		header.meshes = layout.Add(std::span<const ImpMeshEntry>(entries));
+		header.instances = layout.Add(instances);
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const auto& mesh = meshes[i];
+			auto& entry = entries[i];
+			std::memset(&entry, 0, sizeof(entry));
+			entry.boundingVolume = mesh.boundingVolume;
+			for (uint32_t lod = 0; lod < kMaxLODCount; lod++)
+			{
+				entry.lodIndices[lod] = { mesh.lodIndices[lod].GetOffset(), mesh.lodIndices[lod].GetCount() };
+				entry.lodMeshlets[lod] = { mesh.lodMeshlets[lod].meshletBufferOffset, mesh.lodMeshlets[lod].taskCount };
+				entry.lodErrors[lod] = mesh.lodErrors[lod];
+			}
+			entry.vertices = layout.Add(mesh.vertices);
+			entry.indices = layout.Add(mesh.indices);
+			entry.meshlets = layout.Add(mesh.meshlets);
+			entry.meshletBounds = layout.Add(mesh.meshletBounds);
+			entry.meshletVertexData = layout.Add(mesh.meshletVertexData);
+			entry.meshletTriangleData = layout.Add(mesh.meshletTriangleData);
+			entry.normalCones = layout.Add(mesh.normalCones);
+		}
+
+		std::vector<uint8_t> data(static_cast<size_t>(layout.size), 0);
+		std::memcpy(data.data(), &header, sizeof(header));
+		CopyArray(data, header.meshes, std::span<const ImpMeshEntry>(entries));
+		CopyArray(data, header.instances, instances);
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const auto& mesh = meshes[i];
+			const auto& entry = entries[i];
+			CopyArray(data, entry.vertices, mesh.vertices);
+			CopyArray(data, entry.indices, mesh.indices);
+			CopyArray(data, entry.meshlets, mesh.meshlets);
+			CopyArray(data, entry.meshletBounds, mesh.meshletBounds);
+			CopyArray(data, entry.meshletVertexData, mesh.meshletVertexData);
+			CopyArray(data, entry.meshletTriangleData, mesh.meshletTriangleData);
+			CopyArray(data, entry.normalCones, mesh.normalCones);
+		}
+
+		// scene files with the same contents get the same key and can be written at the same time
+		auto tempPath = path;
+		tempPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				printf("[Asset Importer] Failed to open a file: %s\n", tempPath.string().c_str());
+				return false;
+			}
+			file.write(reinterpret_cast<const char*>(data.data()), data.size());
+			if (!file)
+				return false;
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tempPath, path, ec);
+		if (ec)
+		{
+			printf("[Asset Importer] Failed to write '%s': %s\n", path.string().c_str(), ec.message().c_str());
+			std::filesystem::remove(tempPath, ec);
+			return false;
+		}
+		return true;
+	}
+
+	const ImpMeshHeader& ImpMeshFile::GetHeader() const
+	{
+		return *reinterpret_cast<const ImpMeshHeader*>(m_File.GetData());
+	}
+
+	uint32_t ImpMeshFile::GetMeshCount() const
+	{
+		return static_cast<uint32_t>(GetHeader().meshes.count);
+	}
+
+	const ImpMeshEntry& ImpMeshFile::GetMesh(uint32_t mesh) const
+	{
+		assert(mesh < GetMeshCount());
+		return GetArray<ImpMeshEntry>(GetHeader().meshes)[mesh];
+	}
+
+	utils::MeshPayload ImpMeshFile::GetPayload(uint32_t mesh) const
+	{
+		const auto& entry = GetMesh(mesh);
+		utils::MeshPayload payload;
+		payload.vertices = GetArray<Vertex>(entry.vertices);
+		payload.indices = GetArray<uint32_t>(entry.indices);
+		payload.meshlets = GetArray<Meshlet>(entry.meshlets);
+		payload.meshletBounds = GetArray<BoundingVolumeSphere>(entry.meshletBounds);
+		payload.meshletVertexData = GetArray<uint32_t>(entry.meshletVertexData);
+		payload.meshletTriangleData = GetArray<uint8_t>(entry.meshletTriangleData);
+		payload.normalCones = GetArray<NormalCone>(entry.normalCones);
+		for (uint32_t lod = 0; lod < kMaxLODCount; lod++)
+		{
+			payload.lodIndices[lod] = VulkanSubBuffer(entry.lodIndices[lod].offset, entry.lodIndices[lod].count);
+			payload.lodMeshlets[lod] = { entry.lodMeshlets[lod].offset, entry.lodMeshlets[lod].count, entry.lodErrors[lod] };
+			payload.lodErrors[lod] = entry.lodErrors[lod];
+		}
+		payload.boundingVolume = entry.boundingVolume;
+		return payload;
+	}
+
+	std::span<const ImpMeshInstance> ImpMeshFile::GetInstances() const
+	{
+		return GetArray<ImpMeshInstance>(GetHeader().instances);
+	}
+
+	bool ImpMeshFile::IsInFile(const ImpMeshArray& array, size_t elementSize) const
+	{
+		const uint64_t size = m_File.GetSize();
+		return array.offset % kImpMeshAlignment == 0 && array.offset <= size && array.count <= (size - array.offset) / elementSize;
+	}
+
+	// Only checks that everything is where the tables say, the data itself is trusted
+	bool ImpMeshFile::Validate() const
+	{
+		if (m_File.GetSize() < sizeof(ImpMeshHeader))
+			return false;
+
+		const auto& header = GetHeader();
+		if (header.magic != kImpMeshMagic || header.version != kImpMeshVersion || header.vertexSize != sizeof(Vertex) || header.lodCount != kMaxLODCount ||
+			header.maxMeshletVertices != kMaxMeshletVertices || header.maxMeshletTriangles != kMaxMeshletTriangles)
+			return false;
+
+		if (!IsInFile(header.meshes, sizeof(ImpMeshEntry)) || !IsInFile(header.instances, sizeof(ImpMeshInstance)))
+			return false;
+
+		for (uint32_t i = 0; i < GetMeshCount(); i++)
+		{
+			const auto& entry = GetMesh(i);
+			if (!IsInFile(entry.vertices, sizeof(Vertex)) || !IsInFile(entry.indices, sizeof(uint32_t)) || !IsInFile(entry.meshlets, sizeof(Meshlet)) ||
+				!IsInFile(entry.meshletBounds, sizeof(BoundingVolumeSphere)) || entry.meshletBounds.count != entry.meshlets.count ||
+				!IsInFile(entry.meshletVertexData, sizeof(uint32_t)) || !IsInFile(entry.meshletTriangleData, sizeof(uint8_t)) || !IsInFile(entry.normalCones, sizeof(NormalCone)))
+				return false;
+
+			for (uint32_t lod = 0; lod < kMaxLODCount; lod++)
+			{
+				const auto& indices = entry.lodIndices[lod];
+				const auto& meshlets = entry.lodMeshlets[lod];
+				if (uint64_t(indices.offset) + indices.count > entry.indices.count || uint64_t(meshlets.offset) + meshlets.count > entry.meshlets.count)
+					return false;
+			}
+		}
+
+		for (const auto& instance : GetInstances())
+			if (instance.mesh >= GetMeshCount())
+				return false;
+
+		return true;
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "backend/VariousTypeDefinitions.h"
+#include "Utils/MeshProcessing.h"
+#include "Utils/NonCopyable.h"
+#include "Utils/Utilities.h"
+#include <filesystem>
+#include <memory>
+#include <span>
+
+namespace imp
+{
+	// .impmesh is what cooking makes out of an .obj or glTF: meshes already optimized, with lods and meshlets, so loading
+	// is mapping the file and copying. Little endian, the header first, then the mesh and instance tables and then the
+	// arrays, every one aligned to 16 bytes. Bump the version whenever anything in here changes, MeshCache keys by it too
+	inline constexpr uint32_t kImpMeshMagic = 0x48534D49;	// "IMSH"
+	inline constexpr uint32_t kImpMeshVersion = 2;
+
+	// Elements of an array, offset is in bytes from the start of the file
+	struct ImpMeshArray
+	{
+		uint64_t offset;
+		uint64_t count;
+	};
+
+	struct ImpMeshRange
+	{
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	struct ImpMeshHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		// what the data was cooked with, the file is stale when any of these don't match the engine
+		uint32_t vertexSize;
+		uint32_t lodCount;
+		uint32_t maxMeshletVertices;
+		uint32_t maxMeshletTriangles;
+		uint32_t hasCamera;
+		uint32_t pad;
+		ImpMeshArray meshes;		// ImpMeshEntry
+		ImpMeshArray instances;		// ImpMeshInstance
+		glm::mat4 camera;			// glTF camera node transform
+		uint64_t key;				// MeshCache key of the source it was cooked from
+		float processingMilliseconds;	// what loading the source took, parsing and processing
+		uint32_t pad2;
+	};
+	static_assert(sizeof(ImpMeshHeader) % 16 == 0);
+
+	// One processed mesh, same as utils::MeshPayload with the spans as arrays in the file
+	struct ImpMeshEntry
+	{
+		BoundingVolumeSphere boundingVolume;
+		ImpMeshRange lodIndices[kMaxLODCount];		// into indices
+		ImpMeshRange lodMeshlets[kMaxLODCount];		// into meshlets, count is the task count
+		float lodErrors[kMaxLODCount];
+		ImpMeshArray vertices;						// Vertex
+		ImpMeshArray indices;						// uint32_t, every lod
+		ImpMeshArray meshlets;						// Meshlet
+		ImpMeshArray meshletBounds;					// BoundingVolumeSphere, parallel to meshlets
+		ImpMeshArray meshletVertexData;				// uint32_t
+		ImpMeshArray meshletTriangleData;			// uint8_t
+		ImpMeshArray normalCones;					// NormalCone
+	};
+
+	// A node of the scene that draws a mesh, .obj files have none and draw every mesh once
+	struct ImpMeshInstance
+	{
+		glm::mat4 transform;
+		uint32_t mesh;
+		uint32_t pad[3];
+	};
+	static_assert(sizeof(ImpMeshInstance) % 16 == 0);
+
+	class ImpMeshFile : NonCopyable
+	{
+	public:
+		// Maps the file, null when it doesn't exist, has another key, was cooked with different settings or doesn't add up
+		static std::shared_ptr<const ImpMeshFile> Open(const std::filesystem::path& path, uint64_t key);
+		// Writes next to path and renames over it, so a half written file never gets opened
+		static bool Write(const std::filesystem::path& path, uint64_t key, float processingMilliseconds, std::span<const utils::MeshPayload> meshes,
+			std::span<const ImpMeshInstance> instances, const glm::mat4* camera);
+
+		const ImpMeshHeader& GetHeader() const;
+		uint32_t GetMeshCount() const;
+		const ImpMeshEntry& GetMesh(uint32_t mesh) const;
+		// Spans point into the mapping, they live as long as the file does
+		utils::MeshPayload GetPayload(uint32_t mesh) const;
+		std::span<const ImpMeshInstance> GetInstances() const;
+
+	private:
+		ImpMeshFile() = default;
+
+		bool Validate() const;
+		bool IsInFile(const ImpMeshArray& array, size_t elementSize) const;
+
+		template<typename T>
+		std::span<const T> GetArray(const ImpMeshArray& array) const
+		{
+			return std::span<const T>(reinterpret_cast<const T*>(m_File.GetData() + array.offset), static_cast<size_t>(array.count));
+		}
+
+		OS::MappedFile m_File;
+	};
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "backend/VariousTypeDefinitions.h"
+#include "frontend/EngineSettings.h"
+#include <algorithm>
+#include <cmath>
+
+namespace imp
+{
+	namespace utils
+	{
+		// lod of something that projects too small to be worth drawing
+		inline constexpr uint8_t kLodCulled = 0xFF;
+		// no lod to stick to, same as RenderProxies::kNoLod
+		inline constexpr uint8_t kLodNone = 0xFF;
+
+		// Camera and settings part of lod selection, the GPU gets the same in Globals::lodParams
+		struct LodSelection
+		{
+			float pixelsPerUnit;		// pixels covered by something 1 unit tall 1 unit in front of the camera
+			float errorThreshold;		// px
+			float hysteresis;
+			float minProjectedSize;		// px
+		};
+
+		inline LodSelection MakeLodSelection(const glm::mat4& projection, uint32_t viewportHeight, const EngineLodSettings& settings)
+		{
+			// [1][1] is 1 / tan(fovy / 2), negative when y is flipped
+			return { std::abs(projection[1][1]) * static_cast<float>(viewportHeight) * 0.5f, settings.errorThreshold, settings.hysteresis, settings.minProjectedSize };
+		}
+
+		// Lod errors only go up, so the coarsest lod under maxError is one past the last that fits
+		inline uint8_t FindCoarsestLod(const float* lodErrors, float maxError)
+		{
+			uint8_t lod = 0;
+			for (uint8_t i = 1; i < kMaxLODCount; i++)
+				if (lodErrors[i] <= maxError)
+					lod = i;
+			return lod;
+		}
+
+		// Coarsest lod whose simplification error (model space, see GenerateMeshLODS) projects under the threshold at the
+		// nearest point of the sphere, or kLodCulled when the sphere itself projects under minProjectedSize.
+		// A previous lod is kept until the error moves past threshold * (1 -+ hysteresis), so lods don't flicker back and
+		// forth at the boundary. Same math as select_lod in Lod.h
+		inline uint8_t SelectMeshLod(const LodSelection& selection, const float* lodErrors, float nearDistance, float worldRadius, float modelRadius, uint8_t prevLod)
+		{
+			const float distance = nearDistance - worldRadius;
+			// touches the near plane, nothing to project
+			if (distance <= 0.0f)
+				return 0;
+
+			const float pixelsPerUnit = selection.pixelsPerUnit / distance;
+			if (2.0f * worldRadius * pixelsPerUnit < selection.minProjectedSize)
+				return kLodCulled;
+
+			const float errorScale = modelRadius > 0.0f ? worldRadius / modelRadius : 1.0f;
+			const float maxError = selection.errorThreshold / (pixelsPerUnit * errorScale);
+			if (prevLod == kLodNone)
+				return FindCoarsestLod(lodErrors, maxError);
+
+			const uint8_t finest = FindCoarsestLod(lodErrors, maxError * (1.0f - selection.hysteresis));
+			const uint8_t coarsest = FindCoarsestLod(lodErrors, maxError * (1.0f + selection.hysteresis));
+			return std::clamp(prevLod, finest, coarsest);
+		}
+	}
+}
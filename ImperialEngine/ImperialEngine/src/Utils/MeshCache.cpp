@@ -0,0 +1,89 @@
+#include "MeshCache.h"
+#include "Utils/Utilities.h"
+#include "extern/XXHASH/xxhash.h"
+#include <cinttypes>
+#include <cstdio>
+
+namespace imp
+{
+	MeshCache::MeshCache(const std::filesystem::path& directory)
+		: m_Directory(directory), m_ParamsHash(), m_Hits(), m_Misses(), m_MillisecondsSaved()
+	{
+		// the file layout is part of what's derived too
+		const auto params = utils::GetMeshProcessingParams();
+		m_ParamsHash = XXH3_64bits_withSeed(&params, sizeof(params), kImpMeshVersion);
+	}
+
+	uint64_t MeshCache::MakeKey(const std::filesystem::path& sourcePath) const
+	{
+		std::vector<std::filesystem::path> files = { sourcePath };
+		if (sourcePath.extension() == ".gltf")
+		{
+			auto buffers = sourcePath;
+			buffers.replace_extension(".bin");
+			if (std::filesystem::exists(buffers))
+				files.push_back(buffers);
+		}
+
+		XXH3_state_t* state = XXH3_createState();
+		XXH3_64bits_reset_withSeed(state, m_ParamsHash);
+		bool read = true;
+		for (const auto& path : files)
+		{
+			OS::MappedFile file;
+			read = read && file.Open(path);
+			if (read)
+				XXH3_64bits_update(state, file.GetData(), file.GetSize());
+		}
+		const uint64_t key = read ? XXH3_64bits_digest(state) : 0;
+		XXH3_freeState(state);
+		return key;
+	}
+
+	std::shared_ptr<const ImpMeshFile> MeshCache::Find(uint64_t key) const
+	{
+		if (key == 0)
+			return nullptr;
+		return ImpMeshFile::Open(GetEntryPath(key), key);
+	}
+
+	std::shared_ptr<const ImpMeshFile> MeshCache::Store(uint64_t key, double processingMilliseconds, std::span<const utils::MeshPayload> meshes,
+		std::span<const ImpMeshInstance> instances, const glm::mat4* camera) const
+	{
+		if (key == 0)
+			return nullptr;
+
+		std::error_code ec;
+		std::filesystem::create_directories(m_Directory, ec);
+		const auto path = GetEntryPath(key);
+		if (!ImpMeshFile::Write(path, key, static_cast<float>(processingMilliseconds), meshes, instances, camera))
+			return nullptr;
+		return ImpMeshFile::Open(path, key);
+	}
+
+	void MeshCache::RecordHit(const std::filesystem::path& sourcePath, const ImpMeshFile& entry, double loadMilliseconds)
+	{
+		const double saved = entry.GetHeader().processingMilliseconds - loadMilliseconds;
+		m_Hits++;
+		m_MillisecondsSaved += saved;
+		printf("[Mesh Cache] Hit '%s', %.1f ms instead of %.1f ms, saved %.1f ms\n", sourcePath.string().c_str(), loadMilliseconds, entry.GetHeader().processingMilliseconds, saved);
+	}
+
+	void MeshCache::RecordMiss(const std::filesystem::path& sourcePath, double processingMilliseconds)
+	{
+		m_Misses++;
+		printf("[Mesh Cache] Miss '%s', loaded and processed in %.1f ms\n", sourcePath.string().c_str(), processingMilliseconds);
+	}
+
+	void MeshCache::PrintStats() const
+	{
+		printf("[Mesh Cache] %u hits, %u misses, saved %.1f ms\n", m_Hits, m_Misses, m_MillisecondsSaved);
+	}
+
+	std::filesystem::path MeshCache::GetEntryPath(uint64_t key) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016" PRIx64 ".impmesh", key);
+		return m_Directory / name;
+	}
+}
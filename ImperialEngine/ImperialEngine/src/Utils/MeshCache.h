@@ -0,0 +1,41 @@
+#pragma once
+#include "Utils/ImpMesh.h"
+#include "Utils/NonCopyable.h"
+#include <filesystem>
+#include <memory>
+#include <span>
+
+namespace imp
+{
+	// Derived data cache of processed meshes. Entries are .impmesh files in the cache directory named after an XXH3 hash
+	// of the source bytes and utils::MeshProcessingParams, so changing either just misses and processes the source again.
+	// Entries aren't ever removed, clear the directory to get rid of old ones
+	class MeshCache : NonCopyable
+	{
+	public:
+		MeshCache(const std::filesystem::path& directory);
+
+		// Hashes the source file, a .gltf together with the .bin of the same name next to it. 0 when it can't be read
+		uint64_t MakeKey(const std::filesystem::path& sourcePath) const;
+		// Mapped entry of the key, null on a miss
+		std::shared_ptr<const ImpMeshFile> Find(uint64_t key) const;
+		// Writes the entry and maps it back, null when it couldn't be written
+		std::shared_ptr<const ImpMeshFile> Store(uint64_t key, double processingMilliseconds, std::span<const utils::MeshPayload> meshes,
+			std::span<const ImpMeshInstance> instances, const glm::mat4* camera) const;
+
+		// Every load prints a line, PrintStats sums them up
+		void RecordHit(const std::filesystem::path& sourcePath, const ImpMeshFile& entry, double loadMilliseconds);
+		void RecordMiss(const std::filesystem::path& sourcePath, double processingMilliseconds);
+		void PrintStats() const;
+
+	private:
+		std::filesystem::path GetEntryPath(uint64_t key) const;
+
+		std::filesystem::path m_Directory;
+		uint64_t m_ParamsHash;
+
+		uint32_t m_Hits;
+		uint32_t m_Misses;
+		double m_MillisecondsSaved;
+	};
+}
@@ -0,0 +1,289 @@
+#include "MeshProcessing.h"
+#include "GfxUtilities.h"
+#include "ImpMesh.h"
+#include "Utils/SimpleTimer.h"
+#include "Utils/VertexPacking.h"
+#include "backend/parallel/JobSystem.h"
+#include "MESHOPTIMIZER/meshoptimizer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace imp
+{
+	namespace utils
+	{
+		// Where a mesh goes in ProcessedMeshes
+		struct MeshPlacement
+		{
+			uint32_t mesh;
+			uint32_t vertex;
+			uint32_t index;
+			uint32_t meshlet;
+			uint32_t meshletVertex;
+			uint32_t meshletTriangle;
+			uint32_t normalCone;
+		};
+
+		MeshProcessingParams GetMeshProcessingParams()
+		{
+			MeshProcessingParams params;
+			std::memset(&params, 0, sizeof(params));
+			params.meshoptimizerVersion = MESHOPTIMIZER_VERSION;
+			params.vertexSize = sizeof(Vertex);
+			params.lodEnabled = LOD_ENABLED;
+			params.lodCount = kMaxLODCount;
+			params.maxMeshletVertices = kMaxMeshletVertices;
+			params.maxMeshletTriangles = kMaxMeshletTriangles;
+			params.coneCulling = CONE_CULLING_ENABLED;
+			params.meshletConeWeight = MESHLET_CONE_WEIGHT;
+			params.lodTargetFactor = LOD_TARGET_FACTOR;
+			params.lodTargetError = LOD_TARGET_ERROR;
+			params.importVersion = kMeshImportVersion;
+			return params;
+		}
+
+		MeshPayload ProcessedMesh::GetPayload(const MeshCreationRequest& req) const
+		{
+			MeshPayload payload;
+			payload.vertices = req.vertices;
+			payload.indices = req.indices;
+			payload.meshlets = meshlets;
+			payload.meshletBounds = meshletBounds;
+			payload.meshletVertexData = meshletVertexData;
+			payload.meshletTriangleData = meshletTriangleData;
+			payload.normalCones = normalCones;
+			for (auto i = 0; i < kMaxLODCount; i++)
+			{
+				payload.lodIndices[i] = geometry.indices[i];
+				payload.lodErrors[i] = geometry.lodErrors[i];
+				payload.lodMeshlets[i] = ms_md.LODData[i];
+			}
+			payload.boundingVolume = req.boundingVolume;
+			return payload;
+		}
+
+		void ProcessMesh(MeshCreationRequest& req, ProcessedMesh& dst)
+		{
+			OptimizeMesh(req.vertices, req.indices);
+
+			auto& ivb = dst.geometry;
+			ivb = {};
+			ivb.indices[0] = VulkanSubBuffer(0, static_cast<uint32_t>(req.indices.size()));
+			ivb.lodErrors[0] = 0.0f;
+
+#if LOD_ENABLED
+			static constexpr uint32_t numDesiredLODs = kMaxLODCount - 1;
+			GenerateMeshLODS(req.vertices, req.indices, &ivb.indices[1], &ivb.lodErrors[1], numDesiredLODs, LOD_TARGET_FACTOR, LOD_TARGET_ERROR);
+#endif
+
+			dst.ms_md = {};
+			dst.meshlets = GenerateMeshlets(req.vertices, req.indices, dst.meshletVertexData, dst.meshletTriangleData, dst.normalCones, dst.meshletBounds, ivb, dst.ms_md);
+			dst.ms_md.boundingVolume = req.boundingVolume;
+			dst.ms_md.firstTask = 0;
+			for (auto i = 0; i < kMaxLODCount; i++)
+				dst.ms_md.LODData[i].error = ivb.lodErrors[i];
+		}
+
+		static void PlaceMesh(uint32_t meshId, const MeshPayload& mesh, const MeshPlacement& placement, const MeshBufferOffsets& offsets, ProcessedMeshes& dst)
+		{
+			const uint32_t vOffset = placement.vertex + offsets.vertex;
+			const uint32_t iOffset = placement.index + offsets.index;
+			const uint32_t mOffset = placement.meshlet + offsets.meshlet;
+			const uint32_t mvdOffset = placement.meshletVertex + offsets.meshletVertex;
+			const uint32_t mtdOffset = placement.meshletTriangle + offsets.meshletTriangle;
+			const uint32_t ncdOffset = placement.normalCone + offsets.normalCone;
+
+			// These subbuffers will be used to index and offset into the one bound Vertex and Index buffer
+			auto& ivb = dst.geometries[placement.mesh];
+			ivb.vertices = VulkanSubBuffer(vOffset, static_cast<uint32_t>(mesh.vertices.size()));
+			for (auto i = 0; i < kMaxLODCount; i++)
+			{
+				ivb.indices[i] = VulkanSubBuffer(mesh.lodIndices[i].GetOffset() + iOffset, mesh.lodIndices[i].GetCount());
+				ivb.meshlets[i] = VulkanSubBuffer(mesh.lodMeshlets[i].meshletBufferOffset + mOffset, mesh.lodMeshlets[i].taskCount);
+				ivb.lodErrors[i] = mesh.lodErrors[i];
+			}
+#if COMPACT_VERTICES
+			ivb.quantization = ComputeVertexQuantization(mesh.vertices);
+#endif
+
+			// padding is zeroed so the uploads don't depend on what was on the stack
+			auto& md = dst.mds[placement.mesh];
+			std::memset(&md, 0, sizeof(md));
+			md.boundingVolume = mesh.boundingVolume;
+			md.vertexOffset = vOffset;
+			for (auto i = 0; i < kMaxLODCount; i++)
+			{
+				md.LODData[i].firstIndex = ivb.indices[i].GetOffset();
+				md.LODData[i].indexCount = ivb.indices[i].GetCount();
+				md.LODData[i].error = mesh.lodErrors[i];
+			}
+
+			auto& ms_md = dst.ms_mds[placement.mesh];
+			std::memset(&ms_md, 0, sizeof(ms_md));
+			for (auto i = 0; i < kMaxLODCount; i++)
+			{
+				ms_md.LODData[i].meshletBufferOffset = ivb.meshlets[i].GetOffset();
+				ms_md.LODData[i].taskCount = mesh.lodMeshlets[i].taskCount;
+				ms_md.LODData[i].error = mesh.lodErrors[i];
+			}
+			ms_md.boundingVolume = mesh.boundingVolume;
+			ms_md.firstTask = 0;
+
+			dst.meshSlots[placement.mesh] = meshId;
+
+			// vertices and indices don't need offsetting, they go in as they are
+#if COMPACT_VERTICES
+			PackVertices(mesh.vertices, ivb.quantization, dst.verts.data() + placement.vertex);
+#else
+			std::memcpy(dst.verts.data() + placement.vertex, mesh.vertices.data(), mesh.vertices.size_bytes());
+#endif
+			std::memcpy(dst.idxs.data() + placement.index, mesh.indices.data(), mesh.indices.size_bytes());
+
+			// offset meshlet vertex data
+			for (size_t i = 0; i < mesh.meshletVertexData.size(); i++)
+				dst.ms_vd[placement.meshletVertex + i] = mesh.meshletVertexData[i] + vOffset;
+
+			for (size_t i = 0; i < mesh.meshlets.size(); i++)
+			{
+				const auto& src = mesh.meshlets[i];
+				auto& meshlet = dst.mlds[placement.meshlet + i];
+				std::memset(&meshlet, 0, sizeof(meshlet));
+				meshlet.coneOffset = src.coneOffset + ncdOffset;
+				meshlet.triangleOffset = src.triangleOffset + mtdOffset;
+				meshlet.vertexOffset = src.vertexOffset + mvdOffset;
+				meshlet.triangleCount = src.triangleCount;
+				meshlet.vertexCount = src.vertexCount;
+			}
+
+			std::memcpy(dst.ms_td.data() + placement.meshletTriangle, mesh.meshletTriangleData.data(), mesh.meshletTriangleData.size_bytes());
+			std::memcpy(dst.ms_nc.data() + placement.normalCone, mesh.normalCones.data(), mesh.normalCones.size_bytes());
+			std::memcpy(dst.ms_bv.data() + placement.meshlet, mesh.meshletBounds.data(), mesh.meshletBounds.size_bytes());
+		}
+
+		void ProcessMeshes(std::vector<MeshCreationRequest>& reqs, const MeshBufferOffsets& offsets, prl::JobSystem& jobSystem, ProcessedMeshes& dst)
+		{
+			// every mesh is big enough to be its own job, cooked ones only build their occluder
+			std::vector<ProcessedMesh> meshes(reqs.size());
+			std::vector<MeshPayload> payloads(reqs.size());
+			std::vector<std::unique_ptr<OccluderMesh>> occluders(reqs.size());
+			jobSystem.ParallelFor(reqs.size(), [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						auto& req = reqs[i];
+						if (!req.HasGeometry())	// linked mesh
+							continue;
+
+						if (req.cookedFile)
+							payloads[i] = req.cookedFile->GetPayload(req.cookedMesh);
+						else
+						{
+							ProcessMesh(req, meshes[i]);
+							payloads[i] = meshes[i].GetPayload(req);
+						}
+						occluders[i] = BuildOccluderMesh(payloads[i].vertices, payloads[i].indices, payloads[i].lodIndices);
+					}
+				}, 1);
+
+			// prefix sum gives every mesh the place it would have got when appended one by one
+			std::vector<MeshPlacement> placements(reqs.size());
+			MeshPlacement total = {};
+			for (size_t i = 0; i < reqs.size(); i++)
+			{
+				if (!reqs[i].HasGeometry())
+					continue;
+
+				const auto& payload = payloads[i];
+				placements[i] = total;
+				total.mesh++;
+				total.vertex += static_cast<uint32_t>(payload.vertices.size());
+				total.index += static_cast<uint32_t>(payload.indices.size());
+				total.meshlet += static_cast<uint32_t>(payload.meshlets.size());
+				total.meshletVertex += static_cast<uint32_t>(payload.meshletVertexData.size());
+				total.meshletTriangle += static_cast<uint32_t>(payload.meshletTriangleData.size());
+				total.normalCone += static_cast<uint32_t>(payload.normalCones.size());
+			}
+
+			dst.verts.resize(total.vertex);
+			dst.idxs.resize(total.index);
+			dst.mds.resize(total.mesh);
+			dst.mlds.resize(total.meshlet);
+			dst.ms_mds.resize(total.mesh);
+			dst.ms_vd.resize(total.meshletVertex);
+			dst.ms_td.resize(total.meshletTriangle);
+			dst.ms_nc.resize(total.normalCone);
+			dst.ms_bv.resize(total.meshlet);
+			dst.meshSlots.resize(total.mesh);
+			dst.geometries.resize(total.mesh);
+			dst.occluders.resize(total.mesh);
+
+			// ranges don't overlap, copying is parallel too
+			jobSystem.ParallelFor(reqs.size(), [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						if (!reqs[i].HasGeometry())
+							continue;
+						PlaceMesh(reqs[i].id, payloads[i], placements[i], offsets, dst);
+						dst.occluders[placements[i].mesh] = std::move(occluders[i]);
+					}
+				}, 1);
+		}
+
+		template<typename T>
+		static bool SameBytes(const std::vector<T>& a, const std::vector<T>& b)
+		{
+			return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+		}
+
+		static bool SameOutput(const ProcessedMeshes& a, const ProcessedMeshes& b)
+		{
+			bool same = SameBytes(a.verts, b.verts) && SameBytes(a.idxs, b.idxs) && SameBytes(a.mds, b.mds) && SameBytes(a.mlds, b.mlds) &&
+				SameBytes(a.ms_mds, b.ms_mds) && SameBytes(a.ms_vd, b.ms_vd) && SameBytes(a.ms_td, b.ms_td) && SameBytes(a.ms_nc, b.ms_nc) &&
+				SameBytes(a.ms_bv, b.ms_bv) && SameBytes(a.meshSlots, b.meshSlots) && a.occluders.size() == b.occluders.size();
+			for (size_t i = 0; same && i < a.occluders.size(); i++)
+			{
+				const auto* oa = a.occluders[i].get();
+				const auto* ob = b.occluders[i].get();
+				same = (oa == nullptr) == (ob == nullptr) && (oa == nullptr || (oa->positions == ob->positions && oa->indices == ob->indices));
+			}
+			return same;
+		}
+
+		void RunMeshProcessingBenchmark(const std::vector<MeshCreationRequest>& reqs, prl::JobSystem& jobSystem)
+		{
+			static constexpr MeshBufferOffsets kOffsets = {};
+
+			// processing modifies the requests, every run gets fresh ones
+			const auto timeProcessing = [&](prl::JobSystem& jobs, ProcessedMeshes& dst)
+			{
+				auto copy = reqs;
+				SimpleTimer timer;
+				timer.start();
+				ProcessMeshes(copy, kOffsets, jobs, dst);
+				timer.stop();
+				return timer.miliseconds();
+			};
+
+			prl::JobSystemSettings serialSettings;
+			serialSettings.workerCount = 0;
+			prl::JobSystem serialJobs(serialSettings);
+
+			ProcessedMeshes serial;
+			ProcessedMeshes parallel;
+			const double serialTime = timeProcessing(serialJobs, serial);
+			const double parallelTime = timeProcessing(jobSystem, parallel);
+
+			// counted from what came out, cooked requests don't carry their geometry
+			size_t triangleCount = 0;
+			for (const auto& geometry : serial.geometries)
+				triangleCount += geometry.indices[0].GetCount() / 3;
+
+			printf("[Mesh Processing Benchmark] %zu meshes, %zu vertices, %zu triangles, %zu meshlets\n", serial.mds.size(), serial.verts.size(), triangleCount, serial.mlds.size());
+			printf("[Mesh Processing Benchmark] %-10s %10s %10s\n", "threads", "time ms", "speedup");
+			printf("[Mesh Processing Benchmark] %-10u %10.3f %10.2f\n", 1u, serialTime, 1.0);
+			printf("[Mesh Processing Benchmark] %-10u %10.3f %10.2f  %s\n", jobSystem.GetConcurrency(), parallelTime, serialTime / parallelTime, SameOutput(serial, parallel) ? "exact" : "MISMATCH");
+		}
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "backend/graphics/MeshRegistry.h"
+#include "backend/VariousTypeDefinitions.h"
+#include "frontend/Components/Components.h"
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace prl { class JobSystem; }
+
+namespace imp
+{
+	namespace utils
+	{
+		// Where new meshes start in the big GPU buffers, in elements
+		struct MeshBufferOffsets
+		{
+			uint32_t vertex;
+			uint32_t index;
+			uint32_t meshlet;			// meshlet bounds too, basic.task indexes both with the meshlet index
+			uint32_t meshletVertex;
+			uint32_t meshletTriangle;
+			uint32_t normalCone;
+		};
+
+		// A mesh after processing with offsets local to it: lod ranges go into indices and meshlets into the meshlet arrays.
+		// Points into a processed request or straight into a mapped .impmesh
+		struct MeshPayload
+		{
+			std::span<const Vertex> vertices;
+			std::span<const uint32_t> indices;						// every lod
+			std::span<const Meshlet> meshlets;
+			std::span<const BoundingVolumeSphere> meshletBounds;	// parallel to meshlets
+			std::span<const uint32_t> meshletVertexData;
+			std::span<const uint8_t> meshletTriangleData;
+			std::span<const NormalCone> normalCones;
+			VulkanSubBuffer lodIndices[kMaxLODCount];
+			float lodErrors[kMaxLODCount];
+			ms_MeshLOD lodMeshlets[kMaxLODCount];
+			BoundingVolumeSphere boundingVolume;
+		};
+
+		// What processing makes out of a request next to its optimized vertices and indices
+		struct ProcessedMesh
+		{
+			Comp::MeshGeometry geometry;	// lod index ranges and errors
+			ms_MeshData ms_md;
+			std::vector<Meshlet> meshlets;
+			std::vector<uint32_t> meshletVertexData;
+			std::vector<uint8_t> meshletTriangleData;
+			std::vector<NormalCone> normalCones;
+			std::vector<BoundingVolumeSphere> meshletBounds;
+
+			MeshPayload GetPayload(const MeshCreationRequest& req) const;
+		};
+
+		// What the importers hand ProcessMesh: AssetImporter's glTF and Assimp paths, ObjLoader and VertexConversion.
+		// Bump it whenever any of them start giving different vertices, indices or instances for the same file
+		inline constexpr uint32_t kMeshImportVersion = 1;
+
+		// Everything besides the source that changes what ProcessMesh makes, compile time knobs from EngineStaticConfig.h
+		struct MeshProcessingParams
+		{
+			uint32_t meshoptimizerVersion;
+			uint32_t vertexSize;
+			uint32_t lodEnabled;
+			uint32_t lodCount;
+			uint32_t maxMeshletVertices;
+			uint32_t maxMeshletTriangles;
+			uint32_t coneCulling;
+			float meshletConeWeight;
+			double lodTargetFactor;
+			float lodTargetError;
+			uint32_t importVersion;
+		};
+		MeshProcessingParams GetMeshProcessingParams();
+
+		// Optimizes the request in place and generates its lods (appended to its indices) and meshlets
+		void ProcessMesh(MeshCreationRequest& req, ProcessedMesh& dst);
+
+		// Everything CreateAndUploadMeshes uploads, concatenated in request order and offset into the big buffers.
+		// mds, ms_mds, geometries, occluders and meshSlots have an entry per mesh, linked meshes get none
+		struct ProcessedMeshes
+		{
+			std::vector<GPUVertex> verts;			// packed with COMPACT_VERTICES
+			std::vector<uint32_t> idxs;
+			std::vector<MeshData> mds;
+			std::vector<Meshlet> mlds;
+			std::vector<ms_MeshData> ms_mds;
+			std::vector<uint32_t> ms_vd;				// meshlet vertex data
+			std::vector<uint8_t> ms_td;					// meshlet triangle data
+			std::vector<NormalCone> ms_nc;
+			std::vector<BoundingVolumeSphere> ms_bv;	// meshlet bounds, parallel to mlds
+			std::vector<uint32_t> meshSlots;			// where mds and ms_mds go in the mesh tables
+			std::vector<Comp::MeshGeometry> geometries;
+			std::vector<std::unique_ptr<OccluderMesh>> occluders;
+		};
+
+		// ProcessMesh of every request on the job system, one job per mesh, then places them one after another by prefix
+		// sum. Comes out the same as processing them one by one in request order. Cooked requests skip processing and get
+		// copied straight out of their .impmesh
+		void ProcessMeshes(std::vector<MeshCreationRequest>& reqs, const MeshBufferOffsets& offsets, prl::JobSystem& jobSystem, ProcessedMeshes& dst);
+
+		// Times ProcessMeshes on copies of reqs on the calling thread alone and on the job system and checks both come out
+		// byte for byte the same. Run with 'ImperialEngine.exe --benchmark-mesh-processing', on Sponza or something as big
+		void RunMeshProcessingBenchmark(const std::vector<MeshCreationRequest>& reqs, prl::JobSystem& jobSystem);
+	}
+}
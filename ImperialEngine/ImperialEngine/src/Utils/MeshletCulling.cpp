@@ -0,0 +1,170 @@
+#include "MeshletCulling.h"
+#include "GfxUtilities.h"
+#include "Utils/SimpleTimer.h"
+#include "GLM/gtc/matrix_transform.hpp"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace imp
+{
+	namespace utils
+	{
+		MeshletCullResult CullMeshlet(const MeshletCullView& view, const glm::mat4& transform, float scale, const NormalCone& cone, const BoundingVolumeSphere& bounds)
+		{
+			const glm::vec4 center = glm::vec4(glm::vec3(transform * glm::vec4(bounds.center, 1.0f)), 1.0f);
+			const float radius = bounds.radius * scale;
+			for (const auto& plane : view.frustumPlanes)
+				if (glm::dot(plane, center) < -radius)
+					return kMeshletOutsideFrustum;
+
+#if CONE_CULLING_ENABLED
+			// view space, so the camera is at the origin
+			glm::mat4 rotation = view.view * transform;
+			rotation[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			const glm::vec4 decodedCone = glm::vec4(cone.cone[0], cone.cone[1], cone.cone[2], cone.cone[3]) / 127.0f;
+			const glm::vec3 axis = glm::vec3(rotation * glm::vec4(glm::vec3(decodedCone), 1.0f));
+			const glm::vec3 apex = glm::vec3(view.view * transform * glm::vec4(cone.apex, 1.0f));
+			if (glm::dot(glm::normalize(apex), axis) >= decodedCone.w)
+				return kMeshletBackfacing;
+#endif
+
+			// same contribution culling draws get in SelectMeshLod
+			const float distance = glm::dot(view.frustumPlanes[4], center) - radius;
+			if (distance > 0.0f && 2.0f * radius * (view.lodSelection.pixelsPerUnit / distance) < view.lodSelection.minProjectedSize)
+				return kMeshletTooSmall;
+
+			return kMeshletVisible;
+		}
+
+		void CullMeshlets(const MeshletCullView& view, const glm::mat4& transform, const Meshlet* meshlets, const BoundingVolumeSphere* bounds, const NormalCone* cones, uint32_t count, MeshletCullStats& stats)
+		{
+			const float scale = GetScale(transform);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const auto result = CullMeshlet(view, transform, scale, cones[meshlets[i].coneOffset], bounds[i]);
+				stats.meshlets[result]++;
+				stats.triangles[result] += meshlets[i].triangleCount;
+			}
+		}
+
+		// Unit sphere, rings x segments quads
+		static void MakeSphere(uint32_t rings, uint32_t segments, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			static constexpr float kPi = 3.14159265358979f;
+			for (uint32_t r = 0; r <= rings; r++)
+			{
+				const float theta = kPi * r / rings;
+				for (uint32_t s = 0; s <= segments; s++)
+				{
+					const float phi = 2.0f * kPi * s / segments;
+					Vertex v = {};
+					v.vx = std::sin(theta) * std::cos(phi);
+					v.vy = std::cos(theta);
+					v.vz = std::sin(theta) * std::sin(phi);
+					vertices.push_back(v);
+				}
+			}
+
+			for (uint32_t r = 0; r < rings; r++)
+			{
+				for (uint32_t s = 0; s < segments; s++)
+				{
+					const uint32_t a = r * (segments + 1) + s;
+					const uint32_t b = a + segments + 1;
+					indices.insert(indices.end(), { a, a + 1, b, a + 1, b + 1, b });
+				}
+			}
+		}
+
+		void RunMeshletCullBenchmark()
+		{
+			static constexpr uint32_t kGridSize = 48;
+			static constexpr float kSpacing = 3.0f;
+			static constexpr uint32_t kIterations = 10;
+			static constexpr uint32_t kViewportHeight = 1080;
+			static constexpr EngineLodSettings kLodSettings = { 1.0f, 0.0f, 1.0f };
+
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			MakeSphere(64, 128, vertices, indices);
+			OptimizeMesh(vertices, indices);
+
+			// no lods, GenerateMeshlets gives every lod the meshlets of lod 0 when they come out the same
+			Comp::MeshGeometry geometry = {};
+			for (uint32_t lod = 0; lod < kMaxLODCount; lod++)
+				geometry.indices[lod] = VulkanSubBuffer(0, static_cast<uint32_t>(indices.size()));
+
+			std::vector<uint32_t> meshletVertexData;
+			std::vector<uint8_t> meshletTriangleData;
+			std::vector<NormalCone> cones;
+			std::vector<BoundingVolumeSphere> bounds;
+			ms_MeshData meshData = {};
+			const auto meshlets = GenerateMeshlets(vertices, indices, meshletVertexData, meshletTriangleData, cones, bounds, geometry, meshData);
+			const uint32_t meshletCount = meshData.LODData[0].taskCount;
+			uint32_t triangleCount = 0;
+			for (uint32_t i = 0; i < meshletCount; i++)
+				triangleCount += meshlets[i].triangleCount;
+
+			// deterministic field of spheres on the xz plane, scales from tiny to 1 so some of them end up under a pixel
+			std::vector<glm::mat4> transforms;
+			uint32_t seed = 12345;
+			const auto rand01 = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / 16777216.0f); };
+			const float halfExtent = kGridSize * kSpacing * 0.5f;
+			for (uint32_t z = 0; z < kGridSize; z++)
+			{
+				for (uint32_t x = 0; x < kGridSize; x++)
+				{
+					const float scale = 0.01f + rand01() * rand01();
+					auto transform = glm::translate(glm::mat4(1.0f), glm::vec3(x * kSpacing - halfExtent, scale, z * kSpacing - halfExtent));
+					transform = glm::rotate(transform, rand01() * 6.28f, glm::normalize(glm::vec3(rand01(), 1.0f, rand01())));
+					transforms.push_back(glm::scale(transform, glm::vec3(scale)));
+				}
+			}
+
+			struct BenchmarkView
+			{
+				const char* name;
+				glm::vec3 eye;
+				glm::vec3 target;
+			};
+			const BenchmarkView views[] =
+			{
+				{ "ground", { 0.0f, 1.5f, halfExtent + 5.0f }, { 0.0f, 0.0f, 0.0f } },
+				{ "inside", { 0.0f, 1.5f, 0.0f }, { 0.0f, 1.5f, -1.0f } },
+				{ "above", { 0.0f, 80.0f, 1.0f }, { 0.0f, 0.0f, 0.0f } },
+				{ "far", { 0.0f, 60.0f, 600.0f }, { 0.0f, 0.0f, 0.0f } },
+			};
+
+			const glm::mat4 projection = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, 2000.0f);
+			printf("[Meshlet Cull Benchmark] %zu spheres of %u meshlets, %u triangles, min projected size %.1f px at %u px tall, avg of %u iterations\n",
+				transforms.size(), meshletCount, triangleCount, kLodSettings.minProjectedSize, kViewportHeight, kIterations);
+			printf("[Meshlet Cull Benchmark] %-8s | %-45s | %-45s | %8s\n", "view", "meshlets visible / frustum / cone / small", "triangles visible / frustum / cone / small", "time ms");
+
+			for (const auto& bv : views)
+			{
+				MeshletCullView view;
+				view.view = glm::lookAt(bv.eye, bv.target, glm::vec3(0.0f, 1.0f, 0.0f));
+				view.frustumPlanes = FindViewFrustumPlanes(projection * view.view);
+				view.lodSelection = MakeLodSelection(projection, kViewportHeight, kLodSettings);
+
+				MeshletCullStats stats = {};
+				SimpleTimer timer;
+				timer.start();
+				for (uint32_t it = 0; it < kIterations; it++)
+				{
+					stats = {};
+					for (const auto& transform : transforms)
+						CullMeshlets(view, transform, meshlets.data(), bounds.data(), cones.data(), meshletCount, stats);
+				}
+				timer.stop();
+
+				const auto& m = stats.meshlets;
+				const auto& t = stats.triangles;
+				printf("[Meshlet Cull Benchmark] %-8s | %9u / %9u / %9u / %9u | %9u / %9u / %9u / %9u | %8.3f\n", bv.name,
+					m[kMeshletVisible], m[kMeshletOutsideFrustum], m[kMeshletBackfacing], m[kMeshletTooSmall],
+					t[kMeshletVisible], t[kMeshletOutsideFrustum], t[kMeshletBackfacing], t[kMeshletTooSmall], timer.miliseconds() / kIterations);
+			}
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "backend/VariousTypeDefinitions.h"
+#include "Utils/LodSelection.h"
+#include <array>
+
+namespace imp
+{
+	namespace utils
+	{
+		// What happened to a meshlet in the task stage, in the order basic.task tests them
+		enum MeshletCullResult : uint8_t
+		{
+			kMeshletVisible,
+			kMeshletOutsideFrustum,
+			kMeshletBackfacing,		// normal cone points away from the camera
+			kMeshletTooSmall,		// projects under LodSelection::minProjectedSize
+			kMeshletCullResultCount
+		};
+
+		// The part of Globals basic.task culls with
+		struct MeshletCullView
+		{
+			std::array<glm::vec4, 6> frustumPlanes;
+			glm::mat4 view;
+			LodSelection lodSelection;	// pixelsPerUnit and minProjectedSize
+		};
+
+		struct MeshletCullStats
+		{
+			uint32_t meshlets[kMeshletCullResultCount];
+			uint32_t triangles[kMeshletCullResultCount];
+		};
+
+		// CPU version of basic.task, same tests with the same math so it tells what the task stage does with a meshlet.
+		// Hi-Z isn't in here, that needs the depth pyramid. scale is the biggest axis scale of transform
+		MeshletCullResult CullMeshlet(const MeshletCullView& view, const glm::mat4& transform, float scale, const NormalCone& cone, const BoundingVolumeSphere& bounds);
+		// Every meshlet of a draw, bounds are parallel to meshlets and cones are indexed by Meshlet::coneOffset
+		void CullMeshlets(const MeshletCullView& view, const glm::mat4& transform, const Meshlet* meshlets, const BoundingVolumeSphere* bounds, const NormalCone* cones, uint32_t count, MeshletCullStats& stats);
+
+		// Builds meshlets of a generated sphere, culls a field of its instances from a few views and reports how many
+		// meshlets and triangles each test culled. Headless, run with 'ImperialEngine.exe --benchmark-meshlet-cull'
+		void RunMeshletCullBenchmark();
+	}
+}
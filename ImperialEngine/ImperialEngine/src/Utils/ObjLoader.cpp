@@ -0,0 +1,542 @@
+#include "ObjLoader.h"
+#include "GfxUtilities.h"
+#include "Utilities.h"
+#include "SimpleTimer.h"
+#include "backend/parallel/JobSystem.h"
+#include "extern/ASSIMP/Importer.hpp"
+#include "extern/ASSIMP/scene.h"
+#include "extern/ASSIMP/postprocess.h"
+#include "MESHOPTIMIZER/meshoptimizer.h"
+#include <GLM/glm.hpp>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace imp
+{
+	namespace utils
+	{
+		// Chunks smaller than this aren't worth a job
+		static constexpr size_t kMinObjChunkSize = 1 << 20;
+		static constexpr int32_t kNoObjIndex = -1;
+
+		// Indices are 0 based into the whole file once parsing is done, kNoObjIndex when the face didn't have one
+		struct ObjCorner
+		{
+			int32_t v;
+			int32_t vt;
+			int32_t vn;
+		};
+
+		// Faces between two o/g/usemtl lines of a chunk
+		struct ObjSegment
+		{
+			uint32_t firstFace;
+			uint32_t firstCorner;
+			uint32_t faceCount;
+			bool newMesh;			// starts with one of those lines, otherwise it continues what the previous chunk had
+			uint32_t mesh;
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+		};
+
+		struct ObjChunk
+		{
+			const char* begin;
+			const char* end;
+			std::vector<float> positions;
+			std::vector<float> texCoords;
+			std::vector<float> normals;
+			std::vector<ObjCorner> corners;
+			std::vector<uint32_t> faceSizes;
+			std::vector<ObjSegment> segments;
+			// negative indices count back from what was read so far, which the chunk only knows locally until every chunk is
+			// parsed. These point into corners as corner * 3 + attribute
+			std::vector<uint32_t> relativeIndices;
+			// where the chunk's attributes start in the whole file
+			uint32_t positionBase = 0;
+			uint32_t texCoordBase = 0;
+			uint32_t normalBase = 0;
+			const char* error = nullptr;
+		};
+
+		static const char* SkipSpaces(const char* p, const char* end)
+		{
+			while (p != end && (*p == ' ' || *p == '\t'))
+				p++;
+			return p;
+		}
+
+		static const char* SkipLine(const char* p, const char* end)
+		{
+			const auto* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+			return eol ? eol + 1 : end;
+		}
+
+		static bool IsLineEnd(const char* p, const char* end)
+		{
+			return p == end || *p == '\n' || *p == '\r' || *p == '#';
+		}
+
+		// from_chars is exact and doesn't care about the locale, it just doesn't take a leading +
+		static const char* ParseFloat(const char* p, const char* end, float& value)
+		{
+			p = SkipSpaces(p, end);
+			if (p != end && *p == '+')
+				p++;
+			const auto result = std::from_chars(p, end, value);
+			return result.ec == std::errc() ? result.ptr : nullptr;
+		}
+
+		// count floats, the ones past required can be missing and come out 0
+		static const char* ParseFloats(const char* p, const char* end, std::vector<float>& dst, uint32_t count, uint32_t required)
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				float value = 0.0f;
+				if (i >= required && IsLineEnd(SkipSpaces(p, end), end))
+				{
+					dst.push_back(value);
+					continue;
+				}
+				p = ParseFloat(p, end, value);
+				if (!p)
+					return nullptr;
+				dst.push_back(value);
+			}
+			return p;
+		}
+
+		// 1 based or negative for relative, stored 0 based in the chunk for now
+		static const char* ParseIndex(const char* p, const char* end, ObjChunk& chunk, size_t localCount, uint32_t slot, int32_t& index)
+		{
+			int32_t value = 0;
+			const auto result = std::from_chars(p, end, value);
+			if (result.ec != std::errc() || value == 0)
+				return nullptr;
+
+			if (value > 0)
+				index = value - 1;
+			else
+			{
+				index = static_cast<int32_t>(localCount) + value;
+				chunk.relativeIndices.push_back(slot);
+			}
+			return result.ptr;
+		}
+
+		static const char* ParseFace(const char* p, const char* end, ObjChunk& chunk)
+		{
+			const size_t firstCorner = chunk.corners.size();
+			for (p = SkipSpaces(p, end); !IsLineEnd(p, end); p = SkipSpaces(p, end))
+			{
+				ObjCorner corner = { kNoObjIndex, kNoObjIndex, kNoObjIndex };
+				const uint32_t slot = static_cast<uint32_t>(chunk.corners.size() * 3);
+				p = ParseIndex(p, end, chunk, chunk.positions.size() / 3, slot, corner.v);
+				if (p && p != end && *p == '/')
+				{
+					p++;
+					if (p != end && *p != '/')
+						p = ParseIndex(p, end, chunk, chunk.texCoords.size() / 2, slot + 1, corner.vt);
+					if (p && p != end && *p == '/')
+						p = ParseIndex(p + 1, end, chunk, chunk.normals.size() / 3, slot + 2, corner.vn);
+				}
+				if (!p)
+					return nullptr;
+				chunk.corners.push_back(corner);
+			}
+
+			const size_t cornerCount = chunk.corners.size() - firstCorner;
+			// lines and points, Triangulate drops them too
+			if (cornerCount < 3)
+			{
+				while (chunk.relativeIndices.size() && chunk.relativeIndices.back() >= firstCorner * 3)
+					chunk.relativeIndices.pop_back();
+				chunk.corners.resize(firstCorner);
+				return p;
+			}
+
+			chunk.faceSizes.push_back(static_cast<uint32_t>(cornerCount));
+			return p;
+		}
+
+		static bool IsKeyword(const char* p, const char* end, const char* keyword)
+		{
+			const size_t length = std::strlen(keyword);
+			return static_cast<size_t>(end - p) > length && std::memcmp(p, keyword, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+		}
+
+		static void ParseObjChunk(ObjChunk& chunk)
+		{
+			chunk.segments.push_back({ 0, 0, 0, false });
+			const char* end = chunk.end;
+			for (const char* p = chunk.begin; p != end; p = SkipLine(p, end))
+			{
+				const char* line = SkipSpaces(p, end);
+				const char* parsed = line;
+				if (IsKeyword(line, end, "v"))
+					parsed = ParseFloats(line + 1, end, chunk.positions, 3, 3);
+				else if (IsKeyword(line, end, "vt"))
+					parsed = ParseFloats(line + 2, end, chunk.texCoords, 2, 1);
+				else if (IsKeyword(line, end, "vn"))
+					parsed = ParseFloats(line + 2, end, chunk.normals, 3, 3);
+				else if (IsKeyword(line, end, "f"))
+					parsed = ParseFace(line + 1, end, chunk);
+				else if (IsKeyword(line, end, "o") || IsKeyword(line, end, "g") || IsKeyword(line, end, "usemtl"))
+					chunk.segments.push_back({ static_cast<uint32_t>(chunk.faceSizes.size()), static_cast<uint32_t>(chunk.corners.size()), 0, true });
+
+				if (!parsed)
+				{
+					chunk.error = line;
+					return;
+				}
+			}
+
+			for (size_t i = 0; i < chunk.segments.size(); i++)
+			{
+				const uint32_t nextFace = i + 1 < chunk.segments.size() ? chunk.segments[i + 1].firstFace : static_cast<uint32_t>(chunk.faceSizes.size());
+				chunk.segments[i].faceCount = nextFace - chunk.segments[i].firstFace;
+			}
+		}
+
+		// Makes relative indices absolute and checks every index points at something
+		static bool ResolveObjIndices(ObjChunk& chunk, uint32_t positionCount, uint32_t texCoordCount, uint32_t normalCount)
+		{
+			auto* indices = reinterpret_cast<int32_t*>(chunk.corners.data());
+			const uint32_t bases[3] = { chunk.positionBase, chunk.texCoordBase, chunk.normalBase };
+			const uint32_t counts[3] = { positionCount, texCoordCount, normalCount };
+			for (const auto slot : chunk.relativeIndices)
+			{
+				// still negative when it counts back past the start of the file
+				indices[slot] += static_cast<int32_t>(bases[slot % 3]);
+				if (indices[slot] < 0)
+					return false;
+			}
+
+			for (const auto& corner : chunk.corners)
+			{
+				if (corner.v < 0 || static_cast<uint32_t>(corner.v) >= counts[0])
+					return false;
+				if (corner.vt != kNoObjIndex && static_cast<uint32_t>(corner.vt) >= counts[1])
+					return false;
+				if (corner.vn != kNoObjIndex && static_cast<uint32_t>(corner.vn) >= counts[2])
+					return false;
+			}
+			return true;
+		}
+
+		// Fan triangulates the segment's faces and dedups their corners
+		static void BuildObjSegment(const ObjChunk& chunk, ObjSegment& segment, const std::vector<float>& positions, const std::vector<float>& texCoords, const std::vector<float>& normals)
+		{
+			size_t triangleCount = 0;
+			for (uint32_t f = 0; f < segment.faceCount; f++)
+				triangleCount += chunk.faceSizes[segment.firstFace + f] - 2;
+
+			std::vector<Vertex> corners(triangleCount * 3);
+			size_t written = 0;
+			uint32_t firstCorner = segment.firstCorner;
+			for (uint32_t f = 0; f < segment.faceCount; f++)
+			{
+				const uint32_t faceSize = chunk.faceSizes[segment.firstFace + f];
+				for (uint32_t t = 1; t + 1 < faceSize; t++)
+				{
+					const ObjCorner* triangle[3] = { &chunk.corners[firstCorner], &chunk.corners[firstCorner + t], &chunk.corners[firstCorner + t + 1] };
+					glm::vec3 p[3];
+					for (uint32_t c = 0; c < 3; c++)
+						p[c] = glm::vec3(positions[triangle[c]->v * 3], positions[triangle[c]->v * 3 + 1], positions[triangle[c]->v * 3 + 2]);
+
+					// GenNormals gives faces without normals flat ones
+					glm::vec3 faceNormal = glm::cross(p[1] - p[0], p[2] - p[0]);
+					const float length = glm::length(faceNormal);
+					faceNormal = length > 0.0f ? faceNormal / length : glm::vec3(0.0f);
+
+					for (uint32_t c = 0; c < 3; c++)
+					{
+						const auto& corner = *triangle[c];
+						auto& vertex = corners[written++];
+						vertex.vx = p[c].x;
+						vertex.vy = p[c].y;
+						vertex.vz = p[c].z;
+
+						const glm::vec3 normal = corner.vn == kNoObjIndex ? faceNormal : glm::vec3(normals[corner.vn * 3], normals[corner.vn * 3 + 1], normals[corner.vn * 3 + 2]);
+						vertex.nx = meshopt_quantizeHalf(normal.x);
+						vertex.ny = meshopt_quantizeHalf(normal.y);
+						vertex.nz = meshopt_quantizeHalf(normal.z);
+						vertex.nw = 0;
+
+						// FlipUVs
+						vertex.tu = corner.vt == kNoObjIndex ? 0 : meshopt_quantizeHalf(texCoords[corner.vt * 2]);
+						vertex.tv = corner.vt == kNoObjIndex ? 0 : meshopt_quantizeHalf(1.0f - texCoords[corner.vt * 2 + 1]);
+					}
+				}
+				firstCorner += faceSize;
+			}
+
+			// without an index buffer the remap is the index buffer
+			segment.indices.resize(corners.size());
+			const size_t vertexCount = meshopt_generateVertexRemap(segment.indices.data(), static_cast<const uint32_t*>(nullptr), corners.size(), corners.data(), corners.size(), sizeof(Vertex));
+			segment.vertices.resize(vertexCount);
+			meshopt_remapVertexBuffer(segment.vertices.data(), corners.data(), corners.size(), sizeof(Vertex), segment.indices.data());
+		}
+
+		// Segments of a mesh come in file order and are deduped on their own, deduping them together again keeps the first
+		// use order of one pass over the whole mesh
+		static void MergeObjSegments(const std::vector<ObjSegment*>& segments, MeshCreationRequest& req)
+		{
+			if (segments.size() == 1)
+			{
+				req.vertices = std::move(segments.front()->vertices);
+				req.indices = std::move(segments.front()->indices);
+			}
+			else
+			{
+				for (const auto* segment : segments)
+				{
+					const uint32_t baseVertex = static_cast<uint32_t>(req.vertices.size());
+					req.vertices.insert(req.vertices.end(), segment->vertices.begin(), segment->vertices.end());
+					for (const auto index : segment->indices)
+						req.indices.push_back(baseVertex + index);
+				}
+
+				std::vector<uint32_t> remap(req.vertices.size());
+				const size_t vertexCount = meshopt_generateVertexRemap(remap.data(), req.indices.data(), req.indices.size(), req.vertices.data(), req.vertices.size(), sizeof(Vertex));
+				meshopt_remapIndexBuffer(req.indices.data(), req.indices.data(), req.indices.size(), remap.data());
+				meshopt_remapVertexBuffer(req.vertices.data(), req.vertices.data(), req.vertices.size(), sizeof(Vertex), remap.data());
+				req.vertices.resize(vertexCount);
+			}
+
+			req.boundingVolume = FindSphereBoundingVolume(req.vertices.data(), req.vertices.size());
+		}
+
+		template<typename T>
+		static void AppendChunks(std::vector<T>& dst, std::vector<ObjChunk>& chunks, std::vector<T> ObjChunk::* member)
+		{
+			size_t size = 0;
+			for (const auto& chunk : chunks)
+				size += (chunk.*member).size();
+			dst.reserve(size);
+			for (auto& chunk : chunks)
+			{
+				dst.insert(dst.end(), (chunk.*member).begin(), (chunk.*member).end());
+				(chunk.*member) = {};
+			}
+		}
+
+		bool LoadObj(const std::filesystem::path& path, std::vector<MeshCreationRequest>& reqs, prl::JobSystem& jobSystem)
+		{
+			OS::MappedFile file;
+			if (!file.Open(path))
+			{
+				printf("[Asset Importer] Failed to open a file: %s\n", path.string().c_str());
+				return false;
+			}
+
+			// chunks start at a line start, a few per thread so uneven ones even out
+			const char* data = reinterpret_cast<const char*>(file.GetData());
+			const size_t size = file.GetSize();
+			const size_t chunkCount = std::clamp<size_t>(size / kMinObjChunkSize, 1, jobSystem.GetConcurrency() * 4);
+			std::vector<ObjChunk> chunks(chunkCount);
+			const char* chunkBegin = data;
+			for (size_t i = 0; i < chunkCount; i++)
+			{
+				const char* chunkEnd = i + 1 < chunkCount ? SkipLine(std::max(chunkBegin, data + size * (i + 1) / chunkCount), data + size) : data + size;
+				chunks[i].begin = chunkBegin;
+				chunks[i].end = chunkEnd;
+				chunkBegin = chunkEnd;
+			}
+
+			jobSystem.ParallelFor(chunks.size(), [&](const size_t st, const size_t en)
+				{
+					for (size_t i = st; i < en; i++)
+						ParseObjChunk(chunks[i]);
+				}, 1);
+
+			uint32_t positionCount = 0;
+			uint32_t texCoordCount = 0;
+			uint32_t normalCount = 0;
+			for (auto& chunk : chunks)
+			{
+				if (chunk.error)
+				{
+					const auto line = std::count(data, chunk.error, '\n') + 1;
+					printf("[Asset Importer] Failed to parse '%s' at line %zu\n", path.string().c_str(), static_cast<size_t>(line));
+					return false;
+				}
+				chunk.positionBase = positionCount;
+				chunk.texCoordBase = texCoordCount;
+				chunk.normalBase = normalCount;
+				positionCount += static_cast<uint32_t>(chunk.positions.size() / 3);
+				texCoordCount += static_cast<uint32_t>(chunk.texCoords.size() / 2);
+				normalCount += static_cast<uint32_t>(chunk.normals.size() / 3);
+			}
+
+			std::atomic<bool> resolved = true;
+			jobSystem.ParallelFor(chunks.size(), [&](const size_t st, const size_t en)
+				{
+					for (size_t i = st; i < en; i++)
+						if (!ResolveObjIndices(chunks[i], positionCount, texCoordCount, normalCount))
+							resolved = false;
+				}, 1);
+			if (!resolved)
+			{
+				printf("[Asset Importer] '%s' has faces pointing at vertices it doesn't have\n", path.string().c_str());
+				return false;
+			}
+
+			std::vector<float> positions;
+			std::vector<float> texCoords;
+			std::vector<float> normals;
+			AppendChunks(positions, chunks, &ObjChunk::positions);
+			AppendChunks(texCoords, chunks, &ObjChunk::texCoords);
+			AppendChunks(normals, chunks, &ObjChunk::normals);
+
+			// a segment that starts with o/g/usemtl starts a mesh once it has faces
+			uint32_t meshCount = 0;
+			bool newMesh = true;
+			std::vector<ObjSegment*> segments;
+			for (auto& chunk : chunks)
+			{
+				for (auto& segment : chunk.segments)
+				{
+					newMesh |= segment.newMesh;
+					if (!segment.faceCount)
+						continue;
+					if (newMesh)
+						meshCount++;
+					newMesh = false;
+					segment.mesh = meshCount - 1;
+					segments.push_back(&segment);
+				}
+			}
+
+			jobSystem.ParallelFor(chunks.size(), [&](const size_t st, const size_t en)
+				{
+					for (size_t i = st; i < en; i++)
+						for (auto& segment : chunks[i].segments)
+							if (segment.faceCount)
+								BuildObjSegment(chunks[i], segment, positions, texCoords, normals);
+				}, 1);
+
+			std::vector<std::vector<ObjSegment*>> meshSegments(meshCount);
+			for (auto* segment : segments)
+				meshSegments[segment->mesh].push_back(segment);
+
+			const size_t firstReq = reqs.size();
+			reqs.resize(firstReq + meshCount);
+			jobSystem.ParallelFor(meshCount, [&](const size_t st, const size_t en)
+				{
+					for (size_t i = st; i < en; i++)
+						MergeObjSegments(meshSegments[i], reqs[firstReq + i]);
+				}, 1);
+
+			return true;
+		}
+
+		// Sphere of rings x segments quads, with uvs and normals like a scan export would have
+		static void WriteSyntheticObj(const std::filesystem::path& path, uint32_t rings, uint32_t segments)
+		{
+			static constexpr float kPi = 3.14159265358979f;
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			char line[128];
+			for (uint32_t r = 0; r <= rings; r++)
+			{
+				const float theta = kPi * r / rings;
+				for (uint32_t s = 0; s <= segments; s++)
+				{
+					const float phi = 2.0f * kPi * s / segments;
+					const glm::vec3 n(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+					file.write(line, snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+						n.x, n.y, n.z, static_cast<float>(s) / segments, static_cast<float>(r) / rings, n.x, n.y, n.z));
+				}
+			}
+
+			file.write("g sphere\n", 9);
+			for (uint32_t r = 0; r < rings; r++)
+			{
+				for (uint32_t s = 0; s < segments; s++)
+				{
+					const uint32_t a = r * (segments + 1) + s + 1;
+					const uint32_t b = a + segments + 1;
+					file.write(line, snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, b + 1, b + 1, b + 1, a + 1, a + 1, a + 1));
+				}
+			}
+		}
+
+		static double TimeObjLoad(const std::filesystem::path& path, prl::JobSystem& jobSystem, size_t& vertexCount, size_t& indexCount)
+		{
+			std::vector<MeshCreationRequest> reqs;
+			SimpleTimer timer;
+			timer.start();
+			const bool loaded = LoadObj(path, reqs, jobSystem);
+			timer.stop();
+
+			vertexCount = 0;
+			indexCount = 0;
+			for (const auto& req : reqs)
+			{
+				vertexCount += req.vertices.size();
+				indexCount += req.indices.size();
+			}
+			return loaded ? timer.miliseconds() : -1.0;
+		}
+
+		void RunObjLoadBenchmark(const std::vector<std::string>& paths)
+		{
+			std::vector<std::filesystem::path> files;
+			for (const auto& path : paths.size() ? std::vector<std::filesystem::path>(paths.begin(), paths.end()) : OS::GetAllFileNamesInDirectory("Scene/"))
+				if (path.extension() == ".obj")
+					files.push_back(path);
+
+			const auto tempDirectory = std::filesystem::temp_directory_path();
+			const std::filesystem::path synthetic[] = { tempDirectory / "imp_obj_benchmark_256k.obj", tempDirectory / "imp_obj_benchmark_4m.obj" };
+			WriteSyntheticObj(synthetic[0], 256, 1024);
+			WriteSyntheticObj(synthetic[1], 1024, 4096);
+			files.insert(files.end(), std::begin(synthetic), std::end(synthetic));
+
+			prl::JobSystemSettings singleSettings;
+			singleSettings.workerCount = 0;
+			prl::JobSystem single(singleSettings);
+			prl::JobSystem jobs;
+
+			printf("[OBJ Load Benchmark] Assimp with Triangulate | FlipUVs | GenNormals | JoinIdenticalVertices, ReadFile only\n");
+			printf("[OBJ Load Benchmark] %-32s | %8s | %10s | %10s | %10s | %8s | %s\n", "file", "MB", "assimp ms", "1 thread", "threads", "speedup", "vertices / indices assimp, native");
+			for (const auto& path : files)
+			{
+				std::error_code ec;
+				const double megabytes = std::filesystem::file_size(path, ec) / (1024.0 * 1024.0);
+
+				SimpleTimer timer;
+				Assimp::Importer importer;
+				timer.start();
+				const aiScene* scene = importer.ReadFile(path.string(), aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals | aiProcess_JoinIdenticalVertices);
+				timer.stop();
+				const double assimpMs = scene ? timer.miliseconds() : -1.0;
+				size_t assimpVertices = 0;
+				size_t assimpIndices = 0;
+				for (uint32_t i = 0; scene && i < scene->mNumMeshes; i++)
+				{
+					assimpVertices += scene->mMeshes[i]->mNumVertices;
+					assimpIndices += scene->mMeshes[i]->mNumFaces * 3;
+				}
+				importer.FreeScene();
+
+				size_t vertices = 0;
+				size_t indices = 0;
+				const double singleMs = TimeObjLoad(path, single, vertices, indices);
+				const double jobsMs = TimeObjLoad(path, jobs, vertices, indices);
+
+				printf("[OBJ Load Benchmark] %-32s | %8.1f | %10.1f | %10.1f | %10.1f | %7.2fx | %zu / %zu, %zu / %zu\n", path.filename().string().c_str(), megabytes,
+					assimpMs, singleMs, jobsMs, assimpMs / jobsMs, assimpVertices, assimpIndices, vertices, indices);
+			}
+			printf("[OBJ Load Benchmark] %u threads\n", jobs.GetConcurrency());
+
+			std::error_code ec;
+			for (const auto& path : synthetic)
+				std::filesystem::remove(path, ec);
+		}
+	}
+}
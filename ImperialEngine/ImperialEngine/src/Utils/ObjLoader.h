@@ -0,0 +1,25 @@
+#pragma once
+#include "backend/VariousTypeDefinitions.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace prl { class JobSystem; }
+
+namespace imp
+{
+	namespace utils
+	{
+		// Native .obj loader, what Assimp makes with Triangulate | FlipUVs | GenNormals | JoinIdenticalVertices without going
+		// through Assimp. The file is mapped and split into chunks at line starts that get parsed in parallel, then every
+		// chunk triangulates and dedups its faces and every mesh merges its chunks. A mesh per o/g/usemtl run that has faces,
+		// in file order. Faces without normals get flat ones. Vertices are deduped by value in first use order.
+		// Appends to reqs and returns true, or leaves reqs alone and returns false when the file can't be read or parsed
+		bool LoadObj(const std::filesystem::path& path, std::vector<MeshCreationRequest>& reqs, prl::JobSystem& jobSystem);
+
+		// Times LoadObj on one thread and on every thread against Assimp's ReadFile with the flags AssetImporter used on
+		// the given .obj files (Scene/ when empty) and on a couple of big generated ones.
+		// Run with 'ImperialEngine.exe --benchmark-obj-load [--load-files <file names>]'
+		void RunObjLoadBenchmark(const std::vector<std::string>& paths);
+	}
+}
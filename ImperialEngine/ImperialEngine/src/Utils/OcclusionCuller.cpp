@@ -0,0 +1,482 @@
+#include "OcclusionCuller.h"
+#include "GfxUtilities.h"
+#include "SimpleTimer.h"
+#include "backend/parallel/JobSystem.h"
+#include "GLM/gtc/matrix_access.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// SSE2 is always there on x64, no need to check the cpu
+#if defined(_M_X64) || defined(__x86_64__)
+#define IMP_SSE2 1
+#include <emmintrin.h>
+#else
+#define IMP_SSE2 0
+#endif
+
+namespace imp
+{
+	// Occluders get clipped at this w instead of the real near plane, depth is 1/w so anything positive works
+	static constexpr float kNearW = 1e-3f;
+	// Draws are split into fixed blocks so the output doesn't depend on how the job system split the loop
+	static constexpr size_t kDrawBlockSize = 1024;
+
+	static float ToScreen(float ndc, uint32_t size)
+	{
+		return (ndc * 0.5f + 0.5f) * static_cast<float>(size);
+	}
+
+	// for bounds, far outside doesn't matter and has to fit in an int
+	static float ClampToScreen(float screen, uint32_t size)
+	{
+		return std::clamp(screen, -1.0f, static_cast<float>(size) + 1.0f);
+	}
+
+	OcclusionCuller::OcclusionCuller()
+		: m_Enabled(false), m_Spheres(), m_BlockCandidates(), m_Candidates(), m_Scores(), m_Occluders(), m_Triangles()
+		, m_Bins(kTilesX * kTilesY), m_Depth(kWidth * kHeight, 0.0f), m_CoarseDepth(kBlocksX * kBlocksY, 0.0f), m_Visible()
+		, m_BlockOffsets(), m_Output(), m_Stats()
+	{
+	}
+
+	OcclusionCuller::~OcclusionCuller()
+	{
+	}
+
+	void OcclusionCuller::Enable()
+	{
+		m_Enabled = true;
+	}
+
+	void OcclusionCuller::Disable()
+	{
+		m_Enabled = false;
+	}
+
+	void OcclusionCuller::Cull(const glm::mat4& viewProjection, const MeshRegistry& meshes, std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem)
+	{
+		SimpleTimer timer;
+		timer.start();
+		m_Stats = {};
+		m_Stats.tested = static_cast<uint32_t>(visibleData.size());
+
+		SelectOccluders(viewProjection, meshes, visibleData, jobSystem);
+		if (m_Occluders.size())
+		{
+			SetupTriangles(viewProjection, meshes, visibleData, jobSystem);
+			BinTriangles();
+			jobSystem.ParallelFor(kTilesX * kTilesY, [&](size_t st, size_t en)
+				{
+					for (size_t tile = st; tile < en; tile++)
+						RasterizeTile(static_cast<uint32_t>(tile));
+				}, 1);
+			RemoveOccluded(viewProjection, visibleData, jobSystem);
+		}
+		else
+		{
+			std::fill(m_Depth.begin(), m_Depth.end(), 0.0f);
+			std::fill(m_CoarseDepth.begin(), m_CoarseDepth.end(), 0.0f);
+		}
+
+		m_Stats.occluders = static_cast<uint32_t>(m_Occluders.size());
+		m_Stats.occluded = m_Stats.tested - static_cast<uint32_t>(visibleData.size());
+		timer.stop();
+		m_Stats.time = timer.miliseconds();
+	}
+
+	void OcclusionCuller::SelectOccluders(const glm::mat4& viewProjection, const MeshRegistry& meshes, const std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem)
+	{
+		const size_t count = visibleData.size();
+		const size_t blockCount = (count + kDrawBlockSize - 1) / kDrawBlockSize;
+		m_Spheres.resize(count);
+		m_Scores.resize(count);
+		m_BlockCandidates.resize(blockCount);
+
+		// projected radius in NDC is r * yScale / w
+		const glm::vec4 row3 = glm::row(viewProjection, 3);
+		const float yScale = glm::length(glm::vec3(glm::row(viewProjection, 1)));
+
+		// spheres are needed for testing later anyway
+		jobSystem.ParallelFor(blockCount, [&](size_t firstBlock, size_t lastBlock)
+			{
+				for (size_t block = firstBlock; block < lastBlock; block++)
+				{
+					auto& candidates = m_BlockCandidates[block];
+					candidates.clear();
+					const size_t end = std::min((block + 1) * kDrawBlockSize, count);
+					for (size_t i = block * kDrawBlockSize; i < end; i++)
+					{
+						const auto& dds = visibleData[i];
+						const auto BV = utils::TransformBoundingVolume(dds.Transform, meshes.GetBounds(dds.VertexBufferId));
+						m_Spheres[i] = glm::vec4(BV.center, BV.radius);
+
+						const float w = glm::dot(row3, glm::vec4(BV.center, 1.0f));
+						// camera is in the sphere, still a good occluder
+						const float score = BV.radius * yScale / std::max(w, BV.radius);
+						m_Scores[i] = score;
+						if (score >= kMinOccluderSize && meshes.GetOccluder(dds.VertexBufferId))
+							candidates.push_back(static_cast<uint32_t>(i));
+					}
+				}
+			});
+
+		m_Candidates.clear();
+		for (const auto& candidates : m_BlockCandidates)
+			m_Candidates.insert(m_Candidates.end(), candidates.begin(), candidates.end());
+
+		// biggest first, index breaks ties so it's the same every time. Some might not fit in the budget, but going
+		// further than a few times kMaxOccluders isn't worth sorting everything
+		const auto biggerFirst = [&](uint32_t a, uint32_t b)
+			{
+				return m_Scores[a] != m_Scores[b] ? m_Scores[a] > m_Scores[b] : a < b;
+			};
+		if (m_Candidates.size() > kMaxOccluders * 4)
+		{
+			std::nth_element(m_Candidates.begin(), m_Candidates.begin() + kMaxOccluders * 4, m_Candidates.end(), biggerFirst);
+			m_Candidates.resize(kMaxOccluders * 4);
+		}
+		std::sort(m_Candidates.begin(), m_Candidates.end(), biggerFirst);
+
+		m_Occluders.clear();
+		uint32_t triangleSlots = 0;
+		uint32_t budget = kOccluderTriangleBudget;
+		for (const auto idx : m_Candidates)
+		{
+			if (m_Occluders.size() == kMaxOccluders)
+				break;
+
+			// smaller ones might still fit
+			const uint32_t triangles = static_cast<uint32_t>(meshes.GetOccluder(visibleData[idx].VertexBufferId)->indices.size() / 3);
+			if (triangles > budget)
+				continue;
+
+			budget -= triangles;
+			m_Occluders.push_back({ idx, triangleSlots });
+			triangleSlots += triangles * 2;
+		}
+		m_Triangles.resize(triangleSlots);
+	}
+
+	void OcclusionCuller::SetupTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, ScreenTriangle& tri)
+	{
+		// rejected ones are left with empty bounds
+		tri.minX = 0;
+		tri.maxX = -1;
+		tri.minY = 0;
+		tri.maxY = -1;
+
+		// Viewport isn't flipped and front face is clockwise, that's positive area with y going down
+		const float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (!(area > 0.0f))
+			return;
+
+		// pixel centers are at +0.5
+		const int32_t minX = std::max(0, static_cast<int32_t>(std::ceil(ClampToScreen(std::min({ v0.x, v1.x, v2.x }), kWidth) - 0.5f)));
+		const int32_t minY = std::max(0, static_cast<int32_t>(std::ceil(ClampToScreen(std::min({ v0.y, v1.y, v2.y }), kHeight) - 0.5f)));
+		const int32_t maxX = std::min(static_cast<int32_t>(kWidth) - 1, static_cast<int32_t>(std::floor(ClampToScreen(std::max({ v0.x, v1.x, v2.x }), kWidth) - 0.5f)));
+		const int32_t maxY = std::min(static_cast<int32_t>(kHeight) - 1, static_cast<int32_t>(std::floor(ClampToScreen(std::max({ v0.y, v1.y, v2.y }), kHeight) - 0.5f)));
+		if (minX > maxX || minY > maxY)
+			return;
+
+		// edge i is opposite of vertex i, positive inside and equal to area at the vertex
+		const glm::vec3* v[3] = { &v0, &v1, &v2 };
+		for (uint32_t e = 0; e < 3; e++)
+		{
+			const auto& a = *v[(e + 1) % 3];
+			const auto& b = *v[(e + 2) % 3];
+			tri.edgeA[e] = a.y - b.y;
+			tri.edgeB[e] = b.x - a.x;
+			tri.edgeC[e] = -(tri.edgeA[e] * a.x + tri.edgeB[e] * a.y);
+		}
+
+		// 1/w is linear in screen space, barycentrics are the edge functions over the area
+		const float invArea = 1.0f / area;
+		tri.zA = (tri.edgeA[0] * v0.z + tri.edgeA[1] * v1.z + tri.edgeA[2] * v2.z) * invArea;
+		tri.zB = (tri.edgeB[0] * v0.z + tri.edgeB[1] * v1.z + tri.edgeB[2] * v2.z) * invArea;
+		tri.zC = (tri.edgeC[0] * v0.z + tri.edgeC[1] * v1.z + tri.edgeC[2] * v2.z) * invArea;
+		tri.minX = minX;
+		tri.minY = minY;
+		tri.maxX = maxX;
+		tri.maxY = maxY;
+	}
+
+	void OcclusionCuller::SetupClippedTriangle(const glm::vec4* clip, ScreenTriangle* dst)
+	{
+		// clipped against w = kNearW, can end up as a quad
+		glm::vec4 poly[4];
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			const auto& a = clip[i];
+			const auto& b = clip[(i + 1) % 3];
+			const bool aIn = a.w >= kNearW;
+			const bool bIn = b.w >= kNearW;
+			if (aIn)
+				poly[count++] = a;
+			if (aIn != bIn)
+				poly[count++] = glm::mix(a, b, (kNearW - a.w) / (b.w - a.w));
+		}
+
+		glm::vec3 screen[4];
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const float invW = 1.0f / poly[i].w;
+			screen[i] = glm::vec3(ToScreen(poly[i].x * invW, kWidth), ToScreen(poly[i].y * invW, kHeight), invW);
+		}
+
+		dst[0].minX = dst[1].minX = 0;
+		dst[0].maxX = dst[1].maxX = -1;
+		if (count >= 3)
+			SetupTriangle(screen[0], screen[1], screen[2], dst[0]);
+		if (count == 4)
+			SetupTriangle(screen[0], screen[2], screen[3], dst[1]);
+	}
+
+	void OcclusionCuller::SetupTriangles(const glm::mat4& viewProjection, const MeshRegistry& meshes, const std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem)
+	{
+		jobSystem.ParallelFor(m_Occluders.size(), [&](size_t st, size_t en)
+			{
+				// reused between frames. Grab a reference, workers would see their own thread_local otherwise
+				static thread_local std::vector<glm::vec4> tlsClip;
+				auto& clip = tlsClip;
+
+				for (size_t o = st; o < en; o++)
+				{
+					const auto& occluder = m_Occluders[o];
+					const auto& dds = visibleData[occluder.drawIdx];
+					const auto& mesh = *meshes.GetOccluder(dds.VertexBufferId);
+					const glm::mat4 mvp = viewProjection * dds.Transform;
+
+					clip.resize(mesh.positions.size());
+					for (size_t v = 0; v < mesh.positions.size(); v++)
+						clip[v] = mvp * glm::vec4(mesh.positions[v], 1.0f);
+
+					ScreenTriangle* dst = &m_Triangles[occluder.firstTriangle];
+					for (size_t i = 0; i < mesh.indices.size(); i += 3, dst += 2)
+					{
+						const glm::vec4 tri[3] = { clip[mesh.indices[i]], clip[mesh.indices[i + 1]], clip[mesh.indices[i + 2]] };
+						if (tri[0].w >= kNearW && tri[1].w >= kNearW && tri[2].w >= kNearW)
+						{
+							glm::vec3 screen[3];
+							for (uint32_t v = 0; v < 3; v++)
+							{
+								const float invW = 1.0f / tri[v].w;
+								screen[v] = glm::vec3(ToScreen(tri[v].x * invW, kWidth), ToScreen(tri[v].y * invW, kHeight), invW);
+							}
+							SetupTriangle(screen[0], screen[1], screen[2], dst[0]);
+							dst[1].minX = 0;
+							dst[1].maxX = -1;
+						}
+						else
+							SetupClippedTriangle(tri, dst);
+					}
+				}
+			}, 1);
+	}
+
+	void OcclusionCuller::BinTriangles()
+	{
+		for (auto& bin : m_Bins)
+			bin.clear();
+
+		for (uint32_t i = 0; i < m_Triangles.size(); i++)
+		{
+			const auto& tri = m_Triangles[i];
+			if (tri.minX > tri.maxX)
+				continue;
+
+			m_Stats.triangles++;
+			const uint32_t tx1 = tri.maxX / kTileWidth;
+			const uint32_t ty1 = tri.maxY / kTileHeight;
+			for (uint32_t ty = tri.minY / kTileHeight; ty <= ty1; ty++)
+				for (uint32_t tx = tri.minX / kTileWidth; tx <= tx1; tx++)
+					m_Bins[ty * kTilesX + tx].push_back(i);
+		}
+	}
+
+	void OcclusionCuller::RasterizeTile(uint32_t tile)
+	{
+		const int32_t tileX0 = static_cast<int32_t>((tile % kTilesX) * kTileWidth);
+		const int32_t tileY0 = static_cast<int32_t>((tile / kTilesX) * kTileHeight);
+		const int32_t tileX1 = tileX0 + kTileWidth - 1;
+		const int32_t tileY1 = tileY0 + kTileHeight - 1;
+
+		for (int32_t y = tileY0; y <= tileY1; y++)
+			std::fill_n(&m_Depth[y * kWidth + tileX0], kTileWidth, 0.0f);
+
+		for (const auto idx : m_Bins[tile])
+		{
+			const auto& tri = m_Triangles[idx];
+			// tiles start at a multiple of 4, so rows of 4 pixels never cross into another tile
+			const int32_t x0 = std::max(tri.minX, tileX0) & ~3;
+			const int32_t x1 = std::min(tri.maxX, tileX1);
+			const int32_t y0 = std::max(tri.minY, tileY0);
+			const int32_t y1 = std::min(tri.maxY, tileY1);
+
+#if IMP_SSE2
+			const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 e0A = _mm_set1_ps(tri.edgeA[0]);
+			const __m128 e1A = _mm_set1_ps(tri.edgeA[1]);
+			const __m128 e2A = _mm_set1_ps(tri.edgeA[2]);
+			const __m128 zA = _mm_set1_ps(tri.zA);
+			for (int32_t y = y0; y <= y1; y++)
+			{
+				const float py = static_cast<float>(y) + 0.5f;
+				const __m128 e0Row = _mm_set1_ps(tri.edgeB[0] * py + tri.edgeC[0]);
+				const __m128 e1Row = _mm_set1_ps(tri.edgeB[1] * py + tri.edgeC[1]);
+				const __m128 e2Row = _mm_set1_ps(tri.edgeB[2] * py + tri.edgeC[2]);
+				const __m128 zRow = _mm_set1_ps(tri.zB * py + tri.zC);
+				float* depthRow = &m_Depth[y * kWidth];
+				for (int32_t x = x0; x <= x1; x += 4)
+				{
+					const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), pixelOffsets);
+					const __m128 e0 = _mm_add_ps(_mm_mul_ps(e0A, px), e0Row);
+					const __m128 e1 = _mm_add_ps(_mm_mul_ps(e1A, px), e1Row);
+					const __m128 e2 = _mm_add_ps(_mm_mul_ps(e2A, px), e2Row);
+					const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+					if (!_mm_movemask_ps(inside))
+						continue;
+
+					// 1/w is positive and the buffer clears to 0, masked out lanes can just be 0 for the max
+					const __m128 z = _mm_and_ps(_mm_add_ps(_mm_mul_ps(zA, px), zRow), inside);
+					_mm_storeu_ps(depthRow + x, _mm_max_ps(_mm_loadu_ps(depthRow + x), z));
+				}
+			}
+#else
+			for (int32_t y = y0; y <= y1; y++)
+			{
+				const float py = static_cast<float>(y) + 0.5f;
+				float* depthRow = &m_Depth[y * kWidth];
+				for (int32_t x = x0; x <= x1; x++)
+				{
+					const float px = static_cast<float>(x) + 0.5f;
+					bool inside = true;
+					for (uint32_t e = 0; e < 3; e++)
+						inside &= tri.edgeA[e] * px + (tri.edgeB[e] * py + tri.edgeC[e]) >= 0.0f;
+					if (inside)
+						depthRow[x] = std::max(depthRow[x], tri.zA * px + (tri.zB * py + tri.zC));
+				}
+			}
+#endif
+		}
+
+		// farthest depth of every block, something behind that is behind the whole block
+		for (uint32_t by = tileY0 / kBlockSize; by < (tileY1 + 1) / kBlockSize; by++)
+		{
+			for (uint32_t bx = tileX0 / kBlockSize; bx < (tileX1 + 1) / kBlockSize; bx++)
+			{
+				float farthest = FLT_MAX;
+				for (uint32_t y = by * kBlockSize; y < (by + 1) * kBlockSize; y++)
+					for (uint32_t x = bx * kBlockSize; x < (bx + 1) * kBlockSize; x++)
+						farthest = std::min(farthest, m_Depth[y * kWidth + x]);
+				m_CoarseDepth[by * kBlocksX + bx] = farthest;
+			}
+		}
+	}
+
+	bool OcclusionCuller::IsOccluded(const glm::mat4& viewProjection, const glm::vec4& radiusToClip, const glm::vec4& sphere) const
+	{
+		const glm::vec4 clipCenter = viewProjection * glm::vec4(glm::vec3(sphere), 1.0f);
+		const glm::vec4 extent = radiusToClip * sphere.w;
+
+		// the whole box around the sphere has to be in front of the camera to project it
+		const float wMin = clipCenter.w - extent.z;
+		if (wMin < kNearW)
+			return false;
+
+		// nearest point of the sphere
+		const float depth = 1.0f / (clipCenter.w - extent.w);
+
+		// most visible ones are visible right in the middle, no need to project the box for them
+		const float invW = 1.0f / clipCenter.w;
+		const int32_t centerX = static_cast<int32_t>(ClampToScreen(ToScreen(clipCenter.x * invW, kWidth), kWidth));
+		const int32_t centerY = static_cast<int32_t>(ClampToScreen(ToScreen(clipCenter.y * invW, kHeight), kHeight));
+		if (centerX >= 0 && centerX < static_cast<int32_t>(kWidth) && centerY >= 0 && centerY < static_cast<int32_t>(kHeight) &&
+			m_CoarseDepth[(centerY / kBlockSize) * kBlocksX + centerX / kBlockSize] <= depth)
+			return false;
+
+		// x / w and y / w over the box, x, y and w can be anywhere in their ranges. Looser than projecting the corners
+		// but a lot cheaper
+		const float invWMin = 1.0f / wMin;
+		const float invWMax = 1.0f / (clipCenter.w + extent.z);
+		const float xLow = clipCenter.x - extent.x;
+		const float xHigh = clipCenter.x + extent.x;
+		const float yLow = clipCenter.y - extent.y;
+		const float yHigh = clipCenter.y + extent.y;
+		const float minX = xLow * (xLow < 0.0f ? invWMin : invWMax);
+		const float maxX = xHigh * (xHigh > 0.0f ? invWMin : invWMax);
+		const float minY = yLow * (yLow < 0.0f ? invWMin : invWMax);
+		const float maxY = yHigh * (yHigh > 0.0f ? invWMin : invWMax);
+
+		// every pixel the rect touches, not only ones with centers in it
+		const int32_t x0 = std::max(0, static_cast<int32_t>(std::floor(ClampToScreen(ToScreen(minX, kWidth), kWidth))));
+		const int32_t y0 = std::max(0, static_cast<int32_t>(std::floor(ClampToScreen(ToScreen(minY, kHeight), kHeight))));
+		const int32_t x1 = std::min(static_cast<int32_t>(kWidth) - 1, static_cast<int32_t>(std::ceil(ClampToScreen(ToScreen(maxX, kWidth), kWidth))) - 1);
+		const int32_t y1 = std::min(static_cast<int32_t>(kHeight) - 1, static_cast<int32_t>(std::ceil(ClampToScreen(ToScreen(maxY, kHeight), kHeight))) - 1);
+		// frustum culling should have gotten it, keep it anyway
+		if (x0 > x1 || y0 > y1)
+			return false;
+
+		for (uint32_t by = y0 / kBlockSize; by <= y1 / kBlockSize; by++)
+			for (uint32_t bx = x0 / kBlockSize; bx <= x1 / kBlockSize; bx++)
+				if (m_CoarseDepth[by * kBlocksX + bx] <= depth)
+					return false;
+		return true;
+	}
+
+	void OcclusionCuller::RemoveOccluded(const glm::mat4& viewProjection, std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem)
+	{
+		// Same two passes as utils::Cull, flags and counts per block then every block writes at its offset
+		const size_t count = visibleData.size();
+		const size_t blockCount = (count + kDrawBlockSize - 1) / kDrawBlockSize;
+		m_Visible.resize(count);
+		m_BlockOffsets.resize(blockCount + 1);
+		m_BlockOffsets[0] = 0;
+
+		// clip-space x, y and w of a sphere's bounding box go this far from the center per unit of radius, last one is
+		// how much w changes per unit of distance, for the nearest point
+		const glm::vec3 wGradient(viewProjection[0].w, viewProjection[1].w, viewProjection[2].w);
+		glm::vec4 radiusToClip(0.0f, 0.0f, 0.0f, glm::length(wGradient));
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			radiusToClip.x += std::abs(viewProjection[axis].x);
+			radiusToClip.y += std::abs(viewProjection[axis].y);
+			radiusToClip.z += std::abs(viewProjection[axis].w);
+		}
+
+		jobSystem.ParallelFor(blockCount, [&](size_t firstBlock, size_t lastBlock)
+			{
+				for (size_t block = firstBlock; block < lastBlock; block++)
+				{
+					uint32_t visibleCount = 0;
+					const size_t end = std::min((block + 1) * kDrawBlockSize, count);
+					for (size_t i = block * kDrawBlockSize; i < end; i++)
+					{
+						m_Visible[i] = !IsOccluded(viewProjection, radiusToClip, m_Spheres[i]);
+						visibleCount += m_Visible[i];
+					}
+					m_BlockOffsets[block + 1] = visibleCount;
+				}
+			});
+
+		for (size_t block = 0; block < blockCount; block++)
+			m_BlockOffsets[block + 1] += m_BlockOffsets[block];
+
+		m_Output.resize(m_BlockOffsets[blockCount]);
+		jobSystem.ParallelFor(blockCount, [&](size_t firstBlock, size_t lastBlock)
+			{
+				for (size_t block = firstBlock; block < lastBlock; block++)
+				{
+					uint32_t dst = m_BlockOffsets[block];
+					const size_t end = std::min((block + 1) * kDrawBlockSize, count);
+					for (size_t i = block * kDrawBlockSize; i < end; i++)
+						if (m_Visible[i])
+							m_Output[dst++] = visibleData[i];
+				}
+			});
+
+		visibleData.swap(m_Output);
+	}
+}
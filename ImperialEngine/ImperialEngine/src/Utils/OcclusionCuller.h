@@ -0,0 +1,112 @@
+#pragma once
+#include "backend/graphics/Graphics.h"
+#include "Utils/NonCopyable.h"
+#include <vector>
+
+namespace prl { class JobSystem; }
+
+namespace imp
+{
+	// Optional CPU occlusion culling after frustum culling in Traditional mode. Biggest visible objects on screen are
+	// occluders, up to a triangle budget: their OccluderMesh (lowest lod) is rasterized into a small depth buffer of 1/w,
+	// tiles in parallel and 4 pixels at a time with SSE. A coarse level keeps the farthest depth of every block and
+	// screen-space bounds of every visible draw are tested against it. Draws behind occluders in every block they cover
+	// are removed, the rest keep their order.
+	// Not fully conservative: occluders are simplified meshes and pixels count as covered by their centers, so something
+	// peeking out past the edge of an occluder by less than a pixel or a simplification error can get culled.
+	class OcclusionCuller : NonCopyable
+	{
+	public:
+		static constexpr uint32_t kWidth = 320;
+		static constexpr uint32_t kHeight = 192;
+		static constexpr uint32_t kTileWidth = 64;		// multiple of 4 and kBlockSize
+		static constexpr uint32_t kTileHeight = 32;
+		static constexpr uint32_t kTilesX = kWidth / kTileWidth;
+		static constexpr uint32_t kTilesY = kHeight / kTileHeight;
+		static constexpr uint32_t kBlockSize = 8;		// pixels per side of a coarse level block
+		static constexpr uint32_t kBlocksX = kWidth / kBlockSize;
+		static constexpr uint32_t kBlocksY = kHeight / kBlockSize;
+		static constexpr uint32_t kMaxOccluders = 128;
+		static constexpr uint32_t kOccluderTriangleBudget = 32768;
+		// meshes with more than this in their lowest lod don't get an occluder
+		static constexpr uint32_t kMaxOccluderTriangles = 2048;
+		// projected radius in NDC an object needs to be an occluder
+		static constexpr float kMinOccluderSize = 0.05f;
+
+		struct Stats
+		{
+			double time;				// ms, last Cull
+			uint32_t occluders;
+			uint32_t triangles;			// rasterized, after near clipping and backface culling
+			uint32_t tested;
+			uint32_t occluded;
+		};
+
+		OcclusionCuller();
+		~OcclusionCuller();
+
+		void Enable();
+		void Disable();
+		bool IsEnabled() const { return m_Enabled; }
+
+		// visibleData is what was frustum culled with viewProjection, occluded draws get removed from it
+		void Cull(const glm::mat4& viewProjection, const MeshRegistry& meshes, std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem);
+
+		const Stats& GetStats() const { return m_Stats; }
+		// of the last Cull, kWidth * kHeight of 1/w, 0 where nothing was drawn
+		const std::vector<float>& GetDepth() const { return m_Depth; }
+
+	private:
+		struct Occluder
+		{
+			uint32_t drawIdx;
+			uint32_t firstTriangle;		// of its slots in m_Triangles, two per mesh triangle because of near clipping
+		};
+
+		// Edge functions and 1/w as planes in screen space, pixel bounds inclusive. Empty bounds mark unused slots
+		struct ScreenTriangle
+		{
+			float edgeA[3];
+			float edgeB[3];
+			float edgeC[3];
+			float zA;
+			float zB;
+			float zC;
+			int32_t minX;
+			int32_t minY;
+			int32_t maxX;
+			int32_t maxY;
+		};
+
+		static void SetupTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, ScreenTriangle& tri);
+		// writes two, second one is only used when clipping made a quad
+		static void SetupClippedTriangle(const glm::vec4* clip, ScreenTriangle* dst);
+		void SelectOccluders(const glm::mat4& viewProjection, const MeshRegistry& meshes, const std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem);
+		void SetupTriangles(const glm::mat4& viewProjection, const MeshRegistry& meshes, const std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem);
+		void BinTriangles();
+		void RasterizeTile(uint32_t tile);
+		bool IsOccluded(const glm::mat4& viewProjection, const glm::vec4& radiusToClip, const glm::vec4& sphere) const;
+		void RemoveOccluded(const glm::mat4& viewProjection, std::vector<DrawDataSingle>& visibleData, prl::JobSystem& jobSystem);
+
+		bool m_Enabled;
+
+		// world-space spheres of visibleData, xyz center, w radius
+		std::vector<glm::vec4> m_Spheres;
+		std::vector<std::vector<uint32_t>> m_BlockCandidates;
+		std::vector<uint32_t> m_Candidates;
+		std::vector<float> m_Scores;
+		std::vector<Occluder> m_Occluders;
+		std::vector<ScreenTriangle> m_Triangles;
+		std::vector<std::vector<uint32_t>> m_Bins;
+
+		std::vector<float> m_Depth;
+		// farthest (smallest) 1/w of every block
+		std::vector<float> m_CoarseDepth;
+
+		std::vector<uint8_t> m_Visible;
+		std::vector<uint32_t> m_BlockOffsets;
+		std::vector<DrawDataSingle> m_Output;
+
+		Stats m_Stats;
+	};
+}
@@ -0,0 +1,355 @@
+#include "RenderProxies.h"
+#include "GfxUtilities.h"
+#include "backend/parallel/JobSystem.h"
+#include <algorithm>
+
+namespace imp
+{
+	static uint32_t GetSparse(const std::vector<uint32_t>& sparse, entt::entity entity)
+	{
+		const auto idx = entt::to_entity(entity);
+		return idx < sparse.size() ? sparse[idx] : RenderProxies::kInvalidProxy;
+	}
+
+	static void SetSparse(std::vector<uint32_t>& sparse, entt::entity entity, uint32_t value)
+	{
+		const auto idx = entt::to_entity(entity);
+		if (idx >= sparse.size())
+			sparse.resize(idx + 1, RenderProxies::kInvalidProxy);
+		sparse[idx] = value;
+	}
+
+	static void SortUnique(std::vector<uint32_t>& indices, size_t count)
+	{
+		// moved into from a proxy that got removed later in the same update
+		indices.erase(std::remove_if(indices.begin(), indices.end(), [count](uint32_t idx) { return idx >= count; }), indices.end());
+		std::sort(indices.begin(), indices.end());
+		indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+	}
+
+	RenderProxies::RenderProxies()
+		: m_Registry(nullptr), m_NeedsRebuild(true), m_NewRenderables(), m_ChangedRenderables(), m_ChangedTransforms(), m_RemovedRenderables()
+		, m_Scratch(), m_X(), m_Y(), m_Z(), m_Radius(), m_LodRadius(), m_Transforms(), m_MeshIds(), m_MaterialIds(), m_Lods()
+		, m_LocalCenters(), m_Entities(), m_Parents(), m_NextSibling(), m_PrevSibling(), m_ProxyOfEntity(), m_FirstChildOfParent()
+		, m_Version(0), m_Rebuilt(false), m_ChangedIndices(), m_ChangedMeshIndices(), m_Stats()
+	{
+	}
+
+	RenderProxies::~RenderProxies()
+	{
+		Disconnect();
+	}
+
+	void RenderProxies::Connect(entt::registry& registry)
+	{
+		if (m_Registry == &registry)
+			return;
+
+		Disconnect();
+		m_Registry = &registry;
+		m_NewRenderables = std::make_unique<entt::observer>(registry, entt::collector.group<Comp::ChildComponent, Comp::Mesh, Comp::Material>());
+		m_ChangedRenderables = std::make_unique<entt::observer>(registry, entt::collector.update<Comp::ChildComponent>().update<Comp::Mesh>().update<Comp::Material>());
+		m_ChangedTransforms = std::make_unique<entt::observer>(registry, entt::collector.update<Comp::Transform>());
+		// observers forget entities that leave, we need to know which ones did
+		registry.on_destroy<Comp::ChildComponent>().connect<&RenderProxies::OnRenderableRemoved>(*this);
+		registry.on_destroy<Comp::Mesh>().connect<&RenderProxies::OnRenderableRemoved>(*this);
+		registry.on_destroy<Comp::Material>().connect<&RenderProxies::OnRenderableRemoved>(*this);
+		m_NeedsRebuild = true;
+	}
+
+	void RenderProxies::Disconnect()
+	{
+		if (!m_Registry)
+			return;
+
+		m_Registry->on_destroy<Comp::ChildComponent>().disconnect<&RenderProxies::OnRenderableRemoved>(*this);
+		m_Registry->on_destroy<Comp::Mesh>().disconnect<&RenderProxies::OnRenderableRemoved>(*this);
+		m_Registry->on_destroy<Comp::Material>().disconnect<&RenderProxies::OnRenderableRemoved>(*this);
+		// observers don't disconnect themselves when destroyed
+		m_NewRenderables->disconnect();
+		m_ChangedRenderables->disconnect();
+		m_ChangedTransforms->disconnect();
+		m_NewRenderables.reset();
+		m_ChangedRenderables.reset();
+		m_ChangedTransforms.reset();
+		m_RemovedRenderables.clear();
+		m_Registry = nullptr;
+	}
+
+	void RenderProxies::OnRenderableRemoved(entt::registry& registry, entt::entity entity)
+	{
+		// could be any entity with one of the components, Update checks if it had a proxy
+		if (!m_NeedsRebuild)
+			m_RemovedRenderables.push_back(entity);
+	}
+
+	uint32_t RenderProxies::GetProxyIndex(entt::entity entity) const
+	{
+		const uint32_t idx = GetSparse(m_ProxyOfEntity, entity);
+		return idx != kInvalidProxy && m_Entities[idx] == entity ? idx : kInvalidProxy;
+	}
+
+	void RenderProxies::Update(const Graphics& gfx, prl::JobSystem& jobSystem)
+	{
+		if (!m_Registry)
+			return;
+
+		if (m_NeedsRebuild)
+		{
+			Rebuild(gfx, jobSystem);
+			m_Rebuilt = true;
+			m_Version++;
+			return;
+		}
+
+		if (m_RemovedRenderables.empty() && m_NewRenderables->empty() && m_ChangedRenderables->empty() && m_ChangedTransforms->empty())
+			return;
+
+		SimpleTimer timer;
+		timer.start();
+
+		m_ChangedIndices.clear();
+		m_ChangedMeshIndices.clear();
+
+		// removing first, an entity could've left the group and joined it again
+		uint32_t removed = 0;
+		for (const auto entity : m_RemovedRenderables)
+		{
+			const uint32_t idx = GetProxyIndex(entity);
+			if (idx == kInvalidProxy)
+				continue;
+			Remove(idx);
+			removed++;
+		}
+		m_RemovedRenderables.clear();
+
+		m_Scratch.assign(m_NewRenderables->begin(), m_NewRenderables->end());
+		m_NewRenderables->clear();
+		Add(m_Scratch, gfx, jobSystem);
+
+		// everything from here on gets its transform and sphere recomputed
+		const size_t firstRefresh = m_ChangedIndices.size();
+		for (const auto entity : *m_ChangedRenderables)
+		{
+			const uint32_t idx = GetProxyIndex(entity);
+			if (idx == kInvalidProxy)
+				continue;
+
+			const auto parent = m_Registry->get<Comp::ChildComponent>(entity).parent;
+			if (parent != m_Parents[idx])
+			{
+				UnlinkFromParent(idx);
+				m_Parents[idx] = parent;
+				LinkToParent(idx);
+			}
+			m_MaterialIds[idx] = m_Registry->get<Comp::Material>(entity).materialId;
+			SetMesh(idx, m_Registry->get<Comp::Mesh>(entity), gfx);
+			m_ChangedIndices.push_back(idx);
+			m_ChangedMeshIndices.push_back(idx);
+		}
+		m_ChangedRenderables->clear();
+
+		for (const auto parent : *m_ChangedTransforms)
+			for (uint32_t idx = GetSparse(m_FirstChildOfParent, parent); idx != kInvalidProxy; idx = m_NextSibling[idx])
+				m_ChangedIndices.push_back(idx);
+		m_ChangedTransforms->clear();
+
+		// a proxy can be in there twice, jobs can't write it at the same time
+		std::sort(m_ChangedIndices.begin() + firstRefresh, m_ChangedIndices.end());
+		m_ChangedIndices.erase(std::unique(m_ChangedIndices.begin() + firstRefresh, m_ChangedIndices.end()), m_ChangedIndices.end());
+		Refresh(static_cast<uint32_t>(firstRefresh), jobSystem);
+
+		SortUnique(m_ChangedIndices, GetCount());
+		SortUnique(m_ChangedMeshIndices, GetCount());
+		m_Rebuilt = false;
+		m_Version++;
+
+		timer.stop();
+		m_Stats.updateTime = timer.miliseconds();
+		m_Stats.updatedProxies = static_cast<uint32_t>(m_ChangedIndices.size());
+		m_Stats.addedProxies = static_cast<uint32_t>(m_Scratch.size());
+		m_Stats.removedProxies = removed;
+	}
+
+	void RenderProxies::Rebuild(const Graphics& gfx, prl::JobSystem& jobSystem)
+	{
+		SimpleTimer timer;
+		timer.start();
+
+		Resize(0);
+		m_ProxyOfEntity.clear();
+		m_FirstChildOfParent.clear();
+
+		// storage order of the group, the registry is most likely laid out like that too
+		const auto group = m_Registry->group<Comp::ChildComponent, Comp::Mesh, Comp::Material>();
+		m_Scratch.resize(group.size());
+		for (size_t i = 0; i < group.size(); i++)
+			m_Scratch[i] = utils::GetRenderable(group, i);
+		Add(m_Scratch, gfx, jobSystem);
+
+		m_NeedsRebuild = false;
+		m_NewRenderables->clear();
+		m_ChangedRenderables->clear();
+		m_ChangedTransforms->clear();
+		m_RemovedRenderables.clear();
+		m_ChangedIndices.clear();
+		m_ChangedMeshIndices.clear();
+
+		timer.stop();
+		m_Stats.rebuildTime = timer.miliseconds();
+	}
+
+	void RenderProxies::Add(const std::vector<entt::entity>& entities, const Graphics& gfx, prl::JobSystem& jobSystem)
+	{
+		if (entities.empty())
+			return;
+
+		const auto transforms = m_Registry->view<Comp::Transform>();
+		const auto group = m_Registry->group<Comp::ChildComponent, Comp::Mesh, Comp::Material>();
+		const uint32_t first = static_cast<uint32_t>(GetCount());
+		Resize(first + entities.size());
+
+		jobSystem.ParallelFor(entities.size(), [&](size_t st, size_t en)
+			{
+				for (size_t i = st; i < en; i++)
+				{
+					const uint32_t idx = first + static_cast<uint32_t>(i);
+					const auto entity = entities[i];
+					assert(GetProxyIndex(entity) == kInvalidProxy);
+
+					m_Entities[idx] = entity;
+					m_Parents[idx] = group.get<Comp::ChildComponent>(entity).parent;
+					m_MaterialIds[idx] = group.get<Comp::Material>(entity).materialId;
+					m_Lods[idx] = kNoLod;
+					SetMesh(idx, group.get<Comp::Mesh>(entity), gfx);
+					m_Transforms[idx] = transforms.get<Comp::Transform>(m_Parents[idx]).transform;
+					ComputeSphere(idx);
+				}
+			});
+
+		for (uint32_t idx = first; idx < GetCount(); idx++)
+		{
+			SetSparse(m_ProxyOfEntity, m_Entities[idx], idx);
+			LinkToParent(idx);
+			m_ChangedIndices.push_back(idx);
+			m_ChangedMeshIndices.push_back(idx);
+		}
+	}
+
+	// Last proxy takes the place of the removed one
+	void RenderProxies::Remove(uint32_t idx)
+	{
+		UnlinkFromParent(idx);
+		SetSparse(m_ProxyOfEntity, m_Entities[idx], kInvalidProxy);
+
+		const uint32_t last = static_cast<uint32_t>(GetCount() - 1);
+		if (idx != last)
+		{
+			MoveProxy(last, idx);
+			m_ChangedIndices.push_back(idx);
+			m_ChangedMeshIndices.push_back(idx);
+		}
+		Resize(last);
+	}
+
+	void RenderProxies::MoveProxy(uint32_t src, uint32_t dst)
+	{
+		m_X[dst] = m_X[src];
+		m_Y[dst] = m_Y[src];
+		m_Z[dst] = m_Z[src];
+		m_Radius[dst] = m_Radius[src];
+		m_LodRadius[dst] = m_LodRadius[src];
+		m_Transforms[dst] = m_Transforms[src];
+		m_MeshIds[dst] = m_MeshIds[src];
+		m_MaterialIds[dst] = m_MaterialIds[src];
+		m_Lods[dst] = m_Lods[src];
+		m_LocalCenters[dst] = m_LocalCenters[src];
+		m_Entities[dst] = m_Entities[src];
+		m_Parents[dst] = m_Parents[src];
+		m_NextSibling[dst] = m_NextSibling[src];
+		m_PrevSibling[dst] = m_PrevSibling[src];
+
+		// whoever pointed at src points at dst now
+		if (m_PrevSibling[dst] != kInvalidProxy)
+			m_NextSibling[m_PrevSibling[dst]] = dst;
+		else
+			SetSparse(m_FirstChildOfParent, m_Parents[dst], dst);
+		if (m_NextSibling[dst] != kInvalidProxy)
+			m_PrevSibling[m_NextSibling[dst]] = dst;
+		SetSparse(m_ProxyOfEntity, m_Entities[dst], dst);
+	}
+
+	void RenderProxies::SetMesh(uint32_t idx, const Comp::Mesh& mesh, const Graphics& gfx)
+	{
+		// a released mesh's slot may already hold another one
+		assert(gfx.m_Meshes.IsValid(mesh));
+		m_MeshIds[idx] = mesh.meshId;
+		const auto& BV = gfx.m_Meshes.GetBounds(mesh.meshId);
+		m_LocalCenters[idx] = BV.center;
+		m_LodRadius[idx] = BV.radius;
+	}
+
+	void RenderProxies::LinkToParent(uint32_t idx)
+	{
+		const uint32_t head = GetSparse(m_FirstChildOfParent, m_Parents[idx]);
+		m_PrevSibling[idx] = kInvalidProxy;
+		m_NextSibling[idx] = head;
+		if (head != kInvalidProxy)
+			m_PrevSibling[head] = idx;
+		SetSparse(m_FirstChildOfParent, m_Parents[idx], idx);
+	}
+
+	void RenderProxies::UnlinkFromParent(uint32_t idx)
+	{
+		const uint32_t prev = m_PrevSibling[idx];
+		const uint32_t next = m_NextSibling[idx];
+		if (prev != kInvalidProxy)
+			m_NextSibling[prev] = next;
+		else
+			SetSparse(m_FirstChildOfParent, m_Parents[idx], next);
+		if (next != kInvalidProxy)
+			m_PrevSibling[next] = prev;
+	}
+
+	// Copies the parent Transform of changed proxies from m_ChangedIndices[first] onward
+	void RenderProxies::Refresh(uint32_t first, prl::JobSystem& jobSystem)
+	{
+		const auto transforms = m_Registry->view<Comp::Transform>();
+		jobSystem.ParallelFor(m_ChangedIndices.size() - first, [&](size_t st, size_t en)
+			{
+				for (size_t i = first + st; i < first + en; i++)
+				{
+					const auto idx = m_ChangedIndices[i];
+					m_Transforms[idx] = transforms.get<Comp::Transform>(m_Parents[idx]).transform;
+					ComputeSphere(idx);
+				}
+			});
+	}
+
+	void RenderProxies::ComputeSphere(size_t idx)
+	{
+		const auto wBV = utils::TransformBoundingVolume(m_Transforms[idx], { m_LocalCenters[idx], m_LodRadius[idx] });
+		m_X[idx] = wBV.center.x;
+		m_Y[idx] = wBV.center.y;
+		m_Z[idx] = wBV.center.z;
+		m_Radius[idx] = wBV.radius;
+	}
+
+	void RenderProxies::Resize(size_t count)
+	{
+		m_X.resize(count);
+		m_Y.resize(count);
+		m_Z.resize(count);
+		m_Radius.resize(count);
+		m_LodRadius.resize(count);
+		m_Transforms.resize(count);
+		m_MeshIds.resize(count);
+		m_MaterialIds.resize(count);
+		m_Lods.resize(count);
+		m_LocalCenters.resize(count);
+		m_Entities.resize(count);
+		m_Parents.resize(count);
+		m_NextSibling.resize(count);
+		m_PrevSibling.resize(count);
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "backend/graphics/Graphics.h"
+#include "Utils/FrustumCullKernels.h"
+#include "Utils/NonCopyable.h"
+#include <memory>
+#include <vector>
+
+namespace prl { class JobSystem; }
+
+namespace imp
+{
+	// Flat copy of everything rendering needs from the renderables, so hot loops walk arrays instead of going
+	// child -> ChildComponent -> parent -> Transform through the registry for every object. A proxy per renderable
+	// (child entity with ChildComponent, Mesh and Material), kept in sync by registry observers and signals:
+	// - renderables joining the group are appended,
+	// - removed ones are swap-removed, the last proxy takes their index,
+	// - patched or replaced Mesh, Material, ChildComponent or parent Transform only update their proxies.
+	// Indices don't change otherwise. Transforms changed in place without the registry knowing won't be picked up.
+	class RenderProxies : NonCopyable
+	{
+	public:
+		static constexpr uint32_t kInvalidProxy = ~0u;
+		static constexpr uint8_t kNoLod = 0xFF;
+
+		struct Stats
+		{
+			double rebuildTime;			// ms, last full rebuild
+			double updateTime;			// ms, last incremental update
+			uint32_t updatedProxies;	// added, moved or changed in the last update
+			uint32_t addedProxies;
+			uint32_t removedProxies;
+		};
+
+		RenderProxies();
+		~RenderProxies();
+
+		// Starts listening to registry changes and marks for a full rebuild
+		void Connect(entt::registry& registry);
+		void Disconnect();
+		bool IsConnected() const { return m_Registry != nullptr; }
+
+		// Applies whatever changed since the last call
+		void Update(const Graphics& gfx, prl::JobSystem& jobSystem);
+
+		size_t GetCount() const { return m_Transforms.size(); }
+
+		// hot, what culling and draw data go through
+		utils::SphereStreamSoA GetSpheres() const { return { m_X.data(), m_Y.data(), m_Z.data(), m_Radius.data() }; }
+		// world space, xyz center, w radius
+		glm::vec4 GetSphere(size_t idx) const { return glm::vec4(m_X[idx], m_Y[idx], m_Z[idx], m_Radius[idx]); }
+		// model space radius, against the world space one it's the scale lod errors get projected with
+		float GetLodRadius(size_t idx) const { return m_LodRadius[idx]; }
+		const glm::mat4& GetTransform(size_t idx) const { return m_Transforms[idx]; }
+		uint32_t GetMeshId(size_t idx) const { return m_MeshIds[idx]; }
+		uint32_t GetMaterialId(size_t idx) const { return m_MaterialIds[idx]; }
+		// lod the proxy was last drawn with by CPU culling, kNoLod if it never was
+		uint8_t GetLod(size_t idx) const { return m_Lods[idx]; }
+		void SetLod(size_t idx, uint8_t lod) { m_Lods[idx] = lod; }
+
+		// cold
+		entt::entity GetEntity(size_t idx) const { return m_Entities[idx]; }
+		uint32_t GetProxyIndex(entt::entity entity) const;
+
+		// Bumped by every Update that changed something. Whoever mirrors proxies can use the changes below when they've
+		// seen version - 1, otherwise they missed some and have to take everything.
+		uint64_t GetVersion() const { return m_Version; }
+		// last change rebuilt everything
+		bool WasRebuilt() const { return m_Rebuilt; }
+		// sorted indices of proxies that changed in the last update, including appended ones and ones another proxy
+		// was moved into. Empty after a rebuild
+		const std::vector<uint32_t>& GetChangedIndices() const { return m_ChangedIndices; }
+		// subset of the above whose mesh changed, draw commands only need these
+		const std::vector<uint32_t>& GetChangedMeshIndices() const { return m_ChangedMeshIndices; }
+
+		const Stats& GetStats() const { return m_Stats; }
+
+	private:
+		void OnRenderableRemoved(entt::registry& registry, entt::entity entity);
+
+		void Rebuild(const Graphics& gfx, prl::JobSystem& jobSystem);
+		void Add(const std::vector<entt::entity>& entities, const Graphics& gfx, prl::JobSystem& jobSystem);
+		void Remove(uint32_t idx);
+		void MoveProxy(uint32_t src, uint32_t dst);
+		void SetMesh(uint32_t idx, const Comp::Mesh& mesh, const Graphics& gfx);
+		void LinkToParent(uint32_t idx);
+		void UnlinkFromParent(uint32_t idx);
+		void Refresh(uint32_t first, prl::JobSystem& jobSystem);
+		void ComputeSphere(size_t idx);
+		void Resize(size_t count);
+
+		entt::registry* m_Registry;
+		bool m_NeedsRebuild;
+		// renderables that joined the group, whose components or parent Transform changed and that were removed
+		std::unique_ptr<entt::observer> m_NewRenderables;
+		std::unique_ptr<entt::observer> m_ChangedRenderables;
+		std::unique_ptr<entt::observer> m_ChangedTransforms;
+		std::vector<entt::entity> m_RemovedRenderables;
+		std::vector<entt::entity> m_Scratch;
+
+		// hot
+		std::vector<float> m_X;
+		std::vector<float> m_Y;
+		std::vector<float> m_Z;
+		std::vector<float> m_Radius;
+		std::vector<float> m_LodRadius;
+		std::vector<glm::mat4> m_Transforms;
+		std::vector<uint32_t> m_MeshIds;
+		std::vector<uint32_t> m_MaterialIds;
+		std::vector<uint8_t> m_Lods;
+
+		// cold
+		std::vector<glm::vec3> m_LocalCenters;
+		std::vector<entt::entity> m_Entities;
+		std::vector<entt::entity> m_Parents;
+		// proxies of the same parent are a linked list, so a changed Transform finds them
+		std::vector<uint32_t> m_NextSibling;
+		std::vector<uint32_t> m_PrevSibling;
+		// by entity index
+		std::vector<uint32_t> m_ProxyOfEntity;
+		std::vector<uint32_t> m_FirstChildOfParent;
+
+		uint64_t m_Version;
+		bool m_Rebuilt;
+		std::vector<uint32_t> m_ChangedIndices;
+		std::vector<uint32_t> m_ChangedMeshIndices;
+
+		Stats m_Stats;
+	};
+}
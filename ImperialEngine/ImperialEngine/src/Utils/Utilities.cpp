@@ -1,5 +1,15 @@
 #include "Utilities.h"
 #include <fstream>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 std::vector<std::filesystem::path> OS::GetAllFileNamesInDirectory(const std::string& dir)
 {
@@ -7,7 +17,8 @@ std::vector<std::filesystem::path> OS::GetAllFileNamesInDirectory(const std::str
 	if (std::filesystem::exists(dir))
 	{
 		for (const auto& entry : std::filesystem::directory_iterator(dir))
-			filePaths.emplace_back(entry.path());
+			if (entry.is_regular_file())
+				filePaths.emplace_back(entry.path());
 	}
 
 	return filePaths;
@@ -31,3 +42,70 @@ const std::shared_ptr<std::string> OS::ReadFileContents(const std::string& path)
 
 	return str;
 }
+
+OS::MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool OS::MappedFile::Open(const std::filesystem::path& path)
+{
+	Close();
+#if defined(_WIN32)
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!data)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_File = file;
+	m_Mapping = mapping;
+	m_Data = static_cast<const uint8_t*>(data);
+	m_Size = static_cast<size_t>(size.QuadPart);
+#else
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	void* data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps the file alive on its own
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	m_Data = static_cast<const uint8_t*>(data);
+	m_Size = static_cast<size_t>(st.st_size);
+#endif
+	return true;
+}
+
+void OS::MappedFile::Close()
+{
+	if (!m_Data)
+		return;
+#if defined(_WIN32)
+	UnmapViewOfFile(m_Data);
+	CloseHandle(m_Mapping);
+	CloseHandle(m_File);
+	m_File = nullptr;
+	m_Mapping = nullptr;
+#else
+	munmap(const_cast<uint8_t*>(m_Data), m_Size);
+#endif
+	m_Data = nullptr;
+	m_Size = 0;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "Utils/NonCopyable.h"
 #include <vector>
 #include <string>
 #include <filesystem>
@@ -7,4 +8,27 @@ namespace OS
 {
 	std::vector<std::filesystem::path> GetAllFileNamesInDirectory(const std::string& dir);
 	const std::shared_ptr<std::string> ReadFileContents(const std::string& path);
-}
\ No newline at end of file
+
+	// Read only view of a whole file, the OS pages it in on first touch
+	class MappedFile : NonCopyable
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		bool Open(const std::filesystem::path& path);
+		void Close();
+
+		const uint8_t* GetData() const { return m_Data; }
+		size_t GetSize() const { return m_Size; }
+		bool IsOpen() const { return m_Data != nullptr; }
+
+	private:
+		const uint8_t* m_Data = nullptr;
+		size_t m_Size = 0;
+#if defined(_WIN32)
+		void* m_File = nullptr;
+		void* m_Mapping = nullptr;
+#endif
+	};
+}
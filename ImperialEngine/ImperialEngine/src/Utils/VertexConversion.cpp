@@ -0,0 +1,222 @@
+#include "VertexConversion.h"
+#include "Utils/SimpleTimer.h"
+#include "MESHOPTIMIZER/meshoptimizer.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// SSE2 is always there on x64, no need to check the cpu
+#if defined(_M_X64) || defined(__x86_64__)
+#define IMP_SSE2 1
+#include <emmintrin.h>
+#else
+#define IMP_SSE2 0
+#endif
+
+namespace imp
+{
+	namespace utils
+	{
+		// Strided sources get gathered into blocks this big so the conversion itself runs on packed floats
+		static constexpr size_t kBlockSize = 256;
+
+#if IMP_SSE2
+		// meshopt_quantizeHalf on 4 lanes, sign extended so packing them to 16 bits doesn't saturate
+		static __m128i QuantizeHalf4(__m128 v)
+		{
+			const __m128i ui = _mm_castps_si128(v);
+			const __m128i s = _mm_and_si128(_mm_srli_epi32(ui, 16), _mm_set1_epi32(0x8000));
+			const __m128i em = _mm_and_si128(ui, _mm_set1_epi32(0x7fffffff));
+
+			__m128i h = _mm_srai_epi32(_mm_add_epi32(em, _mm_set1_epi32(-(112 << 23) + (1 << 12))), 13);
+			h = _mm_andnot_si128(_mm_cmplt_epi32(em, _mm_set1_epi32(113 << 23)), h);
+			const __m128i overflow = _mm_cmpgt_epi32(em, _mm_set1_epi32((143 << 23) - 1));
+			h = _mm_or_si128(_mm_andnot_si128(overflow, h), _mm_and_si128(overflow, _mm_set1_epi32(0x7c00)));
+			const __m128i nan = _mm_cmpgt_epi32(em, _mm_set1_epi32(255 << 23));
+			h = _mm_or_si128(_mm_andnot_si128(nan, h), _mm_and_si128(nan, _mm_set1_epi32(0x7e00)));
+
+			return _mm_srai_epi32(_mm_slli_epi32(_mm_or_si128(s, h), 16), 16);
+		}
+#endif
+
+		void QuantizeHalfs(const float* src, uint16_t* dst, size_t count)
+		{
+			size_t i = 0;
+#if IMP_SSE2
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m128i lo = QuantizeHalf4(_mm_loadu_ps(src + i));
+				const __m128i hi = QuantizeHalf4(_mm_loadu_ps(src + i + 4));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+			}
+#endif
+			for (; i < count; i++)
+				dst[i] = meshopt_quantizeHalf(src[i]);
+		}
+
+		void QuantizeHalfsStrided(StridedView src, uint8_t* dst, size_t dstStride, size_t count, uint32_t components)
+		{
+			assert(components <= 4);
+			const size_t floatSize = sizeof(float) * components;
+			const size_t halfSize = sizeof(uint16_t) * components;
+			float floats[kBlockSize * 4];
+			uint16_t halfs[kBlockSize * 4];
+			for (size_t begin = 0; begin < count; begin += kBlockSize)
+			{
+				const size_t blockCount = std::min(kBlockSize, count - begin);
+				CopyStrided({ src.data + begin * src.stride, src.stride }, reinterpret_cast<uint8_t*>(floats), floatSize, blockCount, floatSize);
+				QuantizeHalfs(floats, halfs, blockCount * components);
+				CopyStrided({ reinterpret_cast<const uint8_t*>(halfs), halfSize }, dst + begin * dstStride, dstStride, blockCount, halfSize);
+			}
+		}
+
+		void CopyStrided(StridedView src, uint8_t* dst, size_t dstStride, size_t count, size_t elementSize)
+		{
+			if (src.stride == elementSize && dstStride == elementSize)
+			{
+				std::memcpy(dst, src.data, count * elementSize);
+				return;
+			}
+
+			for (size_t i = 0; i < count; i++)
+				std::memcpy(dst + i * dstStride, src.data + i * src.stride, elementSize);
+		}
+
+		template<typename T>
+		static void WidenIndices(const uint8_t* src, uint32_t* dst, size_t count)
+		{
+			// glTF only aligns accessors to their component size, read through memcpy
+			for (size_t i = 0; i < count; i++)
+			{
+				T index;
+				std::memcpy(&index, src + i * sizeof(T), sizeof(T));
+				dst[i] = index;
+			}
+		}
+
+		void WidenIndices(const uint8_t* src, uint32_t indexSize, uint32_t* dst, size_t count)
+		{
+			switch (indexSize)
+			{
+			case sizeof(uint32_t): std::memcpy(dst, src, count * sizeof(uint32_t)); break;
+			case sizeof(uint16_t): WidenIndices<uint16_t>(src, dst, count); break;
+			case sizeof(uint8_t): WidenIndices<uint8_t>(src, dst, count); break;
+			default: assert(false);
+			}
+		}
+
+		void ConvertVertices(StridedView positions, StridedView normals, StridedView texCoords, Vertex* dst, size_t count)
+		{
+			// nw and anything missing stay 0
+			std::memset(dst, 0, count * sizeof(Vertex));
+			auto* bytes = reinterpret_cast<uint8_t*>(dst);
+			CopyStrided(positions, bytes + offsetof(Vertex, vx), sizeof(Vertex), count, sizeof(float) * 3);
+			if (normals.data)
+				QuantizeHalfsStrided(normals, bytes + offsetof(Vertex, nx), sizeof(Vertex), count, 3);
+			if (texCoords.data)
+				QuantizeHalfsStrided(texCoords, bytes + offsetof(Vertex, tu), sizeof(Vertex), count, 2);
+		}
+
+		// How LoadGLTFNode converted vertices before
+		static void ConvertVerticesPerVertex(const float* positionBuffer, const float* normalsBuffer, const float* texCoordsBuffer, size_t vertexCount, std::vector<Vertex>& vertices)
+		{
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				Vertex vertex;
+				std::memcpy(&vertex.vx, &positionBuffer[i * 3], sizeof(float) * 3);
+
+				vertex.nx = meshopt_quantizeHalf(normalsBuffer[i * 3]);
+				vertex.ny = meshopt_quantizeHalf(normalsBuffer[i * 3 + 1]);
+				vertex.nz = meshopt_quantizeHalf(normalsBuffer[i * 3 + 2]);
+				vertex.nw = 0;
+
+				vertex.tu = meshopt_quantizeHalf(texCoordsBuffer[i * 2]);
+				vertex.tv = meshopt_quantizeHalf(texCoordsBuffer[i * 2 + 1]);
+
+				vertices.push_back(vertex);
+			}
+		}
+
+		void RunVertexConversionBenchmark()
+		{
+			static constexpr size_t kVertexCount = 1 << 20;
+			static constexpr uint32_t kIterations = 10;
+
+			// the values meshopt_quantizeHalf has branches for, then random ones
+			std::vector<float> values =
+			{
+				0.0f, -0.0f, 1.0f, -1.0f, 65504.0f, 65520.0f, 1e10f, -1e10f, 6.1e-5f, 6.0e-8f, 1e-10f, -1e-10f,
+				std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::denorm_min(),
+				1.0f + 1.0f / 2048.0f, 1.0f + 3.0f / 2048.0f,
+			};
+			uint32_t seed = 12345;
+			const auto rand01 = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / 16777216.0f); };
+			while (values.size() < kVertexCount * 8)
+				values.push_back((rand01() * 2.0f - 1.0f) * std::pow(2.0f, rand01() * 40.0f - 20.0f));
+
+			// separate streams like the old loop wants and the same data interleaved as pos, normal, uv with padding like
+			// a glTF buffer view with a byteStride
+			static constexpr size_t kInterleavedStride = 40;
+			std::vector<float> positions(kVertexCount * 3), normals(kVertexCount * 3), texCoords(kVertexCount * 2);
+			std::vector<uint8_t> interleaved(kVertexCount * kInterleavedStride);
+			for (size_t i = 0; i < kVertexCount; i++)
+			{
+				std::memcpy(&positions[i * 3], &values[i * 8], sizeof(float) * 3);
+				std::memcpy(&normals[i * 3], &values[i * 8 + 3], sizeof(float) * 3);
+				std::memcpy(&texCoords[i * 2], &values[i * 8 + 6], sizeof(float) * 2);
+				std::memcpy(&interleaved[i * kInterleavedStride], &values[i * 8], sizeof(float) * 8);
+			}
+
+			SimpleTimer timer;
+			std::vector<Vertex> reference;
+			timer.start();
+			for (uint32_t it = 0; it < kIterations; it++)
+			{
+				reference.clear();
+				reference.shrink_to_fit();
+				ConvertVerticesPerVertex(positions.data(), normals.data(), texCoords.data(), kVertexCount, reference);
+			}
+			timer.stop();
+			const double referenceMs = timer.miliseconds() / kIterations;
+
+			struct Layout
+			{
+				const char* name;
+				StridedView positions;
+				StridedView normals;
+				StridedView texCoords;
+			};
+			const Layout layouts[] =
+			{
+				{ "packed", { reinterpret_cast<const uint8_t*>(positions.data()), 12 }, { reinterpret_cast<const uint8_t*>(normals.data()), 12 }, { reinterpret_cast<const uint8_t*>(texCoords.data()), 8 } },
+				{ "interleaved", { interleaved.data(), kInterleavedStride }, { interleaved.data() + 12, kInterleavedStride }, { interleaved.data() + 24, kInterleavedStride } },
+			};
+
+			printf("[Vertex Conversion Benchmark] %zu vertices, avg of %u iterations, simd %s\n", kVertexCount, kIterations, IMP_SSE2 ? "sse2" : "none");
+			printf("[Vertex Conversion Benchmark] %-12s | %10s | %8s | %s\n", "layout", "time ms", "speedup", "matches");
+			printf("[Vertex Conversion Benchmark] %-12s | %10.3f | %7.2fx | %s\n", "per vertex", referenceMs, 1.0, "-");
+			for (const auto& layout : layouts)
+			{
+				std::vector<Vertex> vertices;
+				timer.start();
+				for (uint32_t it = 0; it < kIterations; it++)
+				{
+					vertices.clear();
+					vertices.shrink_to_fit();
+					vertices.resize(kVertexCount);
+					ConvertVertices(layout.positions, layout.normals, layout.texCoords, vertices.data(), kVertexCount);
+				}
+				timer.stop();
+
+				const double ms = timer.miliseconds() / kIterations;
+				const bool matches = std::memcmp(vertices.data(), reference.data(), kVertexCount * sizeof(Vertex)) == 0;
+				printf("[Vertex Conversion Benchmark] %-12s | %10.3f | %7.2fx | %s\n", layout.name, ms, referenceMs / ms, matches ? "yes" : "NO");
+			}
+		}
+	}
+}
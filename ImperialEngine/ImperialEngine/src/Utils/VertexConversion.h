@@ -0,0 +1,33 @@
+#pragma once
+#include "backend/VariousTypeDefinitions.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace imp
+{
+	namespace utils
+	{
+		// Elements stride bytes apart, a glTF accessor or one attribute of interleaved vertices
+		struct StridedView
+		{
+			const uint8_t* data;
+			size_t stride;
+		};
+
+		// meshopt_quantizeHalf of every float, bit for bit the same. SSE2 does 4 at a time on x64
+		void QuantizeHalfs(const float* src, uint16_t* dst, size_t count);
+		// components floats of every element to halves
+		void QuantizeHalfsStrided(StridedView src, uint8_t* dst, size_t dstStride, size_t count, uint32_t components);
+		// elementSize bytes of every element, one memcpy when both sides are tightly packed
+		void CopyStrided(StridedView src, uint8_t* dst, size_t dstStride, size_t count, size_t elementSize);
+		// Indices of 1, 2 or 4 bytes to 32 bit
+		void WidenIndices(const uint8_t* src, uint32_t indexSize, uint32_t* dst, size_t count);
+
+		// Fills dst from float position, normal and uv streams. normals and texCoords can have null data, those come out 0
+		void ConvertVertices(StridedView positions, StridedView normals, StridedView texCoords, Vertex* dst, size_t count);
+
+		// Times ConvertVertices against the per vertex loop the glTF importer used before on 1M interleaved vertices and
+		// checks the output is exactly the same. Run with 'ImperialEngine.exe --benchmark-vertex-conversion'
+		void RunVertexConversionBenchmark();
+	}
+}
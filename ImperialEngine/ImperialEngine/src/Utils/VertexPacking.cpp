@@ -0,0 +1,202 @@
+#include "VertexPacking.h"
+#include "Utils/SimpleTimer.h"
+#include "MESHOPTIMIZER/meshoptimizer.h"
+#include <GLM/geometric.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace imp
+{
+	namespace utils
+	{
+		static constexpr float kUnorm16Max = 65535.0f;
+
+		static float HalfToFloat(uint16_t h)
+		{
+			const uint32_t s = static_cast<uint32_t>(h & 0x8000) << 16;
+			const uint32_t em = h & 0x7fff;
+
+			// rebias the exponent, denormals are just a small number and inf and nan keep an all ones exponent
+			uint32_t r = (em + (112 << 10)) << 13;
+			if (em < (1 << 10))
+			{
+				const float f = static_cast<float>(em) * (1.0f / 16777216.0f);
+				std::memcpy(&r, &f, sizeof(r));
+			}
+			else if (em >= (31 << 10))
+				r += 112 << 23;
+
+			r |= s;
+			float f;
+			std::memcpy(&f, &r, sizeof(f));
+			return f;
+		}
+
+		static uint16_t EncodeOctahedral(glm::vec3 n)
+		{
+			const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+			if (l1 == 0.0f)
+				return 0;
+
+			float u = n.x / l1;
+			float v = n.y / l1;
+			// lower hemisphere folds over the diagonals
+			if (n.z < 0.0f)
+			{
+				const float fu = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+				v = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+				u = fu;
+			}
+
+			const auto snorm8 = [](float x) { return static_cast<uint8_t>(static_cast<int8_t>(std::round(std::clamp(x, -1.0f, 1.0f) * 127.0f))); };
+			return static_cast<uint16_t>(snorm8(u) | (snorm8(v) << 8));
+		}
+
+		VertexQuantization ComputeVertexQuantization(std::span<const Vertex> vertices)
+		{
+			glm::vec3 min(0.0f), max(0.0f);
+			if (vertices.size())
+				min = max = glm::vec3(vertices[0].vx, vertices[0].vy, vertices[0].vz);
+			for (const auto& v : vertices)
+			{
+				const glm::vec3 p(v.vx, v.vy, v.vz);
+				min = glm::min(min, p);
+				max = glm::max(max, p);
+			}
+
+			VertexQuantization quantization;
+			quantization.positionOffset = glm::vec4(min, 0.0f);
+			quantization.positionScale = glm::vec4(max - min, 0.0f);
+			return quantization;
+		}
+
+		void PackVertices(std::span<const Vertex> src, const VertexQuantization& quantization, PackedVertex* dst)
+		{
+			const glm::vec3 offset(quantization.positionOffset);
+			const glm::vec3 scale(quantization.positionScale);
+			// flat axes all go to 0
+			const glm::vec3 invScale(scale.x > 0.0f ? kUnorm16Max / scale.x : 0.0f, scale.y > 0.0f ? kUnorm16Max / scale.y : 0.0f, scale.z > 0.0f ? kUnorm16Max / scale.z : 0.0f);
+			const auto unorm16 = [](float x) { return static_cast<uint16_t>(std::clamp(x, 0.0f, kUnorm16Max) + 0.5f); };
+
+			for (size_t i = 0; i < src.size(); i++)
+			{
+				const auto& v = src[i];
+				const glm::vec3 q = (glm::vec3(v.vx, v.vy, v.vz) - offset) * invScale;
+				auto& p = dst[i];
+				p.px = unorm16(q.x);
+				p.py = unorm16(q.y);
+				p.pz = unorm16(q.z);
+				p.n = EncodeOctahedral(glm::vec3(HalfToFloat(v.nx), HalfToFloat(v.ny), HalfToFloat(v.nz)));
+				p.tu = v.tu;
+				p.tv = v.tv;
+			}
+		}
+
+		glm::vec3 UnpackPosition(const PackedVertex& vertex, const VertexQuantization& quantization)
+		{
+			const glm::vec3 unorm = glm::vec3(vertex.px, vertex.py, vertex.pz) / kUnorm16Max;
+			return glm::vec3(quantization.positionOffset) + unorm * glm::vec3(quantization.positionScale);
+		}
+
+		glm::vec3 UnpackNormal(const PackedVertex& vertex)
+		{
+			const glm::vec2 e = glm::clamp(glm::vec2(static_cast<int8_t>(vertex.n & 0xff), static_cast<int8_t>(vertex.n >> 8)) / 127.0f, -1.0f, 1.0f);
+			glm::vec3 n(e, 1.0f - std::abs(e.x) - std::abs(e.y));
+			const float t = std::max(-n.z, 0.0f);
+			n.x += n.x >= 0.0f ? -t : t;
+			n.y += n.y >= 0.0f ? -t : t;
+			return glm::normalize(n);
+		}
+
+		void RunVertexFormatBenchmark()
+		{
+			static constexpr size_t kVertexCount = 4 << 20;
+			static constexpr uint32_t kIterations = 5;
+
+			// Sponza sized bounds, random unit normals
+			const glm::vec3 boundsMin(-1900.0f, -130.0f, -1200.0f);
+			const glm::vec3 boundsExtent(3800.0f, 1550.0f, 2350.0f);
+			uint32_t seed = 12345;
+			const auto rand01 = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / 16777216.0f); };
+			std::vector<Vertex> vertices(kVertexCount);
+			for (auto& v : vertices)
+			{
+				const glm::vec3 p = boundsMin + glm::vec3(rand01(), rand01(), rand01()) * boundsExtent;
+				glm::vec3 n;
+				do
+					n = glm::vec3(rand01(), rand01(), rand01()) * 2.0f - 1.0f;
+				while (glm::dot(n, n) < 1e-4f || glm::dot(n, n) > 1.0f);
+				n = glm::normalize(n);
+
+				v.vx = p.x;
+				v.vy = p.y;
+				v.vz = p.z;
+				v.nx = static_cast<uint16_t>(meshopt_quantizeHalf(n.x));
+				v.ny = static_cast<uint16_t>(meshopt_quantizeHalf(n.y));
+				v.nz = static_cast<uint16_t>(meshopt_quantizeHalf(n.z));
+				v.nw = 0;
+				v.tu = static_cast<uint16_t>(meshopt_quantizeHalf(rand01()));
+				v.tv = static_cast<uint16_t>(meshopt_quantizeHalf(rand01()));
+			}
+
+			SimpleTimer timer;
+			const VertexQuantization quantization = ComputeVertexQuantization(vertices);
+			std::vector<PackedVertex> packed(kVertexCount);
+			timer.start();
+			PackVertices(vertices, quantization, packed.data());
+			timer.stop();
+			const double packMs = timer.miliseconds();
+
+			double maxPositionError = 0.0, maxNormalDegrees = 0.0, sumNormalDegrees = 0.0;
+			for (size_t i = 0; i < kVertexCount; i++)
+			{
+				const auto& v = vertices[i];
+				const glm::vec3 d = glm::abs(UnpackPosition(packed[i], quantization) - glm::vec3(v.vx, v.vy, v.vz));
+				maxPositionError = std::max(maxPositionError, static_cast<double>(std::max(d.x, std::max(d.y, d.z))));
+
+				const glm::vec3 n = glm::normalize(glm::vec3(HalfToFloat(v.nx), HalfToFloat(v.ny), HalfToFloat(v.nz)));
+				const double degrees = std::acos(std::clamp(static_cast<double>(glm::dot(n, UnpackNormal(packed[i]))), -1.0, 1.0)) * 180.0 / 3.14159265358979;
+				maxNormalDegrees = std::max(maxNormalDegrees, degrees);
+				sumNormalDegrees += degrees;
+			}
+
+			// what a vertex shader does with a vertex, the transform keeps the reads from being thrown away
+			const glm::mat4 transform(1.0f);
+			glm::vec4 sink(0.0f);
+			timer.start();
+			for (uint32_t it = 0; it < kIterations; it++)
+				for (const auto& v : vertices)
+				{
+					const glm::vec3 n(HalfToFloat(v.nx), HalfToFloat(v.ny), HalfToFloat(v.nz));
+					sink += transform * glm::vec4(v.vx, v.vy, v.vz, 1.0f) + glm::vec4(n, 0.0f);
+				}
+			timer.stop();
+			const double floatMs = timer.miliseconds() / kIterations;
+
+			timer.start();
+			for (uint32_t it = 0; it < kIterations; it++)
+				for (const auto& v : packed)
+					sink += transform * glm::vec4(UnpackPosition(v, quantization), 1.0f) + glm::vec4(UnpackNormal(v), 0.0f);
+			timer.stop();
+			const double packedMs = timer.miliseconds() / kIterations;
+
+			const double mb = 1.0 / (1024.0 * 1024.0);
+			const double floatBytes = static_cast<double>(kVertexCount * sizeof(Vertex));
+			const double packedBytes = static_cast<double>(kVertexCount * sizeof(PackedVertex));
+			const float largestExtent = std::max(boundsExtent.x, std::max(boundsExtent.y, boundsExtent.z));
+			printf("[Vertex Format Benchmark] %zu vertices in %.0f x %.0f x %.0f bounds, packed in %.2f ms, compact vertices %s in this build\n",
+				kVertexCount, boundsExtent.x, boundsExtent.y, boundsExtent.z, packMs, COMPACT_VERTICES ? "on" : "off");
+			printf("[Vertex Format Benchmark] %-8s | %5s | %9s | %9s | %11s | %9s\n", "format", "bytes", "buffer MB", "pass ms", "M verts/s", "read GB/s");
+			printf("[Vertex Format Benchmark] %-8s | %5zu | %9.1f | %9.2f | %11.1f | %9.2f\n", "Vertex", sizeof(Vertex), floatBytes * mb, floatMs, kVertexCount / (floatMs * 1e3), floatBytes / (floatMs * 1e6));
+			printf("[Vertex Format Benchmark] %-8s | %5zu | %9.1f | %9.2f | %11.1f | %9.2f\n", "Packed", sizeof(PackedVertex), packedBytes * mb, packedMs, kVertexCount / (packedMs * 1e3), packedBytes / (packedMs * 1e6));
+			// a CPU core decodes slower than it reads, GPUs have the ALU to spare and are bound by the fetch instead
+			printf("[Vertex Format Benchmark] vertex buffer and vertex fetch traffic %.0f%% smaller, %.1f MB less read per pass\n", 100.0 * (1.0 - packedBytes / floatBytes), (floatBytes - packedBytes) * mb);
+			printf("[Vertex Format Benchmark] max position error %.4f (%.6f%% of the largest extent, half a step is %.4f)\n",
+				maxPositionError, 100.0 * maxPositionError / largestExtent, largestExtent / (2.0 * kUnorm16Max));
+			printf("[Vertex Format Benchmark] normal error max %.3f avg %.3f degrees (sink %.1f)\n", maxNormalDegrees, sumNormalDegrees / kVertexCount, sink.x + sink.y + sink.z);
+		}
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "backend/VariousTypeDefinitions.h"
+#include <span>
+
+namespace imp
+{
+	namespace utils
+	{
+		// Bounds of the positions, every axis gets the full 16 bits no matter how flat the mesh is
+		VertexQuantization ComputeVertexQuantization(std::span<const Vertex> vertices);
+		// Vertex to PackedVertex, positions rounded to the nearest step in the quantization's bounds
+		void PackVertices(std::span<const Vertex> src, const VertexQuantization& quantization, PackedVertex* dst);
+		// What the shaders' vertex_position and vertex_normal give for a packed vertex
+		glm::vec3 UnpackPosition(const PackedVertex& vertex, const VertexQuantization& quantization);
+		glm::vec3 UnpackNormal(const PackedVertex& vertex);
+
+		// Packs a generated mesh as big as Sponza and reports the memory it saves, the worst position and normal error,
+		// and how fast a vertex shader like pass reads both formats on the CPU, cold and out of cache.
+		// Headless, run with 'ImperialEngine.exe --benchmark-vertex-format'
+		void RunVertexFormatBenchmark();
+	}
+}
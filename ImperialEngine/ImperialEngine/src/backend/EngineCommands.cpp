@@ -1,86 +1,115 @@
-#pragma once
-#include "frontend/Engine.h"
-
-namespace imp
-{
-	void Engine::Cmd_InitGraphics(std::shared_ptr<void> rsc)
-	{
-		auto re = (Window*)rsc.get();
-		m_Gfx.Initialize(m_EngineSettings.gfxSettings, re);
-		// after initing graphics we can now wait for first update
-		m_SyncPoint->arrive_and_wait();
-	}
-
-	void Engine::Cmd_StartFrame(std::shared_ptr<void> rsc)
-	{
-		m_Gfx.StartFrame();
-	}
-
-	void Engine::Cmd_RenderCameras(std::shared_ptr<void> rsc)
-	{
-		m_Gfx.RenderCameras();
-	}
-
-	void Engine::Cmd_EndFrame(std::shared_ptr<void> rsc)
-	{
-		m_Gfx.EndFrame();
-	}
-	void Engine::Cmd_SyncRenderThread(std::shared_ptr<void> rsc)
+#pragma once
+#include "frontend/Engine.h"
+#include "Utils/MeshProcessing.h"
+
+namespace imp
+{
+	void Engine::Cmd_InitGraphics(Window& window)
 	{
+		m_Gfx.Initialize(m_EngineSettings.gfxSettings, &window, *m_JobSystem);
+		// after initing graphics we can now wait for first update
 		m_SyncPoint->arrive_and_wait();
-	}
-	void Engine::Cmd_RenderImGUI(std::shared_ptr<void> rsc)
+	}
+
+	void Engine::Cmd_ApplyRenderSnapshot(RenderSnapshot* snapshot)
+	{
+		m_Gfx.ApplyRenderSnapshot(*snapshot);
+#if !BENCHMARK_MODE
+		snapshot->renderStats = m_Gfx.GetFrameStats();
+#endif
+		// hand the slot back to main thread
+		snapshot->timesConsumed.fetch_add(1, std::memory_order_release);
+		snapshot->timesConsumed.notify_one();
+	}
+
+	void Engine::Cmd_StartFrame()
+	{
+		m_Gfx.StartFrame();
+	}
+
+	void Engine::Cmd_RenderCameras()
+	{
+		m_Gfx.RenderCameras();
+	}
+
+	void Engine::Cmd_EndFrame()
+	{
+		m_Gfx.EndFrame();
+	}
+	void Engine::Cmd_SyncRenderThread()
+	{
+		m_SyncPoint->arrive_and_wait();
+	}
+	void Engine::Cmd_RenderImGUI()
 	{
 		m_Gfx.RenderImGUI();
+#if !BENCHMARK_MODE
+		m_ImGuiFramesRendered.fetch_add(1, std::memory_order_release);
+		m_ImGuiFramesRendered.notify_one();
+#endif
 	}
-	void Engine::Cmd_UploadMeshes(std::shared_ptr<void> rsc)
+	void Engine::Cmd_UploadMeshes(std::vector<MeshCreationRequest>& reqs)
 	{
-		auto re = (std::vector<imp::MeshCreationRequest>*)rsc.get();
 		// we have place where to add index and vertex components
 		// we know vert and idx data
 
-		m_Gfx.CreateAndUploadMeshes(*re);
-	}
-
-	void Engine::Cmd_UploadMaterials(std::shared_ptr<void> rsc)
-	{
-		auto re = (std::vector<imp::MaterialCreationRequest>*)rsc.get();
-		m_Gfx.CreateAndUploadMaterials(*re);
-	}
-
-	void Engine::Cmd_UploadComputePrograms(std::shared_ptr<void> rsc)
-	{
-		auto re = (std::vector<imp::ComputeProgramCreationRequest>*)rsc.get();
-		m_Gfx.CreateComputePrograms(*re);
-	}
-
-	void Engine::Cmd_ChangeRenderMode(std::shared_ptr<void> rsc)
-	{
-		// Changing settings should only happen at start of the frame.
-		// Later move this command to someplace else on main thread
-		auto* re = (EngineRenderMode*)rsc.get();
-		m_Gfx.GetGraphicsSettings().renderMode = *re;
-	}
-
-	void Engine::Cmd_UpdateDraws(std::shared_ptr<void> rsc)
-	{
-		m_Gfx.UpdateDrawCommands();
-	}
-
-	void Engine::Cmd_ShutDown(std::shared_ptr<void> rsc)
-	{
-		m_Worker->End();
-	}
-
-#if BENCHMARK_MODE
-	void Engine::Cmd_StartBenchmark(std::shared_ptr<void> rsc)
-	{
-		m_Gfx.StartBenchmark();
-	}
-
-	void Engine::Cmd_StopBenchmark(std::shared_ptr<void> rsc)
-	{
-		m_Gfx.StopBenchmark();
-	}
-#endif
+		if (m_BenchmarkMeshProcessing)
+			utils::RunMeshProcessingBenchmark(reqs, *m_JobSystem);
+
+		m_Gfx.CreateAndUploadMeshes(reqs);
+	}
+
+	void Engine::Cmd_UploadMaterials(std::vector<MaterialCreationRequest>& reqs)
+	{
+		m_Gfx.CreateAndUploadMaterials(reqs);
+	}
+
+	void Engine::Cmd_UploadComputePrograms(std::vector<ComputeProgramCreationRequest>& reqs)
+	{
+		m_Gfx.CreateComputePrograms(reqs);
+	}
+
+	void Engine::Cmd_ChangeRenderMode(EngineRenderMode newRenderMode)
+	{
+		// Changing settings should only happen at start of the frame.
+		// Later move this command to someplace else on main thread
+		m_Gfx.GetGraphicsSettings().renderMode = newRenderMode;
+	}
+
+	void Engine::Cmd_SetInstancing(bool enabled)
+	{
+		m_Gfx.GetGraphicsSettings().instancingEnabled = enabled;
+	}
+
+	void Engine::Cmd_SetGPUOcclusionCulling(bool enabled)
+	{
+		m_Gfx.GetGraphicsSettings().gpuOcclusionCullingEnabled = enabled;
+	}
+
+	void Engine::Cmd_SetLodSettings(EngineLodSettings settings)
+	{
+		m_Gfx.GetGraphicsSettings().lod = settings;
+	}
+
+	void Engine::Cmd_UpdateDraws()
+	{
+		m_Gfx.UpdateDrawCommands();
+	}
+
+	void Engine::Cmd_ShutDown()
+	{
+		m_Worker->End();
+	}
+
+#if BENCHMARK_MODE
+	void Engine::Cmd_StartBenchmark()
+	{
+		m_Gfx.StartBenchmark();
+	}
+
+	void Engine::Cmd_StopBenchmark()
+	{
+		m_Gfx.StopBenchmark();
+	}
+#endif
 }
\ No newline at end of file
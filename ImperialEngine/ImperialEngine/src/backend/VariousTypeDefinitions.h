@@ -2,12 +2,15 @@
 #include "extern/GLM/vec3.hpp"
 #include "extern/GLM/mat4x4.hpp"
 #include "Utils/EngineStaticConfig.h"
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <vector>
 
 namespace imp
 {
+	class ImpMeshFile;
+
 	inline constexpr uint32_t kMaxLODCount = LOD_ENABLED ? 4 : 1;
 	inline constexpr size_t kMaxMeshletVertices = MESHLET_MAX_VERTS;
 	inline constexpr size_t kMaxMeshletTriangles = MESHLET_MAX_PRIMS;
@@ -22,12 +25,14 @@ namespace imp
 	{
 		uint32_t indexCount;
 		uint32_t firstIndex;
+		float error;	// model space, see GenerateMeshLODS
 	};
 
 	struct ms_MeshLOD
 	{
 		uint32_t meshletBufferOffset;
 		uint32_t taskCount;
+		float error;
 	};
 
 	// TODO mesh: union
@@ -35,7 +40,7 @@ namespace imp
 	{
 		MeshLOD LODData[kMaxLODCount];
 #if !LOD_ENABLED
-		int32_t pad[2];
+		int32_t pad[1];
 #endif
 		BoundingVolumeSphere boundingVolume;
 		int32_t     vertexOffset;
@@ -45,11 +50,17 @@ namespace imp
 	{
 		ms_MeshLOD LODData[kMaxLODCount];
 #if !LOD_ENABLED
-		int32_t pad[2];
+		int32_t pad[1];
 #endif
 		BoundingVolumeSphere boundingVolume;
 		uint32_t firstTask;
 	};
+	// Must match the std430 MeshData and ms_MeshData in DescriptorSet1.h, boundingVolume starts on 16 bytes after the LODs.
+	// drawGen and ms_drawGen spir-v has the stride baked in, recompile the shaders when these change
+	static_assert(offsetof(MeshData, boundingVolume) == (sizeof(MeshLOD) * kMaxLODCount + 15) / 16 * 16);
+	static_assert(sizeof(MeshData) == (LOD_ENABLED ? 80 : 48));
+	static_assert(offsetof(ms_MeshData, boundingVolume) == (sizeof(ms_MeshLOD) * kMaxLODCount + 15) / 16 * 16);
+	static_assert(sizeof(ms_MeshData) == (LOD_ENABLED ? 80 : 48));
 
 	struct Vertex
 	{
@@ -58,6 +69,30 @@ namespace imp
 		uint16_t tu, tv;
 	};
 
+	// What the vertex buffer holds with COMPACT_VERTICES, half of Vertex. Positions are unorm16 in the mesh bounds,
+	// normals octahedral snorm8 with x in the low byte, uvs the same halves. utils::PackVertices makes these
+	struct PackedVertex
+	{
+		uint16_t px, py, pz;
+		uint16_t n;
+		uint16_t tu, tv;
+	};
+	static_assert(sizeof(PackedVertex) == 12);
+
+	// Takes a mesh's PackedVertex positions back to model space, offset + unorm * scale. Mesh bounds min and extents
+	struct VertexQuantization
+	{
+		glm::vec4 positionOffset;
+		glm::vec4 positionScale;
+	};
+
+	// Vertex layout of the vertex buffer, processing and .impmesh files always work with Vertex
+#if COMPACT_VERTICES
+	using GPUVertex = PackedVertex;
+#else
+	using GPUVertex = Vertex;
+#endif
+
 	struct alignas(16) DrawDataSingle
 	{
 		glm::mat4x4 Transform;
@@ -117,6 +152,12 @@ namespace imp
 		std::vector<Vertex> vertices;
 		std::vector<uint32_t> indices;
 		BoundingVolumeSphere boundingVolume;
+		// already processed mesh cookedMesh of a mapped .impmesh, vertices and indices stay empty then
+		std::shared_ptr<const ImpMeshFile> cookedFile;
+		uint32_t cookedMesh = 0;
+
+		// linked meshes (glTF meshes used by more nodes) only point to one that's already there
+		bool HasGeometry() const { return indices.size() || cookedFile; }
 	};
 
 	struct MaterialCreationRequest
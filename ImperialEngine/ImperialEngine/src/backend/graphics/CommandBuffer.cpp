@@ -29,6 +29,18 @@ void imp::CommandBuffer::Begin()
 	m_CurrentStage = kCBStageActive;
 }
 
+void imp::CommandBuffer::Begin(const VkCommandBufferInheritanceInfo& inheritance)
+{
+	VkCommandBufferBeginInfo beginInfo = kBeginInfo;
+	beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritance;
+	const auto res = vkBeginCommandBuffer(cmb, &beginInfo);
+	assert(res == VK_SUCCESS);
+
+	assert(m_CurrentStage == kCBStageNew);
+	m_CurrentStage = kCBStageActive;
+}
+
 imp::CommandBufferStage imp::CommandBuffer::GetCurrentStage() const
 {
 	return static_cast<CommandBufferStage>(m_CurrentStage);
@@ -17,6 +17,8 @@ namespace imp
 		CommandBuffer(VkCommandBuffer cb);
 
 		void Begin();
+		// secondary command buffer that continues the render pass in inheritance
+		void Begin(const VkCommandBufferInheritanceInfo& inheritance);
 		CommandBufferStage GetCurrentStage() const;
 		void End();
 		void ResetStageToNew();
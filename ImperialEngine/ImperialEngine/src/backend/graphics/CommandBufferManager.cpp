@@ -7,27 +7,40 @@
 namespace imp
 {
     CommandBufferManager::CommandBufferManager(PrimitivePool<Semaphore, SemaphoreFactory>& semaphorePool, PrimitivePool<Fence, FenceFactory>& fencePool)
-        : m_BufferingMode(), m_FrameClock(), m_IsNewFrame(true), m_GfxCommandPools(), m_CommandsBuffersToSubmit(), m_SemaphoresToWaitOnSubmit(), m_CurrentFence(), m_TransferCB(), m_QueueDependencies(), m_SemaphorePool(semaphorePool), m_FencePool(fencePool)
+        : m_BufferingMode(), m_FrameClock(), m_IsNewFrame(true), m_GfxCommandPools(), m_SecondaryCommandPools(), m_RecordingThreadCount(), m_CommandsBuffersToSubmit(), m_SemaphoresToWaitOnSubmit(), m_CurrentFence(), m_TransferCB(), m_QueueDependencies(), m_SemaphorePool(semaphorePool), m_FencePool(fencePool)
     {
     }
 
-    void CommandBufferManager::Initialize(VkDevice device, uint32_t familyIndices, EngineSwapchainImageCount imageCount)
+    static VkCommandPool CreateCommandPool(VkDevice device, uint32_t familyIndices)
+    {
+        VkCommandPoolCreateInfo poolInfo;
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = 0; // we're resetting whole pools so no need for reset flag bit.
+        poolInfo.queueFamilyIndex = familyIndices;
+        poolInfo.pNext = nullptr;
+
+        VkCommandPool pool;
+        VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &pool);
+        if (result != VK_SUCCESS)
+            throw std::runtime_error("Failed to create a command pool");
+        return pool;
+    }
+
+    void CommandBufferManager::Initialize(VkDevice device, uint32_t familyIndices, EngineSwapchainImageCount imageCount, uint32_t recordingThreadCount)
     {
         m_BufferingMode = static_cast<uint32_t>(imageCount);
+        m_RecordingThreadCount = recordingThreadCount;
+        m_SecondaryCommandPools.resize(imageCount);
         for (int i = 0; i < imageCount; i++)
         {
-            VkCommandPoolCreateInfo poolInfo;
-            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-            poolInfo.flags = 0; // we're resetting whole pools so no need for reset flag bit.
-            poolInfo.queueFamilyIndex = familyIndices;
-            poolInfo.pNext = nullptr;
-
-            VkCommandPool pool;
-            VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &pool);
-            if (result != VK_SUCCESS)
-                throw std::runtime_error("Failed to create a command pool");
-
-            m_GfxCommandPools.emplace_back(pool);
+            m_GfxCommandPools.emplace_back(CreateCommandPool(device, familyIndices));
+
+            // pools can't be used from more than one thread at a time, so every recording thread gets its own
+            for (uint32_t thread = 0; thread < recordingThreadCount; thread++)
+            {
+                auto& secondaryPool = m_SecondaryCommandPools[i].emplace_back(CreateCommandPool(device, familyIndices));
+                secondaryPool.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            }
         }
 
         // initial acquire
@@ -60,6 +73,9 @@ namespace imp
         if (m_IsNewFrame)
         {
             m_GfxCommandPools[m_FrameClock].Reset(device, m_SemaphorePool, m_FencePool);
+            // secondaries were executed by this frame's primaries, the wait above covers them too
+            for (auto& pool : m_SecondaryCommandPools[m_FrameClock])
+                pool.Reset(device, m_SemaphorePool, m_FencePool);
             m_IsNewFrame = false;
         }
     }
@@ -167,6 +183,27 @@ namespace imp
         return AquireCommandBuffers(device, 1)[0];
     }
 
+    std::vector<CommandBuffer> CommandBufferManager::AquireSecondaryCommandBuffers(VkDevice device, uint32_t count)
+    {
+        assert(!m_IsNewFrame);
+        assert(count <= m_RecordingThreadCount);
+        std::vector<CommandBuffer> buffers;
+        for (uint32_t thread = 0; thread < count; thread++)
+        {
+            auto& pool = m_SecondaryCommandPools[m_FrameClock][thread];
+            auto cbs = pool.AquireCommandBuffers(device, 1);
+            // nothing to wait on, they go back with the frame
+            pool.ReturnCommandBuffers(cbs, VK_NULL_HANDLE, VK_NULL_HANDLE);
+            buffers.push_back(cbs[0]);
+        }
+        return buffers;
+    }
+
+    uint32_t CommandBufferManager::GetRecordingThreadCount() const
+    {
+        return m_RecordingThreadCount;
+    }
+
     std::vector<VkSemaphore>& CommandBufferManager::GetCommandExecSemaphores()
     {
         return m_GfxCommandPools[m_FrameClock].semaphores;
@@ -254,6 +291,10 @@ namespace imp
             for (auto& sem : pool.semaphores)
                 vkDestroySemaphore(device, sem, nullptr);
         }
+
+        for (auto& framePools : m_SecondaryCommandPools)
+            for (auto& pool : framePools)
+                vkDestroyCommandPool(device, pool.pool, nullptr);
     }
 
     std::vector<CommandBuffer> CommandPool::AquireCommandBuffers(VkDevice device, uint32_t count)
@@ -273,7 +314,7 @@ namespace imp
             VkCommandBufferAllocateInfo cbAllocInfo = {};
             cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
             cbAllocInfo.commandPool = pool;
-            cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            cbAllocInfo.level = level;
             cbAllocInfo.commandBufferCount = left;
             std::vector<VkCommandBuffer> newBufs(left);
             VkResult result = vkAllocateCommandBuffers(device, &cbAllocInfo, newBufs.data());
@@ -26,6 +26,7 @@ namespace imp
 	struct CommandPool
 	{
 		VkCommandPool pool;
+		VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 		std::queue<CommandBuffer> readyPool;
 		std::vector<CommandBuffer> donePool;
 		std::vector<VkSemaphore> semaphores;
@@ -46,7 +47,8 @@ namespace imp
 	{
 	public:
 		CommandBufferManager(PrimitivePool<Semaphore, SemaphoreFactory>& semaphorePool, PrimitivePool<Fence, FenceFactory>& fencePool);
-		void Initialize(VkDevice device, uint32_t familyIndices, EngineSwapchainImageCount imageCount);
+		// recordingThreadCount is how many threads can record secondary command buffers at the same time
+		void Initialize(VkDevice device, uint32_t familyIndices, EngineSwapchainImageCount imageCount, uint32_t recordingThreadCount = 0);
 
 		// Submit command buffer to internal command buffer queue. Will keep them until SubmitToQueue is called.
 		void SubmitInternal(CommandBuffer& cb);
@@ -60,6 +62,11 @@ namespace imp
 		void SignalFrameEnded();
 		std::vector<CommandBuffer> AquireCommandBuffers(VkDevice device, uint32_t count);
 		CommandBuffer AquireCommandBuffer(VkDevice device);
+		// One secondary command buffer from each of the first count recording thread pools of this frame, the i-th one
+		// can be recorded on another thread while the others are. Only valid after a primary was acquired this frame,
+		// they're reset together with the frame's primaries
+		std::vector<CommandBuffer> AquireSecondaryCommandBuffers(VkDevice device, uint32_t count);
+		uint32_t GetRecordingThreadCount() const;
 		std::vector<VkSemaphore>& GetCommandExecSemaphores();
 		const Fence& GetCurrentFence() const;
 
@@ -79,6 +86,9 @@ namespace imp
 		bool m_IsNewFrame;
 
 		std::vector<CommandPool> m_GfxCommandPools;
+		// [frame][recording thread]
+		std::vector<std::vector<CommandPool>> m_SecondaryCommandPools;
+		uint32_t m_RecordingThreadCount;
 		std::vector<CommandBuffer> m_CommandsBuffersToSubmit;
 		std::vector<Semaphore> m_SemaphoresToWaitOnSubmit;
 		Fence m_CurrentFence;
@@ -0,0 +1,59 @@
+#include "DepthPyramid.h"
+#include <bit>
+#include <stdexcept>
+
+namespace imp
+{
+	static constexpr VkFormat kDepthPyramidFormat = VK_FORMAT_R32_SFLOAT;
+
+	DepthPyramid::DepthPyramid()
+		: m_Image(), m_LevelViews(), m_Sampler(), m_Width(), m_Height(), m_LevelCount()
+	{
+	}
+
+	void DepthPyramid::Create(VkDevice device, uint32_t width, uint32_t height, const MemoryProps& memProps)
+	{
+		assert(!IsCreated());
+		m_Width = width;
+		m_Height = height;
+		// down to 1x1, levels are rounded down
+		m_LevelCount = std::min(static_cast<uint32_t>(std::bit_width(std::max(width, height))), kDepthPyramidMaxLevels);
+
+		m_Image.CreateImage(width, height, kDepthPyramidFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			VK_SAMPLE_COUNT_1_BIT, memProps, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, device, m_LevelCount);
+		m_Image.CreateImageView(kDepthPyramidFormat, VK_IMAGE_ASPECT_COLOR_BIT, device, m_LevelCount);
+		for (uint32_t level = 0; level < m_LevelCount; level++)
+			m_LevelViews[level] = Image::CreateImageView(m_Image.GetImage(), kDepthPyramidFormat, VK_IMAGE_ASPECT_COLOR_BIT, device, level, 1);
+
+		// only texelFetch goes through it
+		VkSamplerCreateInfo ci = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		ci.magFilter = VK_FILTER_NEAREST;
+		ci.minFilter = VK_FILTER_NEAREST;
+		ci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		ci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		ci.maxLod = static_cast<float>(m_LevelCount);
+
+		const auto res = vkCreateSampler(device, &ci, nullptr, &m_Sampler);
+		if (res != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the depth pyramid sampler");
+	}
+
+	void DepthPyramid::Destroy(VkDevice device)
+	{
+		if (!IsCreated())
+			return;
+
+		for (uint32_t level = 0; level < m_LevelCount; level++)
+			vkDestroyImageView(device, m_LevelViews[level], nullptr);
+		vkDestroySampler(device, m_Sampler, nullptr);
+		m_Image.Destroy(device);
+
+		m_LevelViews = {};
+		m_Sampler = VK_NULL_HANDLE;
+		m_Width = 0;
+		m_Height = 0;
+		m_LevelCount = 0;
+	}
+}
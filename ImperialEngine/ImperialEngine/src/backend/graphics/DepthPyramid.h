@@ -0,0 +1,46 @@
+#pragma once
+#include "backend/graphics/Image.h"
+#include "Utils/NonCopyable.h"
+#include <array>
+#include <cassert>
+#include <algorithm>
+
+namespace imp
+{
+	inline constexpr uint32_t kDepthPyramidMaxLevels = 16; // DEPTH_PYRAMID_MAX_LEVELS in depthPyramid.comp
+
+	// Hi-Z for GPU occlusion culling. A full mip chain of R32 where level 0 is a copy of the depth buffer and every
+	// texel of the others is the farthest depth of the texels under it, see depthPyramid.comp.
+	// Always in VK_IMAGE_LAYOUT_GENERAL, levels get written as storage images and culling reads it with texelFetch
+	class DepthPyramid : NonCopyable
+	{
+	public:
+		DepthPyramid();
+
+		void Create(VkDevice device, uint32_t width, uint32_t height, const MemoryProps& memProps);
+		bool IsCreated() const { return m_LevelCount != 0; }
+		bool Matches(uint32_t width, uint32_t height) const { return m_Width == width && m_Height == height; }
+
+		uint32_t GetWidth() const { return m_Width; }
+		uint32_t GetHeight() const { return m_Height; }
+		uint32_t GetLevelCount() const { return m_LevelCount; }
+		uint32_t GetLevelWidth(uint32_t level) const { return std::max(m_Width >> level, 1u); }
+		uint32_t GetLevelHeight(uint32_t level) const { return std::max(m_Height >> level, 1u); }
+
+		VkImage GetImage() const { return m_Image.GetImage(); }
+		// all levels
+		VkImageView GetImageView() const { return m_Image.GetImageView(); }
+		VkImageView GetLevelView(uint32_t level) const { return m_LevelViews[level]; }
+		VkSampler GetSampler() const { return m_Sampler; }
+
+		void Destroy(VkDevice device);
+
+	private:
+		Image m_Image;
+		std::array<VkImageView, kDepthPyramidMaxLevels> m_LevelViews;
+		VkSampler m_Sampler;
+		uint32_t m_Width;
+		uint32_t m_Height;
+		uint32_t m_LevelCount;
+	};
+}
@@ -4,9 +4,10 @@
 #include "frontend/Components/Components.h"
 #include "frontend/Window.h"
 #include "Utils/GfxUtilities.h"
+#include "Utils/MeshProcessing.h"
 #include "Utils/Finalizer.h"
 #include "Utils/EngineStaticConfig.h"
-#include "extern/THREAD-POOL/BS_thread_pool.hpp"
+#include "backend/parallel/JobSystem.h"
 #include <vector>
 #include <stdexcept>
 #include <set>
@@ -60,10 +61,16 @@ namespace imp
         m_StagingDrawBuffer(),
         m_BoundingVolumeBuffer(),
         m_NumDraws(),
+        m_DrawCommandCopies(),
+        m_ShaderDrawData(kEngineSwapchainDoubleBuffering),
+        m_DepthPyramid(),
+        m_DepthPyramidSource(),
+        m_DrawVisibilityValid(),
+        m_DrawLodsValid(),
         m_GlobalBuffers(),
         m_DescriptorSets(),
         m_AfterMathTracker(),
-        m_VertexBuffers(),
+        m_Meshes(),
         m_DrawData(),
         m_MainCamera(),
         m_PreviewCamera(),
@@ -72,7 +79,7 @@ namespace imp
     {
     }
 
-    void Graphics::Initialize(const EngineGraphicsSettings& settings, Window* window)
+    void Graphics::Initialize(const EngineGraphicsSettings& settings, Window* window, prl::JobSystem& jobSystem)
     {
 #if USE_AFTERMATH
         m_AfterMathTracker.Initialize();
@@ -87,14 +94,13 @@ namespace imp
         CreateLogicalDevice();
         volkLoadDevice(m_LogicalDevice);
         CreateSwapchain();
+        m_JobSystem = &jobSystem;
         CreateCommandBufferManager();
         CreateSurfaceManager();
         CreateGarbageCollector();
         CreateRenderPassGenerator();
         m_TimestampQueryManager.Initialize(m_PhysicalDevice, m_LogicalDevice, m_Settings);
 
-        m_JobSystem = new BS::thread_pool(std::thread::hardware_concurrency() / 2);
-
         InitializeVulkanMemory();
         m_ShaderManager.Initialize(m_LogicalDevice, m_MemoryManager, m_Settings, m_JobSystem, m_DeviceMemoryProps, m_DrawBuffer, m_VertexBuffer);
 
@@ -139,6 +145,57 @@ namespace imp
         m_TransferCbManager.SubmitToTransferQueue(m_TransferQueue, m_LogicalDevice, m_CurrentFrame);
     }
 
+    void Graphics::ApplyRenderSnapshot(RenderSnapshot& snapshot)
+    {
+        AUTO_TIMER("[ApplyRenderSnapshot]: ");
+        m_MainCamera = snapshot.mainCamera;
+        m_PreviewCamera = snapshot.previewCamera;
+
+        switch (m_Settings.renderMode)
+        {
+        case kEngineRenderModeTraditional:
+            // main thread overwrites the snapshot anyway, swap to keep both allocations around
+            m_DrawData.swap(snapshot.drawData);
+            break;
+        case kEngineRenderModeGPUDriven:
+        case kEngineRenderModeGPUDrivenMeshShading:
+        {
+            // this frame's buffer only gets what it's missing, static scenes copy nothing
+            m_ShaderDrawData.Apply(snapshot.shaderDrawData);
+            const auto frameClock = m_Swapchain.GetFrameClock();
+            if (m_ShaderDrawData.IsDirty(frameClock))
+                m_ShaderDrawData.Flush(frameClock, GetDrawDataBuffer());
+            if (snapshot.drawCommandsDirty)
+                StageDrawCommands(snapshot.drawCommands);
+            break;
+        }
+        }
+    }
+
+    void Graphics::StageDrawCommands(const UploadPatch& patch)
+    {
+        auto& staging = GetDrawCommandStagingBuffer();
+        if (!patch.bytes.empty())
+            std::memcpy(staging.GetRawMappedBufferPointer(), patch.bytes.data(), patch.bytes.size());
+        staging.resize(patch.numElements, patch.elementSize);
+
+        // changed commands are packed in staging, each range goes back to where it belongs
+        m_DrawCommandCopies.clear();
+        VkDeviceSize srcOffset = 0;
+        for (const auto& range : patch.ranges)
+        {
+            VkBufferCopy copy = {};
+            copy.srcOffset = srcOffset;
+            copy.dstOffset = range.first * patch.elementSize;
+            copy.size = range.count * patch.elementSize;
+            m_DrawCommandCopies.push_back(copy);
+            srcOffset += copy.size;
+        }
+
+        // Mark delay so we do transfers in UpdateDraws and not in StartFrame
+        m_DelayTransferOperation = true;
+    }
+
     void Graphics::UpdateDrawCommands()
     {
         // Update the new global draw count
@@ -163,20 +220,52 @@ namespace imp
 
         CommandBuffer& cb = m_TransferCbManager.GetCurrentCB(m_LogicalDevice);
 
-        VkBufferCopy copy = {};
-#if CULLING_ENABLED
-        copy.size = m_NumDraws * sizeof(IndirectDrawCmd);
-#else
-        copy.size = m_NumDraws * sizeof(VkDrawIndexedIndirectCommand);
-#endif
-
-        vkCmdCopyBuffer(cb.cmb, staging.GetBuffer(), dst.GetBuffer(), 1, &copy);
+        if (!m_DrawCommandCopies.empty())
+            vkCmdCopyBuffer(cb.cmb, staging.GetBuffer(), dst.GetBuffer(), static_cast<uint32_t>(m_DrawCommandCopies.size()), m_DrawCommandCopies.data());
 
         assert(m_DelayTransferOperation);
         DoTransfers(true);
     }
 
     void Graphics::Cull()
+    {
+        const bool occlusion = IsGPUOcclusionCullingActive();
+        // before anything is recorded, recreating it has to update descriptor sets
+        if (occlusion)
+            EnsureDepthPyramid();
+
+        CommandBuffer cb = m_CbManager.AquireCommandBuffer(m_LogicalDevice);
+        cb.Begin();
+
+        AcquireDrawCommandBuffer(cb);
+
+        if (!m_DrawLodsValid)
+        {
+            const auto lodBuffer = m_ShaderManager.GetDrawLodBuffer().GetBuffer();
+            vkCmdFillBuffer(cb.cmb, lodBuffer, 0, VK_WHOLE_SIZE, kDrawLodNone);
+            const auto fillBar = utils::CreateBufferMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, lodBuffer);
+            utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, &fillBar, 1);
+            m_DrawLodsValid = true;
+        }
+
+        // early phase goes by what was visible last frame, everything counts as hidden until the late phase says otherwise
+        if (occlusion && !m_DrawVisibilityValid)
+        {
+            const auto visibilityBuffer = m_ShaderManager.GetDrawVisibilityBuffer().GetBuffer();
+            vkCmdFillBuffer(cb.cmb, visibilityBuffer, 0, VK_WHOLE_SIZE, 0);
+            const auto fillBar = utils::CreateBufferMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, visibilityBuffer);
+            utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, &fillBar, 1);
+        }
+        m_DrawVisibilityValid = occlusion;
+
+        m_TimestampQueryManager.WriteTimestamp(cb.cmb, kQueryCullBegin, m_Swapchain.GetFrameClock());
+        RecordCull(cb, occlusion ? kOcclusionPhaseEarly : kOcclusionPhaseNone);
+        m_TimestampQueryManager.WriteTimestamp(cb.cmb, kQueryCullEnd, m_Swapchain.GetFrameClock());
+        cb.End();
+        m_CbManager.SubmitInternal(cb);
+    }
+
+    void Graphics::RecordCull(CommandBuffer& cb, OcclusionPhase phase)
     {
         const auto dispatchCount = (m_NumDraws + 31) / 32;
         const auto renderMode = m_Settings.renderMode;
@@ -191,18 +280,32 @@ namespace imp
 
         std::array<VkDescriptorSet, 2> dsets = { dset1, dset2 };
 
+        // instancing is only done for the indirect pipeline, mesh shading already draws per meshlet
+        const bool instanced = m_Settings.instancingEnabled && renderMode == kEngineRenderModeGPUDriven;
+        const auto numBuckets = m_Meshes.GetSlotCount() * kMaxLODCount;
+
+        // stages that read what drawGen writes
+        const VkPipelineStageFlags drawReadStages = renderMode == kEngineRenderModeGPUDriven ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT : VK_PIPELINE_STAGE_TASK_SHADER_BIT_NV | VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV;
+
         struct Pushs
         {
             uint32_t numDraws;
+            uint32_t pass;
+            uint32_t numBuckets;
+            uint32_t occlusionPhase;
         } push;
         push.numDraws = m_NumDraws;
+        push.pass = instanced ? kDrawGenPassCount : kDrawGenPassSingle;
+        push.numBuckets = numBuckets;
+        push.occlusionPhase = phase;
 
-        CommandBuffer cb = m_CbManager.AquireCommandBuffer(m_LogicalDevice);
-        cb.Begin();
+        // Lods drawGen picked last time are what it sticks to now. With occlusion the late phase of last frame wrote
+        // visibility, the early phase reads it and this frame's late phase writes it again
+        std::array<VkBufferMemoryBarrier, 2> historyBars;
+        historyBars[0] = utils::CreateBufferMemoryBarrier(VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ShaderManager.GetDrawLodBuffer().GetBuffer());
+        historyBars[1] = utils::CreateBufferMemoryBarrier(VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ShaderManager.GetDrawVisibilityBuffer().GetBuffer());
+        utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, historyBars.data(), phase != kOcclusionPhaseNone ? 2 : 1);
 
-        AcquireDrawCommandBuffer(cb);
-
-        m_TimestampQueryManager.WriteTimestamp(cb.cmb, kQueryCullBegin, m_Swapchain.GetFrameClock());
         vkCmdBindPipeline(cb.cmb, VK_PIPELINE_BIND_POINT_COMPUTE, updateDrawsProgram.GetPipeline());
         vkCmdPushConstants(cb.cmb, updateDrawsProgram.GetPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
         vkCmdBindDescriptorSets(cb.cmb, VK_PIPELINE_BIND_POINT_COMPUTE, updateDrawsProgram.GetPipelineLayout(), 0, dsets.size(), dsets.data(), 0, nullptr);
@@ -219,9 +322,42 @@ namespace imp
         memBars2[1] = utils::CreateBufferMemoryBarrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, m_ShaderManager.GetDrawDataIndicesBuffer().GetBuffer());
         // make sure new draw command count is visible to vkCmdDrawIndirectIndexedCount
         memBars2[2] = utils::CreateBufferMemoryBarrier(VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, m_ShaderManager.GetDrawCommandCountBuffer().GetBuffer());
-        utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, memBars2.data(), memBars2.size());
+        utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | drawReadStages | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, memBars2.data(), memBars2.size());
 
-        vkCmdDispatch(cb.cmb, dispatchCount, 1, 1);
+        if (instanced)
+        {
+            const auto bucketBuffer = m_ShaderManager.GetInstanceBucketBuffer().GetBuffer();
+            const auto drawInstanceBuffer = m_ShaderManager.GetDrawInstanceBuffer().GetBuffer();
+
+            // last frame's passes might still be reading the buckets
+            auto bucketBar = utils::CreateBufferMemoryBarrier(VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, bucketBuffer);
+            utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, &bucketBar, 1);
+            vkCmdFillBuffer(cb.cmb, bucketBuffer, 0, kInstanceBucketHeaderSize + numBuckets * sizeof(InstanceBucket), 0);
+            bucketBar = utils::CreateBufferMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, bucketBuffer);
+            utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, &bucketBar, 1);
+
+            // count instances per bucket
+            vkCmdDispatch(cb.cmb, dispatchCount, 1, 1);
+
+            std::array<VkBufferMemoryBarrier, 2> passBars;
+            passBars[0] = utils::CreateBufferMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, bucketBuffer);
+            passBars[1] = utils::CreateBufferMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, drawInstanceBuffer);
+            utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, passBars.data(), static_cast<uint32_t>(passBars.size()));
+
+            // a draw per bucket
+            push.pass = kDrawGenPassBuckets;
+            vkCmdPushConstants(cb.cmb, updateDrawsProgram.GetPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+            vkCmdDispatch(cb.cmb, (numBuckets + 31) / 32, 1, 1);
+
+            utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, passBars.data(), 1);
+
+            // draw data indices of the instances
+            push.pass = kDrawGenPassScatter;
+            vkCmdPushConstants(cb.cmb, updateDrawsProgram.GetPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+            vkCmdDispatch(cb.cmb, dispatchCount, 1, 1);
+        }
+        else
+            vkCmdDispatch(cb.cmb, dispatchCount, 1, 1);
 
         std::array<VkBufferMemoryBarrier, 3> memBars;
         // make sure CS has populated draw buffer
@@ -232,10 +368,78 @@ namespace imp
         memBars[2] = utils::CreateBufferMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, m_ShaderManager.GetDrawCommandCountBuffer().GetBuffer());
         
         // I wonder what happens when you have multiple pipeline stage flag bits like I do here
-        utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, memBars.data(), static_cast<uint32_t>(memBars.size()));
-        m_TimestampQueryManager.WriteTimestamp(cb.cmb, kQueryCullEnd, m_Swapchain.GetFrameClock());
-        cb.End();
-        m_CbManager.SubmitInternal(cb);
+        utils::InsertBufferBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | drawReadStages, memBars.data(), static_cast<uint32_t>(memBars.size()));
+    }
+
+    bool Graphics::IsGPUOcclusionCullingActive() const
+    {
+#if CULLING_ENABLED
+        const auto renderMode = m_Settings.renderMode;
+        return m_Settings.gpuOcclusionCullingEnabled && (renderMode == kEngineRenderModeGPUDriven || renderMode == kEngineRenderModeGPUDrivenMeshShading);
+#else
+        return false;
+#endif
+    }
+
+    void Graphics::EnsureDepthPyramid()
+    {
+        const auto& extent = m_Swapchain.GetSwapchainImageSurfaceDesc();
+        if (m_DepthPyramid.IsCreated() && m_DepthPyramid.Matches(extent.width, extent.height))
+            return;
+
+        // both compute descriptor sets point to the old one
+        vkDeviceWaitIdle(m_LogicalDevice);
+        m_DepthPyramid.Destroy(m_LogicalDevice);
+        m_DepthPyramid.Create(m_LogicalDevice, extent.width, extent.height, m_DeviceMemoryProps);
+        m_ShaderManager.UpdateDepthPyramidDescriptors(m_LogicalDevice, m_DepthPyramid);
+        // visibility of the last size says nothing
+        m_DrawVisibilityValid = false;
+    }
+
+    void Graphics::BuildDepthPyramid(CommandBuffer& cb, const Image& depth)
+    {
+        assert(m_DepthPyramid.IsCreated());
+        if (depth.GetImageView() != m_DepthPyramidSource)
+        {
+            // depth surfaces get reused, this only happens when they're recreated
+            vkDeviceWaitIdle(m_LogicalDevice);
+            m_ShaderManager.UpdateDepthSourceDescriptor(m_LogicalDevice, depth.GetImageView(), m_DepthPyramid.GetSampler());
+            m_DepthPyramidSource = depth.GetImageView();
+        }
+
+        const auto pyramidCS = m_ShaderManager.GetShader("depthPyramid.comp");
+        const ComputePipelineConfig config = { pyramidCS.GetShaderModule(), m_ShaderManager.GetDescriptorSetLayout(), m_ShaderManager.GetComputeDescriptorSetLayout(), m_ShaderManager.GetDepthPyramidDescriptorSetLayout() };
+        const auto& pyramidProgram = m_PipelineManager.GetComputePipeline(config);
+        const auto dset = m_ShaderManager.GetDepthPyramidDescriptorSet();
+
+        const auto pyramidImage = m_DepthPyramid.GetImage();
+        // last frame's culling is done with it and every level gets rewritten
+        std::array<VkImageMemoryBarrier, 2> startBars;
+        startBars[0] = utils::CreateImageMemoryBarrier(VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, depth.GetImage(), VK_IMAGE_ASPECT_DEPTH_BIT);
+        startBars[1] = utils::CreateImageMemoryBarrier(0, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, pyramidImage, VK_IMAGE_ASPECT_COLOR_BIT);
+        const VkPipelineStageFlags pyramidReadStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | (m_Settings.renderMode == kEngineRenderModeGPUDrivenMeshShading ? VK_PIPELINE_STAGE_TASK_SHADER_BIT_NV : 0);
+        utils::InsertImageBarrier(cb, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | pyramidReadStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, startBars.data(), static_cast<uint32_t>(startBars.size()));
+
+        vkCmdBindPipeline(cb.cmb, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidProgram.GetPipeline());
+        vkCmdBindDescriptorSets(cb.cmb, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidProgram.GetPipelineLayout(), 2, 1, &dset, 0, nullptr);
+
+        for (uint32_t level = 0; level < m_DepthPyramid.GetLevelCount(); level++)
+        {
+            if (level > 0)
+            {
+                const auto levelBar = utils::CreateImageMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, pyramidImage, VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1);
+                utils::InsertImageBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, &levelBar, 1);
+            }
+
+            vkCmdPushConstants(cb.cmb, pyramidProgram.GetPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(level), &level);
+            vkCmdDispatch(cb.cmb, (m_DepthPyramid.GetLevelWidth(level) + 7) / 8, (m_DepthPyramid.GetLevelHeight(level) + 7) / 8, 1);
+        }
+
+        // late cull reads the pyramid, the late draws write depth again
+        std::array<VkImageMemoryBarrier, 2> endBars;
+        endBars[0] = utils::CreateImageMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, pyramidImage, VK_IMAGE_ASPECT_COLOR_BIT);
+        endBars[1] = utils::CreateImageMemoryBarrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depth.GetImage(), VK_IMAGE_ASPECT_DEPTH_BIT);
+        utils::InsertImageBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, pyramidReadStages | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, endBars.data(), static_cast<uint32_t>(endBars.size()));
     }
 
     // This happens before UpdateDrawCommands
@@ -254,7 +458,7 @@ namespace imp
         switch (m_Settings.renderMode)
         {
         case kEngineRenderModeTraditional:
-            m_ShaderManager.UpdateDrawData(m_LogicalDevice, index, m_DrawData, m_VertexBuffers);
+            m_ShaderManager.UpdateDrawData(m_LogicalDevice, index, m_DrawData, m_Meshes);
             m_CbManager.AddQueueDependencies(m_ShaderManager.GetDrawDataBuffers(index).GetTimeline());
             m_ShaderManager.GetDrawDataBuffers(index).MarkUsedInQueue();
             break;
@@ -278,6 +482,10 @@ namespace imp
         const auto frustumPlanes = utils::FindViewFrustumPlanes(mainCamVP);
         std::memcpy(&data.FrustumPlanes, frustumPlanes.data(), sizeof(data.FrustumPlanes));
 
+        // lods are picked for the main camera like culling
+        const auto lodSelection = utils::MakeLodSelection(m_MainCamera.Projection, m_Swapchain.GetSwapchainImageSurfaceDesc().height, m_Settings.lod);
+        data.LodParams = glm::vec4(lodSelection.pixelsPerUnit, lodSelection.errorThreshold, lodSelection.hysteresis, lodSelection.minProjectedSize);
+
         m_ShaderManager.UpdateGlobalData(m_LogicalDevice, index, data);
         m_CbManager.AddQueueDependencies(m_ShaderManager.GetGlobalDataBuffer(index).GetTimeline());
         m_ShaderManager.GetGlobalDataBuffer(index).MarkUsedInQueue();
@@ -377,121 +585,35 @@ namespace imp
 
         cb.Begin();
 
-        uint32_t vtxAllocSize = 0;
-        uint32_t idxAllocSize = 0;
-        uint32_t mdAllocSize = 0;
-        uint32_t mldAllocSize = 0;
-        uint32_t ms_mdAllocSize = 0;
-        uint32_t ms_vdAllocSize = 0;
-        uint32_t ms_tdAllocSize = 0;
-        uint32_t ms_ncAllocSize = 0;
-        std::vector<Vertex> verts;
-        std::vector<uint32_t> idxs;
-        std::vector<MeshData> mds;
-        std::vector<Meshlet> mlds;
-        std::vector<ms_MeshData> ms_mds;
-        std::vector<uint32_t> ms_vd;// meshlet vertex data
-        std::vector<uint8_t> ms_td; // meshlet triangle data
-        std::vector<NormalCone> ms_nc;
-        const uint32_t vertBufferOffset = m_VertexBuffer.GetOffset() / sizeof(Vertex);
-        const uint32_t indBufferOffset = m_IndexBuffer.GetOffset() / sizeof(uint32_t);
-        const uint32_t meshletBufferOffset = m_ShaderManager.GetMeshletDataBuffer().GetOffset() / sizeof(Meshlet);
-        const uint32_t meshletVertexDataBufferOffset = m_ShaderManager.GetMeshletVertexDataBuffer().GetOffset() / sizeof(uint32_t);
-        const uint32_t meshletTriangleVertexDataBufferOffset = m_ShaderManager.GetMeshletTriangleDataBuffer().GetOffset() / sizeof(uint8_t);
-        const uint32_t meshletNormalConeDataBufferOffset = m_ShaderManager.GetMeshletNormalConeDataBuffer().GetOffset() / sizeof(NormalCone);
-
-        for (auto& req : meshCreationData)
+        utils::MeshBufferOffsets offsets;
+        offsets.vertex = m_VertexBuffer.GetOffset() / sizeof(GPUVertex);
+        offsets.index = m_IndexBuffer.GetOffset() / sizeof(uint32_t);
+        offsets.meshlet = m_ShaderManager.GetMeshletDataBuffer().GetOffset() / sizeof(Meshlet);
+        offsets.meshletVertex = m_ShaderManager.GetMeshletVertexDataBuffer().GetOffset() / sizeof(uint32_t);
+        offsets.meshletTriangle = m_ShaderManager.GetMeshletTriangleDataBuffer().GetOffset() / sizeof(uint8_t);
+        offsets.normalCone = m_ShaderManager.GetMeshletNormalConeDataBuffer().GetOffset() / sizeof(NormalCone);
+        // basic.task indexes both with the meshlet index
+        assert(m_ShaderManager.GetMeshletBoundsBuffer().GetOffset() / sizeof(BoundingVolumeSphere) == offsets.meshlet);
+
+        // optimizing, lods and meshlets are per mesh so they run on the job system
+        utils::ProcessedMeshes meshes;
+        utils::ProcessMeshes(meshCreationData, offsets, *m_JobSystem, meshes);
+        for (size_t i = 0; i < meshes.meshSlots.size(); i++)
         {
-            // this is a linked mesh
-            if (req.indices.size() == 0)
-                continue;
-
-            const auto vOffset = verts.size() + vertBufferOffset;
-            const auto iOffset = idxs.size() + indBufferOffset;
-            const auto mOffset = mlds.size() + meshletBufferOffset;
-            const auto mvdOffset = ms_vd.size() + meshletVertexDataBufferOffset;
-            const auto mtdOffset = ms_td.size() + meshletTriangleVertexDataBufferOffset;
-            const auto ncdOffset = ms_nc.size() + meshletNormalConeDataBufferOffset;
-
-            utils::OptimizeMesh(req.vertices, req.indices);
-
-            // These subbuffers will be used to index and offset into the one bound Vertex and Index buffer
-            VulkanSubBuffer vtxSub = VulkanSubBuffer(vOffset, static_cast<uint32_t>(req.vertices.size()));
-            VulkanSubBuffer idxSub = VulkanSubBuffer(0, static_cast<uint32_t>(req.indices.size()));
-
-            Comp::MeshGeometry ivb;
-            ivb.vertices = vtxSub;
-            ivb.indices[0] = idxSub;
-
-#if LOD_ENABLED
-            static constexpr uint32_t numDesiredLODs = kMaxLODCount - 1;
-            utils::GenerateMeshLODS(req.vertices, req.indices, &ivb.indices[1], numDesiredLODs, 0.75, 0.75);
-#endif
-
-            ms_MeshData ms_md;
-            std::vector<uint32_t> meshletVertexData;// meshlet vertex data
-            std::vector<uint8_t> meshletTriangleData; // meshlet triangle data
-            std::vector<NormalCone> meshletNormalConeData;
-            std::vector<Meshlet> meshlets = utils::GenerateMeshlets(req.vertices, req.indices, meshletVertexData, meshletTriangleData, meshletNormalConeData, ivb, ms_md);
-            ms_md.boundingVolume = req.boundingVolume;
-            ms_md.firstTask = 0;
-
-            m_BVs[req.id] = req.boundingVolume;
-            
-            for (auto i = 0; i < kMaxLODCount; i++)
-                ms_md.LODData[i].meshletBufferOffset += mOffset;
-
-            for (auto i = 0; i < kMaxLODCount; i++)
-            {
-                ivb.indices[i].m_Offset += iOffset;
-                ivb.meshlets[i].m_Offset = ms_md.LODData[i].meshletBufferOffset;
-                ivb.meshlets[i].m_Count = ms_md.LODData[i].taskCount;
-            }
-
-            verts.insert(verts.end(), req.vertices.begin(), req.vertices.end());
-            idxs.insert(idxs.end(), req.indices.begin(), req.indices.end());
-            vtxAllocSize += static_cast<uint32_t>(req.vertices.size() * sizeof(Vertex));
-            idxAllocSize += static_cast<uint32_t>(req.indices.size() * sizeof(uint32_t));
-
-            MeshData md;
-            md.boundingVolume = req.boundingVolume;
-            md.vertexOffset = vOffset;
-            for (auto i = 0; i < kMaxLODCount; i++)
-            {
-                md.LODData[i].firstIndex = ivb.indices[i].GetOffset();
-                md.LODData[i].indexCount = ivb.indices[i].GetCount();
-            }
-            mds.emplace_back(md);
-
-            ms_mds.emplace_back(ms_md);
-
-            // offset meshlet vertex data
-            for (auto& v : meshletVertexData)
-                v += vOffset;
-
-            for (auto& meshlet : meshlets)
-            {
-                meshlet.vertexOffset += mvdOffset;
-                meshlet.triangleOffset += mtdOffset;
-                meshlet.coneOffset += ncdOffset;
-            }
-
-            ms_vd.insert(ms_vd.end(), meshletVertexData.begin(), meshletVertexData.end());
-            ms_td.insert(ms_td.end(), meshletTriangleData.begin(), meshletTriangleData.end());
-            ms_nc.insert(ms_nc.end(), meshletNormalConeData.begin(), meshletNormalConeData.end());
-            mlds.insert(mlds.end(), meshlets.begin(), meshlets.end());
-
-            mldAllocSize += meshlets.size() * sizeof(Meshlet);
-            ms_vdAllocSize += meshletVertexData.size() * sizeof(uint32_t);
-            ms_tdAllocSize += meshletTriangleData.size() * sizeof(uint8_t);
-            ms_ncAllocSize += meshletNormalConeData.size() * sizeof(NormalCone);
-
-            mdAllocSize += static_cast<uint32_t>(sizeof(MeshData));
-            ms_mdAllocSize += static_cast<uint32_t>(sizeof(ms_MeshData));
-   
-            m_VertexBuffers[req.id] = ivb;
+            m_Meshes.SetOccluder(meshes.meshSlots[i], std::move(meshes.occluders[i]));
+            m_Meshes.SetGeometry(meshes.meshSlots[i], meshes.geometries[i]);
         }
 
+        const uint32_t vtxAllocSize = static_cast<uint32_t>(meshes.verts.size() * sizeof(GPUVertex));
+        const uint32_t idxAllocSize = static_cast<uint32_t>(meshes.idxs.size() * sizeof(uint32_t));
+        const uint32_t mdAllocSize = static_cast<uint32_t>(meshes.mds.size() * sizeof(MeshData));
+        const uint32_t mldAllocSize = static_cast<uint32_t>(meshes.mlds.size() * sizeof(Meshlet));
+        const uint32_t ms_mdAllocSize = static_cast<uint32_t>(meshes.ms_mds.size() * sizeof(ms_MeshData));
+        const uint32_t ms_vdAllocSize = static_cast<uint32_t>(meshes.ms_vd.size() * sizeof(uint32_t));
+        const uint32_t ms_tdAllocSize = static_cast<uint32_t>(meshes.ms_td.size() * sizeof(uint8_t));
+        const uint32_t ms_ncAllocSize = static_cast<uint32_t>(meshes.ms_nc.size() * sizeof(NormalCone));
+        const uint32_t ms_bvAllocSize = static_cast<uint32_t>(meshes.ms_bv.size() * sizeof(BoundingVolumeSphere));
+
         // TODO LOD: i shouldnt have to pass these
         const auto usageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
         const auto memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
@@ -499,35 +621,39 @@ namespace imp
         // TODO nice-to-have: batch uploads and use transfer queueu
         // upload vertices
         assert(vtxAllocSize);
-        UploadVulkanBuffer(usageFlags, memoryFlags, m_VertexBuffer, cb, vtxAllocSize, verts.data());
+        UploadVulkanBuffer(usageFlags, memoryFlags, m_VertexBuffer, cb, vtxAllocSize, meshes.verts.data());
 
         // upload indices
         assert(idxAllocSize);
-        UploadVulkanBuffer(usageFlags, memoryFlags, m_IndexBuffer, cb, idxAllocSize, idxs.data());
+        UploadVulkanBuffer(usageFlags, memoryFlags, m_IndexBuffer, cb, idxAllocSize, meshes.idxs.data());
 
         // upload mesh data
         assert(mdAllocSize);
-        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshDataBuffer(), cb, mdAllocSize, mds.data());
+        UploadMeshTable(usageFlags, memoryFlags, m_ShaderManager.GetMeshDataBuffer(), cb, sizeof(MeshData), meshes.meshSlots, meshes.mds.data());
 
         // upload meshlets
         assert(mldAllocSize);
-        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshletDataBuffer(), cb, mldAllocSize, mlds.data());
+        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshletDataBuffer(), cb, mldAllocSize, meshes.mlds.data());
 
         // upload mesh shading mesh data
         assert(ms_mdAllocSize);
-        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetmsMeshDataBuffer(), cb, ms_mdAllocSize, ms_mds.data());
+        UploadMeshTable(usageFlags, memoryFlags, m_ShaderManager.GetmsMeshDataBuffer(), cb, sizeof(ms_MeshData), meshes.meshSlots, meshes.ms_mds.data());
 
         // upload meshlet vertex data
         assert(ms_vdAllocSize);
-        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshletVertexDataBuffer(), cb, ms_vdAllocSize, ms_vd.data());
+        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshletVertexDataBuffer(), cb, ms_vdAllocSize, meshes.ms_vd.data());
 
         // upload meshlet triangle data
         assert(ms_tdAllocSize);
-        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshletTriangleDataBuffer(), cb, ms_tdAllocSize, ms_td.data());
+        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshletTriangleDataBuffer(), cb, ms_tdAllocSize, meshes.ms_td.data());
 
         // upload meshlet normal cone data
         assert(ms_ncAllocSize);
-        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshletNormalConeDataBuffer(), cb, ms_ncAllocSize, ms_nc.data());
+        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshletNormalConeDataBuffer(), cb, ms_ncAllocSize, meshes.ms_nc.data());
+
+        // upload meshlet bounds
+        assert(ms_bvAllocSize);
+        UploadVulkanBuffer(usageFlags, memoryFlags, m_ShaderManager.GetMeshletBoundsBuffer(), cb, ms_bvAllocSize, meshes.ms_bv.data());
 
         cb.End();
 
@@ -569,7 +695,7 @@ namespace imp
 
     const Comp::MeshGeometry& Graphics::GetMeshData(uint32_t index) const
     {
-        return m_VertexBuffers.at(index);
+        return m_Meshes.GetGeometry(index);
     }
 
     EngineGraphicsSettings& Graphics::GetGraphicsSettings()
@@ -577,6 +703,11 @@ namespace imp
         return m_Settings;
     }
 
+    uint32_t Graphics::GetFrameClock() const
+    {
+        return m_Swapchain.GetFrameClock();
+    }
+
     const GraphicsCaps& Graphics::GetGfxCaps() const
     {
         return m_GfxCaps;
@@ -589,8 +720,6 @@ namespace imp
 
         vkDeviceWaitIdle(device);
 
-        delete m_JobSystem;
-
 #if !BENCHMARK_MODE
         ImGui_ImplVulkan_Shutdown();
         renderpassgui->Destroy(device);
@@ -598,6 +727,7 @@ namespace imp
         CollectFinalResults();
 #endif
         m_TimestampQueryManager.Destroy(device);
+        m_DepthPyramid.Destroy(device);
         m_ShaderManager.Destroy(device);
 
         m_VertexBuffer.Destroy(device);
@@ -741,6 +871,8 @@ namespace imp
         physical_features2.features.samplerAnisotropy = VK_TRUE;
         vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &physical_features2);
         physical_features2.features.multiDrawIndirect = true;
+        // drawGen.comp passes the draw data offset of a draw through firstInstance
+        physical_features2.features.drawIndirectFirstInstance = true;
 
 
         VkPhysicalDeviceVulkan11Features features11 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES };
@@ -769,6 +901,11 @@ namespace imp
         featuresMesh.taskShader = m_GfxCaps.IsMeshShadingSupported();
 #endif
 
+        VkPhysicalDeviceMultiDrawFeaturesEXT featuresMultiDraw = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTI_DRAW_FEATURES_EXT };
+        featuresMultiDraw.multiDraw = VK_TRUE;
+        if (m_GfxCaps.IsMultiDrawSupported())
+            featuresMesh.pNext = &featuresMultiDraw;
+
         features11.pNext = &featuresMesh;
         features12.pNext = &features11;
         physical_features2.pNext = &features12;
@@ -804,7 +941,8 @@ namespace imp
 
     void Graphics::CreateCommandBufferManager()
     {
-        m_CbManager.Initialize(m_LogicalDevice, m_GfxCaps.GetQueueFamilies().graphicsFamily, m_Settings.swapchainImageCount);
+        // render passes can record secondaries on every job system thread
+        m_CbManager.Initialize(m_LogicalDevice, m_GfxCaps.GetQueueFamilies().graphicsFamily, m_Settings.swapchainImageCount, m_JobSystem->GetConcurrency());
         m_TransferCbManager.Initialize(m_LogicalDevice, m_GfxCaps.GetQueueFamilies().transferFamily, m_Settings.swapchainImageCount);
     }
 
@@ -950,6 +1088,41 @@ namespace imp
         m_VulkanGarbageCollector.AddGarbageResource(std::make_shared<VulkanBuffer>(stagingBuffer));
     }
 
+    void Graphics::UploadMeshTable(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryFlags, VulkanBuffer& dst, const CommandBuffer& cb, uint32_t elementSize, const std::vector<uint32_t>& slots, const void* dataToUpload)
+    {
+        // tables are indexed by mesh slot, reused slots land in the middle instead of at the write offset
+        const uint32_t allocSize = elementSize * static_cast<uint32_t>(slots.size());
+        auto stagingBuffer = m_MemoryManager.GetBuffer(m_LogicalDevice, allocSize, usageFlags, memoryFlags, m_DeviceMemoryProps);
+        stagingBuffer.UpdateLastUsed(m_CurrentFrame);
+        dst.UpdateLastUsed(m_CurrentFrame);
+
+        void* data;
+        const auto res = vkMapMemory(m_LogicalDevice, stagingBuffer.GetMemory(), 0, stagingBuffer.GetSize(), 0, &data);
+        assert(res == VK_SUCCESS);
+        memcpy(data, dataToUpload, allocSize);
+        vkUnmapMemory(m_LogicalDevice, stagingBuffer.GetMemory());
+
+        // one region per run of consecutive slots, normally that's just one
+        std::vector<VkBufferCopy> regions;
+        uint32_t tableEnd = dst.GetOffset();
+        for (uint32_t i = 0; i < slots.size(); i++)
+        {
+            const uint32_t dstOffset = slots[i] * elementSize;
+            if (dstOffset + elementSize > dst.GetSize())
+                throw std::runtime_error("[Graphics Memory]: Fatal Error! Mesh table overflow");
+
+            if (regions.size() && slots[i] == slots[i - 1] + 1)
+                regions.back().size += elementSize;
+            else
+                regions.push_back({ i * elementSize, dstOffset, elementSize });
+            tableEnd = std::max(tableEnd, dstOffset + elementSize);
+        }
+        vkCmdCopyBuffer(cb.cmb, stagingBuffer.GetBuffer(), dst.GetBuffer(), static_cast<uint32_t>(regions.size()), regions.data());
+        dst.RegisterNewUpload(tableEnd - dst.GetOffset());
+
+        m_VulkanGarbageCollector.AddGarbageResource(std::make_shared<VulkanBuffer>(stagingBuffer));
+    }
+
     void Graphics::CopyVulkanBuffer(const VulkanBuffer& src, VulkanBuffer& dst, const CommandBuffer& cb)
     {
         assert(src.GetSize());
@@ -1032,7 +1205,7 @@ namespace imp
     {
         assert(data);
         assert(size);
-        vkCmdPushConstants(cb, pipeLayout, VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_VERTEX_BIT, 0, size, data);
+        vkCmdPushConstants(cb, pipeLayout, kGraphicsPushConstantStages, 0, size, data);
     }
 
     void Graphics::DrawIndexed(VkCommandBuffer cb, uint32_t indexCount) const
@@ -1,10 +1,13 @@
 #pragma once
 #include "backend/graphics/RenderPassGeneratorBase.h"
 #include "backend/graphics/CommandBufferManager.h"
+#include "backend/graphics/DepthPyramid.h"
+#include "backend/graphics/MeshRegistry.h"
 #include "backend/graphics/VulkanShaderManager.h"
 #include "backend/graphics/PipelineManager.h"
 #include "backend/graphics/SurfaceManager.h"
 #include "backend/graphics/RenderPassImGUI.h"
+#include "backend/graphics/RenderSnapshot.h"
 #include "backend/graphics/Semaphore.h"
 #include "backend/graphics/Swapchain.h"
 #include "backend/graphics/VkDebug.h"
@@ -22,7 +25,7 @@
 
 #include "extern/AFTERMATH/NsightAftermathGpuCrashTracker.h"
 
-namespace BS { class thread_pool; }
+namespace prl { class JobSystem; }
 
 namespace imp
 {
@@ -33,9 +36,14 @@ namespace imp
 	{
 	public:
 		Graphics();
-		void Initialize(const EngineGraphicsSettings& settings, Window* window);
+		void Initialize(const EngineGraphicsSettings& settings, Window* window, prl::JobSystem& jobSystem);
 
 		void DoTransfers(bool releaseAll);
+		// Pipelined frames only. Takes cameras and draw data written by the main thread for the next frame.
+		// Has to happen before StartFrame, same as the copy in the engine barrier.
+		void ApplyRenderSnapshot(RenderSnapshot& snapshot);
+		// Puts the changed draw commands into this frame's staging buffer, UpdateDrawCommands copies them into place
+		void StageDrawCommands(const UploadPatch& patch);
 		void UpdateDrawCommands();
 		void Cull();
 		void StartFrame();
@@ -62,6 +70,8 @@ namespace imp
 		IGPUBuffer& GetDrawCommandStagingBuffer();
 		// Will return ref to VulkanBuffer used for uploading new descriptor draw data
 		IGPUBuffer& GetDrawDataBuffer();
+		// which of the per-frame buffers is used this frame
+		uint32_t GetFrameClock() const;
 
 		const Comp::MeshGeometry& GetMeshData(uint32_t index) const;
 
@@ -88,9 +98,20 @@ namespace imp
 		// transfer commands
 		VulkanBuffer UploadVulkanBuffer(VkBufferUsageFlags usageFlags, VkBufferUsageFlags dstUsageFlags, VkMemoryPropertyFlags memoryFlags, VkMemoryPropertyFlags dstMemoryFlags, const CommandBuffer& cb, uint32_t allocSize, const void* dataToUpload);
 		void UploadVulkanBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryFlags, VulkanBuffer& dst, const CommandBuffer& cb, uint32_t allocSize, const void* dataToUpload);
+		// elements of dataToUpload go to the given slots of dst
+		void UploadMeshTable(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryFlags, VulkanBuffer& dst, const CommandBuffer& cb, uint32_t elementSize, const std::vector<uint32_t>& slots, const void* dataToUpload);
 		void CopyVulkanBuffer(const VulkanBuffer& src, VulkanBuffer& dst, const CommandBuffer& cb);
 
 		void AcquireDrawCommandBuffer(CommandBuffer& cb);
+		// drawGen passes of a phase, Cull records the early (or only) one and DefaultColorRP the late one
+		void RecordCull(CommandBuffer& cb, OcclusionPhase phase);
+
+		// Hi-Z occlusion culling, only in the GPU-Driven modes
+		bool IsGPUOcclusionCullingActive() const;
+		// (re)creates the pyramid when the swapchain size changed
+		void EnsureDepthPyramid();
+		// depth has to be done being written and in VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, and is left like that
+		void BuildDepthPyramid(CommandBuffer& cb, const Image& depth);
 
 		const Pipeline& EnsurePipeline(VkCommandBuffer cb, const RenderPass& rp /*, Material material*/);
 		void PushConstants(VkCommandBuffer cb, const void* data, uint32_t size, VkPipelineLayout pipeLayout) const;
@@ -147,7 +168,8 @@ namespace imp
 		PrimitivePool<Semaphore, SemaphoreFactory> m_SemaphorePool;
 		PrimitivePool<Fence, FenceFactory> m_FencePool;
 
-		BS::thread_pool* m_JobSystem;
+		// owned by the engine
+		prl::JobSystem* m_JobSystem;
 
 		VkWindow m_Window;
 		VulkanMemory m_MemoryManager;
@@ -159,6 +181,15 @@ namespace imp
 		std::array<VulkanBuffer, kEngineSwapchainDoubleBuffering> m_StagingDrawBuffer;
 		VulkanBuffer m_BoundingVolumeBuffer;
 		uint32_t m_NumDraws;
+		std::vector<VkBufferCopy> m_DrawCommandCopies;
+		// Pipelined frames only. Draw data snapshots only carry what changed, this keeps track of which of the
+		// per-frame draw data buffers are missing what
+		MirroredUploadBuffer m_ShaderDrawData;
+
+		DepthPyramid m_DepthPyramid;
+		VkImageView m_DepthPyramidSource;	// depth view depthPyramid.comp's descriptor set points to
+		bool m_DrawVisibilityValid;			// last frame's visibility is there to draw the early phase with
+		bool m_DrawLodsValid;				// lods drawGen sticks to got filled, they're "none" before the first cull
 
 		std::array<VulkanBuffer, kEngineSwapchainDoubleBuffering> m_GlobalBuffers;
 		std::array<VkDescriptorSet, kEngineSwapchainDoubleBuffering> m_DescriptorSets;
@@ -166,9 +197,8 @@ namespace imp
 		GpuCrashTracker m_AfterMathTracker;
 
 	public:
-		std::unordered_map<uint32_t, Comp::MeshGeometry> m_VertexBuffers;
-
-		std::unordered_map<uint32_t, BoundingVolumeSphere> m_BVs;
+		// every mesh's bounds and geometry, indexed by Comp::Mesh::meshId
+		MeshRegistry m_Meshes;
 
 		// TODO: remove this section and replace with some API
 
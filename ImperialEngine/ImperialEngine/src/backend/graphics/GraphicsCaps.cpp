@@ -5,7 +5,10 @@
 imp::GraphicsCaps::GraphicsCaps() 
     : m_DeviceSurfaceCaps(),
     m_QueueFamilyIndices(),
-    m_MeshShadingSupported(true)
+    m_MeshShadingSupported(true),
+    m_InheritedQueriesSupported(false),
+    m_MultiDrawSupported(false),
+    m_MaxMultiDrawCount(0)
 {
 }
 
@@ -81,6 +84,20 @@ void imp::GraphicsCaps::CollectSupportedFeatures(VkPhysicalDevice device, const
 {
     m_MeshShadingSupported = std::find_if(extensionsUsed.begin(), extensionsUsed.end(), [](auto ex) { return strcmp(ex, VK_NV_MESH_SHADER_EXTENSION_NAME) == 0; }) != extensionsUsed.end();
 
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(device, &features);
+    m_InheritedQueriesSupported = features.inheritedQueries;
+
+    m_MultiDrawSupported = std::find_if(extensionsUsed.begin(), extensionsUsed.end(), [](auto ex) { return strcmp(ex, VK_EXT_MULTI_DRAW_EXTENSION_NAME) == 0; }) != extensionsUsed.end();
+    if (m_MultiDrawSupported)
+    {
+        VkPhysicalDeviceMultiDrawPropertiesEXT multiDrawProps = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTI_DRAW_PROPERTIES_EXT };
+        VkPhysicalDeviceProperties2 props = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+        props.pNext = &multiDrawProps;
+        vkGetPhysicalDeviceProperties2(device, &props);
+        m_MaxMultiDrawCount = multiDrawProps.maxMultiDrawCount;
+    }
+
     // TODO nice-to-have: find support for other stuff like bindless and nvidia nsight extensions..
 }
 
@@ -94,6 +111,21 @@ bool imp::GraphicsCaps::IsMeshShadingSupported() const
     return m_MeshShadingSupported;
 }
 
+bool imp::GraphicsCaps::IsInheritedQueriesSupported() const
+{
+    return m_InheritedQueriesSupported;
+}
+
+bool imp::GraphicsCaps::IsMultiDrawSupported() const
+{
+    return m_MultiDrawSupported;
+}
+
+uint32_t imp::GraphicsCaps::GetMaxMultiDrawCount() const
+{
+    return m_MaxMultiDrawCount;
+}
+
 VkSurfaceFormatKHR imp::GraphicsCaps::ChooseBestSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats)
 {
     if (formats.size() == 1 && formats[0].format == VK_FORMAT_UNDEFINED)
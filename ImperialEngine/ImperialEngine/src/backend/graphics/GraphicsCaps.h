@@ -51,6 +51,11 @@ namespace imp
 		void SetQueueFamilies(QueueFamilyIndices& fams);
 
 		bool IsMeshShadingSupported() const;
+		// queries active in a primary command buffer can count what its secondaries do
+		bool IsInheritedQueriesSupported() const;
+		bool IsMultiDrawSupported() const;
+		// most draws a single vkCmdDrawMultiIndexedEXT can take
+		uint32_t GetMaxMultiDrawCount() const;
 
 		static QueueFamilyIndices GetQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface);
 		static VkSurfaceFormatKHR ChooseBestSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats);
@@ -64,6 +69,9 @@ namespace imp
 		PhysicalDeviceSurfaceCaps m_DeviceSurfaceCaps;
 		QueueFamilyIndices m_QueueFamilyIndices;
 		bool m_MeshShadingSupported;
+		bool m_InheritedQueriesSupported;
+		bool m_MultiDrawSupported;
+		uint32_t m_MaxMultiDrawCount;
 	};
 
 
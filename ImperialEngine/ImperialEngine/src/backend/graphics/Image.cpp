@@ -12,7 +12,7 @@ imp::Image::Image(VkImage img, VkImageView imgView, VkDeviceMemory imgMem)
 {
 }
 
-void imp::Image::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkSampleCountFlagBits numSamples, MemoryProps memProps, VkMemoryPropertyFlags propFlags, VkDevice logicalDevice)
+void imp::Image::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkSampleCountFlagBits numSamples, MemoryProps memProps, VkMemoryPropertyFlags propFlags, VkDevice logicalDevice, uint32_t mipLevels)
 {
     VkImageCreateInfo imageCreateInfo = {};
     imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -20,7 +20,7 @@ void imp::Image::CreateImage(uint32_t width, uint32_t height, VkFormat format, V
     imageCreateInfo.extent.width = width;
     imageCreateInfo.extent.height = height;
     imageCreateInfo.extent.depth = 1;
-    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.mipLevels = mipLevels;
     imageCreateInfo.arrayLayers = 1;
     imageCreateInfo.format = format;
     imageCreateInfo.tiling = tiling;
@@ -47,12 +47,12 @@ void imp::Image::CreateImage(uint32_t width, uint32_t height, VkFormat format, V
     vkBindImageMemory(logicalDevice, m_Image, m_ImageMemory, 0);
 }
 
-void imp::Image::CreateImageView(VkFormat format, VkImageAspectFlags aspectFlags, VkDevice logicalDevice)
+void imp::Image::CreateImageView(VkFormat format, VkImageAspectFlags aspectFlags, VkDevice logicalDevice, uint32_t levelCount)
 {
-    m_ImageView = Image::CreateImageView(m_Image, format, aspectFlags, logicalDevice);
+    m_ImageView = Image::CreateImageView(m_Image, format, aspectFlags, logicalDevice, 0, levelCount);
 }
 
-VkImageView imp::Image::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkDevice logicalDevice)
+VkImageView imp::Image::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkDevice logicalDevice, uint32_t baseMipLevel, uint32_t levelCount)
 {
     assert(image);
     VkImageView imageView;
@@ -67,8 +67,8 @@ VkImageView imp::Image::CreateImageView(VkImage image, VkFormat format, VkImageA
     viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
     viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
     viewCreateInfo.subresourceRange.aspectMask = aspectFlags;
-    viewCreateInfo.subresourceRange.baseMipLevel = 0;
-    viewCreateInfo.subresourceRange.levelCount = 1;
+    viewCreateInfo.subresourceRange.baseMipLevel = baseMipLevel;
+    viewCreateInfo.subresourceRange.levelCount = levelCount;
     viewCreateInfo.subresourceRange.baseArrayLayer = 0;
     viewCreateInfo.subresourceRange.layerCount = 1;
     viewCreateInfo.pNext = nullptr;
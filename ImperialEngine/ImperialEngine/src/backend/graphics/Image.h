@@ -9,9 +9,9 @@ namespace imp
 	public:
 		Image();
 		Image(VkImage img, VkImageView imgView, VkDeviceMemory imgMem);
-		void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkSampleCountFlagBits numSamples, MemoryProps memProps, VkMemoryPropertyFlags propFlags, VkDevice logicalDevice);
-		void CreateImageView(VkFormat format, VkImageAspectFlags aspectFlags, VkDevice logicalDevice);
-		static VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkDevice logicalDevice);
+		void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkSampleCountFlagBits numSamples, MemoryProps memProps, VkMemoryPropertyFlags propFlags, VkDevice logicalDevice, uint32_t mipLevels = 1);
+		void CreateImageView(VkFormat format, VkImageAspectFlags aspectFlags, VkDevice logicalDevice, uint32_t levelCount = 1);
+		static VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkDevice logicalDevice, uint32_t baseMipLevel = 0, uint32_t levelCount = 1);
 
 		VkImage GetImage() const { return m_Image; }
 		VkImageView GetImageView() const { return m_ImageView; }
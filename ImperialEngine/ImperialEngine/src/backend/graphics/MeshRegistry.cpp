@@ -0,0 +1,123 @@
+#include "MeshRegistry.h"
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+
+namespace imp
+{
+	MeshRegistry::MeshRegistry()
+		: m_Bounds()
+		, m_Geometry()
+		, m_Slots()
+		, m_Occluders()
+		, m_FreeSlots()
+		, m_SlotCount(0)
+		, m_NumPages(0)
+		, m_Mutex()
+	{
+	}
+
+	MeshRegistry::~MeshRegistry()
+	{
+		for (uint32_t page = 0; page < m_NumPages; page++)
+			for (auto& occluder : *m_Occluders[page])
+				delete occluder.load(std::memory_order_relaxed);
+	}
+
+	MeshHandle MeshRegistry::Create(const BoundingVolumeSphere& bounds)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		uint32_t index;
+		if (m_FreeSlots.size())
+		{
+			index = m_FreeSlots.back();
+			m_FreeSlots.pop_back();
+		}
+		else
+		{
+			index = m_SlotCount.load(std::memory_order_relaxed);
+			if (index >= kMaxMeshCount)
+				throw std::runtime_error("[Mesh Registry] Fatal Error! Out of mesh slots");
+			if ((index >> kPageShift) >= m_NumPages)
+				AddPage();
+		}
+
+		auto& slot = GetSlot(index);
+		assert(slot.state.load(std::memory_order_relaxed) == SlotState::kFree);
+		slot.state.store(SlotState::kCreated, std::memory_order_release);
+		m_Bounds[index >> kPageShift]->at(index & kPageMask) = bounds;
+		m_Geometry[index >> kPageShift]->at(index & kPageMask) = Comp::MeshGeometry();
+
+		// publish after the slot is filled in, readers only go up to the slot count
+		if (index == m_SlotCount.load(std::memory_order_relaxed))
+			m_SlotCount.store(index + 1, std::memory_order_release);
+
+		return { index, slot.generation };
+	}
+
+	void MeshRegistry::Release(MeshHandle handle)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		if (!IsValid(handle))
+		{
+			printf("[Mesh Registry] Trying to release stale mesh handle %u (generation %u)\n", handle.index, handle.generation);
+			return;
+		}
+
+		auto& slot = GetSlot(handle.index);
+		slot.generation++;
+		slot.state.store(SlotState::kFree, std::memory_order_release);
+		delete m_Occluders[handle.index >> kPageShift]->at(handle.index & kPageMask).exchange(nullptr, std::memory_order_acq_rel);
+		m_FreeSlots.push_back(handle.index);
+	}
+
+	bool MeshRegistry::IsValid(MeshHandle handle) const
+	{
+		if (handle.index >= GetSlotCount())
+			return false;
+
+		const auto& slot = GetSlot(handle.index);
+		return slot.state.load(std::memory_order_acquire) != SlotState::kFree && slot.generation == handle.generation;
+	}
+
+	void MeshRegistry::SetGeometry(uint32_t index, const Comp::MeshGeometry& geometry)
+	{
+		assert(index < GetSlotCount());
+		auto& slot = GetSlot(index);
+		assert(slot.state.load(std::memory_order_relaxed) != SlotState::kFree);
+		m_Geometry[index >> kPageShift]->at(index & kPageMask) = geometry;
+		slot.state.store(SlotState::kUploaded, std::memory_order_release);
+	}
+
+	void MeshRegistry::SetOccluder(uint32_t index, std::unique_ptr<OccluderMesh> occluder)
+	{
+		assert(index < GetSlotCount());
+		assert(GetSlot(index).state.load(std::memory_order_relaxed) != SlotState::kFree);
+		delete m_Occluders[index >> kPageShift]->at(index & kPageMask).exchange(occluder.release(), std::memory_order_acq_rel);
+	}
+
+	uint32_t MeshRegistry::GetLiveCount() const
+	{
+		std::lock_guard lock(m_Mutex);
+		return GetSlotCount() - static_cast<uint32_t>(m_FreeSlots.size());
+	}
+
+	void MeshRegistry::AddPage()
+	{
+		assert(m_NumPages < kMaxPages);
+		m_Bounds[m_NumPages] = std::make_unique<Page<BoundingVolumeSphere>>();
+		m_Geometry[m_NumPages] = std::make_unique<Page<Comp::MeshGeometry>>();
+		m_Slots[m_NumPages] = std::make_unique<Page<Slot>>();
+		m_Occluders[m_NumPages] = std::make_unique<Page<std::atomic<const OccluderMesh*>>>();
+		for (auto& occluder : *m_Occluders[m_NumPages])
+			occluder.store(nullptr, std::memory_order_relaxed);
+		for (auto& slot : *m_Slots[m_NumPages])
+		{
+			slot.generation = 0;
+			slot.state.store(SlotState::kFree, std::memory_order_relaxed);
+		}
+		m_NumPages++;
+	}
+}
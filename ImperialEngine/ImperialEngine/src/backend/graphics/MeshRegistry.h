@@ -0,0 +1,103 @@
+#pragma once
+#include "backend/graphics/VulkanShaderManager.h"
+#include "backend/VariousTypeDefinitions.h"
+#include "frontend/Components/Components.h"
+#include "Utils/NonCopyable.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace imp
+{
+	// Index is what Comp::Mesh, draw data and the GPU mesh tables use. Generation tells a released and reused
+	// slot apart from the mesh that used to be there
+	struct MeshHandle
+	{
+		uint32_t index;
+		uint32_t generation;
+	};
+
+	// Position only copy of a low lod, what CPU occlusion culling rasterizes
+	struct OccluderMesh
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+	};
+
+	// Dense table of every mesh, indexed by slot. Storage is in fixed pages that never move, so the importer can
+	// create meshes on the main thread while the render thread fills in geometry of others and culling reads bounds.
+	// Hot (bounds, lod ranges) and cold (generations, upload state) parts live in separate arrays.
+	// Released slots are reused by the next Create.
+	class MeshRegistry : NonCopyable
+	{
+	public:
+		static constexpr uint32_t kPageShift = 12;
+		static constexpr uint32_t kPageSize = 1u << kPageShift;
+		static constexpr uint32_t kPageMask = kPageSize - 1;
+		static constexpr uint32_t kMaxPages = (kMaxMeshCount + kPageSize - 1) / kPageSize;
+
+		MeshRegistry();
+		~MeshRegistry();
+
+		// Thread safe. Bounds are known when importing, geometry only once it's uploaded
+		MeshHandle Create(const BoundingVolumeSphere& bounds);
+		// Caller makes sure nothing uses the mesh anymore, GPU included
+		void Release(MeshHandle handle);
+
+		bool IsValid(MeshHandle handle) const;
+		bool IsValid(const Comp::Mesh& mesh) const { return IsValid(MeshHandle{ mesh.meshId, mesh.generation }); }
+		// current handle of a live slot
+		MeshHandle GetHandle(uint32_t index) const { return { index, GetSlot(index).generation }; }
+
+		// hot, unchecked. Geometry is only there once IsUploaded says so, other threads than the render thread check first
+		const BoundingVolumeSphere& GetBounds(uint32_t index) const { return m_Bounds[index >> kPageShift]->at(index & kPageMask); }
+		const Comp::MeshGeometry& GetGeometry(uint32_t index) const { return m_Geometry[index >> kPageShift]->at(index & kPageMask); }
+
+		// render thread, once the mesh has been uploaded. Publishes the geometry to IsUploaded
+		void SetGeometry(uint32_t index, const Comp::MeshGeometry& geometry);
+		bool IsUploaded(uint32_t index) const { return GetSlot(index).state.load(std::memory_order_acquire) == SlotState::kUploaded; }
+		// render thread too, null is fine for meshes that shouldn't occlude. Main thread can read it any time after
+		void SetOccluder(uint32_t index, std::unique_ptr<OccluderMesh> occluder);
+		const OccluderMesh* GetOccluder(uint32_t index) const { return m_Occluders[index >> kPageShift]->at(index & kPageMask).load(std::memory_order_acquire); }
+
+		// one past the highest slot ever created, GPU mesh tables have to cover this much
+		uint32_t GetSlotCount() const { return m_SlotCount.load(std::memory_order_acquire); }
+		uint32_t GetLiveCount() const;
+
+	private:
+		enum class SlotState : uint8_t
+		{
+			kFree,
+			kCreated,
+			kUploaded
+		};
+
+		struct Slot
+		{
+			uint32_t generation;
+			std::atomic<SlotState> state;
+		};
+
+		template<typename T>
+		using Page = std::array<T, kPageSize>;
+
+		const Slot& GetSlot(uint32_t index) const { return m_Slots[index >> kPageShift]->at(index & kPageMask); }
+		Slot& GetSlot(uint32_t index) { return m_Slots[index >> kPageShift]->at(index & kPageMask); }
+		void AddPage();
+
+		// hot
+		std::array<std::unique_ptr<Page<BoundingVolumeSphere>>, kMaxPages> m_Bounds;
+		std::array<std::unique_ptr<Page<Comp::MeshGeometry>>, kMaxPages> m_Geometry;
+
+		// cold
+		std::array<std::unique_ptr<Page<Slot>>, kMaxPages> m_Slots;
+		// owned, deleted on Release
+		std::array<std::unique_ptr<Page<std::atomic<const OccluderMesh*>>>, kMaxPages> m_Occluders;
+		std::vector<uint32_t> m_FreeSlots;
+		std::atomic_uint32_t m_SlotCount;
+		uint32_t m_NumPages;
+		mutable std::mutex m_Mutex;
+	};
+}
@@ -0,0 +1,159 @@
+#include "MirroredUploadBuffer.h"
+#include "IGPUBuffer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace imp
+{
+	MirroredUploadBuffer::MirroredUploadBuffer(uint32_t destinationCount)
+		: m_ElementSize(0), m_NumElements(0), m_Bytes(), m_Destinations(destinationCount, { {}, true, 0 }), m_DirtyMask(), m_Ranges()
+	{
+		assert(destinationCount <= 8);
+	}
+
+	void MirroredUploadBuffer::Reset(size_t elementSize)
+	{
+		if (m_ElementSize == elementSize)
+			return;
+
+		m_ElementSize = elementSize;
+		m_NumElements = 0;
+		m_Bytes.clear();
+		m_DirtyMask.clear();
+		MarkAllDirty();
+	}
+
+	void MirroredUploadBuffer::Resize(size_t numElements)
+	{
+		const size_t oldSize = m_NumElements;
+		m_NumElements = numElements;
+		m_Bytes.resize(numElements * m_ElementSize);
+		m_DirtyMask.resize(numElements, 0);
+
+		// destinations just get the smaller size, dirty elements past the end are gone
+		if (numElements < oldSize)
+		{
+			for (auto& dest : m_Destinations)
+				dest.dirty.erase(std::remove_if(dest.dirty.begin(), dest.dirty.end(), [numElements](uint32_t idx) { return idx >= numElements; }), dest.dirty.end());
+			return;
+		}
+		for (size_t i = oldSize; i < numElements; i++)
+			MarkDirty(i);
+	}
+
+	void MirroredUploadBuffer::Write(size_t idx, const void* data)
+	{
+		assert(idx < m_NumElements);
+		std::memcpy(m_Bytes.data() + idx * m_ElementSize, data, m_ElementSize);
+		MarkDirty(idx);
+	}
+
+	void MirroredUploadBuffer::MarkDirty(size_t idx)
+	{
+		for (uint32_t d = 0; d < m_Destinations.size(); d++)
+		{
+			auto& dest = m_Destinations[d];
+			const uint8_t bit = static_cast<uint8_t>(1u << d);
+			if (dest.allDirty || (m_DirtyMask[idx] & bit))
+				continue;
+
+			m_DirtyMask[idx] |= bit;
+			dest.dirty.push_back(static_cast<uint32_t>(idx));
+		}
+	}
+
+	void MirroredUploadBuffer::MarkAllDirty()
+	{
+		for (auto& dest : m_Destinations)
+		{
+			dest.dirty.clear();
+			dest.allDirty = true;
+		}
+		std::fill(m_DirtyMask.begin(), m_DirtyMask.end(), 0);
+	}
+
+	bool MirroredUploadBuffer::IsDirty(uint32_t destination) const
+	{
+		const auto& dest = m_Destinations[destination];
+		return dest.allDirty || !dest.dirty.empty() || dest.flushedSize != m_NumElements;
+	}
+
+	void MirroredUploadBuffer::Apply(const UploadPatch& patch)
+	{
+		Reset(patch.elementSize);
+		Resize(patch.numElements);
+
+		const std::byte* src = patch.bytes.data();
+		for (const auto& range : patch.ranges)
+		{
+			const size_t size = range.count * m_ElementSize;
+			std::memcpy(m_Bytes.data() + range.first * m_ElementSize, src, size);
+			src += size;
+			if (!patch.full)
+				for (uint32_t i = range.first; i < range.first + range.count; i++)
+					MarkDirty(i);
+		}
+
+		if (patch.full)
+			MarkAllDirty();
+	}
+
+	bool MirroredUploadBuffer::TakeDirtyRanges(uint32_t destination, std::vector<UploadRange>& ranges)
+	{
+		auto& dest = m_Destinations[destination];
+		ranges.clear();
+		dest.flushedSize = m_NumElements;
+
+		if (dest.allDirty)
+		{
+			if (m_NumElements)
+				ranges.push_back({ 0, static_cast<uint32_t>(m_NumElements) });
+			dest.allDirty = false;
+			return true;
+		}
+
+		std::sort(dest.dirty.begin(), dest.dirty.end());
+		const uint8_t bit = static_cast<uint8_t>(1u << destination);
+		for (const auto idx : dest.dirty)
+		{
+			m_DirtyMask[idx] &= ~bit;
+			if (!ranges.empty() && ranges.back().first + ranges.back().count == idx)
+				ranges.back().count++;
+			else
+				ranges.push_back({ idx, 1 });
+		}
+		dest.dirty.clear();
+		return false;
+	}
+
+	void MirroredUploadBuffer::Flush(uint32_t destination, IGPUBuffer& dst)
+	{
+		TakeDirtyRanges(destination, m_Ranges);
+
+		auto* dstBytes = static_cast<std::byte*>(dst.GetRawMappedBufferPointer());
+		for (const auto& range : m_Ranges)
+			std::memcpy(dstBytes + range.first * m_ElementSize, m_Bytes.data() + range.first * m_ElementSize, range.count * m_ElementSize);
+		dst.resize(m_NumElements, m_ElementSize);
+	}
+
+	void MirroredUploadBuffer::Flush(uint32_t destination, UploadPatch& patch)
+	{
+		patch.clear();
+		patch.numElements = m_NumElements;
+		patch.elementSize = m_ElementSize;
+		patch.full = TakeDirtyRanges(destination, patch.ranges);
+
+		size_t size = 0;
+		for (const auto& range : patch.ranges)
+			size += range.count * m_ElementSize;
+		patch.bytes.resize(size);
+
+		std::byte* dst = patch.bytes.data();
+		for (const auto& range : patch.ranges)
+		{
+			std::memcpy(dst, m_Bytes.data() + range.first * m_ElementSize, range.count * m_ElementSize);
+			dst += range.count * m_ElementSize;
+		}
+	}
+}
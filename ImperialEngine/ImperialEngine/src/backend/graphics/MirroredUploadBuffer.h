@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace imp
+{
+	class IGPUBuffer;
+
+	struct UploadRange
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// Elements that changed in a MirroredUploadBuffer, packed back to back in range order.
+	// Carried to the render thread in RenderSnapshot.
+	struct UploadPatch
+	{
+		UploadPatch() : numElements(), elementSize(), full(), ranges(), bytes() {}
+
+		void clear() { ranges.clear(); bytes.clear(); full = false; }
+
+		size_t numElements;		// size of the whole buffer after applying
+		size_t elementSize;
+		bool full;				// every element is in it, whoever applies it has to treat everything as changed
+		std::vector<UploadRange> ranges;
+		std::vector<std::byte> bytes;
+	};
+
+	// CPU copy of a GPU buffer that gets copied into several destinations (per-frame buffers, snapshots), keeping track
+	// of what each one of them is missing. Writing an element marks it dirty for everyone, flushing a destination copies
+	// only its dirty elements in as few contiguous ranges as they allow. Nothing changed - nothing gets copied.
+	class MirroredUploadBuffer
+	{
+	public:
+		// up to 8 destinations
+		MirroredUploadBuffer(uint32_t destinationCount);
+
+		// Drops the contents if the element size changes, destinations get everything on the next flush
+		void Reset(size_t elementSize);
+		// New elements are dirty everywhere, shrinking only drops what's past the end
+		void Resize(size_t numElements);
+		void Write(size_t idx, const void* data);
+		// For filling lots of elements without marking them one by one, follow up with MarkAllDirty
+		void* Data() { return m_Bytes.data(); }
+		void MarkDirty(size_t idx);
+		void MarkAllDirty();
+		bool IsDirty(uint32_t destination) const;
+		// Writes the elements and marks them dirty everywhere, a full patch marks everything
+		void Apply(const UploadPatch& patch);
+
+		// Copies what destination is missing into a host-visible GPU buffer
+		void Flush(uint32_t destination, IGPUBuffer& dst);
+		// Packs what destination is missing into patch
+		void Flush(uint32_t destination, UploadPatch& patch);
+
+		size_t size() const { return m_NumElements; }
+		size_t GetElementSize() const { return m_ElementSize; }
+
+	private:
+		struct Destination
+		{
+			std::vector<uint32_t> dirty;
+			bool allDirty;
+			size_t flushedSize;		// it needs a flush when the size changed, even if nothing is dirty
+		};
+
+		// sorts and merges dirty elements of the destination into ranges and forgets them
+		bool TakeDirtyRanges(uint32_t destination, std::vector<UploadRange>& ranges);
+
+		size_t m_ElementSize;
+		size_t m_NumElements;
+		std::vector<std::byte> m_Bytes;
+		std::vector<Destination> m_Destinations;
+		std::vector<uint8_t> m_DirtyMask;	// bit per destination, set while the element is in its dirty list
+		std::vector<UploadRange> m_Ranges;
+	};
+}
@@ -22,6 +22,8 @@ namespace imp
 		VkShaderModule computeModule;
 		VkDescriptorSetLayout descriptorSetLayout;
 		VkDescriptorSetLayout descriptorSetLayout2;
+		// only programs that need a set of their own, VK_NULL_HANDLE otherwise
+		VkDescriptorSetLayout descriptorSetLayout3;
 		auto operator<=>(const ComputePipelineConfig&) const = default;
 	};
 
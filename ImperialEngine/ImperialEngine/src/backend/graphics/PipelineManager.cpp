@@ -52,9 +52,9 @@ namespace imp
 		const auto depthStencilState = MakeDepthStencilStateCI();
 
 		VkPushConstantRange pushRange;
-		pushRange.size = sizeof(uint32_t); // index into draw data
+		pushRange.size = kGraphicsPushConstantSize;
 		pushRange.offset = 0;
-		pushRange.stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_VERTEX_BIT;
+		pushRange.stageFlags = kGraphicsPushConstantStages;
 		std::vector<VkDescriptorSetLayout> layouts = { config.descriptorSetLayout };
 		if (meshPipeline) layouts.push_back(config.descriptorSetLayout2);
 
@@ -92,6 +92,7 @@ namespace imp
 		stage.pName = "main";
 
 		std::vector<VkDescriptorSetLayout> dsetLayouts = { config.descriptorSetLayout, config.descriptorSetLayout2 };
+		if (config.descriptorSetLayout3 != VK_NULL_HANDLE) dsetLayouts.push_back(config.descriptorSetLayout3);
 
 		// TODO mesh: is this needed anymore?
 		VkPushConstantRange pushRange;
@@ -138,7 +139,7 @@ namespace imp
 	{
 		VkVertexInputBindingDescription desc;
 		desc.binding = 0;
-		desc.stride = sizeof(Vertex);
+		desc.stride = sizeof(GPUVertex);
 		desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX; // get from pipe config
 		return desc;
 	}
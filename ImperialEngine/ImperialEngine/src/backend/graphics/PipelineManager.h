@@ -2,10 +2,15 @@
 #include "Utils/NonCopyable.h"
 #include "backend/graphics/Pipeline.h"
 #include "backend/graphics/RenderPass/RenderPass.h"
+#include "Utils/EngineStaticConfig.h"
 #include <optional>
 
 namespace imp
 {
+	// draw index, then the occlusion phase for the task shader
+	inline constexpr uint32_t kGraphicsPushConstantSize = sizeof(uint32_t) * 2;
+	inline constexpr VkShaderStageFlags kGraphicsPushConstantStages = VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_VERTEX_BIT | (CONE_CULLING_ENABLED ? VK_SHADER_STAGE_TASK_BIT_EXT : 0);
+
 	class PipelineManager : NonCopyable
 	{
 	public: 
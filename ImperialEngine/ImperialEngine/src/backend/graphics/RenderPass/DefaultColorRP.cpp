@@ -1,22 +1,26 @@
 #include "DefaultColorRP.h"
 #include "backend/graphics/Graphics.h"
 #include "Utils/GfxUtilities.h"
+#include "backend/parallel/JobSystem.h"
 #include "GLM/gtc/matrix_transform.hpp"
 
 namespace imp
 {
+	// Below this many draws per thread it's not worth recording in parallel
+	static constexpr uint32_t kMinDrawsPerSecondary = 2048;
+
 	DefaultColorRP::DefaultColorRP()
-		: RenderPass()
+		: RenderPass(), m_ResumeRenderPass()
 	{
 	}
 
 	void DefaultColorRP::Execute(Graphics& gfx, const CameraData& cam)
 	{
 		const auto& renderMode = gfx.GetGraphicsSettings().renderMode;
+		const uint32_t secondaryCount = renderMode == kEngineRenderModeTraditional ? GetSecondaryCommandBufferCount(gfx) : 0;
 		constexpr uint32_t numCmbs = 1;
 		auto cmbs = gfx.m_CbManager.AquireCommandBuffers(gfx.m_LogicalDevice, numCmbs);
 		CommandBuffer cmb = cmbs[0];
-		VkCommandBuffer cb = cmb.cmb;
 		cmb.Begin();
 
 #if !CULLING_ENABLED
@@ -24,9 +28,96 @@ namespace imp
 		// If culling is disabled then we still have to acquire draw command buffer if transfer was done. Even if no tranfer we need to mark this buffer used in queueu.
 		gfx.AcquireDrawCommandBuffer(cmb);
 #endif
+		if (secondaryCount)
+			RecordTraditionalInParallel(gfx, cmb, secondaryCount);
+		else if (gfx.IsGPUOcclusionCullingActive())
+			RecordTwoPhase(gfx, cmb);
+		else
+			RecordInline(gfx, cmb);
+		cmb.End();
+
+		// since we know vertex and index buffer will have same semaphore it's safe to do this for now
+		// but probably should implement some easier way to round up all unique semaphores.. Or is it not needed? Maybe we can wait of two identical semaphores
+		auto semaphores = GetSemaphoresToWaitOn();
+		if (gfx.m_VertexBuffer.HasSemaphore())
+			semaphores.push_back(gfx.m_VertexBuffer.StealSemaphore());
+		if(gfx.m_DrawBuffer.HasSemaphore())
+			semaphores.push_back(gfx.m_DrawBuffer.StealSemaphore());
+
+		//TODO: switch using VkSemaphores to imp::Semaphores
+		std::vector<Semaphore> ourSemaphores;
+		for (const auto& sem : semaphores)
+			ourSemaphores.push_back(Semaphore(sem));
+
+		gfx.m_CbManager.SubmitInternal(cmb, ourSemaphores); // should provide semaphores here
+	}
+
+	void DefaultColorRP::Destroy(VkDevice device)
+	{
+		if (m_ResumeRenderPass)
+			vkDestroyRenderPass(device, m_ResumeRenderPass, nullptr);
+		RenderPass::Destroy(device);
+	}
+
+	void DefaultColorRP::RecordInline(Graphics& gfx, CommandBuffer cmb)
+	{
+		const auto& renderMode = gfx.GetGraphicsSettings().renderMode;
+		VkCommandBuffer cb = cmb.cmb;
+
 		BeginRenderPass(gfx, cmb);
 
 		gfx.m_TimestampQueryManager.BeginPipelineStatQueries(cb, gfx.m_Swapchain.GetFrameClock());
+		if (renderMode == kEngineRenderModeTraditional)
+		{
+			AUTO_TIMER("[CPU DRAWS]: ");
+			const auto pipe = gfx.EnsurePipeline(cb, *this);	// since we have to get pipeline, bind here and not in that func
+			const auto dset = gfx.m_ShaderManager.GetDescriptorSet(gfx.m_Swapchain.GetFrameClock());
+			vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe.GetPipelineLayout(), 0, 1, &dset, 0, nullptr);
+			vkCmdBindIndexBuffer(cb, gfx.m_IndexBuffer.GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+			RecordTraditionalDraws(gfx, cb, pipe.GetPipelineLayout(), 0, static_cast<uint32_t>(gfx.m_DrawData.size()));
+		}
+		else
+			RecordIndirectDraws(gfx, cb, kOcclusionPhaseNone);
+
+		gfx.m_TimestampQueryManager.EndPipelineStatQueries(cb, gfx.m_Swapchain.GetFrameClock());
+
+		EndRenderPass(gfx, cmb);
+	}
+
+	void DefaultColorRP::RecordTwoPhase(Graphics& gfx, CommandBuffer cmb)
+	{
+		VkCommandBuffer cb = cmb.cmb;
+		const auto frameClock = gfx.m_Swapchain.GetFrameClock();
+
+		// the pyramid gets built between the passes, so queries go around both of them
+		gfx.m_TimestampQueryManager.BeginPipelineStatQueries(cb, frameClock);
+
+		BeginRenderPass(gfx, cmb);
+		RecordIndirectDraws(gfx, cb, kOcclusionPhaseEarly);
+		EndRenderPass(gfx, cmb);
+
+		gfx.m_TimestampQueryManager.WriteTimestamp(cb, kQueryOcclusionBegin, frameClock);
+		gfx.BuildDepthPyramid(cmb, m_Surfaces.back().GetImage());	// depth goes after color
+		gfx.RecordCull(cmb, kOcclusionPhaseLate);
+		gfx.m_TimestampQueryManager.WriteTimestamp(cb, kQueryOcclusionEnd, frameClock);
+
+		// late draws go on top of what the early ones wrote
+		VkMemoryBarrier colorBar = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		colorBar.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		colorBar.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 1, &colorBar, 0, nullptr, 0, nullptr);
+
+		ResumeRenderPass(gfx, cmb);
+		RecordIndirectDraws(gfx, cb, kOcclusionPhaseLate);
+		EndRenderPass(gfx, cmb);
+
+		gfx.m_TimestampQueryManager.EndPipelineStatQueries(cb, frameClock);
+	}
+
+	void DefaultColorRP::RecordIndirectDraws(Graphics& gfx, VkCommandBuffer cb, OcclusionPhase phase)
+	{
+		const auto& renderMode = gfx.GetGraphicsSettings().renderMode;
 		const auto pipe = gfx.EnsurePipeline(cb, *this);	// since we have to get pipeline, bind here and not in that func
 		if (renderMode == kEngineRenderModeGPUDrivenMeshShading)
 		{
@@ -46,26 +137,12 @@ namespace imp
 		const auto bigIdxBuffer = gfx.m_IndexBuffer.GetBuffer();
 		vkCmdBindIndexBuffer(cb, bigIdxBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-		const auto vp = gfx.m_MainCamera.Projection * gfx.m_MainCamera.View;
+		// draw index comes from the draw commands, basic.task needs the phase
+		const std::array<uint32_t, 2> push = { 0, phase };
+		gfx.PushConstants(cb, push.data(), sizeof(push), pipe.GetPipelineLayout());
 
 		switch (renderMode)
 		{
-		case kEngineRenderModeTraditional:
-		{
-			AUTO_TIMER("[CPU DRAWS]: ");
-			uint32_t drawIndex = 0;
-			for (const auto& drawData : gfx.m_DrawData)
-			{
-				gfx.PushConstants(cb, &drawIndex, sizeof(uint32_t), pipe.GetPipelineLayout());
-
-				const auto lodIdx = drawData.LodIdx;
-
-				const auto& mesh = gfx.m_VertexBuffers.at(drawData.VertexBufferId);
-				vkCmdDrawIndexed(cb, mesh.indices[lodIdx].GetCount(), 1, mesh.indices[lodIdx].GetOffset(), mesh.vertices.GetOffset(), 0);
-				drawIndex++;
-			}
-		}
-			break;
 #if CULLING_ENABLED
 		case kEngineRenderModeGPUDriven:
 			vkCmdDrawIndexedIndirectCount(cb, gfx.m_DrawBuffer.GetBuffer(), 0, gfx.GetDrawCommandCountBuffer().GetBuffer(), 0, gfx.m_NumDraws, sizeof(VkDrawIndexedIndirectCommand));
@@ -84,26 +161,187 @@ namespace imp
 			vkCmdDrawMeshTasksIndirectNV(cb, gfx.m_DrawBuffer.GetBuffer(), 0, gfx.m_NumDraws, DrawMeshTasksIndirectCountSize);
 			break;
 #endif
+		default:
+			break;
 		}
+	}
 
-		gfx.m_TimestampQueryManager.EndPipelineStatQueries(cb, gfx.m_Swapchain.GetFrameClock());
+	void DefaultColorRP::ResumeRenderPass(Graphics& gfx, CommandBuffer cmb)
+	{
+		if (!m_ResumeRenderPass)
+		{
+			RenderPassDesc desc = m_Desc;
+			for (uint32_t i = 0; i < desc.colorAttachmentCount; i++)
+			{
+				desc.colorSurfaces[i].loadOp = kLoadOpLoad;
+				desc.colorSurfaces[i].initialLayout = desc.colorSurfaces[i].finalLayout;
+			}
+			desc.depthSurface.loadOp = kLoadOpLoad;
+			desc.depthSurface.initialLayout = desc.depthSurface.finalLayout;
+			// compatible with m_RenderPass, so the framebuffer and pipelines work with both
+			m_ResumeRenderPass = CreateVkRenderPass(gfx.m_LogicalDevice, desc);
+		}
+
+		VkRenderPassBeginInfo renderPassBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+		renderPassBeginInfo.renderPass = m_ResumeRenderPass;
+		renderPassBeginInfo.renderArea.offset = { 0, 0 };
+		renderPassBeginInfo.renderArea.extent = { GetSurfaceDescriptions()[0].width, GetSurfaceDescriptions()[0].height };
+		renderPassBeginInfo.framebuffer = m_Framebuffer.GetVkFramebuffer();
+
+		vkCmdBeginRenderPass(cmb.cmb, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	}
+
+	// Draw data gets split in even ranges, each recorded into a secondary command buffer from its own pool on a job
+	// system thread. The primary only begins the render pass and executes them
+	void DefaultColorRP::RecordTraditionalInParallel(Graphics& gfx, CommandBuffer cmb, uint32_t secondaryCount)
+	{
+		AUTO_TIMER("[CPU DRAWS]: ");
+		VkCommandBuffer cb = cmb.cmb;
+		const auto frameClock = gfx.m_Swapchain.GetFrameClock();
+
+		// pipeline manager isn't thread safe, get it here. Binding it to the primary outside the render pass does nothing
+		const auto pipe = gfx.EnsurePipeline(cb, *this);
+		const auto pipeLayout = pipe.GetPipelineLayout();
+		const auto dset = gfx.m_ShaderManager.GetDescriptorSet(frameClock);
+		const auto bigIdxBuffer = gfx.m_IndexBuffer.GetBuffer();
+
+		// nothing but vkCmdExecuteCommands can go into a subpass with secondary contents, so queries go around the render pass
+		gfx.m_TimestampQueryManager.BeginPipelineStatQueries(cb, frameClock);
+		BeginRenderPass(gfx, cmb, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		VkCommandBufferInheritanceInfo inheritance = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+		inheritance.renderPass = m_RenderPass;
+		inheritance.subpass = 0;
+		inheritance.framebuffer = m_Framebuffer.GetVkFramebuffer();
+		inheritance.pipelineStatistics = kPipelineStatisticFlags;
+
+		auto secondaries = gfx.m_CbManager.AquireSecondaryCommandBuffers(gfx.m_LogicalDevice, secondaryCount);
+		const uint32_t drawCount = static_cast<uint32_t>(gfx.m_DrawData.size());
+		const uint32_t drawsPerSecondary = (drawCount + secondaryCount - 1) / secondaryCount;
+
+		// a secondary per job, its pool isn't touched by any other thread while it's recorded
+		gfx.m_JobSystem->ParallelFor(secondaryCount, [&](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+				{
+					auto& secondary = secondaries[i];
+					secondary.Begin(inheritance);
+
+					// no state is inherited from the primary
+					vkCmdBindPipeline(secondary.cmb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe.GetPipeline());
+					vkCmdBindDescriptorSets(secondary.cmb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeLayout, 0, 1, &dset, 0, nullptr);
+					vkCmdBindIndexBuffer(secondary.cmb, bigIdxBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+					const uint32_t firstDraw = std::min(static_cast<uint32_t>(i) * drawsPerSecondary, drawCount);
+					const uint32_t lastDraw = std::min(firstDraw + drawsPerSecondary, drawCount);
+					RecordTraditionalDraws(gfx, secondary.cmb, pipeLayout, firstDraw, lastDraw);
+
+					secondary.End();
+				}
+			}, 1);
+
+		std::vector<VkCommandBuffer> secondaryCmbs;
+		for (const auto& secondary : secondaries)
+			secondaryCmbs.push_back(secondary.cmb);
+		vkCmdExecuteCommands(cb, static_cast<uint32_t>(secondaryCmbs.size()), secondaryCmbs.data());
 
 		EndRenderPass(gfx, cmb);
-		cmb.End();
+		gfx.m_TimestampQueryManager.EndPipelineStatQueries(cb, frameClock);
+	}
 
-		// since we know vertex and index buffer will have same semaphore it's safe to do this for now
-		// but probably should implement some easier way to round up all unique semaphores.. Or is it not needed? Maybe we can wait of two identical semaphores
-		auto semaphores = GetSemaphoresToWaitOn();
-		if (gfx.m_VertexBuffer.HasSemaphore())
-			semaphores.push_back(gfx.m_VertexBuffer.StealSemaphore());
-		if(gfx.m_DrawBuffer.HasSemaphore())
-			semaphores.push_back(gfx.m_DrawBuffer.StealSemaphore());
+	static EngineDrawIdMode GetDrawIdMode(const EngineGraphicsSettings& settings, const GraphicsCaps& caps)
+	{
+		if (settings.drawIdMode == kEngineDrawIdMultiDraw && !caps.IsMultiDrawSupported())
+			return kEngineDrawIdFirstInstance;
+		return settings.drawIdMode;
+	}
 
-		//TODO: switch using VkSemaphores to imp::Semaphores
-		std::vector<Semaphore> ourSemaphores;
-		for (const auto& sem : semaphores)
-			ourSemaphores.push_back(Semaphore(sem));
+	void DefaultColorRP::RecordTraditionalDraws(const Graphics& gfx, VkCommandBuffer cb, VkPipelineLayout pipeLayout, uint32_t first, uint32_t last) const
+	{
+		const bool instanced = gfx.m_Settings.instancingEnabled;
+		const auto drawIdMode = GetDrawIdMode(gfx.m_Settings, gfx.m_GfxCaps);
 
-		gfx.m_CbManager.SubmitInternal(cmb, ourSemaphores); // should provide semaphores here
+		// basic.vert adds up the pushed index, gl_InstanceIndex and gl_DrawID, so it has to be 0 when nothing else is pushed
+		if (drawIdMode != kEngineDrawIdPushConstant)
+		{
+			const uint32_t zero = 0;
+			gfx.PushConstants(cb, &zero, sizeof(uint32_t), pipeLayout);
+		}
+
+		// instanced runs all have different instance counts, a multi draw takes one for all of its draws
+		if (drawIdMode == kEngineDrawIdMultiDraw && !instanced)
+		{
+			RecordTraditionalMultiDraws(gfx, cb, first, last);
+			return;
+		}
+
+		const auto& allDrawData = gfx.m_DrawData;
+		uint32_t drawIndex = first;
+		while (drawIndex < last)
+		{
+			const auto& drawData = allDrawData[drawIndex];
+			uint32_t firstInstance = drawIndex;
+			if (drawIdMode == kEngineDrawIdPushConstant)
+			{
+				gfx.PushConstants(cb, &drawIndex, sizeof(uint32_t), pipeLayout);
+				firstInstance = 0;
+			}
+
+			// draw data got sorted by mesh and lod, a run of the same one is one instanced draw.
+			// basic.vert finds the rest of the draw data after drawIndex
+			uint32_t instanceCount = 1;
+			if (instanced)
+			{
+				while (drawIndex + instanceCount < last
+					&& allDrawData[drawIndex + instanceCount].VertexBufferId == drawData.VertexBufferId
+					&& allDrawData[drawIndex + instanceCount].LodIdx == drawData.LodIdx)
+					instanceCount++;
+			}
+
+			const auto lodIdx = drawData.LodIdx;
+
+			const auto& mesh = gfx.m_Meshes.GetGeometry(drawData.VertexBufferId);
+			vkCmdDrawIndexed(cb, mesh.indices[lodIdx].GetCount(), instanceCount, mesh.indices[lodIdx].GetOffset(), mesh.vertices.GetOffset(), firstInstance);
+			drawIndex += instanceCount;
+		}
+	}
+
+	void DefaultColorRP::RecordTraditionalMultiDraws(const Graphics& gfx, VkCommandBuffer cb, uint32_t first, uint32_t last) const
+	{
+		// reused between frames, every recording thread has its own
+		static thread_local std::vector<VkMultiDrawIndexedInfoEXT> tlsDraws;
+		auto& draws = tlsDraws;
+
+		const auto& allDrawData = gfx.m_DrawData;
+		const uint32_t maxBatch = gfx.m_GfxCaps.GetMaxMultiDrawCount();
+		for (uint32_t batchStart = first; batchStart < last; batchStart += maxBatch)
+		{
+			const uint32_t batchEnd = std::min(batchStart + maxBatch, last);
+			draws.resize(batchEnd - batchStart);
+			for (uint32_t drawIndex = batchStart; drawIndex < batchEnd; drawIndex++)
+			{
+				const auto& drawData = allDrawData[drawIndex];
+				const auto& mesh = gfx.m_Meshes.GetGeometry(drawData.VertexBufferId);
+				auto& draw = draws[drawIndex - batchStart];
+				draw.firstIndex = mesh.indices[drawData.LodIdx].GetOffset();
+				draw.indexCount = mesh.indices[drawData.LodIdx].GetCount();
+				draw.vertexOffset = mesh.vertices.GetOffset();
+			}
+
+			// gl_DrawID counts from 0 in every call, firstInstance says where the batch starts
+			vkCmdDrawMultiIndexedEXT(cb, static_cast<uint32_t>(draws.size()), draws.data(), 1, batchStart, sizeof(VkMultiDrawIndexedInfoEXT), nullptr);
+		}
+	}
+
+	uint32_t DefaultColorRP::GetSecondaryCommandBufferCount(const Graphics& gfx) const
+	{
+		// secondaries have to count towards the pipeline statistics query of the primary
+		if (!gfx.m_GfxCaps.IsInheritedQueriesSupported())
+			return 0;
+
+		const uint32_t drawCount = static_cast<uint32_t>(gfx.m_DrawData.size());
+		const uint32_t count = std::min(gfx.m_CbManager.GetRecordingThreadCount(), drawCount / kMinDrawsPerSecondary);
+		// one is no better than recording inline
+		return count > 1 ? count : 0;
 	}
-}
+}
\ No newline at end of file
@@ -10,5 +10,26 @@ namespace imp
 		DefaultColorRP();
 
 		void Execute(Graphics& gfx, const CameraData& cam) override;
+
+		void Destroy(VkDevice device) override;
+
+	private:
+		void RecordInline(Graphics& gfx, CommandBuffer cmb);
+		// GPU-Driven with Hi-Z occlusion culling. Draws what was visible last frame, builds the depth pyramid out of that,
+		// culls against it and draws what turned visible in a second pass that keeps the first one's color and depth
+		void RecordTwoPhase(Graphics& gfx, CommandBuffer cmb);
+		void RecordIndirectDraws(Graphics& gfx, VkCommandBuffer cb, OcclusionPhase phase);
+		// same framebuffer as BeginRenderPass, loads instead of clearing
+		void ResumeRenderPass(Graphics& gfx, CommandBuffer cmb);
+		// Traditional only, draws get recorded into secondaries on job system threads
+		void RecordTraditionalInParallel(Graphics& gfx, CommandBuffer cmb, uint32_t secondaryCount);
+		// draws [first, last) of the draw data
+		void RecordTraditionalDraws(const Graphics& gfx, VkCommandBuffer cb, VkPipelineLayout pipeLayout, uint32_t first, uint32_t last) const;
+		// same as above without instancing, as few vkCmdDrawMultiIndexedEXT as maxMultiDrawCount allows
+		void RecordTraditionalMultiDraws(const Graphics& gfx, VkCommandBuffer cb, uint32_t first, uint32_t last) const;
+		// 0 when draws should be recorded inline
+		uint32_t GetSecondaryCommandBufferCount(const Graphics& gfx) const;
+
+		VkRenderPass m_ResumeRenderPass;
 	};
 }
\ No newline at end of file
@@ -11,15 +11,19 @@ imp::RenderPass::RenderPass()
 void imp::RenderPass::Create(VkDevice device, const RenderPassDesc& desc)
 {
 	m_Desc = desc;
+	m_RenderPass = CreateVkRenderPass(device, desc);
+}
 
-	auto attachmentDescriptions = CreateAttachmentDescs(m_Desc.colorSurfaces.data(), m_Desc.colorAttachmentCount);
+VkRenderPass imp::RenderPass::CreateVkRenderPass(VkDevice device, const RenderPassDesc& desc) const
+{
+	auto attachmentDescriptions = CreateAttachmentDescs(desc.colorSurfaces.data(), desc.colorAttachmentCount);
 	if (desc.depthSurface.format)
 	{
-		auto depthDescriptions = CreateAttachmentDescs(&m_Desc.depthSurface, 1);
+		auto depthDescriptions = CreateAttachmentDescs(&desc.depthSurface, 1);
 		attachmentDescriptions.insert(attachmentDescriptions.end(), depthDescriptions.begin(), depthDescriptions.end());
 	}
 	// TODO: not implemented!! supposed to be empty rn
-	auto resolveDescriptions = CreateResolveAttachmentDescs(m_Desc.colorSurfaces.data(), m_Desc.colorAttachmentCount);
+	auto resolveDescriptions = CreateResolveAttachmentDescs(desc.colorSurfaces.data(), desc.colorAttachmentCount);
 
 	std::vector<VkAttachmentReference> colorAttachments;
 	colorAttachments.resize(desc.colorAttachmentCount);
@@ -77,9 +81,11 @@ void imp::RenderPass::Create(VkDevice device, const RenderPassDesc& desc)
 	renderPassCreateInfo.dependencyCount = 1;
 	renderPassCreateInfo.pDependencies = &dependency;
 
-	VkResult result = vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &m_RenderPass);
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkResult result = vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &renderPass);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create a Render Pass");
+	return renderPass;
 }
 
 bool imp::RenderPass::HasBackbuffer() const
@@ -163,7 +169,7 @@ void imp::RenderPass::Destroy(VkDevice device)
 	vkDestroyRenderPass(device, m_RenderPass, nullptr);
 }
 
-void imp::RenderPass::BeginRenderPass(Graphics& gfx, CommandBuffer cmb)
+void imp::RenderPass::BeginRenderPass(Graphics& gfx, CommandBuffer cmb, VkSubpassContents contents)
 {
 	// TODO: should somehow be able to get input surfaces
 	// and also attachments and map them to the surface descriptions
@@ -209,7 +215,7 @@ void imp::RenderPass::BeginRenderPass(Graphics& gfx, CommandBuffer cmb)
 	renderPassBeginInfo.clearValueCount = clear ? clearValues.size() : 0;
 	renderPassBeginInfo.framebuffer = m_Framebuffer.GetVkFramebuffer();
 
-	vkCmdBeginRenderPass(cmb.cmb, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(cmb.cmb, &renderPassBeginInfo, contents);
 }
 
 void imp::RenderPass::EndRenderPass(Graphics& gfx, CommandBuffer cmb)
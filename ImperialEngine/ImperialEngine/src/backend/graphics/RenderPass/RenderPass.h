@@ -64,9 +64,11 @@ namespace imp
 
 	protected:
 
-		void BeginRenderPass(Graphics& gfx, CommandBuffer cmb);
+		void BeginRenderPass(Graphics& gfx, CommandBuffer cmb, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 		void EndRenderPass(Graphics& gfx, CommandBuffer cmb);
 
+		VkRenderPass CreateVkRenderPass(VkDevice device, const RenderPassDesc& desc) const;
+
 		std::vector<VkAttachmentDescription> CreateAttachmentDescs(const SurfaceDesc* descs, const uint32_t descCount) const;
 		std::vector<VkAttachmentDescription> CreateResolveAttachmentDescs(const SurfaceDesc* descs, const uint32_t descCount) const;
 
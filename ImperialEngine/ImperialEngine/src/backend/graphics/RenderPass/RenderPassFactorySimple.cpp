@@ -39,7 +39,7 @@ namespace imp
 			1,
 			0, // udnefined
 			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-			kLoadOpClear, kStoreOpDontCare,
+			kLoadOpClear, kStoreOpStore, // Hi-Z reads it after the pass
 			false,
 			false };
 
@@ -0,0 +1,35 @@
+#pragma once
+#include "backend/VariousTypeDefinitions.h"
+#include "backend/graphics/MirroredUploadBuffer.h"
+#include "Utils/FrameTimeTable.h"
+#include <atomic>
+#include <vector>
+
+namespace imp
+{
+	// Everything the render thread needs from the main thread for one frame.
+	// Used when frames are pipelined (EngineSettings::framesInFlight > 0) instead of copying in the barrier.
+	struct RenderSnapshot
+	{
+		RenderSnapshot()
+			: mainCamera(), previewCamera(), drawData(), shaderDrawData(), drawCommands(), drawCommandsDirty(), renderStats(), timesConsumed(0)
+		{}
+
+		CameraData mainCamera;
+		CameraData previewCamera;
+
+		// Traditional
+		std::vector<DrawDataSingle> drawData;
+
+		// GPU-driven, only what changed since the last snapshot
+		UploadPatch shaderDrawData;
+		UploadPatch drawCommands;	// only filled when drawCommandsDirty
+		bool drawCommandsDirty;
+
+		// Written by the render thread when it picks the snapshot up, read by main thread once it gets the slot back
+		FrameTimeRow renderStats;
+
+		// Fence. Number of times the render thread has picked up this slot.
+		std::atomic<uint64_t> timesConsumed;
+	};
+}
@@ -87,9 +87,9 @@ imp::Surface imp::SurfaceManager::CreateSurface(const SurfaceDesc& desc, VkDevic
             VK_IMAGE_TILING_OPTIMAL, attachmentBit | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
             static_cast<VkSampleCountFlagBits>(desc.msaaCount), m_MemoryProps, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, device);
     }
-    else
+    else // depth gets sampled to build the depth pyramid
         img.CreateImage(desc.width, desc.height, desc.format,
-            VK_IMAGE_TILING_OPTIMAL, attachmentBit,
+            VK_IMAGE_TILING_OPTIMAL, attachmentBit | VK_IMAGE_USAGE_SAMPLED_BIT,
             static_cast<VkSampleCountFlagBits>(desc.msaaCount), m_MemoryProps, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, device);
 
     // This is not good, now only creating one specific view
@@ -1,6 +1,6 @@
 #include "VulkanShaderManager.h"
 #include "backend/graphics/Graphics.h"
-#include "extern/THREAD-POOL/BS_thread_pool.hpp"
+#include "backend/parallel/JobSystem.h"
 #include <optional>
 #include <execution>
 #include <algorithm>
@@ -19,19 +19,26 @@ namespace imp
 		m_MeshData(),
 		m_msMeshData(),
 		m_DrawCommandCount(),
+		m_InstanceBuckets(),
+		m_DrawInstances(),
+		m_DrawVisibility(),
+		m_DrawLods(),
 		m_MeshletData(),
 		m_MeshletVertexData(),
 		m_MeshletTriangleData(),
 		m_MeshletNormalConeData(),
+		m_MeshletBounds(),
 		m_JobSystem(),
 		m_DescriptorSets(),
 		m_ComputeDescriptorSets(),
 		m_DescriptorSetLayout(),
-		m_ComputeDescriptorSetLayout()
+		m_ComputeDescriptorSetLayout(),
+		m_DepthPyramidDescriptorSet(),
+		m_DepthPyramidDescriptorSetLayout()
 	{
 	}
 
-	void VulkanShaderManager::Initialize(VkDevice device, VulkanMemory& memory, const EngineGraphicsSettings& settings, BS::thread_pool* jobSystem, const MemoryProps& memProps, VulkanBuffer& drawCommands, VulkanBuffer& vertices)
+	void VulkanShaderManager::Initialize(VkDevice device, VulkanMemory& memory, const EngineGraphicsSettings& settings, prl::JobSystem* jobSystem, const MemoryProps& memProps, VulkanBuffer& drawCommands, VulkanBuffer& vertices)
 	{
 		m_JobSystem = jobSystem;
 
@@ -45,6 +52,10 @@ namespace imp
 		static constexpr uint32_t kMeshDataBufferSize = sizeof(MeshData) * kMaxMeshCount;
 		static constexpr uint32_t kmsMeshDataBufferSize = sizeof(ms_MeshData) * kMaxMeshCount;
 		static constexpr uint32_t kDrawCommandCountBufferSize = sizeof(uint32_t);
+		static constexpr uint32_t kInstanceBucketBufferSize = kInstanceBucketHeaderSize + sizeof(InstanceBucket) * kMaxMeshCount * kMaxLODCount;
+		static constexpr uint32_t kDrawInstanceBufferSize = sizeof(uint32_t) * kMaxDrawCount;
+		static constexpr uint32_t kDrawVisibilityBufferSize = sizeof(uint32_t) * kMaxDrawCount;
+		static constexpr uint32_t kDrawLodBufferSize = sizeof(uint32_t) * kMaxDrawCount;
 
 		// these allocations related to meshlets are probably not correct if we're trying to allocate max allowed
 		// (this means we have max unique meshes then they can have only 1 meshlet each)
@@ -52,6 +63,7 @@ namespace imp
 		static constexpr uint32_t kMeshletVertexDataBufferSize = sizeof(uint32_t) * kMaxMeshCount * kMaxMeshletVertices * 6;
 		static constexpr uint32_t kMeshletTriangleDataBufferSize = sizeof(uint8_t) * kMaxMeshCount * kMaxMeshletTriangles * 9;
 		static constexpr uint32_t kMeshletNormalConeDataBufferSize = sizeof(NormalCone) * kMaxMeshCount * 6;
+		static constexpr uint32_t kMeshletBoundsBufferSize = sizeof(BoundingVolumeSphere) * kMaxMeshCount * 6;
 
 		static constexpr auto kHostVisisbleCoherentFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 		static constexpr auto kStorageDstFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
@@ -83,12 +95,18 @@ namespace imp
 		m_MeshData = memory.GetBuffer(device, kMeshDataBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
 		m_msMeshData = memory.GetBuffer(device, kmsMeshDataBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
 		m_DrawCommandCount = memory.GetBuffer(device, kDrawCommandCountBufferSize, kStorageDstFlags | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
+		m_InstanceBuckets = memory.GetBuffer(device, kInstanceBucketBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
+		m_DrawInstances = memory.GetBuffer(device, kDrawInstanceBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
+		m_DrawVisibility = memory.GetBuffer(device, kDrawVisibilityBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
+		m_DrawLods = memory.GetBuffer(device, kDrawLodBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
 		m_MeshletData = memory.GetBuffer(device, kMeshletDataBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
 		m_MeshletVertexData = memory.GetBuffer(device, kMeshletVertexDataBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
 		m_MeshletTriangleData = memory.GetBuffer(device, kMeshletTriangleDataBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
 		m_MeshletNormalConeData = memory.GetBuffer(device, kMeshletNormalConeDataBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
+		m_MeshletBounds = memory.GetBuffer(device, kMeshletBoundsBufferSize, kStorageDstFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memProps);
 
 		deviceMemUsed += kMeshDataBufferSize + kDrawDataIndicesBufferSize + kDrawCommandCountBufferSize + kMeshletDataBufferSize + kmsMeshDataBufferSize + kMeshletVertexDataBufferSize + kMeshletTriangleDataBufferSize + kMeshletNormalConeDataBufferSize;
+		deviceMemUsed += kInstanceBucketBufferSize + kDrawInstanceBufferSize + kDrawVisibilityBufferSize + kDrawLodBufferSize + kMeshletBoundsBufferSize;
 
 		CreateMegaDescriptorSets(device);
 
@@ -109,6 +127,12 @@ namespace imp
 		WriteUpdateDescriptorSetsSingleBuffer(device, m_ComputeDescriptorSets.data(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletVertexData, kMeshletVertexDataBufferSize, 6, 1, kEngineSwapchainDoubleBuffering);
 		WriteUpdateDescriptorSetsSingleBuffer(device, m_ComputeDescriptorSets.data(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletTriangleData, kMeshletTriangleDataBufferSize, 7, 1, kEngineSwapchainDoubleBuffering);
 		WriteUpdateDescriptorSetsSingleBuffer(device, m_ComputeDescriptorSets.data(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletNormalConeData, kMeshletNormalConeDataBufferSize, 8, 1, kEngineSwapchainDoubleBuffering);
+		WriteUpdateDescriptorSetsSingleBuffer(device, m_ComputeDescriptorSets.data(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_InstanceBuckets, kInstanceBucketBufferSize, 9, 1, kEngineSwapchainDoubleBuffering);
+		WriteUpdateDescriptorSetsSingleBuffer(device, m_ComputeDescriptorSets.data(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_DrawInstances, kDrawInstanceBufferSize, 10, 1, kEngineSwapchainDoubleBuffering);
+		WriteUpdateDescriptorSetsSingleBuffer(device, m_ComputeDescriptorSets.data(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_DrawVisibility, kDrawVisibilityBufferSize, 11, 1, kEngineSwapchainDoubleBuffering);
+		WriteUpdateDescriptorSetsSingleBuffer(device, m_ComputeDescriptorSets.data(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletBounds, kMeshletBoundsBufferSize, 12, 1, kEngineSwapchainDoubleBuffering);
+		// binding 13, the depth pyramid, gets written once Graphics creates it
+		WriteUpdateDescriptorSetsSingleBuffer(device, m_ComputeDescriptorSets.data(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_DrawLods, kDrawLodBufferSize, 14, 1, kEngineSwapchainDoubleBuffering);
 
 		CreateDefaultMaterial(device);
 
@@ -133,6 +157,16 @@ namespace imp
 		return m_ComputeDescriptorSets[idx];
 	}
 
+	VkDescriptorSet VulkanShaderManager::GetDepthPyramidDescriptorSet() const
+	{
+		return m_DepthPyramidDescriptorSet;
+	}
+
+	VkDescriptorSetLayout VulkanShaderManager::GetDepthPyramidDescriptorSetLayout() const
+	{
+		return m_DepthPyramidDescriptorSetLayout;
+	}
+
 	VkDescriptorSetLayout VulkanShaderManager::GetDescriptorSetLayout() const
 	{
 		return m_DescriptorSetLayout;
@@ -188,6 +222,31 @@ namespace imp
 		return m_MeshletNormalConeData;
 	}
 
+	VulkanBuffer& VulkanShaderManager::GetInstanceBucketBuffer()
+	{
+		return m_InstanceBuckets;
+	}
+
+	VulkanBuffer& VulkanShaderManager::GetDrawInstanceBuffer()
+	{
+		return m_DrawInstances;
+	}
+
+	VulkanBuffer& VulkanShaderManager::GetDrawVisibilityBuffer()
+	{
+		return m_DrawVisibility;
+	}
+
+	VulkanBuffer& VulkanShaderManager::GetDrawLodBuffer()
+	{
+		return m_DrawLods;
+	}
+
+	VulkanBuffer& VulkanShaderManager::GetMeshletBoundsBuffer()
+	{
+		return m_MeshletBounds;
+	}
+
 	VulkanBuffer& VulkanShaderManager::GetGlobalDataBuffer(uint32_t idx)
 	{
 		return m_GlobalBuffers[idx];
@@ -219,7 +278,9 @@ namespace imp
 		const auto shader = VulkanShader(CreateShaderModule(device, *req.spv.get()));
 		m_ShaderMap[req.shaderName + ".comp"] = shader;
 
-		ComputePipelineConfig config = { shader.GetShaderModule(), m_DescriptorSetLayout, m_ComputeDescriptorSetLayout };
+		ComputePipelineConfig config = { shader.GetShaderModule(), m_DescriptorSetLayout, m_ComputeDescriptorSetLayout, VK_NULL_HANDLE };
+		if (req.shaderName == "depthPyramid")
+			config.descriptorSetLayout3 = m_DepthPyramidDescriptorSetLayout;
 		pipeManager.CreateComputePipeline(device, config);
 	}
 
@@ -230,7 +291,7 @@ namespace imp
 		UpdateDescriptorData(device, buf, sizeof(GlobalData), 0, &data);
 	}
 
-	void VulkanShaderManager::UpdateDrawData(VkDevice device, uint32_t descriptorSetIdx, const std::vector<DrawDataSingle>& drawData, std::unordered_map<uint32_t, Comp::MeshGeometry>& geometryData)
+	void VulkanShaderManager::UpdateDrawData(VkDevice device, uint32_t descriptorSetIdx, const std::vector<DrawDataSingle>& drawData, const MeshRegistry& meshes)
 	{
 		AUTO_TIMER("[CPU UPDATE DRAW DATA]: ");
 		std::vector<ShaderDrawData> shaderData;
@@ -245,34 +306,87 @@ namespace imp
 			ShaderDrawData dat;
 			dat.transform = drawData[i].Transform;
 			dat.materialIndex = kDefaultMaterialIndex;
-			dat.vertexOffset = geometryData.at(drawData[i].VertexBufferId).vertices.GetOffset();
+			dat.vertexOffset = meshes.GetGeometry(drawData[i].VertexBufferId).vertices.GetOffset();
+#if COMPACT_VERTICES
+			dat.quantization = meshes.GetGeometry(drawData[i].VertexBufferId).quantization;
+#endif
 
 			buf.insert(i, &dat, sizeof(ShaderDrawData));
 		}
 #else
-		m_JobSystem->parallelize_loop(drawData.size(), [&](const auto st, const auto en)
+		m_JobSystem->ParallelFor(drawData.size(), [&](const size_t st, const size_t en)
 			{
 				for (auto i = st; i < en; i++)
 				{
 					ShaderDrawData dat;
 					dat.transform = drawData[i].Transform;
 					dat.materialIndex = kDefaultMaterialIndex;
-					dat.vertexOffset = geometryData.at(drawData[i].VertexBufferId).vertices.GetOffset();
+					dat.vertexOffset = meshes.GetGeometry(drawData[i].VertexBufferId).vertices.GetOffset();
+#if COMPACT_VERTICES
+					dat.quantization = meshes.GetGeometry(drawData[i].VertexBufferId).quantization;
+#endif
 
 					m_DrawDataBuffers[descriptorSetIdx].insert(i, &dat, sizeof(ShaderDrawData));
 				}
-			}).wait();
+			});
 #endif
 	}
 
+	void VulkanShaderManager::UpdateDepthPyramidDescriptors(VkDevice device, const DepthPyramid& pyramid)
+	{
+		VkDescriptorImageInfo pyramidInfo = { pyramid.GetSampler(), pyramid.GetImageView(), VK_IMAGE_LAYOUT_GENERAL };
+
+		// levels past the last one keep pointing at the last so every element of the array is valid
+		std::array<VkDescriptorImageInfo, kDepthPyramidMaxLevels> levelInfos;
+		for (uint32_t i = 0; i < kDepthPyramidMaxLevels; i++)
+			levelInfos[i] = { VK_NULL_HANDLE, pyramid.GetLevelView(std::min(i, pyramid.GetLevelCount() - 1)), VK_IMAGE_LAYOUT_GENERAL };
+
+		std::array<VkWriteDescriptorSet, kEngineSwapchainDoubleBuffering + 1> writes = {};
+		for (uint32_t i = 0; i < kEngineSwapchainDoubleBuffering; i++)
+		{
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = m_ComputeDescriptorSets[i];
+			writes[i].dstBinding = 13;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[i].descriptorCount = 1;
+			writes[i].pImageInfo = &pyramidInfo;
+		}
+		auto& levelWrite = writes.back();
+		levelWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		levelWrite.dstSet = m_DepthPyramidDescriptorSet;
+		levelWrite.dstBinding = 1;
+		levelWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		levelWrite.descriptorCount = kDepthPyramidMaxLevels;
+		levelWrite.pImageInfo = levelInfos.data();
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	void VulkanShaderManager::UpdateDepthSourceDescriptor(VkDevice device, VkImageView depthView, VkSampler sampler)
+	{
+		VkDescriptorImageInfo depthInfo = { sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_DepthPyramidDescriptorSet;
+		write.dstBinding = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.descriptorCount = 1;
+		write.pImageInfo = &depthInfo;
+
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
+
 	void VulkanShaderManager::Destroy(VkDevice device)
 	{
 		vkDestroyDescriptorSetLayout(device, m_DescriptorSetLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, m_ComputeDescriptorSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, m_DepthPyramidDescriptorSetLayout, nullptr);
 
 		static constexpr uint32_t dSetCount = kEngineSwapchainDoubleBuffering;
 		vkFreeDescriptorSets(device, m_DescriptorPool, dSetCount, m_DescriptorSets.data());
 		vkFreeDescriptorSets(device, m_DescriptorPool, dSetCount, m_ComputeDescriptorSets.data());
+		vkFreeDescriptorSets(device, m_DescriptorPool, 1, &m_DepthPyramidDescriptorSet);
 
 		for (uint32_t i = 0; i < dSetCount; i++)
 		{
@@ -289,10 +403,15 @@ namespace imp
 		m_MeshData.Destroy(device);
 		m_msMeshData.Destroy(device);
 		m_DrawCommandCount.Destroy(device);
+		m_InstanceBuckets.Destroy(device);
+		m_DrawInstances.Destroy(device);
+		m_DrawVisibility.Destroy(device);
+		m_DrawLods.Destroy(device);
 		m_MeshletData.Destroy(device);
 		m_MeshletVertexData.Destroy(device);
 		m_MeshletTriangleData.Destroy(device);
 		m_MeshletNormalConeData.Destroy(device);
+		m_MeshletBounds.Destroy(device);
 
 		vkDestroyDescriptorPool(device, m_DescriptorPool, nullptr);
 	}
@@ -355,6 +474,7 @@ namespace imp
 	{
 		CreateMegaDescriptorSetLayout(device);		// set 0
 		CreateComputeDescriptorSetLayout(device);	// set 1
+		CreateDepthPyramidDescriptorSetLayout(device);	// set 2
 
 		// variable descriptor counts
 		VkDescriptorSetVariableDescriptorCountAllocateInfo variable_info = {};
@@ -368,6 +488,8 @@ namespace imp
 
 		std::array<VkDescriptorSetLayout, kEngineSwapchainDoubleBuffering> computeLayouts = { m_ComputeDescriptorSetLayout, m_ComputeDescriptorSetLayout};
 		AllocateDescriptorSets(device, m_ComputeDescriptorSets.data(), m_DescriptorPool, m_ComputeDescriptorSets.size(), computeLayouts.data(), nullptr);
+
+		AllocateDescriptorSets(device, &m_DepthPyramidDescriptorSet, m_DescriptorPool, 1, &m_DepthPyramidDescriptorSetLayout, nullptr);
 	}
 
 	void VulkanShaderManager::CreateMegaDescriptorSetLayout(VkDevice device)
@@ -413,12 +535,19 @@ namespace imp
 		const auto meshletVertexDataBufferBinding = CreateDescriptorBinding(6, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_MESH_BIT_EXT | taskFlagBit);
 		const auto meshletTriangleDataBufferBinding = CreateDescriptorBinding(7, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_MESH_BIT_EXT | taskFlagBit);
 		const auto meshletNormalConeDataBufferBinding = CreateDescriptorBinding(8, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, taskFlagBit);
+		const auto instanceBucketBufferBinding = CreateDescriptorBinding(9, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+		const auto drawInstanceBufferBinding = CreateDescriptorBinding(10, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+		const auto drawVisibilityBufferBinding = CreateDescriptorBinding(11, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+		const auto meshletBoundsBufferBinding = CreateDescriptorBinding(12, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT | taskFlagBit);
+		const auto depthPyramidBinding = CreateDescriptorBinding(13, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT | taskFlagBit);
+		const auto drawLodBufferBinding = CreateDescriptorBinding(14, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
 
-		std::array<VkDescriptorSetLayoutBinding, kComputeBindingCount> bindings = { drawCommandStagingBufferBinding, drawCommandBufferBinding, boundingVolumeBinding, drawCommandCountBufferBinding, meshletBufferBinding, msMeshDataBufferBinding, meshletVertexDataBufferBinding, meshletTriangleDataBufferBinding, meshletNormalConeDataBufferBinding };
+		std::array<VkDescriptorSetLayoutBinding, kComputeBindingCount> bindings = { drawCommandStagingBufferBinding, drawCommandBufferBinding, boundingVolumeBinding, drawCommandCountBufferBinding, meshletBufferBinding, msMeshDataBufferBinding, meshletVertexDataBufferBinding, meshletTriangleDataBufferBinding, meshletNormalConeDataBufferBinding, instanceBucketBufferBinding, drawInstanceBufferBinding, drawVisibilityBufferBinding, meshletBoundsBufferBinding, depthPyramidBinding, drawLodBufferBinding };
 
 		static constexpr VkDescriptorBindingFlags nonVariableBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;// | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
 
-		std::array<VkDescriptorBindingFlags, kComputeBindingCount> multipleFlags = { nonVariableBindingFlags, nonVariableBindingFlags, nonVariableBindingFlags, nonVariableBindingFlags, nonVariableBindingFlags, nonVariableBindingFlags, nonVariableBindingFlags, nonVariableBindingFlags, nonVariableBindingFlags };
+		std::array<VkDescriptorBindingFlags, kComputeBindingCount> multipleFlags;
+		multipleFlags.fill(nonVariableBindingFlags);
 
 		VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags = {};
 		bindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
@@ -436,6 +565,22 @@ namespace imp
 		assert(res == VK_SUCCESS);
 	}
 
+	void VulkanShaderManager::CreateDepthPyramidDescriptorSetLayout(VkDevice device)
+	{
+		const auto depthSourceBinding = CreateDescriptorBinding(0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT);
+		const auto pyramidLevelsBinding = CreateDescriptorBinding(1, kDepthPyramidMaxLevels, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);
+
+		std::array<VkDescriptorSetLayoutBinding, kDepthPyramidBindingCount> bindings = { depthSourceBinding, pyramidLevelsBinding };
+
+		m_DepthPyramidDescriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSetLayoutCreateInfo dci = {};
+		dci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		dci.bindingCount = kDepthPyramidBindingCount;
+		dci.pBindings = bindings.data();
+		const auto res = vkCreateDescriptorSetLayout(device, &dci, nullptr, &m_DepthPyramidDescriptorSetLayout);
+		assert(res == VK_SUCCESS);
+	}
+
 	VkDescriptorSetLayoutBinding VulkanShaderManager::CreateDescriptorBinding(uint32_t binding, uint32_t descriptorCount, VkDescriptorType type, VkShaderStageFlags stageFlags)
 	{
 		assert(descriptorCount);
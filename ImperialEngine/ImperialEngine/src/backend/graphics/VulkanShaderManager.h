@@ -2,6 +2,7 @@
 #include "Utils/NonCopyable.h"
 #include "backend/VariousTypeDefinitions.h"
 #include "backend/graphics/VulkanShader.h"
+#include "backend/graphics/DepthPyramid.h"
 #include "backend/VulkanBuffer.h"
 #include "frontend/EngineSettings.h"
 #include <extern/GLM/mat4x4.hpp>
@@ -11,18 +12,15 @@
 #include <array>
 #include <GLM/ext/quaternion_float.hpp>
 
-namespace Comp
+namespace prl
 {
-	struct MeshGeometry;
-}
-
-namespace BS
-{
-	class thread_pool;
+	class JobSystem;
 }
 
 namespace imp
 {
+	class MeshRegistry;
+
 	inline constexpr uint32_t kBindingCount					= 5;
 	inline constexpr uint32_t kMaxMaterialCount				= 128;
 	inline constexpr uint32_t kMaxDrawCount					= 1'048'000; //Should be upper bound, lets see what happens with 2
@@ -38,7 +36,36 @@ namespace imp
 	inline constexpr uint32_t kDrawDataBufferBindingSlot	= kDrawDataIndicesBindingSlot + kDrawDataIndicesBindCount;
 	inline constexpr uint32_t kDefaultMaterialIndex			= 0;
 
-	inline constexpr uint32_t kComputeBindingCount			= 9;
+	inline constexpr uint32_t kComputeBindingCount			= 15;
+	// LOD_NONE in Lod.h, what drawGen's lod history is filled with
+	inline constexpr uint32_t kDrawLodNone					= ~0u;
+	inline constexpr uint32_t kDepthPyramidBindingCount		= 2;
+
+	// drawGen.comp passes. Instancing buckets visible draws by (mesh, lod) in Count, writes a draw per bucket in Buckets
+	// and the draw data indices of every bucket's instances in Scatter
+	enum DrawGenPass : uint32_t
+	{
+		kDrawGenPassSingle,
+		kDrawGenPassCount,
+		kDrawGenPassBuckets,
+		kDrawGenPassScatter
+	};
+
+	// Two-phase Hi-Z occlusion culling, see Occlusion.h. None is plain frustum culling
+	enum OcclusionPhase : uint32_t
+	{
+		kOcclusionPhaseNone,
+		kOcclusionPhaseEarly,
+		kOcclusionPhaseLate
+	};
+
+	struct InstanceBucket
+	{
+		uint32_t instanceCount;
+		uint32_t firstInstance;
+	};
+	// instanceTotal and padding in front of the buckets
+	inline constexpr uint32_t kInstanceBucketHeaderSize		= sizeof(uint32_t) * 2;
 
 	struct GlobalData
 	{
@@ -46,6 +73,8 @@ namespace imp
 		glm::mat4x4 ViewMatrix;
 		glm::mat4x4 CameraTransform;
 		glm::vec4 FrustumPlanes[6];
+		// utils::LodSelection: pixels per unit, error threshold, hysteresis, min projected size
+		glm::vec4 LodParams;
 	};
 
 	struct MaterialData
@@ -58,7 +87,15 @@ namespace imp
 		glm::mat4x4 transform;
 		uint32_t materialIndex;
 		uint32_t vertexOffset;
+		// world-space center and radius from RenderProxies, GPU culling reads this instead of transforming the mesh BV
+		alignas(16) glm::vec4 boundingSphere;
+#if COMPACT_VERTICES
+		// of the mesh, vertex shaders can't get to the mesh table
+		VertexQuantization quantization;
+#endif
 	};
+	// std430 DrawData stride in DescriptorSet0.h, spir-v/compact has the bigger one
+	static_assert(sizeof(ShaderDrawData) == (COMPACT_VERTICES ? 128 : 96));
 
 	class VulkanMemory;
 	class PipelineManager;
@@ -70,13 +107,15 @@ namespace imp
 	public:
 		VulkanShaderManager();
 
-		void Initialize(VkDevice device, VulkanMemory& memory, const EngineGraphicsSettings& settings, BS::thread_pool* jobSystem, const MemoryProps& memProps, VulkanBuffer& drawCommands, VulkanBuffer& vertices);
+		void Initialize(VkDevice device, VulkanMemory& memory, const EngineGraphicsSettings& settings, prl::JobSystem* jobSystem, const MemoryProps& memProps, VulkanBuffer& drawCommands, VulkanBuffer& vertices);
 
 		VulkanShader GetShader(const std::string& shaderName) const;
 		VkDescriptorSet GetDescriptorSet(uint32_t idx) const;
 		VkDescriptorSet GetComputeDescriptorSet(uint32_t idx) const;
 		VkDescriptorSetLayout GetDescriptorSetLayout() const;
 		VkDescriptorSetLayout GetComputeDescriptorSetLayout() const;
+		VkDescriptorSet GetDepthPyramidDescriptorSet() const;
+		VkDescriptorSetLayout GetDepthPyramidDescriptorSetLayout() const;
 		VulkanBuffer& GetGlobalDataBuffer(uint32_t idx);
 		VulkanBuffer& GetDrawDataBuffers(uint32_t idx);
 		VulkanBuffer& GetDrawCommandBuffer();
@@ -88,11 +127,19 @@ namespace imp
 		VulkanBuffer& GetMeshletVertexDataBuffer();
 		VulkanBuffer& GetMeshletTriangleDataBuffer();
 		VulkanBuffer& GetMeshletNormalConeDataBuffer();
+		VulkanBuffer& GetInstanceBucketBuffer();
+		VulkanBuffer& GetDrawInstanceBuffer();
+		VulkanBuffer& GetDrawVisibilityBuffer();
+		VulkanBuffer& GetDrawLodBuffer();
+		VulkanBuffer& GetMeshletBoundsBuffer();
 
 		void CreateVulkanShaderSet(VkDevice device, const MaterialCreationRequest& req);
 		void CreateComputePrograms(VkDevice device, PipelineManager& pipeManager, const ComputeProgramCreationRequest& req);
 		void UpdateGlobalData(VkDevice device, uint32_t descriptorSetIdx, const GlobalData& data);
-		void UpdateDrawData(VkDevice device, uint32_t descriptorSetIdx, const std::vector<DrawDataSingle>& drawData, std::unordered_map<uint32_t, Comp::MeshGeometry>& geometryData);
+		void UpdateDrawData(VkDevice device, uint32_t descriptorSetIdx, const std::vector<DrawDataSingle>& drawData, const MeshRegistry& meshes);
+		// culling reads the pyramid through set 1, depthPyramid.comp writes its levels through set 2
+		void UpdateDepthPyramidDescriptors(VkDevice device, const DepthPyramid& pyramid);
+		void UpdateDepthSourceDescriptor(VkDevice device, VkImageView depthView, VkSampler sampler);
 
 		void Destroy(VkDevice device);
 
@@ -103,6 +150,7 @@ namespace imp
 		void CreateMegaDescriptorSets(VkDevice device);
 		void CreateMegaDescriptorSetLayout(VkDevice device);
 		void CreateComputeDescriptorSetLayout(VkDevice device);
+		void CreateDepthPyramidDescriptorSetLayout(VkDevice device);
 		VkDescriptorSetLayoutBinding CreateDescriptorBinding(uint32_t binding, uint32_t descriptorCount, VkDescriptorType type, VkShaderStageFlags stageFlags);
 
 		void WriteUpdateDescriptorSets(VkDevice device, VkDescriptorSet* dSets, VkDescriptorType type, std::array<VulkanBuffer, kEngineSwapchainDoubleBuffering>& buffers, size_t descriptorDataSize, uint32_t bindSlot, uint32_t descriptorCount, uint32_t dSetCount);
@@ -125,18 +173,26 @@ namespace imp
 		VulkanBuffer m_MeshData;
 		VulkanBuffer m_msMeshData;
 		VulkanBuffer m_DrawCommandCount;
+		VulkanBuffer m_InstanceBuckets;
+		VulkanBuffer m_DrawInstances;
+		VulkanBuffer m_DrawVisibility;
+		VulkanBuffer m_DrawLods;
 
 		// Mesh Shading
 		VulkanBuffer m_MeshletData;
 		VulkanBuffer m_MeshletVertexData;
 		VulkanBuffer m_MeshletTriangleData;
 		VulkanBuffer m_MeshletNormalConeData;
+		VulkanBuffer m_MeshletBounds;
 
-		BS::thread_pool* m_JobSystem;
+		prl::JobSystem* m_JobSystem;
 
 		std::array<VkDescriptorSet, kEngineSwapchainDoubleBuffering> m_DescriptorSets;
 		std::array<VkDescriptorSet, kEngineSwapchainDoubleBuffering> m_ComputeDescriptorSets;
 		VkDescriptorSetLayout m_DescriptorSetLayout;
 		VkDescriptorSetLayout m_ComputeDescriptorSetLayout;
+		// only depthPyramid.comp, kept out of set 1 so changing the depth source doesn't touch sets that are already recorded
+		VkDescriptorSet m_DepthPyramidDescriptorSet;
+		VkDescriptorSetLayout m_DepthPyramidDescriptorSetLayout;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,195 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace prl
+{
+	inline void CpuRelax()
+	{
+#if defined(_M_X64) || defined(__x86_64__)
+		_mm_pause();
+#else
+		std::this_thread::yield();
+#endif
+	}
+
+	// One slot of the ring. Payload lives inline so adding a command never touches the heap.
+	// Sized to a cache line so producer and consumer don't false share neighbouring slots.
+	template <typename T> struct alignas(64) Command
+	{
+		static constexpr size_t kPayloadSize = 48;
+
+		void (*invoke)(T& owner, void* payload);
+		void (*destroy)(void* payload);
+		alignas(16) std::byte payload[kPayloadSize];
+	};
+
+	// Bounded single-producer/single-consumer command ring.
+	// Producer is the main thread, consumer is the render thread. Commands are member functions of T
+	// that take their payload by reference (or by value), e.g. m_Q->add<&Engine::Cmd_UploadMeshes>(std::move(reqs)).
+	// Both sides spin for a bit and then park on the index they're waiting on (C++20 atomic wait).
+	template <typename T, uint32_t Capacity = 256> class CommandRing
+	{
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+	public:
+		static constexpr uint32_t kSpinCount = 1024;
+		// spinning on a single core only steals time from the thread we're waiting on
+		inline static const uint32_t s_SpinCount = std::thread::hardware_concurrency() > 1 ? kSpinCount : 0;
+
+		CommandRing()
+			: m_Write(0), m_ConsumerParked(false), m_CachedRead(0)
+			, m_Read(0), m_ProducerParked(false), m_CachedWrite(0)
+			, m_Slots()
+		{
+		}
+
+		virtual ~CommandRing()
+		{
+			// destroy payloads of commands that never got executed
+			const uint32_t write = m_Write.load(std::memory_order_acquire);
+			for (uint32_t read = m_Read.load(std::memory_order_relaxed); read != write; read++)
+			{
+				auto& slot = m_Slots[read & kMask];
+				slot.destroy(slot.payload);
+			}
+		}
+
+		template <auto Func, typename... Args>
+		inline void add(Args&&... args)
+		{
+			using Payload = std::tuple<std::decay_t<Args>...>;
+			static_assert(sizeof(Payload) <= Command<T>::kPayloadSize, "Command payload too big to store inline, pass a pointer or smaller type");
+			static_assert(alignof(Payload) <= 16, "Command payload alignment not supported");
+
+			if (T* owner = GetInlineOwner())
+			{
+				// single-threaded mode, execute on add
+				Payload payload(std::forward<Args>(args)...);
+				Invoke<Func, Payload>(*owner, &payload);
+				return;
+			}
+
+			const uint32_t write = m_Write.load(std::memory_order_relaxed);
+			if (write - m_CachedRead == Capacity)
+				WaitForFreeSlot(write);
+
+			auto& slot = m_Slots[write & kMask];
+			new (slot.payload) Payload(std::forward<Args>(args)...);
+			slot.invoke = &Invoke<Func, Payload>;
+			slot.destroy = &Destroy<Payload>;
+
+			// seq_cst pairs with the consumer setting m_ConsumerParked, so either it sees the new command or we see it parked
+			m_Write.store(write + 1, std::memory_order_seq_cst);
+			if (m_ConsumerParked.load(std::memory_order_seq_cst) && m_ConsumerParked.exchange(false))
+				m_Write.notify_one();
+		}
+
+		// Blocks until a command is available and executes it on the calling thread.
+		inline void execute(T& owner)
+		{
+			const uint32_t read = m_Read.load(std::memory_order_relaxed);
+			if (m_CachedWrite == read)
+				WaitForCommand(read);
+
+			auto& slot = m_Slots[read & kMask];
+			slot.invoke(owner, slot.payload);
+			slot.destroy(slot.payload);
+
+			m_Read.store(read + 1, std::memory_order_seq_cst);
+			if (m_ProducerParked.load(std::memory_order_seq_cst) && m_ProducerParked.exchange(false))
+				m_Read.notify_one();
+		}
+
+		inline size_t size() const
+		{
+			return m_Write.load(std::memory_order_acquire) - m_Read.load(std::memory_order_acquire);
+		}
+
+		inline bool empty() const
+		{
+			return size() == 0;
+		}
+
+	protected:
+		// Returns the owner when commands should be executed right away instead of being queued
+		virtual T* GetInlineOwner() { return nullptr; }
+
+	private:
+		static constexpr uint32_t kMask = Capacity - 1;
+
+		template <auto Func, typename Payload>
+		static void Invoke(T& owner, void* payload)
+		{
+			std::apply([&owner](auto&... args) { std::invoke(Func, owner, args...); }, *static_cast<Payload*>(payload));
+		}
+
+		template <typename Payload>
+		static void Destroy(void* payload)
+		{
+			static_cast<Payload*>(payload)->~Payload();
+		}
+
+		void WaitForCommand(uint32_t read)
+		{
+			for (uint32_t i = 0; i < s_SpinCount; i++)
+			{
+				m_CachedWrite = m_Write.load(std::memory_order_acquire);
+				if (m_CachedWrite != read)
+					return;
+				CpuRelax();
+			}
+
+			// whoever clears the parked flag is the one that wakes us up, so only one notify per park
+			while (true)
+			{
+				m_ConsumerParked.store(true, std::memory_order_seq_cst);
+				if ((m_CachedWrite = m_Write.load(std::memory_order_seq_cst)) != read)
+					break;
+				m_Write.wait(read, std::memory_order_acquire);
+			}
+			m_ConsumerParked.store(false, std::memory_order_relaxed);
+		}
+
+		void WaitForFreeSlot(uint32_t write)
+		{
+			const uint32_t full = write - Capacity;
+			for (uint32_t i = 0; i < s_SpinCount; i++)
+			{
+				m_CachedRead = m_Read.load(std::memory_order_acquire);
+				if (m_CachedRead != full)
+					return;
+				CpuRelax();
+			}
+
+			while (true)
+			{
+				m_ProducerParked.store(true, std::memory_order_seq_cst);
+				if ((m_CachedRead = m_Read.load(std::memory_order_seq_cst)) != full)
+					break;
+				m_Read.wait(full, std::memory_order_acquire);
+			}
+			m_ProducerParked.store(false, std::memory_order_relaxed);
+		}
+
+		// producer side
+		alignas(64) std::atomic<uint32_t> m_Write;
+		std::atomic<bool> m_ConsumerParked;
+		uint32_t m_CachedRead;
+		// consumer side
+		alignas(64) std::atomic<uint32_t> m_Read;
+		std::atomic<bool> m_ProducerParked;
+		uint32_t m_CachedWrite;
+
+		Command<T> m_Slots[Capacity];
+	};
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "CommandRing.h"
+
+namespace prl
+{
+	template <typename T> class CommandRing_ST : public CommandRing<T>
+	{
+	public:
+		CommandRing_ST(T& functionOwner)
+			: CommandRing<T>(), m_FunctionOwner(functionOwner)
+		{}
+
+	protected:
+		inline T* GetInlineOwner() override {
+			return &m_FunctionOwner;
+		}
+	private:
+		T& m_FunctionOwner;
+	};
+}
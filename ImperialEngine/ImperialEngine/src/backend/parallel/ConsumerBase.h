@@ -1,18 +1,13 @@
 #pragma once
-#include <functional>
-#include <memory>
-#include <utility>
+#include "CommandRing.h"
 
 namespace prl
 {
-	template <typename T>
-	class WorkQ;
-
 	template <typename T> class ConsumerBase
 	{
 	public:
-		ConsumerBase(T& functionOwner, WorkQ<T>& workQ)
-			: m_FunctionOwner(functionOwner), m_Q(workQ), m_Alive(true)
+		ConsumerBase(T& functionOwner, CommandRing<T>& commandRing)
+			: m_FunctionOwner(functionOwner), m_Q(commandRing), m_Alive(true)
 		{
 		}
 
@@ -25,7 +20,7 @@ namespace prl
 	protected:
 
 		T& m_FunctionOwner;
-		WorkQ<T>& m_Q;
+		CommandRing<T>& m_Q;
 		bool m_Alive;
 	};
 }
@@ -7,8 +7,8 @@ namespace prl
 	template <typename T> class ConsumerThread : ConsumerBase<T>
 	{
 	public:
-		ConsumerThread(T& functionOwner, WorkQ<T>& workQ)
-			: ConsumerBase<T>(functionOwner, workQ), m_Thread(&ConsumerThread::WorkLoop, this)
+		ConsumerThread(T& functionOwner, CommandRing<T>& commandRing)
+			: ConsumerBase<T>(functionOwner, commandRing), m_Thread(&ConsumerThread::WorkLoop, this)
 		{}
 
 		void End()
@@ -24,11 +24,8 @@ namespace prl
 	private:
 		void WorkLoop()
 		{
-			while (this->m_Alive || this->m_Q.size())
-			{
-				auto funcNdata = this->m_Q.remove();
-				funcNdata.first(this->m_FunctionOwner, funcNdata.second);
-			}
+			while (this->m_Alive || !this->m_Q.empty())
+				this->m_Q.execute(this->m_FunctionOwner);
 		}
 
 		std::thread m_Thread;
@@ -0,0 +1,162 @@
+#include "JobBenchmark.h"
+#include "JobSystem.h"
+#include "Utils/SimpleTimer.h"
+#include "extern/THREAD-POOL/BS_thread_pool.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace prl
+{
+	static constexpr uint32_t kSphereCount = 1 << 20;
+	static constexpr uint32_t kIterations = 20;
+	// in the skewed loop every 8th block of spheres is this many times more expensive
+	static constexpr uint32_t kSkewFactor = 16;
+
+	struct BenchSphere { float x, y, z, r; };
+	struct BenchPlane { float x, y, z, w; };
+
+	struct CullBenchmarkData
+	{
+		std::vector<BenchSphere> spheres;
+		std::vector<BenchPlane> planes;
+		std::vector<uint8_t> visible;
+	};
+
+	static CullBenchmarkData MakeData()
+	{
+		CullBenchmarkData data;
+		data.spheres.resize(kSphereCount);
+		data.visible.resize(kSphereCount);
+
+		// deterministic so runs are comparable
+		uint32_t seed = 12345;
+		const auto rand01 = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / 16777216.0f); };
+		for (auto& s : data.spheres)
+			s = { rand01() * 200.0f - 100.0f, rand01() * 200.0f - 100.0f, rand01() * 200.0f - 100.0f, rand01() * 2.0f };
+
+		// box [-50, 50]^3 as 6 planes, roughly half of the spheres survive
+		data.planes = { { 1, 0, 0, 50 }, { -1, 0, 0, 50 }, { 0, 1, 0, 50 }, { 0, -1, 0, 50 }, { 0, 0, 1, 50 }, { 0, 0, -1, 50 } };
+		return data;
+	}
+
+	static void CullRange(CullBenchmarkData& data, size_t begin, size_t end, bool skewed)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const auto& s = data.spheres[i];
+			const uint32_t repeats = (skewed && (i / 4096) % 8 == 0) ? kSkewFactor : 1;
+			uint8_t visible = 0;
+			for (uint32_t r = 0; r < repeats; r++)
+			{
+				visible = 1;
+				for (const auto& p : data.planes)
+					visible &= (p.x * s.x + p.y * s.y + p.z * s.z + p.w) >= -s.r;
+			}
+			data.visible[i] = visible;
+		}
+	}
+
+	// BS::thread_pool splits into as many blocks as it has threads, same as the engine used it
+	static double TimeThreadPool(BS::thread_pool& pool, CullBenchmarkData& data, bool skewed)
+	{
+		imp::SimpleTimer timer;
+		timer.start();
+		for (uint32_t it = 0; it < kIterations; it++)
+			pool.parallelize_loop(size_t(kSphereCount), [&data, skewed](size_t st, size_t en) { CullRange(data, st, en, skewed); }).wait();
+		timer.stop();
+		return timer.miliseconds() / kIterations;
+	}
+
+	static double TimeJobSystem(JobSystem& jobs, CullBenchmarkData& data, bool skewed)
+	{
+		imp::SimpleTimer timer;
+		timer.start();
+		for (uint32_t it = 0; it < kIterations; it++)
+			jobs.ParallelFor(kSphereCount, [&data, skewed](size_t st, size_t en) { CullRange(data, st, en, skewed); });
+		timer.stop();
+		return timer.miliseconds() / kIterations;
+	}
+
+	// two threads submitting loops at the same time, like main thread culling while render thread fills draw data
+	template <typename Func>
+	static double TimeConcurrent(Func&& loopOnThread)
+	{
+		imp::SimpleTimer timer;
+		timer.start();
+		std::thread other([&loopOnThread]() { loopOnThread(1); });
+		loopOnThread(0);
+		other.join();
+		timer.stop();
+		return timer.miliseconds() / kIterations;
+	}
+
+	void RunJobSystemBenchmark()
+	{
+		const auto topology = CpuTopology::Query();
+		const uint32_t logicalCount = topology.logicalProcessorCount;
+		printf("[Job Benchmark] %u physical cores, %u logical processors, %u spheres, avg of %u iterations\n",
+			static_cast<uint32_t>(topology.physicalCores.size()), logicalCount, kSphereCount, kIterations);
+
+		auto data = MakeData();
+		CullBenchmarkData reference = data;
+		CullRange(reference, 0, kSphereCount, false);
+
+		// scaling, thread count includes the thread calling ParallelFor
+		printf("[Job Benchmark] %-8s | %-24s | %-24s\n", "threads", "uniform pool / jobs (ms)", "skewed pool / jobs (ms)");
+		std::vector<uint32_t> threadCounts;
+		for (uint32_t threads = 1; threads < logicalCount; threads *= 2)
+			threadCounts.push_back(threads);
+		threadCounts.push_back(logicalCount);
+
+		for (const auto threads : threadCounts)
+		{
+			BS::thread_pool pool(threads);
+			JobSystemSettings settings;
+			settings.workerCount = threads - 1;
+			settings.pinWorkers = false;
+			JobSystem jobs(settings);
+
+			const double poolUniform = TimeThreadPool(pool, data, false);
+			const double jobsUniform = TimeJobSystem(jobs, data, false);
+			const bool exact = data.visible == reference.visible;
+			const double poolSkewed = TimeThreadPool(pool, data, true);
+			const double jobsSkewed = TimeJobSystem(jobs, data, true);
+
+			printf("[Job Benchmark] %-8u | %10.3f / %-10.3f   | %10.3f / %-10.3f  %s\n", threads, poolUniform, jobsUniform, poolSkewed, jobsSkewed, exact ? "" : "MISMATCH");
+		}
+
+		// the old setup: two pools of hardware_concurrency / 2, one per submitting thread
+		CullBenchmarkData otherData = data;
+		CullBenchmarkData* perThread[2] = { &data, &otherData };
+		double twoPools = 0.0;
+		{
+			BS::thread_pool poolA(std::max(logicalCount / 2, 1u));
+			BS::thread_pool poolB(std::max(logicalCount / 2, 1u));
+			BS::thread_pool* pools[2] = { &poolA, &poolB };
+			twoPools = TimeConcurrent([&](uint32_t idx)
+				{
+					for (uint32_t it = 0; it < kIterations; it++)
+						pools[idx]->parallelize_loop(size_t(kSphereCount), [d = perThread[idx]](size_t st, size_t en) { CullRange(*d, st, en, false); }).wait();
+				});
+		}
+
+		double shared = 0.0;
+		uint32_t workerCount = 0;
+		bool pinned = false;
+		{
+			JobSystem jobs;
+			workerCount = jobs.GetWorkerCount();
+			pinned = jobs.AreWorkersPinned();
+			shared = TimeConcurrent([&](uint32_t idx)
+				{
+					for (uint32_t it = 0; it < kIterations; it++)
+						jobs.ParallelFor(kSphereCount, [d = perThread[idx]](size_t st, size_t en) { CullRange(*d, st, en, false); });
+				});
+		}
+
+		printf("[Job Benchmark] Two loops at once: 2x BS::thread_pool(%u) %.3f ms | shared JobSystem (%u workers%s) %.3f ms\n",
+			std::max(logicalCount / 2, 1u), twoPools, workerCount, pinned ? ", pinned" : "", shared);
+	}
+}
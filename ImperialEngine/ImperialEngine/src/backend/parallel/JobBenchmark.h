@@ -0,0 +1,10 @@
+#pragma once
+
+namespace prl
+{
+	// Scaling benchmark of the JobSystem against BS::thread_pool, which the engine used before (two of them).
+	// Cull-like loops over 1M spheres: uniform cost, skewed cost and two loops submitted at once from two threads
+	// like main thread culling while render thread updates draw data.
+	// Run with 'ImperialEngine.exe --benchmark-jobs'
+	void RunJobSystemBenchmark();
+}
@@ -0,0 +1,409 @@
+#include "JobSystem.h"
+#include "CommandRing.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fstream>
+#include <pthread.h>
+#endif
+
+namespace prl
+{
+	struct Task
+	{
+		JobSystem::Job func;
+		std::atomic<uint32_t> unfinished = 1;
+		std::atomic<uint32_t> pendingDependencies = 1;	// 1 is held by Schedule until all dependencies are registered
+		SpinLock lock;
+		bool finished = false;
+		std::vector<TaskHandle> continuations;
+	};
+
+	struct JobSystem::ParallelForContext
+	{
+		const RangeFunc* func;
+		size_t grain;
+		std::atomic<size_t> remaining;
+	};
+
+	static constexpr uint32_t kWorkerSpinCount = 2048;
+	static constexpr size_t kChunksPerThread = 32;
+
+	// worker index of the current thread, -1 for threads that don't belong to the job system
+	static thread_local int32_t t_WorkerIndex = -1;
+	static thread_local const JobSystem* t_WorkerOwner = nullptr;
+
+	void SpinLock::lock()
+	{
+		while (!try_lock())
+			CpuRelax();
+	}
+
+	CpuTopology CpuTopology::Query()
+	{
+		CpuTopology topology;
+		topology.logicalProcessorCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+#ifdef _WIN32
+		DWORD length = 0;
+		GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+		std::vector<uint8_t> buffer(length);
+		if (length && GetLogicalProcessorInformationEx(RelationProcessorCore, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()), &length))
+		{
+			for (DWORD offset = 0; offset < length;)
+			{
+				const auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data() + offset);
+				const auto& mask = info->Processor.GroupMask[0];
+				if (mask.Mask)
+				{
+					unsigned long firstSibling = 0;
+					_BitScanForward64(&firstSibling, mask.Mask);
+					topology.physicalCores.push_back({ mask.Group, static_cast<uint16_t>(firstSibling) });
+				}
+				offset += info->Size;
+			}
+		}
+#else
+		// a logical cpu is the first sibling of its core if it's the first entry of its sibling list
+		for (uint32_t cpu = 0; cpu < topology.logicalProcessorCount; cpu++)
+		{
+			std::ifstream siblings("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+			uint32_t firstSibling = cpu;
+			if (siblings && !(siblings >> firstSibling))
+				firstSibling = cpu;
+			if (firstSibling == cpu)
+				topology.physicalCores.push_back({ 0, static_cast<uint16_t>(cpu) });
+		}
+#endif
+
+		// couldn't query, assume no SMT
+		if (topology.physicalCores.empty())
+			for (uint32_t i = 0; i < topology.logicalProcessorCount; i++)
+				topology.physicalCores.push_back({ 0, static_cast<uint16_t>(i) });
+
+		return topology;
+	}
+
+	JobSystem::JobSystem(JobSystemSettings settings)
+		: m_Topology(CpuTopology::Query())
+		, m_Workers()
+		, m_Queues()
+		, m_SharedQueue()
+		, m_WorkSignal(0)
+		, m_SleepingWorkers(0)
+		, m_Stop(false)
+		, m_WorkersPinned(false)
+	{
+		// SMT siblings share execution units, culling and draw data loops are bound by those, so one worker per core.
+		// Main and render threads help out while waiting, leave their cores to them.
+		const uint32_t physicalCoreCount = static_cast<uint32_t>(m_Topology.physicalCores.size());
+		const uint32_t workerCount = settings.workerCount != kAutoWorkerCount ? settings.workerCount
+			: (physicalCoreCount > 2 ? physicalCoreCount - 2 : 1);
+
+		// only pin when every worker gets a core of its own, otherwise let the OS balance
+		m_WorkersPinned = settings.pinWorkers && workerCount + 2 <= physicalCoreCount;
+
+		m_Queues.reserve(workerCount);
+		for (uint32_t i = 0; i < workerCount; i++)
+			m_Queues.push_back(std::make_unique<JobQueue>());
+
+		m_Workers.reserve(workerCount);
+		for (uint32_t i = 0; i < workerCount; i++)
+		{
+			m_Workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+			// skip the first two cores, that's where the OS usually puts main and render thread
+			if (m_WorkersPinned)
+				PinThread(m_Workers.back(), m_Topology.physicalCores[i + 2]);
+		}
+	}
+
+	JobSystem::~JobSystem()
+	{
+		m_Stop.store(true);
+		m_WorkSignal.fetch_add(1);
+		m_WorkSignal.notify_all();
+		for (auto& worker : m_Workers)
+			worker.join();
+	}
+
+	TaskHandle JobSystem::Schedule(Job func, const std::vector<TaskHandle>& dependencies)
+	{
+		auto task = std::make_shared<Task>();
+		task->func = std::move(func);
+
+		for (const auto& dependency : dependencies)
+		{
+			std::lock_guard lock(dependency->lock);
+			if (dependency->finished)
+				continue;
+			// bump before unlocking so the dependency can't finish and decrement first
+			task->pendingDependencies.fetch_add(1);
+			dependency->continuations.push_back(task);
+		}
+
+		if (task->pendingDependencies.fetch_sub(1) == 1)
+			Enqueue(task);
+
+		return task;
+	}
+
+	void JobSystem::Wait(const TaskHandle& task)
+	{
+		WaitForZero(task->unfinished);
+	}
+
+	bool JobSystem::IsDone(const TaskHandle& task) const
+	{
+		return task->unfinished.load(std::memory_order_acquire) == 0;
+	}
+
+	TaskHandle JobSystem::CreateManualTask()
+	{
+		return std::make_shared<Task>();
+	}
+
+	void JobSystem::Complete(const TaskHandle& task)
+	{
+		assert(!task->func);
+		FinishTask(task);
+	}
+
+	int32_t JobSystem::GetCurrentWorkerIndex() const
+	{
+		return t_WorkerOwner == this ? t_WorkerIndex : -1;
+	}
+
+	void JobSystem::ParallelFor(size_t count, const RangeFunc& func, size_t minGrain)
+	{
+		if (count == 0)
+			return;
+
+		const size_t grain = minGrain ? minGrain : std::max<size_t>(1, count / (GetConcurrency() * kChunksPerThread));
+		if (m_Workers.empty() || count <= grain)
+		{
+			func(0, count);
+			return;
+		}
+
+		// jobs hold a reference so the last one can still notify after we've seen remaining hit 0 and returned
+		auto ctx = std::make_shared<ParallelForContext>();
+		ctx->func = &func;
+		ctx->grain = grain;
+		ctx->remaining.store(count);
+
+		RunRange(ctx, 0, count);
+		WaitForZero(ctx->remaining);
+	}
+
+	void JobSystem::RunRange(const std::shared_ptr<ParallelForContext>& ctx, size_t begin, size_t end)
+	{
+		while (begin < end)
+		{
+			// lazy binary splitting: give away half of what's left whenever our queue has run dry
+			while (end - begin > ctx->grain && ShouldSplit())
+			{
+				const size_t mid = begin + (end - begin) / 2;
+				PushJob([this, ctx, mid, end]() { RunRange(ctx, mid, end); });
+				end = mid;
+			}
+
+			const size_t chunkEnd = std::min(begin + ctx->grain, end);
+			(*ctx->func)(begin, chunkEnd);
+			if (ctx->remaining.fetch_sub(chunkEnd - begin, std::memory_order_acq_rel) == chunkEnd - begin)
+				ctx->remaining.notify_all();
+			begin = chunkEnd;
+		}
+	}
+
+	bool JobSystem::ShouldSplit()
+	{
+		auto& queue = (t_WorkerOwner == this) ? *m_Queues[t_WorkerIndex] : m_SharedQueue;
+		std::lock_guard lock(queue.lock);
+		return queue.jobs.empty();
+	}
+
+	void JobSystem::Enqueue(const TaskHandle& task)
+	{
+		PushJob([this, task]() { RunTask(task); });
+	}
+
+	void JobSystem::RunTask(const TaskHandle& task)
+	{
+		task->func();
+		task->func = nullptr;
+		FinishTask(task);
+	}
+
+	void JobSystem::FinishTask(const TaskHandle& task)
+	{
+		std::vector<TaskHandle> continuations;
+		{
+			std::lock_guard lock(task->lock);
+			task->finished = true;
+			continuations.swap(task->continuations);
+		}
+
+		task->unfinished.store(0, std::memory_order_release);
+		task->unfinished.notify_all();
+
+		for (const auto& continuation : continuations)
+			if (continuation->pendingDependencies.fetch_sub(1) == 1)
+				Enqueue(continuation);
+	}
+
+	void JobSystem::PushJob(Job&& job)
+	{
+		auto& queue = (t_WorkerOwner == this) ? *m_Queues[t_WorkerIndex] : m_SharedQueue;
+		{
+			std::lock_guard lock(queue.lock);
+			queue.jobs.push_back(std::move(job));
+		}
+
+		// seq_cst pairs with workers registering as sleeping, either they see the new signal or we see them
+		m_WorkSignal.fetch_add(1);
+		if (m_SleepingWorkers.load())
+			m_WorkSignal.notify_one();
+	}
+
+	bool JobSystem::PopJob(Job& job)
+	{
+		if (t_WorkerOwner == this)
+		{
+			auto& own = *m_Queues[t_WorkerIndex];
+			std::lock_guard lock(own.lock);
+			if (!own.jobs.empty())
+			{
+				// newest first, it's the one still warm in cache
+				job = std::move(own.jobs.back());
+				own.jobs.pop_back();
+				return true;
+			}
+		}
+
+		{
+			std::lock_guard lock(m_SharedQueue.lock);
+			if (!m_SharedQueue.jobs.empty())
+			{
+				job = std::move(m_SharedQueue.jobs.front());
+				m_SharedQueue.jobs.pop_front();
+				return true;
+			}
+		}
+
+		return StealJob(job, t_WorkerOwner == this ? t_WorkerIndex : 0);
+	}
+
+	bool JobSystem::StealJob(Job& job, uint32_t thiefIndex)
+	{
+		const uint32_t queueCount = static_cast<uint32_t>(m_Queues.size());
+		for (uint32_t i = 1; i <= queueCount; i++)
+		{
+			auto& victim = *m_Queues[(thiefIndex + i) % queueCount];
+			// don't wait behind the owner, try the next one
+			std::unique_lock lock(victim.lock, std::try_to_lock);
+			if (!lock.owns_lock() || victim.jobs.empty())
+				continue;
+
+			// oldest first, that's the biggest chunk of a split range
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			return true;
+		}
+		return false;
+	}
+
+	bool JobSystem::TryRunJob()
+	{
+		Job job;
+		if (!PopJob(job))
+			return false;
+		job();
+		return true;
+	}
+
+	void JobSystem::WorkerLoop(uint32_t workerIndex)
+	{
+		t_WorkerIndex = static_cast<int32_t>(workerIndex);
+		t_WorkerOwner = this;
+
+		while (!m_Stop.load(std::memory_order_relaxed))
+		{
+			// read the signal before looking for work, anything pushed after that changes it and wakes us
+			const uint32_t signal = m_WorkSignal.load();
+			if (TryRunJob())
+				continue;
+
+			bool signaled = false;
+			for (uint32_t i = 0; i < kWorkerSpinCount && !signaled; i++)
+			{
+				CpuRelax();
+				signaled = m_WorkSignal.load(std::memory_order_relaxed) != signal;
+			}
+			if (signaled)
+				continue;
+
+			m_SleepingWorkers.fetch_add(1);
+			m_WorkSignal.wait(signal);
+			m_SleepingWorkers.fetch_sub(1);
+		}
+	}
+
+	template <typename Counter, typename TryRunJob>
+	static void WaitForZeroImpl(Counter& counter, bool canSleep, TryRunJob tryRunJob)
+	{
+		while (true)
+		{
+			const auto value = counter.load(std::memory_order_acquire);
+			if (value == 0)
+				return;
+			if (tryRunJob())
+				continue;
+
+			// nothing to help with, the remaining work is already running somewhere
+			bool changed = false;
+			for (uint32_t i = 0; i < kWorkerSpinCount && !changed; i++)
+			{
+				CpuRelax();
+				changed = counter.load(std::memory_order_acquire) != value;
+			}
+			// without workers whatever we're waiting on can only be sitting in a queue, or running on another helping thread
+			if (!changed && canSleep)
+				counter.wait(value, std::memory_order_acquire);
+			else if (!changed)
+				std::this_thread::yield();
+		}
+	}
+
+	void JobSystem::WaitForZero(std::atomic<uint32_t>& counter)
+	{
+		WaitForZeroImpl(counter, !m_Workers.empty(), [this]() { return TryRunJob(); });
+	}
+
+	void JobSystem::WaitForZero(std::atomic<size_t>& counter)
+	{
+		WaitForZeroImpl(counter, !m_Workers.empty(), [this]() { return TryRunJob(); });
+	}
+
+	void JobSystem::PinThread(std::thread& thread, const LogicalProcessor& processor)
+	{
+#ifdef _WIN32
+		GROUP_AFFINITY affinity = {};
+		affinity.Group = processor.group;
+		affinity.Mask = KAFFINITY(1) << processor.index;
+		if (!SetThreadGroupAffinity(thread.native_handle(), &affinity, nullptr))
+			printf("[Job System] Failed to pin worker to processor %u:%u\n", processor.group, processor.index);
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(processor.index, &set);
+		if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set))
+			printf("[Job System] Failed to pin worker to processor %u\n", processor.index);
+#endif
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "Utils/NonCopyable.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace prl
+{
+	struct LogicalProcessor
+	{
+		uint16_t group;		// processor group, only meaningful on windows with >64 logical processors
+		uint16_t index;		// index inside the group
+	};
+
+	struct CpuTopology
+	{
+		uint32_t logicalProcessorCount;
+		// one entry per physical core, the first SMT sibling of each. Workers get pinned to these
+		std::vector<LogicalProcessor> physicalCores;
+
+		static CpuTopology Query();
+	};
+
+	// Cheap lock for the worker deques, critical sections are a handful of instructions.
+	class SpinLock
+	{
+	public:
+		void lock();
+		bool try_lock() { return !m_Flag.load(std::memory_order_relaxed) && !m_Flag.exchange(true, std::memory_order_acquire); }
+		void unlock() { m_Flag.store(false, std::memory_order_release); }
+	private:
+		std::atomic<bool> m_Flag = false;
+	};
+
+	struct Task;
+	using TaskHandle = std::shared_ptr<Task>;
+
+	inline constexpr uint32_t kAutoWorkerCount = ~0u;
+
+	struct JobSystemSettings
+	{
+		// auto picks one worker per physical core, minus the cores main and render threads live on.
+		// 0 is valid too, then everything runs on the threads that wait for it
+		uint32_t workerCount = kAutoWorkerCount;
+		// pinning only happens when every worker gets a physical core of its own
+		bool pinWorkers = true;
+	};
+
+	// Engine-wide work-stealing scheduler. Every worker owns a deque: it pushes and pops its own jobs from the back
+	// and other workers steal from the front. Threads that aren't workers (main, render) push into a shared queue
+	// and help executing jobs while they wait, so nothing ever blocks on a pool that's busy with someone else's work.
+	class JobSystem : NonCopyable
+	{
+	public:
+		using Job = std::function<void()>;
+		using RangeFunc = std::function<void(size_t begin, size_t end)>;
+
+		JobSystem(JobSystemSettings settings = {});
+		~JobSystem();
+
+		// Runs func once all dependencies have finished. Dependencies can be ones that already finished.
+		TaskHandle Schedule(Job func, const std::vector<TaskHandle>& dependencies = {});
+		// Executes other jobs while waiting
+		void Wait(const TaskHandle& task);
+		bool IsDone(const TaskHandle& task) const;
+		// Task that never gets queued, it finishes when Complete is called. For work that has to stay on one thread
+		// but others depend on.
+		TaskHandle CreateManualTask();
+		void Complete(const TaskHandle& task);
+
+		// Calls func over [0, count) in chunks and returns when all of them are done. Ranges are split lazily - only while
+		// there's nobody to steal already split work - so the grain adapts to how busy the workers are.
+		// minGrain 0 picks something reasonable for count.
+		void ParallelFor(size_t count, const RangeFunc& func, size_t minGrain = 0);
+
+		uint32_t GetWorkerCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+		bool AreWorkersPinned() const { return m_WorkersPinned; }
+		// workers + the calling thread
+		uint32_t GetConcurrency() const { return GetWorkerCount() + 1; }
+		const CpuTopology& GetTopology() const { return m_Topology; }
+		// -1 when called from a thread that isn't one of our workers
+		int32_t GetCurrentWorkerIndex() const;
+
+	private:
+		struct alignas(64) JobQueue
+		{
+			SpinLock lock;
+			std::deque<Job> jobs;
+		};
+		struct ParallelForContext;
+
+		void WorkerLoop(uint32_t workerIndex);
+		void PushJob(Job&& job);
+		bool TryRunJob();
+		bool PopJob(Job& job);
+		bool StealJob(Job& job, uint32_t thiefIndex);
+		void RunTask(const TaskHandle& task);
+		void FinishTask(const TaskHandle& task);
+		void Enqueue(const TaskHandle& task);
+		void RunRange(const std::shared_ptr<ParallelForContext>& ctx, size_t begin, size_t end);
+		bool ShouldSplit();
+		// Helps out until counter hits 0
+		void WaitForZero(std::atomic<uint32_t>& counter);
+		void WaitForZero(std::atomic<size_t>& counter);
+		void PinThread(std::thread& thread, const LogicalProcessor& processor);
+
+		CpuTopology m_Topology;
+		std::vector<std::thread> m_Workers;
+		std::vector<std::unique_ptr<JobQueue>> m_Queues;
+		JobQueue m_SharedQueue;
+
+		alignas(64) std::atomic<uint32_t> m_WorkSignal;
+		std::atomic<uint32_t> m_SleepingWorkers;
+		std::atomic<bool> m_Stop;
+		bool m_WorkersPinned;
+	};
+}
@@ -0,0 +1,159 @@
+#include "QueueBenchmark.h"
+#include "CommandRing.h"
+#include "ConsumerThread.h"
+#include "WorkQ.h"
+#include "Utils/SimpleTimer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace prl
+{
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr uint32_t kThroughputCommandCount = 1'000'000;
+	static constexpr uint32_t kLatencySampleCount = 2000;
+	// long enough for the ring consumer to give up spinning and park
+	static constexpr std::chrono::microseconds kLatencySendInterval(500);
+
+	struct QueueBenchmarkResult
+	{
+		double commandsPerSecond;
+		double latencyAvgUs;
+		double latencyP50Us;
+		double latencyP99Us;
+	};
+
+	class BenchmarkOwner
+	{
+	public:
+		BenchmarkOwner() : m_Executed(0), m_Alive(true), m_Worker(nullptr), m_Latencies() {}
+
+		// CommandRing commands
+		void Cmd_Noop() { m_Executed++; }
+		void Cmd_Stamp(Clock::time_point sent) { RecordLatency(sent); }
+		void Cmd_Stop() { m_Worker->End(); }
+
+		// WorkQ commands
+		void Cmd_NoopOld(std::shared_ptr<void>) { m_Executed++; }
+		void Cmd_StampOld(std::shared_ptr<void> rsc) { RecordLatency(*(Clock::time_point*)rsc.get()); }
+		void Cmd_StopOld(std::shared_ptr<void>) { m_Alive = false; }
+
+		void RecordLatency(Clock::time_point sent)
+		{
+			const auto now = Clock::now();
+			m_Latencies.push_back(std::chrono::duration<double, std::micro>(now - sent).count());
+			m_Executed++;
+		}
+
+		uint64_t m_Executed;
+		bool m_Alive;
+		ConsumerThread<BenchmarkOwner>* m_Worker;
+		std::vector<double> m_Latencies;
+	};
+
+	static void SpinFor(std::chrono::microseconds duration)
+	{
+		// sleep_for is too coarse on windows
+		const auto end = Clock::now() + duration;
+		while (Clock::now() < end)
+			std::this_thread::yield();
+	}
+
+	static void FillLatencyResult(QueueBenchmarkResult& result, std::vector<double>& latencies)
+	{
+		std::sort(latencies.begin(), latencies.end());
+		double sum = 0.0;
+		for (const auto l : latencies)
+			sum += l;
+		result.latencyAvgUs = sum / latencies.size();
+		result.latencyP50Us = latencies[latencies.size() / 2];
+		result.latencyP99Us = latencies[latencies.size() * 99 / 100];
+	}
+
+	static QueueBenchmarkResult BenchmarkWorkQ()
+	{
+		QueueBenchmarkResult result = {};
+		BenchmarkOwner owner;
+		WorkQ<BenchmarkOwner> q;
+
+		// same loop as the old ConsumerThread::WorkLoop
+		std::thread consumer([&owner, &q]()
+			{
+				while (owner.m_Alive || q.size())
+				{
+					auto funcNdata = q.remove();
+					funcNdata.first(owner, funcNdata.second);
+				}
+			});
+
+		imp::SimpleTimer timer;
+		timer.start();
+		for (uint32_t i = 0; i < kThroughputCommandCount; i++)
+			q.add(std::mem_fn(&BenchmarkOwner::Cmd_NoopOld), std::shared_ptr<void>());
+		while (q.size())
+			CpuRelax();
+		timer.stop();
+		result.commandsPerSecond = kThroughputCommandCount / (timer.miliseconds() * 1e-3);
+
+		for (uint32_t i = 0; i < kLatencySampleCount; i++)
+		{
+			SpinFor(kLatencySendInterval);
+			q.add(std::mem_fn(&BenchmarkOwner::Cmd_StampOld), std::make_shared<Clock::time_point>(Clock::now()));
+		}
+		q.add(std::mem_fn(&BenchmarkOwner::Cmd_StopOld), std::shared_ptr<void>());
+		consumer.join();
+
+		FillLatencyResult(result, owner.m_Latencies);
+		return result;
+	}
+
+	static QueueBenchmarkResult BenchmarkCommandRing()
+	{
+		QueueBenchmarkResult result = {};
+		BenchmarkOwner owner;
+		// the consumer has to go before the ring it reads
+		auto q = std::make_unique<CommandRing<BenchmarkOwner>>();
+		auto consumer = std::make_unique<ConsumerThread<BenchmarkOwner>>(owner, *q);
+		owner.m_Worker = consumer.get();
+
+		imp::SimpleTimer timer;
+		timer.start();
+		for (uint32_t i = 0; i < kThroughputCommandCount; i++)
+			q->add<&BenchmarkOwner::Cmd_Noop>();
+		while (!q->empty())
+			CpuRelax();
+		timer.stop();
+		result.commandsPerSecond = kThroughputCommandCount / (timer.miliseconds() * 1e-3);
+
+		for (uint32_t i = 0; i < kLatencySampleCount; i++)
+		{
+			SpinFor(kLatencySendInterval);
+			q->add<&BenchmarkOwner::Cmd_Stamp>(Clock::now());
+		}
+		q->add<&BenchmarkOwner::Cmd_Stop>();
+		consumer->Join();
+		consumer.reset();
+
+		FillLatencyResult(result, owner.m_Latencies);
+		return result;
+	}
+
+	static void PrintResult(const char* name, const QueueBenchmarkResult& result)
+	{
+		printf("[Queue Benchmark] %-12s %8.2f M cmds/s | wake-up latency avg %7.2f us, p50 %7.2f us, p99 %7.2f us\n",
+			name, result.commandsPerSecond * 1e-6, result.latencyAvgUs, result.latencyP50Us, result.latencyP99Us);
+	}
+
+	void RunQueueBenchmark()
+	{
+		printf("[Queue Benchmark] %u commands for throughput, %u samples for wake-up latency (%lli us apart)\n",
+			kThroughputCommandCount, kLatencySampleCount, static_cast<long long>(kLatencySendInterval.count()));
+
+		PrintResult("WorkQ", BenchmarkWorkQ());
+		PrintResult("CommandRing", BenchmarkCommandRing());
+	}
+}
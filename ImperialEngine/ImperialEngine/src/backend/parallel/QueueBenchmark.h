@@ -0,0 +1,9 @@
+#pragma once
+
+namespace prl
+{
+	// Microbenchmark of the main->render thread command queues.
+	// Compares the old mutex WorkQ with the SPSC CommandRing: commands/sec and wake-up latency of a parked consumer.
+	// Run with 'ImperialEngine.exe --benchmark-queues'
+	void RunQueueBenchmark();
+}
@@ -0,0 +1,204 @@
+#include "TaskGraph.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace prl
+{
+	using Clock = std::chrono::steady_clock;
+
+	TaskGraph::TaskGraph()
+		: m_Systems(), m_Tasks(), m_Built(false), m_ExecutionStart(), m_LastExecutionTime(0.0)
+	{
+	}
+
+	uint32_t TaskGraph::AddSystem(const char* name, SystemAccess access, SystemFunc func, SystemThread thread)
+	{
+		m_Systems.push_back({ name, std::move(access), std::move(func), thread, {}, 0.0, 0.0, -1 });
+		m_Built = false;
+		return static_cast<uint32_t>(m_Systems.size() - 1);
+	}
+
+	void TaskGraph::Clear()
+	{
+		m_Systems.clear();
+		m_Tasks.clear();
+		m_Built = false;
+		m_LastExecutionTime = 0.0;
+	}
+
+	static bool Intersects(const std::vector<Resource>& a, const std::vector<Resource>& b)
+	{
+		for (const auto& res : a)
+			if (std::find(b.begin(), b.end(), res) != b.end())
+				return true;
+		return false;
+	}
+
+	bool TaskGraph::Conflicts(const SystemAccess& first, const SystemAccess& second)
+	{
+		return Intersects(first.writes, second.writes) || Intersects(first.writes, second.reads) || Intersects(first.reads, second.writes);
+	}
+
+	void TaskGraph::Build()
+	{
+		for (uint32_t i = 0; i < m_Systems.size(); i++)
+		{
+			auto& system = m_Systems[i];
+			system.dependencies.clear();
+			for (uint32_t j = 0; j < i; j++)
+				if (Conflicts(m_Systems[j].access, system.access))
+					system.dependencies.push_back(j);
+		}
+		m_Built = true;
+	}
+
+	void TaskGraph::RunSystem(System& system, const JobSystem& jobSystem)
+	{
+		const auto start = Clock::now();
+		system.func();
+		const auto end = Clock::now();
+
+		system.start = std::chrono::duration<double, std::milli>(start - m_ExecutionStart).count();
+		system.duration = std::chrono::duration<double, std::milli>(end - start).count();
+		system.workerIndex = jobSystem.GetCurrentWorkerIndex();
+	}
+
+	void TaskGraph::Execute(JobSystem& jobSystem)
+	{
+		if (!m_Built)
+			Build();
+
+		m_ExecutionStart = Clock::now();
+		m_Tasks.resize(m_Systems.size());
+
+		// systems are already in a valid order, dependencies always point backwards
+		std::vector<TaskHandle> dependencies;
+		for (uint32_t i = 0; i < m_Systems.size(); i++)
+		{
+			auto& system = m_Systems[i];
+			if (system.thread == kSystemMainThread)
+			{
+				m_Tasks[i] = jobSystem.CreateManualTask();
+				continue;
+			}
+
+			dependencies.clear();
+			for (const auto dep : system.dependencies)
+				dependencies.push_back(m_Tasks[dep]);
+			m_Tasks[i] = jobSystem.Schedule([this, &system, &jobSystem]() { RunSystem(system, jobSystem); }, dependencies);
+		}
+
+		// main thread systems in order, helping out with the rest while their dependencies finish
+		for (uint32_t i = 0; i < m_Systems.size(); i++)
+		{
+			auto& system = m_Systems[i];
+			if (system.thread != kSystemMainThread)
+				continue;
+
+			for (const auto dep : system.dependencies)
+				jobSystem.Wait(m_Tasks[dep]);
+			RunSystem(system, jobSystem);
+			jobSystem.Complete(m_Tasks[i]);
+		}
+
+		for (const auto& task : m_Tasks)
+			jobSystem.Wait(task);
+
+		m_LastExecutionTime = std::chrono::duration<double, std::milli>(Clock::now() - m_ExecutionStart).count();
+	}
+
+	std::vector<uint32_t> TaskGraph::FindCriticalPath() const
+	{
+		if (m_Systems.empty())
+			return {};
+
+		// longest chain of dependent systems by measured time
+		std::vector<double> finish(m_Systems.size(), 0.0);
+		std::vector<int32_t> previous(m_Systems.size(), -1);
+		for (uint32_t i = 0; i < m_Systems.size(); i++)
+		{
+			double longestDependency = 0.0;
+			for (const auto dep : m_Systems[i].dependencies)
+			{
+				if (finish[dep] > longestDependency)
+				{
+					longestDependency = finish[dep];
+					previous[i] = static_cast<int32_t>(dep);
+				}
+			}
+			finish[i] = longestDependency + m_Systems[i].duration;
+		}
+
+		std::vector<uint32_t> path;
+		for (int32_t i = static_cast<int32_t>(std::max_element(finish.begin(), finish.end()) - finish.begin()); i >= 0; i = previous[i])
+			path.push_back(static_cast<uint32_t>(i));
+		std::reverse(path.begin(), path.end());
+		return path;
+	}
+
+	void TaskGraph::Dump() const
+	{
+		const auto criticalPath = FindCriticalPath();
+		double criticalPathTime = 0.0;
+		for (const auto idx : criticalPath)
+			criticalPathTime += m_Systems[idx].duration;
+
+		printf("[Frame Graph] %zu systems, last execution %.3f ms, critical path %.3f ms\n", m_Systems.size(), m_LastExecutionTime, criticalPathTime);
+		printf("[Frame Graph]    %-3s %-24s %-8s %10s %10s  %s\n", "#", "system", "thread", "start ms", "time ms", "depends on");
+		for (uint32_t i = 0; i < m_Systems.size(); i++)
+		{
+			const auto& system = m_Systems[i];
+			const bool critical = std::find(criticalPath.begin(), criticalPath.end(), i) != criticalPath.end();
+
+			char thread[16];
+			if (system.workerIndex < 0)
+				snprintf(thread, sizeof(thread), system.thread == kSystemMainThread ? "main" : "helper");
+			else
+				snprintf(thread, sizeof(thread), "worker%d", system.workerIndex);
+
+			std::string deps;
+			for (const auto dep : system.dependencies)
+				deps += m_Systems[dep].name + " ";
+
+			printf("[Frame Graph]  %c %-3u %-24s %-8s %10.3f %10.3f  %s\n", critical ? '*' : ' ', i, system.name.c_str(), thread, system.start, system.duration, deps.c_str());
+		}
+	}
+
+	bool TaskGraph::WriteDot(const std::string& path) const
+	{
+		std::ofstream file(path, std::ios::out);
+		if (!file.is_open())
+		{
+			printf("[Frame Graph] Failed to open '%s'\n", path.c_str());
+			return false;
+		}
+
+		const auto criticalPath = FindCriticalPath();
+		const auto isCritical = [&criticalPath](uint32_t idx) { return std::find(criticalPath.begin(), criticalPath.end(), idx) != criticalPath.end(); };
+		const auto isCriticalEdge = [&criticalPath](uint32_t from, uint32_t to)
+		{
+			const auto it = std::find(criticalPath.begin(), criticalPath.end(), from);
+			return it != criticalPath.end() && it + 1 != criticalPath.end() && *(it + 1) == to;
+		};
+
+		file << "digraph FrameGraph {\n\trankdir=LR;\n\tnode [shape=box];\n";
+		for (uint32_t i = 0; i < m_Systems.size(); i++)
+		{
+			const auto& system = m_Systems[i];
+			file << "\tn" << i << " [label=\"" << system.name << "\\n" << system.duration << " ms\\nstart " << system.start << " ms";
+			for (const auto& res : system.access.reads)
+				file << "\\nR " << res.name;
+			for (const auto& res : system.access.writes)
+				file << "\\nW " << res.name;
+			file << "\"" << (isCritical(i) ? ", color=red" : "") << "];\n";
+		}
+		for (uint32_t i = 0; i < m_Systems.size(); i++)
+			for (const auto dep : m_Systems[i].dependencies)
+				file << "\tn" << dep << " -> n" << i << (isCriticalEdge(dep, i) ? " [color=red]" : "") << ";\n";
+		file << "}\n";
+
+		printf("[Frame Graph] Wrote '%s'\n", path.c_str());
+		return true;
+	}
+}
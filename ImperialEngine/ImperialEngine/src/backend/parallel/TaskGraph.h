@@ -0,0 +1,92 @@
+#pragma once
+#include "JobSystem.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace prl
+{
+	// Anything a system can read or write - a component type or a tag type for data that lives outside the registry
+	struct Resource
+	{
+		uintptr_t id;
+		const char* name;
+
+		bool operator==(const Resource& other) const { return id == other.id; }
+	};
+
+	template <typename T> Resource ResourceOf()
+	{
+		// address of a function local static is unique per type across translation units
+		static const char tag = 0;
+		return { reinterpret_cast<uintptr_t>(&tag), typeid(T).name() };
+	}
+
+	struct SystemAccess
+	{
+		template <typename... Ts> SystemAccess& Read() { (reads.push_back(ResourceOf<Ts>()), ...); return *this; }
+		template <typename... Ts> SystemAccess& Write() { (writes.push_back(ResourceOf<Ts>()), ...); return *this; }
+
+		std::vector<Resource> reads;
+		std::vector<Resource> writes;
+	};
+
+	enum SystemThread
+	{
+		kSystemAnyThread,
+		kSystemMainThread	// runs on the thread calling Execute, for things like glfw input
+	};
+
+	// Per-frame graph of systems. Systems declare what they read and write, a system depends on every system added
+	// before it that it conflicts with (write/write or read/write on the same resource), everything else is free to
+	// run at the same time on the job system. Order of AddSystem is the order things would run single-threaded.
+	class TaskGraph
+	{
+	public:
+		using SystemFunc = std::function<void()>;
+
+		TaskGraph();
+
+		uint32_t AddSystem(const char* name, SystemAccess access, SystemFunc func, SystemThread thread = kSystemAnyThread);
+		void Clear();
+		bool Empty() const { return m_Systems.empty(); }
+
+		// Must be called from the main thread
+		void Execute(JobSystem& jobSystem);
+
+		// Timings of the last Execute
+		double GetLastExecutionTime() const { return m_LastExecutionTime; }
+		std::vector<uint32_t> FindCriticalPath() const;
+		void Dump() const;
+		// graphviz, critical path is drawn red
+		bool WriteDot(const std::string& path) const;
+
+	private:
+		struct System
+		{
+			std::string name;
+			SystemAccess access;
+			SystemFunc func;
+			SystemThread thread;
+			std::vector<uint32_t> dependencies;
+
+			// last Execute
+			double start;
+			double duration;
+			int32_t workerIndex;
+		};
+
+		static bool Conflicts(const SystemAccess& first, const SystemAccess& second);
+		void Build();
+		void RunSystem(System& system, const JobSystem& jobSystem);
+
+		std::vector<System> m_Systems;
+		std::vector<TaskHandle> m_Tasks;
+		bool m_Built;
+		std::chrono::steady_clock::time_point m_ExecutionStart;
+		double m_LastExecutionTime;
+	};
+}
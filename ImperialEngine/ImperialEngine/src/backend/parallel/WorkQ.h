@@ -3,6 +3,7 @@
 #include <vector>
 #include <list>
 #include <mutex>
+#include <condition_variable>
 #include <memory>
 #include <utility>
 
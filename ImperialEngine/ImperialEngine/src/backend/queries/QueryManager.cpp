@@ -21,7 +21,7 @@ namespace imp
 		assert(res == VK_SUCCESS);
 
 		ci.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
-		ci.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT;
+		ci.pipelineStatistics = kPipelineStatisticFlags;
 		res = vkCreateQueryPool(device, &ci, nullptr, &m_StatPool);
 		assert(res == VK_SUCCESS);
 
@@ -124,6 +124,11 @@ namespace imp
 							row.cull = (endQ - beginQ) * 1e-6;
 							break;
 						}
+						case kQueryOcclusionEnd:
+						{
+							row.occlusionCull = (endQ - beginQ) * 1e-6;
+							break;
+						}
 						default:
 							break;
 					}
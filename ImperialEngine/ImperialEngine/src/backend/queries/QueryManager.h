@@ -17,6 +17,8 @@ namespace imp
 		kQueryGPUFrameEnd,
 		kQueryCullBegin,
 		kQueryCullEnd,
+		kQueryOcclusionBegin,	// depth pyramid and late cull of the GPU-Driven modes
+		kQueryOcclusionEnd,
 		kQueryCount
 	};
 
@@ -26,6 +28,9 @@ namespace imp
 		kStatQueryCount
 	};
 
+	// what the pipeline statistics pool counts, secondary command buffers have to inherit the same
+	inline constexpr VkQueryPipelineStatisticFlags kPipelineStatisticFlags = VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT;
+
 	class QueryManager : NonCopyable
 	{
 	public:
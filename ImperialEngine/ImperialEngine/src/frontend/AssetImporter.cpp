@@ -1,9 +1,16 @@
 #include "AssetImporter.h"
 #include "Utils/Utilities.h"
 #include "Utils/GfxUtilities.h"
+#include "Utils/ImpMesh.h"
+#include "Utils/MeshCache.h"
+#include "Utils/MeshProcessing.h"
+#include "Utils/ObjLoader.h"
+#include "Utils/SimpleTimer.h"
+#include "Utils/VertexConversion.h"
 #include "backend/VariousTypeDefinitions.h"
 #include "frontend/Engine.h"
 #include "frontend/Components/Components.h"
+#include "backend/parallel/JobSystem.h"
 #define TINYGLTF_USE_CPP14
 #define TINYGLTF_NO_INCLUDE_STB_IMAGE
 #include "extern/STB/stb_image.h"
@@ -14,42 +21,121 @@
 #include "GLM/gtc/type_ptr.hpp"
 #include "extern/GLM/mat4x4.hpp"
 #include "MESHOPTIMIZER/meshoptimizer.h"
+#include <algorithm>
 #include <unordered_map>
 
 namespace imp
 {
-	static std::atomic_uint32_t temporaryMeshCounter = 0;
-
 	AssetImporter::AssetImporter(Engine& engine)
-		: m_Engine(engine), m_Loader(new tinygltf::TinyGLTF())
+		: m_Engine(engine), m_MeshCache(new MeshCache("Cache/")), m_CookMeshes(false)
 	{
 	}
 
+	AssetImporter::~AssetImporter() = default;
+
+	// One scene file on its way in. Importing fills it on the job system, FinishLoadingScenes makes mesh handles and entities
+	// out of it on the main thread. Until then mesh ids in reqs and entities are indices into reqs
+	struct AssetImporter::SceneImport
+	{
+		std::filesystem::path path;
+		std::vector<MeshCreationRequest> reqs;
+		std::vector<Comp::GLTFEntity> entities;		// glTF only, .obj meshes all hang off one main entity
+		Comp::GLTFCamera camera = {};
+		std::shared_ptr<const ImpMeshFile> cached;	// mesh cache hit
+		double milliseconds = 0.0;					// of the hit, or of loading and processing on a miss
+		prl::TaskHandle task;
+	};
+
 	void AssetImporter::LoadScenes(const std::vector<std::string>& paths)
 	{
-		const auto path = std::filesystem::current_path();
-		Assimp::Importer importer;
-		if (paths.size())
+		m_ImportTimer.start();
+		std::vector<std::filesystem::path> files(paths.begin(), paths.end());
+		// By default lets still try load something from Scene/
+		if (files.empty())
+			files = OS::GetAllFileNamesInDirectory("Scene/");
+
+		for (const auto& path : files)
 		{
-			for (const auto& file : paths)
-			{
-				std::filesystem::path path(file);
-				// must load data using assimp
-				// create entity and from main thread it seems like the object has been loaded and created
-				// meanwhile launch render thread command to create vertex and index buffers and upload to gpu
-				// entity will have a handle to this data and when time comes to render it'll be magically inplace
-				LoadFile(importer, path);
-			}
+			if (!std::filesystem::exists(path))
+				throw std::runtime_error("Provided file was not found!");
+
+			const auto extension = path.extension().string();
+			if (extension != ".obj" && extension != ".gltf" && extension != ".glb")
+				continue;
+
+			// files don't share anything until FinishLoadingScenes, each is a job and its meshes are jobs of their own
+			auto& scene = *m_PendingScenes.emplace_back(std::make_unique<SceneImport>());
+			scene.path = path;
+			scene.task = m_Engine.m_JobSystem->Schedule([this, &scene]() { ImportFile(scene); });
 		}
-		else
+	}
+
+	void AssetImporter::FinishLoadingScenes()
+	{
+		static bool tFirstEntityLoaded = true;
+
+		// every file goes up in one upload
+		std::vector<MeshCreationRequest> reqs;
+		for (const auto& pending : m_PendingScenes)
 		{
-			// By default lets still try load something from Scene/
-			const auto files = OS::GetAllFileNamesInDirectory("Scene/");
-			for (const auto& path : files)
-				LoadFile(importer, path);
+			auto& scene = *pending;
+			m_Engine.m_JobSystem->Wait(scene.task);
+			if (scene.cached)
+				m_MeshCache->RecordHit(scene.path, *scene.cached, scene.milliseconds);
+			else
+				m_MeshCache->RecordMiss(scene.path, scene.milliseconds);
+
+			// in file order, so handles come out the same as when loading one by one
+			std::vector<Comp::Mesh> meshes(scene.reqs.size());
+			for (size_t i = 0; i < scene.reqs.size(); i++)
+			{
+				if (!scene.reqs[i].HasGeometry())
+					continue;
+				// BV was already found while converting the mesh
+				const auto handle = m_Engine.m_Gfx.m_Meshes.Create(scene.reqs[i].boundingVolume);
+				meshes[i] = { handle.index, handle.generation };
+			}
+			// linked meshes point at the request they share
+			for (auto& req : scene.reqs)
+				req.id = meshes[req.id].meshId;
+
+			if (scene.path.extension() == ".obj")
+			{
+				// create main entity, that the renderable entities will point to
+				auto& reg = m_Engine.m_Entities;
+				const entt::entity mainEntity = reg.create();
+				reg.emplace<Comp::Transform>(mainEntity, glm::mat4x4(1.0f));
+
+				if (!tFirstEntityLoaded)
+				{
+					for (const auto& mesh : meshes)
+					{
+						const auto childEntity = reg.create();
+						reg.emplace<Comp::Mesh>(childEntity, mesh.meshId, mesh.generation);
+						reg.emplace<Comp::Material>(childEntity, kDefaultMaterialIndex);
+						reg.emplace<Comp::ChildComponent>(childEntity, mainEntity);
+					}
+				}
+				tFirstEntityLoaded = true;
+			}
+			else
+			{
+				for (auto& ent : scene.entities)
+					ent.mesh = meshes[ent.mesh.meshId];
+				CreateGLTFEntities(scene.entities, scene.camera);
+			}
+
+			reqs.insert(reqs.end(), std::make_move_iterator(scene.reqs.begin()), std::make_move_iterator(scene.reqs.end()));
 		}
 
-		printf("[Asset Importer] Successfully loaded scenes with %d files\n", static_cast<int>(paths.size()));
+		m_ImportTimer.stop();
+		printf("[Asset Importer] Successfully loaded scenes with %d files in %.1f ms on %u threads\n", static_cast<int>(m_PendingScenes.size()),
+			m_ImportTimer.miliseconds(), m_Engine.m_JobSystem->GetConcurrency());
+		m_MeshCache->PrintStats();
+		m_PendingScenes.clear();
+
+		if (reqs.size())
+			m_Engine.m_Q->add<&Engine::Cmd_UploadMeshes>(std::move(reqs));
 	}
 
 	void AssetImporter::LoadMaterials(const std::string& path)
@@ -58,10 +144,10 @@ namespace imp
 		const auto paths = OS::GetAllFileNamesInDirectory(path);
 
 		// load files and compose material creation requests
-		const auto materialCreationReqs = LoadShaders(paths);
+		auto materialCreationReqs = LoadShaders(paths);
 
 		// parse material creation requests and create materials
-		m_Engine.m_Q->add(std::mem_fn(&Engine::Cmd_UploadMaterials), std::make_shared<std::vector<imp::MaterialCreationRequest>>(materialCreationReqs));
+		m_Engine.m_Q->add<&Engine::Cmd_UploadMaterials>(std::move(materialCreationReqs));
 
 		// should also create material entities.
 		// since we only have one no need for now.
@@ -84,44 +170,118 @@ namespace imp
 
 			reqs.emplace_back(shaderPath.filename().stem().stem().stem().string(), OS::ReadFileContents(shaderPath.string()));
 		}
-		m_Engine.m_Q->add(std::mem_fn(&Engine::Cmd_UploadComputePrograms), std::make_shared<std::vector<imp::ComputeProgramCreationRequest>>(reqs));
+		// no fallbacks, same as the graphics spir-v. --hiz-cull would silently do nothing without the depth pyramid
+		for (const char* required : { "drawGen", "ms_drawGen", "depthPyramid" })
+			if (std::none_of(reqs.begin(), reqs.end(), [required](const ComputeProgramCreationRequest& req) { return req.shaderName == required; }))
+				throw std::runtime_error(std::string("Missing spir-v for compute program '") + required + "', run Shaders/compile_shaders.py");
+		m_Engine.m_Q->add<&Engine::Cmd_UploadComputePrograms>(std::move(reqs));
 		printf("[Asset Importer] Successfully loaded compute programs from '%s' with %i total shaders\n", path.c_str(), static_cast<int>(paths.size()));
 	}
 
 	uint32_t imp::AssetImporter::GetNumberOfUniqueMeshesLoaded() const
 	{
-		return temporaryMeshCounter;
+		return m_Engine.m_Gfx.m_Meshes.GetSlotCount();
+	}
+
+	void AssetImporter::SetCookMeshes(bool cook)
+	{
+		m_CookMeshes = cook;
 	}
 
-	void AssetImporter::LoadGLTFScene(const std::filesystem::path& path)
+	// A request per mesh of the file, processing copies them straight out of the mapping
+	static std::vector<MeshCreationRequest> MakeCookedRequests(const std::shared_ptr<const ImpMeshFile>& file)
 	{
+		std::vector<MeshCreationRequest> reqs(file->GetMeshCount());
+		for (uint32_t i = 0; i < file->GetMeshCount(); i++)
+		{
+			reqs[i].id = i;
+			reqs[i].boundingVolume = file->GetMesh(i).boundingVolume;
+			reqs[i].cookedFile = file;
+			reqs[i].cookedMesh = i;
+		}
+		return reqs;
+	}
+
+	// Where the accessor's elements start and how far apart they are, glTF lets views interleave attributes
+	static utils::StridedView GetAccessorView(const tinygltf::Model& model, const tinygltf::Accessor& accessor)
+	{
+		const auto& view = model.bufferViews[accessor.bufferView];
+		return { &model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset], static_cast<size_t>(accessor.ByteStride(view)) };
+	}
+
+	static utils::StridedView FindGLTFAttribute(const tinygltf::Model& model, const tinygltf::Primitive& prim, const char* name)
+	{
+		const auto it = prim.attributes.find(name);
+		if (it == prim.attributes.end())
+			return { nullptr, 0 };
+
+		const auto& accessor = model.accessors[it->second];
+		assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+		return GetAccessorView(model, accessor);
+	}
+
+	static void ConvertGLTFPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& prim, MeshCreationRequest& req)
+	{
+		const auto positions = FindGLTFAttribute(model, prim, "POSITION");
+		const size_t vertexCount = model.accessors[prim.attributes.at("POSITION")].count;
+		req.vertices.resize(vertexCount);
+		utils::ConvertVertices(positions, FindGLTFAttribute(model, prim, "NORMAL"), FindGLTFAttribute(model, prim, "TEXCOORD_0"), req.vertices.data(), vertexCount);
+
+		// index accessors are always tightly packed
+		const auto& accessor = model.accessors[prim.indices];
+		req.indices.resize(accessor.count);
+		utils::WidenIndices(GetAccessorView(model, accessor).data, tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType)), req.indices.data(), accessor.count);
+
+		req.boundingVolume = utils::FindSphereBoundingVolume(req.vertices.data(), req.vertices.size());
+	}
+
+	void AssetImporter::ImportGLTFScene(SceneImport& scene)
+	{
+		const auto& path = scene.path;
 		assert(path.extension().string() == ".gltf" || path.extension().string() == ".glb");
+		// a loader per file, they import in parallel
+		tinygltf::TinyGLTF loader;
 		tinygltf::Model model;
 		std::string err;
 		std::string warn;
 
 		// TODO gltf: implement failure path
 		if(path.extension().string() == ".gltf")
-			m_Loader->LoadASCIIFromFile(&model, &err, &warn, path.string());
+			loader.LoadASCIIFromFile(&model, &err, &warn, path.string());
 		else
-			m_Loader->LoadBinaryFromFile(&model, &err, &warn, path.string());
+		{
+			// straight from the mapping, LoadBinaryFromFile reads the whole file into a vector first
+			OS::MappedFile file;
+			if (file.Open(path))
+				loader.LoadBinaryFromMemory(&model, &err, &warn, file.GetData(), static_cast<unsigned int>(file.GetSize()), path.parent_path().string());
+			else
+				err = "Failed to map '" + path.string() + "'";
+		}
 
 		if (err.size()) printf("[Asset Importer] Error: %s\n", err.c_str());
 		if (warn.size()) printf("[Asset Importer] Warning: %s\n", warn.c_str());
 
 		assert(model.scenes.size() == 1);
-		// large potential for parallel for
-		std::vector<MeshCreationRequest> reqs;
-		std::unordered_map<uint32_t, uint32_t> meshIdMap;
-		std::vector<Comp::GLTFEntity> entities;
-		Comp::GLTFCamera camera;
-		camera.valid = false;
+		std::unordered_map<uint32_t, Comp::Mesh> meshIdMap;
+		std::vector<const tinygltf::Primitive*> primitives;
 		for (const auto& nodeIdx : model.scenes.front().nodes)
 		{
 			const auto& node = model.nodes[nodeIdx];
-			LoadGLTFNode(node, model, reqs, entities, meshIdMap, camera);
+			LoadGLTFNode(node, model, scene.reqs, scene.entities, meshIdMap, scene.camera, primitives);
 		}
 
+		// the nodes only say what goes where, converting the geometry is where the time goes
+		auto& reqs = scene.reqs;
+		m_Engine.m_JobSystem->ParallelFor(reqs.size(), [&](const size_t st, const size_t en)
+			{
+				for (size_t i = st; i < en; i++)
+					if (primitives[i])
+						ConvertGLTFPrimitive(model, *primitives[i], reqs[i]);
+			}, 1);
+	}
+
+	void AssetImporter::CreateGLTFEntities(const std::vector<Comp::GLTFEntity>& entities, const Comp::GLTFCamera& camera)
+	{
 		// means we loaded somekind of camera, try to override exisitng one
 		if (camera.valid)
 		{
@@ -151,15 +311,13 @@ namespace imp
 			reg.emplace<Comp::Transform>(mainEntity, ent.transform.transform);
 
 			const auto childEntity = reg.create();
-			reg.emplace<Comp::Mesh>(childEntity, ent.mesh.meshId);
+			reg.emplace<Comp::Mesh>(childEntity, ent.mesh.meshId, ent.mesh.generation);
 			reg.emplace<Comp::Material>(childEntity, kDefaultMaterialIndex);
 			reg.emplace<Comp::ChildComponent>(childEntity, mainEntity);
 		}
-
-		m_Engine.m_Q->add(std::mem_fn(&Engine::Cmd_UploadMeshes), std::make_shared<std::vector<imp::MeshCreationRequest>>(reqs));
 	}
 
-	void AssetImporter::LoadGLTFNode(const tinygltf::Node& node, const tinygltf::Model& model, std::vector<MeshCreationRequest>& reqs, std::vector<Comp::GLTFEntity>& entities, std::unordered_map<uint32_t, uint32_t>& meshIdMap, Comp::GLTFCamera& camera)
+	void AssetImporter::LoadGLTFNode(const tinygltf::Node& node, const tinygltf::Model& model, std::vector<MeshCreationRequest>& reqs, std::vector<Comp::GLTFEntity>& entities, std::unordered_map<uint32_t, Comp::Mesh>& meshIdMap, Comp::GLTFCamera& camera, std::vector<const tinygltf::Primitive*>& primitives)
 	{
 		auto transform = glm::mat4x4(1.0f);
 
@@ -185,17 +343,19 @@ namespace imp
 		}
 
 		for (const auto child : node.children)
-			LoadGLTFNode(model.nodes[child], model, reqs, entities, meshIdMap, camera);
+			LoadGLTFNode(model.nodes[child], model, reqs, entities, meshIdMap, camera, primitives);
 
 		if (meshIdMap.find(node.mesh) != meshIdMap.end())
 		{
+			const auto mesh = meshIdMap[node.mesh];
 			MeshCreationRequest req;
-			req.id = meshIdMap[node.mesh];
+			req.id = mesh.meshId;
 			reqs.push_back(req);
+			primitives.push_back(nullptr);
 
 			Comp::GLTFEntity ent;
 			ent.transform = { transform };
-			ent.mesh = { req.id };
+			ent.mesh = mesh;
 			entities.push_back(ent);
 
 			return;
@@ -208,98 +368,30 @@ namespace imp
 
 			for (const auto& prim : mesh.primitives)
 			{
-				MeshCreationRequest req;
-				req.id = temporaryMeshCounter.fetch_add(1);
-
-				meshIdMap[node.mesh] = req.id; // can keep rewriting this
-
-				const float* positionBuffer = nullptr;
-				const float* normalsBuffer = nullptr;
-				const float* texCoordsBuffer = nullptr;
-				size_t vertexCount = 0;
-
-				// TODO nice-to-have: reduce code size by making this a function
-				if (prim.attributes.find("POSITION") != prim.attributes.end()) {
-					const auto& accessor = model.accessors[prim.attributes.find("POSITION")->second];
-					const auto& view = model.bufferViews[accessor.bufferView];
-					positionBuffer = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-					vertexCount = accessor.count;
-				}
-
-				if (prim.attributes.find("NORMAL") != prim.attributes.end()) {
-					const auto& accessor = model.accessors[prim.attributes.find("NORMAL")->second];
-					const auto& view = model.bufferViews[accessor.bufferView];
-					normalsBuffer = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-				}
-
-				if (prim.attributes.find("TEXCOORD_0") != prim.attributes.end()) {
-					const auto& accessor = model.accessors[prim.attributes.find("TEXCOORD_0")->second];
-					const auto& view = model.bufferViews[accessor.bufferView];
-					texCoordsBuffer = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-				}
-
-				assert(vertexCount);
-				for (size_t i = 0; i < vertexCount; i++)
-				{
-					Vertex vertex;
-					std::memcpy(&vertex.vx, &positionBuffer[i * 3], sizeof(float) * 3);
-
-					vertex.nx = meshopt_quantizeHalf(normalsBuffer[i * 3]);
-					vertex.ny = meshopt_quantizeHalf(normalsBuffer[i * 3 + 1]);
-					vertex.nz = meshopt_quantizeHalf(normalsBuffer[i * 3 + 2]);
-					vertex.nw = 0.0f;
-
-					vertex.tu = prim.attributes.find("TEXCOORD_0") != prim.attributes.end() ? meshopt_quantizeHalf(texCoordsBuffer[i * 2]) : 0.0f;
-					vertex.tv = prim.attributes.find("TEXCOORD_0") != prim.attributes.end() ? meshopt_quantizeHalf(texCoordsBuffer[i * 2 + 1]) : 0.0f;
-
-					req.vertices.push_back(vertex);
-				}
-
-				const auto& accessor = model.accessors[prim.indices];
-				const auto& bufferView = model.bufferViews[accessor.bufferView];
-				const auto& buffer = model.buffers[bufferView.buffer];
-
-				const auto indexCount = accessor.count;
-
-				const auto FillIndices = [&](const auto& buf)
-				{
-					for (size_t index = 0; index < accessor.count; index++)
-					{
-						req.indices.push_back(buf[index]);
-					}
-				};
-				switch (accessor.componentType) {
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: 
-				{
-					const uint32_t* buf = reinterpret_cast<const uint32_t*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-					FillIndices(buf);
-					break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: 
-				{
-					const uint16_t* buf = reinterpret_cast<const uint16_t*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-					FillIndices(buf);
+				// converted once every node is in, a primitive per job
+				assert(prim.attributes.find("POSITION") != prim.attributes.end());
+				switch (model.accessors[prim.indices].componentType) {
+				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
 					break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: 
-				{
-					const uint8_t* buf = reinterpret_cast<const uint8_t*>(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-					FillIndices(buf);
-					break;
-				}
 				default:
-					printf("[Asset Importer] Error: Index component type %i not supported!\n", accessor.componentType);
+					printf("[Asset Importer] Error: Index component type %i not supported!\n", model.accessors[prim.indices].componentType);
 					return;
 				}
 
-				req.boundingVolume = utils::FindSphereBoundingVolume(req.vertices.data(), req.vertices.size());
+				MeshCreationRequest req;
+				// handles get made on the main thread, until then the mesh is its index in reqs
+				req.id = static_cast<uint32_t>(reqs.size());
+				meshIdMap[node.mesh] = { req.id, 0 }; // can keep rewriting this
 
 				Comp::GLTFEntity ent;
 				ent.transform = { transform };
-				ent.mesh = { req.id };
+				ent.mesh = { req.id, 0 };
 
 				entities.push_back(ent);
 				reqs.push_back(req);
+				primitives.push_back(&prim);
 			}
 		}
 
@@ -311,120 +403,184 @@ namespace imp
 		}
 	}
 
-	void AssetImporter::LoadFile(Assimp::Importer& imp, const std::filesystem::path& path)
+	void AssetImporter::ImportFile(SceneImport& scene)
 	{
-		static bool tFirstEntityLoaded = true;
+		// cached meshes skip parsing and processing, cooking always goes from the source
+		SimpleTimer timer;
+		timer.start();
+		const uint64_t key = m_MeshCache->MakeKey(scene.path);
+		if (!m_CookMeshes)
+			scene.cached = m_MeshCache->Find(key);
+
+		if (scene.cached)
+		{
+			scene.reqs = MakeCookedRequests(scene.cached);
+			for (const auto& instance : scene.cached->GetInstances())
+			{
+				Comp::GLTFEntity ent;
+				ent.transform = { instance.transform };
+				ent.mesh = { instance.mesh, 0 };
+				scene.entities.push_back(ent);
+			}
+
+			const auto& header = scene.cached->GetHeader();
+			scene.camera.transform = { header.camera };
+			scene.camera.valid = header.hasCamera != 0;
 
-		if (!std::filesystem::exists(path))
-			throw std::runtime_error("Provided file was not found!");
+			timer.stop();
+			scene.milliseconds = timer.miliseconds();
+			return;
+		}
 
-		const auto extension = path.extension().string();
-		if (extension == ".obj")
+		if (scene.path.extension() == ".obj")
 		{
-			// create main entity, that the renderable entities will point to
-			auto& reg = m_Engine.m_Entities;
-			const entt::entity mainEntity = reg.create();
-			reg.emplace<Comp::Transform>(mainEntity, glm::mat4x4(1.0f));
+			// Assimp only for what the native loader can't read. An importer per file, a thread waiting for meshes of its
+			// file can pick up another file meanwhile
+			if (!utils::LoadObj(scene.path, scene.reqs, *m_Engine.m_JobSystem))
+			{
+				printf("[Asset Importer] Loading '%s' with Assimp instead\n", scene.path.string().c_str());
+				Assimp::Importer importer;
+				LoadModel(scene.reqs, importer, scene.path);
+			}
+			for (size_t i = 0; i < scene.reqs.size(); i++)
+				scene.reqs[i].id = static_cast<uint32_t>(i);
+		}
+		else
+		{
+			ImportGLTFScene(scene);
+		}
 
-			std::vector<imp::MeshCreationRequest> reqs;
-			LoadModel(reqs, imp, path);
+		CookMeshes(scene, key, timer);
+	}
 
-			for (auto& req : reqs)
+	void AssetImporter::CookMeshes(SceneImport& scene, uint64_t key, SimpleTimer& loadTimer)
+	{
+		auto& reqs = scene.reqs;
+		const auto& camera = scene.camera;
+		// linked meshes have nothing to cook, the rest become entries in request order
+		static constexpr uint32_t kNotCooked = ~0u;
+		std::vector<uint32_t> entryIndices(reqs.size(), kNotCooked);
+		uint32_t entryCount = 0;
+		for (size_t i = 0; i < reqs.size(); i++)
+			if (reqs[i].HasGeometry())
+				entryIndices[i] = entryCount++;
+
+		std::vector<utils::ProcessedMesh> meshes(reqs.size());
+		std::vector<utils::MeshPayload> payloads(entryCount);
+		m_Engine.m_JobSystem->ParallelFor(reqs.size(), [&](const size_t st, const size_t en)
 			{
-				if (!tFirstEntityLoaded)
+				for (size_t i = st; i < en; i++)
 				{
-					const auto childEntity = reg.create();
-					reg.emplace<Comp::Mesh>(childEntity, temporaryMeshCounter); // temporary mesh counter will be used to point to mesh id and bounding volume id 
-																				//(because 1:1 ratio for mesh and BV)
-					reg.emplace<Comp::Material>(childEntity, kDefaultMaterialIndex);
-					reg.emplace<Comp::ChildComponent>(childEntity, mainEntity);
+					if (entryIndices[i] == kNotCooked)
+						continue;
+					utils::ProcessMesh(reqs[i], meshes[i]);
+					payloads[entryIndices[i]] = meshes[i].GetPayload(reqs[i]);
 				}
+			}, 1);
 
-				// TODO acceleration-part-1: create BV once
-				const auto BV = utils::FindSphereBoundingVolume(req.vertices.data(), req.vertices.size());
-				m_Engine.m_Gfx.m_BVs[temporaryMeshCounter] = BV;
+		// glTF nodes point at meshes by request, the file by entry
+		std::vector<ImpMeshInstance> instances;
+		if (scene.entities.size())
+		{
+			std::unordered_map<uint32_t, uint32_t> requestEntries;
+			for (size_t i = 0; i < reqs.size(); i++)
+				if (entryIndices[i] != kNotCooked)
+					requestEntries[reqs[i].id] = entryIndices[i];
 
-				// this counter can be used to identify the mesh or BV
-				req.id = static_cast<uint32_t>(temporaryMeshCounter);
-				temporaryMeshCounter++;
+			for (const auto& ent : scene.entities)
+			{
+				ImpMeshInstance instance = {};
+				instance.transform = ent.transform.transform;
+				instance.mesh = requestEntries.at(ent.mesh.meshId);
+				instances.push_back(instance);
 			}
-			tFirstEntityLoaded = true;
+		}
 
-			// TODO: this is needed now because on ST mode the UploadMeshes command would get executed instantly
-			// that doesn't fit now because we actually should store the creation requests somewhere and then add the command when the game loop starts
-			// TODO: this is probably not needed anymore ?
-			if(m_Engine.m_EngineSettings.threadingMode == kEngineSingleThreaded)
-				m_Engine.m_SyncPoint->arrive_and_wait();
+		// what a hit saves, writing the entry doesn't count
+		loadTimer.stop();
+		scene.milliseconds = loadTimer.miliseconds();
 
-			// TODO: put this somewhere higher in the callstack so we upload all the meshes at the same time
-			m_Engine.m_Q->add(std::mem_fn(&Engine::Cmd_UploadMeshes), std::make_shared<std::vector<imp::MeshCreationRequest>>(reqs));
+		const auto file = m_MeshCache->Store(key, scene.milliseconds, payloads, instances, camera.valid ? &camera.transform.transform : nullptr);
+		if (!file)
+		{
+			// requests are processed in place, upload processes them again from lod 0 that's still at the front
+			printf("[Mesh Cache] Failed to store '%s', processing it again on upload\n", scene.path.string().c_str());
+			for (size_t i = 0; i < reqs.size(); i++)
+				if (entryIndices[i] != kNotCooked)
+					reqs[i].indices.resize(meshes[i].geometry.indices[0].GetCount());
+			return;
 		}
-		else if (extension == ".gltf" || extension == ".glb")
+
+		// upload from the file like any cooked load would
+		for (size_t i = 0; i < reqs.size(); i++)
 		{
-			LoadGLTFScene(path);
+			if (entryIndices[i] == kNotCooked)
+				continue;
+			reqs[i].vertices = {};
+			reqs[i].indices = {};
+			reqs[i].cookedFile = file;
+			reqs[i].cookedMesh = entryIndices[i];
 		}
 	}
 
-	static void LoadMesh(std::vector<imp::MeshCreationRequest>& meshList, aiNode* node, const aiScene* scene)
+	static void CollectMeshes(std::vector<const aiMesh*>& meshes, aiNode* node, const aiScene* scene)
 	{
-		// go through each mesh at this node and create it, then add it to our meshlist
 		for (size_t i = 0; i < node->mNumMeshes; i++)
-		{
-			imp::MeshCreationRequest req;
-			const auto& mesh = scene->mMeshes[node->mMeshes[i]];
+			meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
 
-			//resize vertex list to hold all vertices for mesh
-			req.vertices.resize(mesh->mNumVertices);
+		// go through each node attached to this node and collect its meshes after ours, keeps the same order as before
+		for (size_t i = 0; i < node->mNumChildren; i++)
+			CollectMeshes(meshes, node->mChildren[i], scene);
+	}
 
-			static_assert(sizeof(Vertex) == 24);
+	static void LoadMesh(imp::MeshCreationRequest& req, const aiMesh* mesh)
+	{
+		//resize vertex list to hold all vertices for mesh
+		req.vertices.resize(mesh->mNumVertices);
 
-			for (size_t j = 0; j < mesh->mNumVertices; j++)
-			{
-				// set position
-				req.vertices[j].vx = mesh->mVertices[j].x;
-				req.vertices[j].vy = mesh->mVertices[j].y;
-				req.vertices[j].vz = mesh->mVertices[j].z;
+		static_assert(sizeof(Vertex) == 24);
 
-				// set tex coords (if they exist)
-				if (mesh->mTextureCoords[0])
-				{
-					req.vertices[j].tu = meshopt_quantizeHalf(mesh->mTextureCoords[0][j].x);
-					req.vertices[j].tv = meshopt_quantizeHalf(mesh->mTextureCoords[0][j].y);
-				}
-				else
-				{
-					req.vertices[j].tu = 0;
-				 	req.vertices[j].tv = 0;
-				}	
-
-				req.vertices[j].nx = meshopt_quantizeHalf(mesh->mNormals[j].x);
-				req.vertices[j].ny = meshopt_quantizeHalf(mesh->mNormals[j].y);
-				req.vertices[j].nz = meshopt_quantizeHalf(mesh->mNormals[j].z);
-				req.vertices[j].nw = 0;
-			}
+		for (size_t j = 0; j < mesh->mNumVertices; j++)
+		{
+			// set position
+			req.vertices[j].vx = mesh->mVertices[j].x;
+			req.vertices[j].vy = mesh->mVertices[j].y;
+			req.vertices[j].vz = mesh->mVertices[j].z;
 
-			// iterate over indices through faces and copy across
-			for (size_t j = 0; j < mesh->mNumFaces; j++)
+			// set tex coords (if they exist)
+			if (mesh->mTextureCoords[0])
 			{
-				// get a face
-				aiFace face = mesh->mFaces[j];
-
-				// go through face's indices and add to list
-				for (size_t k = 0; k < face.mNumIndices; k++)
-				{
-					req.indices.push_back(face.mIndices[k]);
-				}
+				req.vertices[j].tu = meshopt_quantizeHalf(mesh->mTextureCoords[0][j].x);
+				req.vertices[j].tv = meshopt_quantizeHalf(mesh->mTextureCoords[0][j].y);
 			}
+			else
+			{
+				req.vertices[j].tu = 0;
+			 	req.vertices[j].tv = 0;
+			}	
+
+			req.vertices[j].nx = meshopt_quantizeHalf(mesh->mNormals[j].x);
+			req.vertices[j].ny = meshopt_quantizeHalf(mesh->mNormals[j].y);
+			req.vertices[j].nz = meshopt_quantizeHalf(mesh->mNormals[j].z);
+			req.vertices[j].nw = 0;
+		}
 
-			const auto BV = utils::FindSphereBoundingVolume(req.vertices.data(), req.vertices.size());
-			req.boundingVolume = BV;
+		// iterate over indices through faces and copy across
+		req.indices.reserve(mesh->mNumFaces * 3);
+		for (size_t j = 0; j < mesh->mNumFaces; j++)
+		{
+			// get a face
+			aiFace face = mesh->mFaces[j];
 
-			meshList.push_back(req);
+			// go through face's indices and add to list
+			for (size_t k = 0; k < face.mNumIndices; k++)
+			{
+				req.indices.push_back(face.mIndices[k]);
+			}
 		}
 
-		// go through each node attached to this node and load it, then append their meshes to this node's mesh list
-		for (size_t i = 0; i < node->mNumChildren; i++)
-			LoadMesh(meshList, node->mChildren[i], scene);
+		const auto BV = utils::FindSphereBoundingVolume(req.vertices.data(), req.vertices.size());
+		req.boundingVolume = BV;
 	}
 
 	void AssetImporter::LoadModel(std::vector<imp::MeshCreationRequest>& reqs, Assimp::Importer& imp, const std::filesystem::path& path)
@@ -435,7 +591,18 @@ namespace imp
 			printf("[Asset Importer] Failed to read '%s' with error: '%s' \n", path.c_str(), imp.GetErrorString());
 			return;
 		}
-		LoadMesh(reqs, scene->mRootNode, scene);
+
+		std::vector<const aiMesh*> meshes;
+		CollectMeshes(meshes, scene->mRootNode, scene);
+
+		// meshes are independent, convert them on the job system. Each one is big enough to be its own job
+		const size_t firstReq = reqs.size();
+		reqs.resize(firstReq + meshes.size());
+		m_Engine.m_JobSystem->ParallelFor(meshes.size(), [&](const size_t st, const size_t en)
+			{
+				for (size_t i = st; i < en; i++)
+					LoadMesh(reqs[firstReq + i], meshes[i]);
+			}, 1);
 		assert(reqs.size());
 	}
 
@@ -471,22 +638,24 @@ namespace imp
 #endif
 		const auto fragmentShaderPath = shader + ".frag.spv";
 
+		// spir-v isn't built with the engine, a missing file means compile_shaders.py wasn't run after the glsl changed
+		const auto readSpirv = [](const std::string& path)
+		{
+			auto spv = OS::ReadFileContents(path);
+			if (!spv)
+				throw std::runtime_error("Missing spir-v '" + path + "', run Shaders/compile_shaders.py");
+			return spv;
+		};
+
 		MaterialCreationRequest req;
 		req.shaderName = shaderPath.stem().string();
-		req.vertexSpv = OS::ReadFileContents(vertexShaderPath);
-		req.vertexIndSpv = OS::ReadFileContents(vertexIndirectShaderPath);
-		req.meshSpv = OS::ReadFileContents(meshShaderPath);
-#if CONE_CULLING_ENABLED
-		req.taskSpv = OS::ReadFileContents(taskShaderPath);
-#endif
-		req.fragmentSpv = OS::ReadFileContents(fragmentShaderPath);
-		assert(req.vertexSpv.get());
-		assert(req.vertexIndSpv.get());
-		assert(req.meshSpv.get());
+		req.vertexSpv = readSpirv(vertexShaderPath);
+		req.vertexIndSpv = readSpirv(vertexIndirectShaderPath);
+		req.meshSpv = readSpirv(meshShaderPath);
 #if CONE_CULLING_ENABLED
-		assert(req.taskSpv.get());
+		req.taskSpv = readSpirv(taskShaderPath);
 #endif
-		assert(req.fragmentSpv.get());
+		req.fragmentSpv = readSpirv(fragmentShaderPath);
 		return req;
 	}
 
@@ -1,8 +1,11 @@
 #pragma once
 #include "Utils/NonCopyable.h"
+#include "Utils/SimpleTimer.h"
 #include <string>
 #include <filesystem>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace Assimp
 {
@@ -11,13 +14,14 @@ namespace Assimp
 
 namespace tinygltf
 {
-	class TinyGLTF;
 	class Node;
 	class Model;
+	struct Primitive;
 }
 
 namespace Comp
 {
+	struct Mesh;
 	struct GLTFEntity;
 	struct GLTFCamera;
 }
@@ -27,27 +31,42 @@ namespace imp
 	struct MeshCreationRequest;
 	struct MaterialCreationRequest;
 	class Engine;
+	class ImpMeshFile;
+	class MeshCache;
 
 	class AssetImporter : NonCopyable
 	{
 	public:
 		AssetImporter(Engine& engine);
+		~AssetImporter();
+		// Starts importing the files on the job system and returns, FinishLoadingScenes waits for them
 		void LoadScenes(const std::vector<std::string>& paths);
+		// Makes mesh handles and entities of the imported scenes in file order and uploads all their meshes at once
+		void FinishLoadingScenes();
 		void LoadMaterials(const std::string& path);
 		void LoadComputeProgams(const std::string& path);
 
 		uint32_t GetNumberOfUniqueMeshesLoaded() const;
+		// Scene files loaded after this ignore their mesh cache entries, get parsed and processed again and replace the entries
+		void SetCookMeshes(bool cook);
 
 	private:
 
-		void LoadGLTFScene(const std::filesystem::path& path);
-		void LoadGLTFNode(const tinygltf::Node& node, const tinygltf::Model& model, std::vector<MeshCreationRequest>& reqs, std::vector<Comp::GLTFEntity>& entities, std::unordered_map<uint32_t, uint32_t>& meshIdMap, Comp::GLTFCamera& camera);
-		void LoadFile(Assimp::Importer& imp, const std::filesystem::path& path);
+		struct SceneImport;
+
+		void ImportFile(SceneImport& scene);
+		void ImportGLTFScene(SceneImport& scene);
+		void CreateGLTFEntities(const std::vector<Comp::GLTFEntity>& entities, const Comp::GLTFCamera& camera);
+		void LoadGLTFNode(const tinygltf::Node& node, const tinygltf::Model& model, std::vector<MeshCreationRequest>& reqs, std::vector<Comp::GLTFEntity>& entities, std::unordered_map<uint32_t, Comp::Mesh>& meshIdMap, Comp::GLTFCamera& camera, std::vector<const tinygltf::Primitive*>& primitives);
 		void LoadModel(std::vector<imp::MeshCreationRequest>& reqs, Assimp::Importer& imp, const std::filesystem::path& path);
+		void CookMeshes(SceneImport& scene, uint64_t key, SimpleTimer& loadTimer);
 		std::vector<MaterialCreationRequest> LoadShaders(const std::vector<std::filesystem::path>& shaders);
 		MaterialCreationRequest LoadShader(const std::string& shader);
 
 		Engine& m_Engine;
-		tinygltf::TinyGLTF* m_Loader;
+		std::unique_ptr<MeshCache> m_MeshCache;
+		bool m_CookMeshes;
+		std::vector<std::unique_ptr<SceneImport>> m_PendingScenes;
+		SimpleTimer m_ImportTimer;
 	};
 }
\ No newline at end of file
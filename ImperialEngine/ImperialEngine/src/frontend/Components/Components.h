@@ -40,6 +40,7 @@ namespace Comp
 	struct Mesh
 	{
 		uint32_t meshId;
+		uint32_t generation;	// of the MeshRegistry slot meshId points to
 	};
 
 	struct GLTFEntity
@@ -65,5 +66,11 @@ namespace Comp
 		imp::VulkanSubBuffer vertices;
 		imp::VulkanSubBuffer indices[imp::kMaxLODCount];
 		imp::VulkanSubBuffer meshlets[imp::kMaxLODCount];
+		// model space simplification error of every lod, lod selection goes by these
+		float lodErrors[imp::kMaxLODCount];
+#if COMPACT_VERTICES
+		// draw data of every draw of the mesh carries this so shaders can decode its vertices
+		imp::VertexQuantization quantization;
+#endif
 	};
 }
\ No newline at end of file
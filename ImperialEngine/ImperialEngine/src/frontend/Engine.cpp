@@ -4,7 +4,7 @@
 #include "Utils/GfxUtilities.h"
 #include "Components/Components.h"
 #include "extern/IMGUI/imgui.h"
-#include "extern/THREAD-POOL/BS_thread_pool.hpp"
+#include "backend/parallel/JobSystem.h"
 #include "extern/GLM/ext/matrix_transform.hpp"
 #include "extern/GLM/ext/matrix_clip_space.hpp"
 #include "extern/GLM/gtx/quaternion.hpp"
@@ -14,18 +14,61 @@
 
 namespace imp
 {
+	// Frame graph resources that don't live in the registry
+	namespace FrameRes
+	{
+		struct WindowInput {};
+		// Comp::Transform of cameras. Nothing renderable has a camera, so it never overlaps with the transforms culling and draw data read
+		struct CameraTransforms {};
+		struct MeshBounds {};
+		struct RenderProxies {};
+		// m_ShaderDrawData and m_DrawCommands
+		struct GPUDrawData {};
+		struct MeshGeometry {};
+		struct VisibleDrawData {};
+		// m_DrawDataDirty and the snapshot slot's drawCommandsDirty
+		struct DrawDataDirty {};
+		// m_FrameStats and m_SyncWaitTime
+		struct FrameStats {};
+		// the render snapshot slot of this frame and its parts
+		struct SnapshotSlot {};
+		struct SnapshotCameras {};
+		struct SnapshotDrawData {};
+		struct SnapshotDrawCommands {};
+	}
+
 	Engine::Engine()
 		: m_Entities()
 		, m_DrawDataDirty(false)
 		, m_Q(nullptr)
 		, m_Worker(nullptr)
 		, m_SyncPoint(nullptr)
+		, m_RenderSnapshots()
+		, m_RenderSnapshotsPublished(0)
+		, m_FramesSynced(0)
+#if !BENCHMARK_MODE
+		, m_ImGuiFramesRendered(0)
+		, m_ImGuiFramesQueued(0)
+#endif
+		, m_FrameGraph()
+		, m_FrameGraphRenderMode()
+		, m_FrameGraphPipelined()
+		, m_DumpFrameGraph(false)
+		, m_BenchmarkCull(false)
+		, m_BenchmarkMeshProcessing(false)
 		, m_EngineSettings()
 		, m_Window()
 		, m_UI()
-		, m_ThreadPool(nullptr)
+		, m_JobSystem(nullptr)
 		, m_Gfx()
 		, m_VisibleDrawData()
+		, m_RenderProxies()
+		, m_CullingBVH()
+		, m_OcclusionCuller()
+		, m_ShaderDrawData(kEngineSwapchainDoubleBuffering + 1)
+		, m_DrawCommands(1)
+		, m_DrawCommandPatch()
+		, m_DrawDataProxiesVersion(0)
 #if BENCHMARK_MODE
 		, m_InitialCameraTransform()
 		, m_FrameTimeTables()
@@ -34,6 +77,7 @@ namespace imp
 #endif
 		, m_FrameTimer()
 		, m_CullTimer()
+		, m_SyncWaitTime()
 		, m_FullFrameTimer()
 		, m_LastFrameTime()
 #if BENCHMARK_MODE
@@ -54,6 +98,7 @@ namespace imp
 		InitWindow();
 		InitGraphics();
 		CreateCameras();
+		m_RenderProxies.Connect(m_Entities);
 
 		// wait until backend initted
 		m_SyncPoint->arrive_and_wait();
@@ -67,8 +112,17 @@ namespace imp
 
 	void Engine::LoadAssets()
 	{
+		// scenes are still importing on the job system meanwhile
+#if COMPACT_VERTICES
+		// compile_shaders.py builds this variant next to the default one, LoadShader throws if it hasn't been.
+		// Compute programs too, DrawData is bigger with the quantization in it
+		m_AssetImporter.LoadMaterials("Shaders/spir-v/compact");
+		m_AssetImporter.LoadComputeProgams("Shaders/spir-v/compact");
+#else
 		m_AssetImporter.LoadMaterials("Shaders/spir-v");
 		m_AssetImporter.LoadComputeProgams("Shaders/spir-v");
+#endif
+		m_AssetImporter.FinishLoadingScenes();
 		MarkDrawDataDirty();
 	}
 
@@ -92,21 +146,22 @@ namespace imp
 		m_LastFrameTime = m_FullFrameTimer.miliseconds();
 		m_FullFrameTimer.start();
 		m_FrameTimer.start();
+		m_SyncWaitTime = 0.0;
 
-		m_Q->add(std::mem_fn(&Engine::Cmd_StartFrame), std::shared_ptr<void>());
+		// pipelined frames queue this together with the render snapshot
+		if (!IsFramePipelined())
+			m_Q->add<&Engine::Cmd_StartFrame>();
 	}
 
 	void Engine::Update()
 	{
 		// not sure if this should be here
 #if !BENCHMARK_MODE
+		WaitForImGuiRendered();
 		m_Window.UpdateImGUI();
 #endif
 		m_Window.Update();
 		UpdateRegistry();
-
-		if (m_EngineSettings.gfxSettings.renderMode == kEngineRenderModeTraditional)
-			Cull();
 	}
 
 	void Engine::Render()
@@ -119,7 +174,7 @@ namespace imp
 
 	void Engine::EndFrame()
 	{
-		m_Q->add(std::mem_fn(&Engine::Cmd_EndFrame), std::shared_ptr<void>());
+		m_Q->add<&Engine::Cmd_EndFrame>();
 	}
 
 	void Engine::SyncRenderThread()
@@ -135,9 +190,17 @@ namespace imp
 			FrameTimeRow row;
 			row.frameMainCPU = m_FrameTimer.miliseconds();
 			row.frame = m_LastFrameTime;
+			row.syncWait = m_SyncWaitTime;
 
 			if (renderMode == kEngineRenderModeTraditional)
+			{
 				row.cull = m_CullTimer.miliseconds();
+				if (m_OcclusionCuller.IsEnabled())
+				{
+					row.occlusionCull = m_OcclusionCuller.GetStats().time;
+					row.occluded = m_OcclusionCuller.GetStats().occluded;
+				}
+			}
 #if !BENCHMARK_MODE
 			m_FrameStats.push_back(std::move(row));
 #else
@@ -146,13 +209,26 @@ namespace imp
 			table.table_rows.push_back(row);
 #endif
 		}
-		if (m_EngineSettings.threadingMode == kEngineMultiThreaded)
-			m_Q->add(std::mem_fn(&Engine::Cmd_SyncRenderThread), std::shared_ptr<void>());
+		if (m_EngineSettings.threadingMode == kEngineMultiThreaded && !IsFramePipelined())
+			m_Q->add<&Engine::Cmd_SyncRenderThread>();
 	}
 
 	void Engine::SyncGameThread()
 	{
-		m_SyncPoint->arrive_and_wait();
+		if (IsFramePipelined())
+		{
+			PublishRenderSnapshot();
+		}
+		else
+		{
+			// includes EngineThreadSyncFunc since both threads sit here while it runs
+			SimpleTimer waitTimer;
+			waitTimer.start();
+			m_SyncPoint->arrive_and_wait();
+			waitTimer.stop();
+			m_SyncWaitTime += waitTimer.miliseconds();
+		}
+		m_FramesSynced++;
 	}
 
 #if BENCHMARK_MODE
@@ -160,7 +236,7 @@ namespace imp
 	{
 		m_CollectBenchmarkData = true;
 
-		m_Q->add(std::mem_fn(&Engine::Cmd_StartBenchmark), std::shared_ptr<void>());
+		m_Q->add<&Engine::Cmd_StartBenchmark>();
 	}
 
 	void Engine::StopBenchmark()
@@ -176,7 +252,7 @@ namespace imp
 			transform.transform = m_InitialCameraTransform;
 		}
 
-		m_Q->add(std::mem_fn(&Engine::Cmd_StopBenchmark), std::shared_ptr<void>());
+		m_Q->add<&Engine::Cmd_StopBenchmark>();
 	}
 
 	const std::array<FrameTimeTable, kEngineRenderModeCount>& Engine::GetMainBenchmarkTable() const
@@ -227,7 +303,7 @@ namespace imp
 		}
 
 		m_EngineSettings.gfxSettings.renderMode = newRenderMode;
-		m_Q->add(std::mem_fn(&Engine::Cmd_ChangeRenderMode), std::make_shared<EngineRenderMode>(newRenderMode));
+		m_Q->add<&Engine::Cmd_ChangeRenderMode>(newRenderMode);
 		MarkDrawDataDirty();
 		return newRenderMode;
 	}
@@ -252,7 +328,8 @@ namespace imp
 			
 			const auto child = reg.create();
 			reg.emplace<Comp::ChildComponent>(child, monkey);
-			reg.emplace<Comp::Mesh>(child, (uint32_t)rand() % numMeshes);
+			const auto mesh = m_Gfx.m_Meshes.GetHandle((uint32_t)rand() % numMeshes);
+			reg.emplace<Comp::Mesh>(child, mesh.index, mesh.generation);
 			reg.emplace<Comp::Material>(child, kDefaultMaterialIndex);
 		}
 	}
@@ -279,21 +356,28 @@ namespace imp
 	void Engine::InitThreading(EngineThreadingMode mode)
 	{
 		BarrierFunctionObject func(*this);
+		prl::JobSystemSettings jobSettings;
+		jobSettings.workerCount = m_EngineSettings.jobWorkerCount;
+		m_JobSystem = new prl::JobSystem(jobSettings);
+		printf("[Job System] %u workers on %u physical cores, %u logical processors%s\n", m_JobSystem->GetWorkerCount(),
+			static_cast<uint32_t>(m_JobSystem->GetTopology().physicalCores.size()), m_JobSystem->GetTopology().logicalProcessorCount, m_JobSystem->AreWorkersPinned() ? ", pinned" : "");
+
 		switch (mode)
 		{
 		case kEngineSingleThreaded:
 			// TODO: I may have to abandon this..
 			// single-threaded so we only need the single-threaded version of the queue that executes task on add.
-			m_Q = new prl::WorkQ_ST<Engine>(*this);
+			m_Q = new prl::CommandRing_ST<Engine>(*this);
 
 			m_SyncPoint = new std::barrier(1, func);
 			break;
 		case kEngineMultiThreaded:
 			constexpr int numThreads = 2;
-			m_Q = new prl::WorkQ<Engine>();
+			m_Q = new prl::CommandRing<Engine>();
 			m_Worker = new prl::ConsumerThread<Engine>(*this, *m_Q);
 			m_SyncPoint = new std::barrier(numThreads, func);
-			m_ThreadPool = new BS::thread_pool(std::thread::hardware_concurrency() / 2);
+			if (m_EngineSettings.framesInFlight)
+				m_RenderSnapshots = std::vector<RenderSnapshot>(m_EngineSettings.framesInFlight);
 			break;
 		}
 	}
@@ -313,22 +397,23 @@ namespace imp
 	{
 		// Get required VK extensions
 		m_EngineSettings.gfxSettings.requiredExtensions = m_Window.GetRequiredExtensions();
-		m_Q->add(std::mem_fn(&Engine::Cmd_InitGraphics), std::make_shared<Window>(m_Window));
+		m_Q->add<&Engine::Cmd_InitGraphics>(m_Window);
 	}
 
 	void Engine::CleanUpThreading()
 	{
 		if (m_EngineSettings.threadingMode == kEngineMultiThreaded)
 		{
-			m_Q->add(std::mem_fn(&Engine::Cmd_ShutDown), std::make_shared<Window>(m_Window));
-			m_SyncPoint->arrive_and_wait();
+			m_Q->add<&Engine::Cmd_ShutDown>();
+			// pipelined frames don't leave a Cmd_SyncRenderThread in the queue to meet us at the barrier
+			if (!IsFramePipelined())
+				m_SyncPoint->arrive_and_wait();
 			m_Worker->Join();
-			m_ThreadPool->wait_for_tasks();
 			delete m_Worker;
 			delete m_SyncPoint;
-			delete m_ThreadPool;
 		}
 		delete m_Q;
+		delete m_JobSystem;
 	}
 
 	void Engine::CleanUpWindow()
@@ -367,7 +452,7 @@ namespace imp
 
 	void Engine::RenderCameras()
 	{
-		m_Q->add(std::mem_fn(&Engine::Cmd_RenderCameras), std::shared_ptr<void>());
+		m_Q->add<&Engine::Cmd_RenderCameras>();
 	}
 
 	void Engine::RenderImGUI()
@@ -388,13 +473,169 @@ namespace imp
 		}
 
 		m_UI.Update(*this, m_Entities, m_FrameStats);
-		m_Q->add(std::mem_fn(&Engine::Cmd_RenderImGUI), std::shared_ptr<void>());
+		m_Q->add<&Engine::Cmd_RenderImGUI>();
+		m_ImGuiFramesQueued++;
 #endif
 	}
 
 	void Engine::UpdateRegistry()
 	{
-		UpdateCameras();
+		if (m_FrameGraph.Empty() || m_FrameGraphRenderMode != GetCurrentRenderMode() || m_FrameGraphPipelined != IsFramePipelined())
+			BuildFrameGraph();
+
+		m_FrameGraph.Execute(*m_JobSystem);
+
+		if (m_DumpFrameGraph)
+		{
+			m_FrameGraph.Dump();
+			m_FrameGraph.WriteDot("FrameGraph.dot");
+			m_DumpFrameGraph = false;
+		}
+
+		if (m_BenchmarkCull)
+		{
+			utils::RunCullBenchmark(m_Entities, m_Gfx, utils::FindCullingLodSelection(m_Entities, static_cast<uint32_t>(m_Window.GetHeight()), m_EngineSettings.gfxSettings.lod));
+			m_BenchmarkCull = false;
+		}
+	}
+
+	void Engine::BuildFrameGraph()
+	{
+		using prl::SystemAccess;
+		m_FrameGraph.Clear();
+		m_FrameGraphRenderMode = GetCurrentRenderMode();
+		m_FrameGraphPipelined = IsFramePipelined();
+		const bool traditional = m_FrameGraphRenderMode == kEngineRenderModeTraditional;
+		const bool isMeshPipe = m_FrameGraphRenderMode == kEngineRenderModeGPUDrivenMeshShading;
+
+		// glfw input can only be read on the main thread
+		m_FrameGraph.AddSystem("UpdateCameras", SystemAccess().Read<FrameRes::WindowInput>().Write<FrameRes::CameraTransforms, Comp::Camera>(),
+			[this]() { UpdateCameras(); }, prl::kSystemMainThread);
+
+		// with the barrier the render thread has to be parked while we write its data, that happens in EngineThreadSyncFunc.
+		// Pipelined frames write into a snapshot slot of their own, so that can overlap with everything else.
+		if (m_FrameGraphPipelined)
+		{
+			m_FrameGraph.AddSystem("AcquireRenderSnapshot", SystemAccess().Write<FrameRes::SnapshotSlot, FrameRes::FrameStats, FrameRes::DrawDataDirty>(),
+				[this]() { AcquireRenderSnapshot(GetCurrentRenderSnapshot()); });
+			// also clears camera dirty flags
+			m_FrameGraph.AddSystem("SnapshotCameras", SystemAccess().Read<FrameRes::SnapshotSlot, FrameRes::CameraTransforms>().Write<Comp::Camera, FrameRes::SnapshotCameras>(),
+				[this]() { auto& snapshot = GetCurrentRenderSnapshot(); CopyCameras(snapshot.mainCamera, snapshot.previewCamera); });
+		}
+
+		// culling and GPU draw data only go through the proxies after this
+		m_FrameGraph.AddSystem("UpdateRenderProxies", SystemAccess().Read<Comp::Transform, Comp::ChildComponent, Comp::Mesh, Comp::Material, FrameRes::MeshBounds>().Write<FrameRes::RenderProxies>(),
+			[this]() { m_RenderProxies.Update(m_Gfx, *m_JobSystem); });
+
+		if (traditional)
+			m_FrameGraph.AddSystem("Cull", SystemAccess().Read<Comp::Camera, Comp::Transform, FrameRes::MeshGeometry>().Write<FrameRes::RenderProxies, FrameRes::VisibleDrawData>(),
+				[this]() { Cull(); });
+
+		if (!m_FrameGraphPipelined)
+			return;
+
+		if (traditional)
+		{
+			m_FrameGraph.AddSystem("SnapshotDrawData", SystemAccess().Read<FrameRes::SnapshotSlot, FrameRes::VisibleDrawData>().Write<FrameRes::SnapshotDrawData>(),
+				[this]() { FillTraditionalDrawData(GetCurrentRenderSnapshot().drawData); });
+		}
+		else
+		{
+			m_FrameGraph.AddSystem("UpdateGPUDrawData", SystemAccess().Read<FrameRes::RenderProxies, FrameRes::MeshGeometry>().Write<FrameRes::GPUDrawData, FrameRes::DrawDataDirty>(),
+				[this, isMeshPipe]() { UpdateGPUDrawData(isMeshPipe); });
+			// snapshots only get what changed since the last one
+			m_FrameGraph.AddSystem("SnapshotDrawCommands", SystemAccess().Read<FrameRes::SnapshotSlot, FrameRes::GPUDrawData>().Write<FrameRes::SnapshotDrawCommands, FrameRes::DrawDataDirty>(),
+				[this]()
+				{
+					auto& snapshot = GetCurrentRenderSnapshot();
+					snapshot.drawCommandsDirty = m_DrawCommands.IsDirty(0);
+					if (snapshot.drawCommandsDirty)
+						m_DrawCommands.Flush(0, snapshot.drawCommands);
+				});
+			m_FrameGraph.AddSystem("SnapshotShaderDrawData", SystemAccess().Read<FrameRes::SnapshotSlot, FrameRes::GPUDrawData>().Write<FrameRes::SnapshotDrawData>(),
+				[this]() { m_ShaderDrawData.Flush(kSnapshotDrawDataDestination, GetCurrentRenderSnapshot().shaderDrawData); });
+		}
+	}
+
+	void Engine::RequestFrameGraphDump()
+	{
+		m_DumpFrameGraph = true;
+	}
+
+	void Engine::RequestCullBenchmark()
+	{
+		m_BenchmarkCull = true;
+	}
+
+	void Engine::RequestMeshProcessingBenchmark()
+	{
+		// read on the render thread, only by upload commands queued after this
+		m_BenchmarkMeshProcessing = true;
+	}
+
+	void Engine::SetMeshCookingEnabled(bool enabled)
+	{
+		m_AssetImporter.SetCookMeshes(enabled);
+	}
+
+	void Engine::SetCullingBVHEnabled(bool enabled)
+	{
+		if (enabled)
+			m_CullingBVH.Enable();
+		else
+			m_CullingBVH.Disable();
+	}
+
+	bool Engine::IsCullingBVHEnabled() const
+	{
+		return m_CullingBVH.IsEnabled();
+	}
+
+	void Engine::SetOcclusionCullingEnabled(bool enabled)
+	{
+		if (enabled)
+			m_OcclusionCuller.Enable();
+		else
+			m_OcclusionCuller.Disable();
+	}
+
+	bool Engine::IsOcclusionCullingEnabled() const
+	{
+		return m_OcclusionCuller.IsEnabled();
+	}
+
+	void Engine::SetInstancingEnabled(bool enabled)
+	{
+		m_EngineSettings.gfxSettings.instancingEnabled = enabled;
+		m_Q->add<&Engine::Cmd_SetInstancing>(enabled);
+		MarkDrawDataDirty();
+	}
+
+	bool Engine::IsInstancingEnabled() const
+	{
+		return m_EngineSettings.gfxSettings.instancingEnabled;
+	}
+
+	void Engine::SetGPUOcclusionCullingEnabled(bool enabled)
+	{
+		m_EngineSettings.gfxSettings.gpuOcclusionCullingEnabled = enabled;
+		m_Q->add<&Engine::Cmd_SetGPUOcclusionCulling>(enabled);
+	}
+
+	bool Engine::IsGPUOcclusionCullingEnabled() const
+	{
+		return m_EngineSettings.gfxSettings.gpuOcclusionCullingEnabled;
+	}
+
+	void Engine::SetLodSettings(const EngineLodSettings& settings)
+	{
+		m_EngineSettings.gfxSettings.lod = settings;
+		m_Q->add<&Engine::Cmd_SetLodSettings>(settings);
+	}
+
+	const EngineLodSettings& Engine::GetLodSettings() const
+	{
+		return m_EngineSettings.gfxSettings.lod;
 	}
 
 	void Engine::UpdateCameras()
@@ -429,7 +670,20 @@ namespace imp
 #endif
 			m_CullTimer.start();
 #if CULLING_ENABLED
-		utils::Cull(m_Entities, m_VisibleDrawData, m_Gfx, *m_ThreadPool);
+		const auto lodSelection = utils::FindCullingLodSelection(m_Entities, static_cast<uint32_t>(m_Window.GetHeight()), m_EngineSettings.gfxSettings.lod);
+		if (m_CullingBVH.IsEnabled())
+		{
+			m_CullingBVH.Update(m_RenderProxies, *m_JobSystem);
+			m_CullingBVH.Cull(utils::FindCullingFrustum(m_Entities), m_RenderProxies, lodSelection, m_Gfx.m_Meshes, m_VisibleDrawData, *m_JobSystem);
+		}
+		else
+			utils::Cull(m_Entities, m_RenderProxies, lodSelection, m_Gfx.m_Meshes, m_VisibleDrawData, *m_JobSystem);
+
+		if (m_OcclusionCuller.IsEnabled())
+			m_OcclusionCuller.Cull(utils::FindCullingViewProjection(m_Entities), m_Gfx.m_Meshes, m_VisibleDrawData, *m_JobSystem);
+
+		if (m_EngineSettings.gfxSettings.instancingEnabled)
+			utils::SortDrawsForInstancing(m_VisibleDrawData, m_Gfx.m_Meshes.GetSlotCount(), *m_JobSystem);
 #endif
 
 #if BENCHMARK_MODE
@@ -438,12 +692,21 @@ namespace imp
 			m_CullTimer.stop();
 	}
 
-	inline void GenerateIndirectDrawCommand(IGPUBuffer& dstBuffer, const Comp::MeshGeometry& meshData, uint32_t meshId, bool isMeshPipeline)
+	static size_t GetIndirectDrawCommandSize(bool isMeshPipeline)
+	{
+#if CULLING_ENABLED
+		return sizeof(IndirectDrawCmd);
+#else
+		return isMeshPipeline ? sizeof(ms_IndirectDrawCommand) : sizeof(VkDrawIndexedIndirectCommand);
+#endif
+	}
+
+	static void GenerateIndirectDrawCommand(MirroredUploadBuffer& dstBuffer, size_t idx, const Comp::MeshGeometry& meshData, uint32_t meshId, bool isMeshPipeline)
 	{
 #if CULLING_ENABLED
 		IndirectDrawCmd cmd;
 		cmd.meshDataIndex = meshId;
-		dstBuffer.push_back(&cmd, sizeof(IndirectDrawCmd));
+		dstBuffer.Write(idx, &cmd);
 #else
 		if (!isMeshPipeline)
 		{
@@ -453,7 +716,7 @@ namespace imp
 			cmd.instanceCount = 1;
 			cmd.firstInstance = 0;
 			cmd.vertexOffset = meshData.vertices.GetOffset();
-			dstBuffer.push_back(&cmd, sizeof(VkDrawIndexedIndirectCommand));
+			dstBuffer.Write(idx, &cmd);
 			return;
 		}
 		ms_IndirectDrawCommand mcmd;
@@ -461,107 +724,129 @@ namespace imp
 		mcmd.taskCount = CONE_CULLING_ENABLED ? (meshData.meshlets[0].GetCount() + MESH_WGROUP - 1) / MESH_WGROUP : meshData.meshlets[0].GetCount();
 		mcmd.meshTaskCount = meshData.meshlets[0].GetCount();
 		mcmd.meshletBufferOffset = meshData.meshlets[0].GetOffset();
-		dstBuffer.push_back(&mcmd, sizeof(ms_IndirectDrawCommand));
+		dstBuffer.Write(idx, &mcmd);
 #endif
 	}
 
-	// This member function gets executed when both main and render thread arrive at the barrier.
-	// Can be used to sync data.
-	// Keep as fast as possible.
-	// TODO: remove barrier to prevent whole engine stall
-	// TODO: figure out why I'm copying this data around? Is there a way to prevent doubling down this data?
-	// at least remove these dumb duplicate types like 'CameraData', just use Camera component
-	void Engine::EngineThreadSyncFunc() noexcept
+	static ShaderDrawData MakeShaderDrawData(const RenderProxies& proxies, size_t idx, const Comp::MeshGeometry& meshData)
 	{
-		AUTO_TIMER("[ENGINE SYNC]: ");
-		m_Window.UpdateDeltaTime();
+		ShaderDrawData sdd;
+		sdd.transform = proxies.GetTransform(idx);
+		sdd.materialIndex = kDefaultMaterialIndex;
+		sdd.vertexOffset = 0;
+		sdd.boundingSphere = proxies.GetSphere(idx);
+#if COMPACT_VERTICES
+		sdd.quantization = meshData.quantization;
+#endif
+		return sdd;
+	}
 
-		const auto renderMode = GetCurrentRenderMode();
-		bool isMeshPipe = renderMode == kEngineRenderModeGPUDrivenMeshShading;
+	// Brings m_ShaderDrawData and m_DrawCommands up to date with m_RenderProxies. Only proxies it says changed get
+	// rewritten, draw commands only when their mesh did, unless something needs everything redone (render mode switch,
+	// missed changes). Nothing changed - nothing to do.
+	void Engine::UpdateGPUDrawData(bool isMeshPipe)
+	{
+		const size_t count = m_RenderProxies.GetCount();
+		const uint64_t proxiesVersion = m_RenderProxies.GetVersion();
+		const bool proxiesChanged = proxiesVersion != m_DrawDataProxiesVersion;
+		const bool everything = IsDrawDataDirty() || (proxiesChanged && (m_RenderProxies.WasRebuilt() || proxiesVersion != m_DrawDataProxiesVersion + 1));
+		if (!everything && !proxiesChanged)
+			return;
 
-		switch (renderMode)
+		// meshes the render thread hasn't uploaded yet go in empty and everything gets redone next time
+		static const Comp::MeshGeometry kNotUploaded = {};
+		std::atomic_bool pendingUploads = false;
+		const auto getMeshData = [this, &pendingUploads](uint32_t meshId) -> const Comp::MeshGeometry&
 		{
-		case kEngineRenderModeTraditional:
+			if (m_Gfx.m_Meshes.IsUploaded(meshId))
+				return m_Gfx.GetMeshData(meshId);
+			pendingUploads.store(true, std::memory_order_relaxed);
+			return kNotUploaded;
+		};
+		const auto writeDrawCommand = [this, isMeshPipe, &getMeshData](size_t idx)
 		{
-#if CULLING_ENABLED
-			auto& srcDrawData = m_VisibleDrawData;
-#else 
-			if (IsDrawDataDirty())
-			{
-				const auto transforms = m_Entities.view<Comp::Transform>();
-				const auto group = m_Entities.group<Comp::ChildComponent, Comp::Mesh, Comp::Material>();
-				const auto groupSize = group.size();
-				m_VisibleDrawData.resize(0);
+			const uint32_t meshId = m_RenderProxies.GetMeshId(idx);
+			GenerateIndirectDrawCommand(m_DrawCommands, idx, getMeshData(meshId), meshId, isMeshPipe);
+		};
+		const auto makeDrawData = [this, &getMeshData](size_t idx)
+		{
+			return MakeShaderDrawData(m_RenderProxies, idx, getMeshData(m_RenderProxies.GetMeshId(idx)));
+		};
+
+		m_DrawCommands.Reset(GetIndirectDrawCommandSize(isMeshPipe));
+		m_DrawCommands.Resize(count);
+		m_ShaderDrawData.Reset(sizeof(ShaderDrawData));
+		m_ShaderDrawData.Resize(count);
+		if (everything)
+		{
+			for (size_t i = 0; i < count; i++)
+				writeDrawCommand(i);
 
-				for (const auto ent : group)
+			auto* shaderDrawData = static_cast<ShaderDrawData*>(m_ShaderDrawData.Data());
+			m_JobSystem->ParallelFor(count, [&](size_t st, size_t en)
 				{
-					const auto& mesh = group.get<Comp::Mesh>(ent);
-					const auto& parent = group.get<Comp::ChildComponent>(ent).parent;
-					const auto& transform = transforms.get<Comp::Transform>(parent);
-
-					DrawDataSingle dds;
-					dds.Transform = transform.transform;
-					dds.VertexBufferId = mesh.meshId;
-					dds.LodIdx = 0;
+					for (size_t i = st; i < en; i++)
+						shaderDrawData[i] = makeDrawData(i);
+				});
+			m_ShaderDrawData.MarkAllDirty();
+			m_DrawCommands.MarkAllDirty();
+		}
+		else
+		{
+			for (const auto idx : m_RenderProxies.GetChangedMeshIndices())
+				writeDrawCommand(idx);
 
-					m_VisibleDrawData.push_back(dds);
-				}
+			for (const auto idx : m_RenderProxies.GetChangedIndices())
+			{
+				const auto sdd = makeDrawData(idx);
+				m_ShaderDrawData.Write(idx, &sdd);
 			}
-			auto& srcDrawData = m_VisibleDrawData;
-#endif
-
-			auto& dstDrawData = m_Gfx.m_DrawData;
-			dstDrawData.resize(0);
-
-			// We already composed the draw data in Engine::Cull, can just copy it in
-			dstDrawData.insert(dstDrawData.end(), srcDrawData.begin(), srcDrawData.end());
-			break;
 		}
-		case kEngineRenderModeGPUDriven:
-		case kEngineRenderModeGPUDrivenMeshShading:
-		{
-			AUTO_TIMER("[ENGINE SYNC - GPU-Driven part]: ");
-			// This can stall because it may wait on timeline semaphore
-			IGPUBuffer& drawCmdBuffer = m_Gfx.GetDrawCommandStagingBuffer();
-			drawCmdBuffer.resize(0, 0);
 
-			IGPUBuffer& drawDataBuffer = m_Gfx.GetDrawDataBuffer();
-			drawDataBuffer.resize(0, 0);
+		m_DrawDataProxiesVersion = proxiesVersion;
+		m_DrawDataDirty = pendingUploads.load(std::memory_order_relaxed);
+	}
 
-			const auto renderableChildren = m_Entities.view<Comp::ChildComponent, Comp::Mesh, Comp::Material>();
+	void Engine::FillTraditionalDrawData(std::vector<DrawDataSingle>& dstDrawData)
+	{
+#if CULLING_ENABLED
+		auto& srcDrawData = m_VisibleDrawData;
+#else 
+		if (IsDrawDataDirty())
+		{
 			const auto transforms = m_Entities.view<Comp::Transform>();
-			for (auto ent : renderableChildren)
+			const auto group = m_Entities.group<Comp::ChildComponent, Comp::Mesh, Comp::Material>();
+			const auto groupSize = group.size();
+			m_VisibleDrawData.resize(0);
+
+			for (const auto ent : group)
 			{
-				const auto& mesh = renderableChildren.get<Comp::Mesh>(ent);
-				const auto& parent = renderableChildren.get<Comp::ChildComponent>(ent).parent;
-			    const auto& transform = transforms.get<Comp::Transform>(parent);
+				const auto& mesh = group.get<Comp::Mesh>(ent);
+				const auto& parent = group.get<Comp::ChildComponent>(ent).parent;
+				const auto& transform = transforms.get<Comp::Transform>(parent);
 
-				const auto& meshData = m_Gfx.GetMeshData(mesh.meshId);
-				if (IsDrawDataDirty())
-				{
-					// Needed for GPU-driven
-					GenerateIndirectDrawCommand(drawCmdBuffer, meshData, mesh.meshId, isMeshPipe);
-				}
+				DrawDataSingle dds;
+				dds.Transform = transform.transform;
+				dds.VertexBufferId = mesh.meshId;
+				dds.LodIdx = 0;
 
-				// Also update shader draw data. Also contains mesh id, that CPU-driven can use to generate draw commands
-				ShaderDrawData sdd;
-				sdd.transform = transform.transform;
-				sdd.materialIndex = kDefaultMaterialIndex;
-				sdd.vertexOffset = 0;
-				// This seems to be quite slow, might be faster if I'd templatize the VulkanBuffer container
-				drawDataBuffer.push_back(&sdd, sizeof(sdd));
-			}
-			if (IsDrawDataDirty())
-			{
-				// Mark delay so we do transfers in UpdateDraws and not in StartFrame
-				m_Gfx.m_DelayTransferOperation = true;
-				m_Q->add(std::mem_fn(&Engine::Cmd_UpdateDraws), std::shared_ptr<void>());
-				m_DrawDataDirty = false;
+				m_VisibleDrawData.push_back(dds);
 			}
-			break;
-		}
+
+			if (m_EngineSettings.gfxSettings.instancingEnabled)
+				utils::SortDrawsForInstancing(m_VisibleDrawData, m_Gfx.m_Meshes.GetSlotCount(), *m_JobSystem);
 		}
+		auto& srcDrawData = m_VisibleDrawData;
+#endif
+
+		dstDrawData.resize(0);
+
+		// We already composed the draw data in Engine::Cull, can just copy it in
+		dstDrawData.insert(dstDrawData.end(), srcDrawData.begin(), srcDrawData.end());
+	}
 
+	void Engine::CopyCameras(CameraData& mainCamera, CameraData& previewCamera)
+	{
 		const auto cameras = m_Entities.view<Comp::Transform, Comp::Camera>();
 		for (auto ent : cameras)
 		{
@@ -571,25 +856,137 @@ namespace imp
 			// Supporting only 1 camera and 1 "fake offset" camera
 			static constexpr uint32_t cameraID = 0;
 			if (cam.preview)
-				m_Gfx.m_PreviewCamera = { cam.projection, cam.view, transform.transform, cam.camOutputType, cameraID, cam.dirty, cam.preview, cam.isRenderCamera };
+				previewCamera = { cam.projection, cam.view, transform.transform, cam.camOutputType, cameraID, cam.dirty, cam.preview, cam.isRenderCamera };
 			else
-				m_Gfx.m_MainCamera = { cam.projection, cam.view, transform.transform, cam.camOutputType, cameraID, cam.dirty, cam.preview, cam.isRenderCamera };
+				mainCamera = { cam.projection, cam.view, transform.transform, cam.camOutputType, cameraID, cam.dirty, cam.preview, cam.isRenderCamera };
 
 			cam.dirty = false;
 		}
+	}
 
 #if !BENCHMARK_MODE
-		const auto& stats = m_Gfx.GetFrameStats();
-		if (stats.frameGPU > 0.0f)
+	// Render thread stats arrive framesBehind frames late, merge them into the row of the frame they belong to
+	void Engine::MergeRenderFrameStats(const FrameTimeRow& stats, size_t framesBehind)
+	{
+		if (stats.frameGPU > 0.0f && m_FrameStats.size() > framesBehind)
 		{
-			auto& row = m_FrameStats[m_FrameStats.size() - 1 - kEngineSwapchainDoubleBuffering];
+			auto& row = m_FrameStats[m_FrameStats.size() - 1 - framesBehind];
 			row.cull = std::max(row.cull, stats.cull);
 			row.frame = std::max(row.frame, stats.frame);
 			row.frameGPU = stats.frameGPU;
 			row.frameRenderCPU = stats.frameRenderCPU;
 			row.triangles = stats.triangles;
 		}
+	}
+
+	void Engine::WaitForImGuiRendered()
+	{
+		// barrier already makes sure of this
+		if (!IsFramePipelined())
+			return;
+
+		SimpleTimer waitTimer;
+		waitTimer.start();
+		for (auto rendered = m_ImGuiFramesRendered.load(std::memory_order_acquire); rendered != m_ImGuiFramesQueued; rendered = m_ImGuiFramesRendered.load(std::memory_order_acquire))
+			m_ImGuiFramesRendered.wait(rendered, std::memory_order_acquire);
+		waitTimer.stop();
+		m_SyncWaitTime += waitTimer.miliseconds();
+	}
+#endif
+
+	bool Engine::IsFramePipelined() const
+	{
+		return m_EngineSettings.threadingMode == kEngineMultiThreaded && m_EngineSettings.framesInFlight > 0 && m_FramesSynced > 0;
+	}
+
+	// Replaces the barrier when frames are pipelined. Main thread only waits if the render thread
+	// hasn't picked up the snapshot it wrote framesInFlight frames ago.
+	// The snapshot was already filled by the frame graph in Update
+	void Engine::PublishRenderSnapshot()
+	{
+		auto& snapshot = GetCurrentRenderSnapshot();
+		m_Window.UpdateDeltaTime();
+
+		m_Q->add<&Engine::Cmd_ApplyRenderSnapshot>(&snapshot);
+		m_Q->add<&Engine::Cmd_StartFrame>();
+		if (snapshot.drawCommandsDirty)
+			m_Q->add<&Engine::Cmd_UpdateDraws>();
+		m_RenderSnapshotsPublished++;
+	}
+
+	RenderSnapshot& Engine::GetCurrentRenderSnapshot()
+	{
+		return m_RenderSnapshots[m_RenderSnapshotsPublished % m_RenderSnapshots.size()];
+	}
+
+	// Waits until the render thread has picked up what we wrote into this slot framesInFlight frames ago.
+	// Runs as the first snapshot system of the frame graph, the rest of the snapshot systems fill it in.
+	void Engine::AcquireRenderSnapshot(RenderSnapshot& snapshot)
+	{
+		const uint64_t timesPublished = m_RenderSnapshotsPublished / m_RenderSnapshots.size();
+
+		SimpleTimer waitTimer;
+		waitTimer.start();
+		for (auto consumed = snapshot.timesConsumed.load(std::memory_order_acquire); consumed != timesPublished; consumed = snapshot.timesConsumed.load(std::memory_order_acquire))
+			snapshot.timesConsumed.wait(consumed, std::memory_order_acquire);
+		waitTimer.stop();
+		m_SyncWaitTime += waitTimer.miliseconds();
+
+		snapshot.drawCommandsDirty = false;
+
+#if !BENCHMARK_MODE
+		// stats the render thread left in this slot the last time it picked it up
+		MergeRenderFrameStats(snapshot.renderStats, kEngineSwapchainDoubleBuffering + m_RenderSnapshots.size());
+#endif
+	}
+
+	// This member function gets executed when both main and render thread arrive at the barrier.
+	// Can be used to sync data.
+	// Keep as fast as possible.
+	// TODO: remove barrier to prevent whole engine stall
+	// TODO: figure out why I'm copying this data around? Is there a way to prevent doubling down this data?
+	// at least remove these dumb duplicate types like 'CameraData', just use Camera component
+	void Engine::EngineThreadSyncFunc() noexcept
+	{
+		AUTO_TIMER("[ENGINE SYNC]: ");
+		m_Window.UpdateDeltaTime();
+
+		const auto renderMode = GetCurrentRenderMode();
+		bool isMeshPipe = renderMode == kEngineRenderModeGPUDrivenMeshShading;
+
+		switch (renderMode)
+		{
+		case kEngineRenderModeTraditional:
+		{
+			FillTraditionalDrawData(m_Gfx.m_DrawData);
+			break;
+		}
+		case kEngineRenderModeGPUDriven:
+		case kEngineRenderModeGPUDrivenMeshShading:
+		{
+			AUTO_TIMER("[ENGINE SYNC - GPU-Driven part]: ");
+			// UI could have added renderables after the frame graph updated the spheres, main thread is parked here
+			m_RenderProxies.Update(m_Gfx, *m_JobSystem);
+			UpdateGPUDrawData(isMeshPipe);
+
+			// This can stall because it may wait on timeline semaphore
+			if (m_ShaderDrawData.IsDirty(m_Gfx.GetFrameClock()))
+				m_ShaderDrawData.Flush(m_Gfx.GetFrameClock(), m_Gfx.GetDrawDataBuffer());
+			if (m_DrawCommands.IsDirty(0))
+			{
+				m_DrawCommands.Flush(0, m_DrawCommandPatch);
+				m_Gfx.StageDrawCommands(m_DrawCommandPatch);
+				m_Q->add<&Engine::Cmd_UpdateDraws>();
+			}
+			break;
+		}
+		}
+
+		CopyCameras(m_Gfx.m_MainCamera, m_Gfx.m_PreviewCamera);
+
+#if !BENCHMARK_MODE
+		MergeRenderFrameStats(m_Gfx.GetFrameStats(), kEngineSwapchainDoubleBuffering);
 #endif
 	}
 
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -2,18 +2,23 @@
 #include "Utils/FrameTimeTable.h"
 #include "Utils/NonCopyable.h"
 #include "Utils/SimpleTimer.h"
+#include "Utils/CullingBVH.h"
+#include "Utils/OcclusionCuller.h"
+#include "Utils/RenderProxies.h"
 #include "extern/ENTT/entt.hpp"
 #include "backend/graphics/Graphics.h"
-#include "backend/parallel/WorkQ_ST.h"
+#include "backend/parallel/CommandRing_ST.h"
 #include "backend/parallel/ConsumerThread.h"
+#include "backend/parallel/TaskGraph.h"
 #include "frontend/AssetImporter.h"
 #include "frontend/Window.h"
 #include "frontend/UI.h"
+#include <atomic>
 #include <barrier>
 
 // No Vulkan stuff here
 
-namespace BS { class thread_pool; }
+namespace prl { class JobSystem; }
 
 namespace imp
 {
@@ -22,6 +27,7 @@ namespace imp
 	public:
 		Engine();
 		bool Initialize(EngineSettings settings);
+		// Scene files import on the job system until LoadAssets, which waits for them after loading the shaders
 		void LoadScenes(const std::vector<std::string>& scenes);
 		void LoadAssets();
 
@@ -54,6 +60,35 @@ namespace imp
 		// temporary
 		void AddDemoEntity(uint32_t count);
 
+		// Traditional mode CPU culling through CullingBVH instead of going over every renderable
+		void SetCullingBVHEnabled(bool enabled);
+		bool IsCullingBVHEnabled() const;
+
+		// Traditional mode CPU occlusion culling of what frustum culling left, see OcclusionCuller
+		void SetOcclusionCullingEnabled(bool enabled);
+		bool IsOcclusionCullingEnabled() const;
+
+		// Merges draws of the same mesh and lod into instanced draws, in Traditional and GPU-Driven modes
+		void SetInstancingEnabled(bool enabled);
+		bool IsInstancingEnabled() const;
+
+		// GPU-Driven modes Hi-Z occlusion culling against a depth pyramid of the frame, see Occlusion.h
+		void SetGPUOcclusionCullingEnabled(bool enabled);
+		bool IsGPUOcclusionCullingEnabled() const;
+
+		// Screen-space error lod selection and contribution culling, CPU and GPU culling both go by these
+		void SetLodSettings(const EngineLodSettings& settings);
+		const EngineLodSettings& GetLodSettings() const;
+
+		// Prints the frame graph with timings of the next frame and writes it to FrameGraph.dot
+		void RequestFrameGraphDump();
+		// Runs the culling benchmark on the loaded scene after the next frame's update
+		void RequestCullBenchmark();
+		// Times processing of every mesh batch loaded after this single threaded vs on the job system, before it gets uploaded
+		void RequestMeshProcessingBenchmark();
+		// Scenes loaded after this skip the mesh cache and get processed again, replacing their cache entries
+		void SetMeshCookingEnabled(bool enabled);
+
 		bool ShouldClose() const;
 		void ShutDown();
 	private:
@@ -76,12 +111,27 @@ namespace imp
 		void RenderCameras();
 		void RenderImGUI();
 
-		// update systems
+		// update systems, run through m_FrameGraph
 		void UpdateRegistry();
+		void BuildFrameGraph();
 		void UpdateCameras();
 
 		void Cull();
 
+		// Pipelined frames (EngineSettings::framesInFlight > 0) hand data to the render thread through snapshot slots
+		// instead of meeting at the barrier. First frame still uses the barrier so loading is done before we start.
+		bool IsFramePipelined() const;
+		void PublishRenderSnapshot();
+		RenderSnapshot& GetCurrentRenderSnapshot();
+		void AcquireRenderSnapshot(RenderSnapshot& snapshot);
+#if !BENCHMARK_MODE
+		void WaitForImGuiRendered();
+		void MergeRenderFrameStats(const FrameTimeRow& stats, size_t framesBehind);
+#endif
+		void UpdateGPUDrawData(bool isMeshPipe);
+		void FillTraditionalDrawData(std::vector<DrawDataSingle>& dstDrawData);
+		void CopyCameras(CameraData& mainCamera, CameraData& previewCamera);
+
 		void EngineThreadSyncFunc()  noexcept;
 
 		// entity stuff
@@ -90,7 +140,9 @@ namespace imp
 		bool m_DrawDataDirty;
 
 		// parallel stuff
-		prl::WorkQ<Engine>* m_Q;
+		// Main thread is the only producer. Barrier completion can run on the render thread and add to it, that's fine
+		// since the main thread is blocked on the barrier at that point.
+		prl::CommandRing<Engine>* m_Q;
 		prl::ConsumerThread<Engine>* m_Worker;
 		struct BarrierFunctionObject
 		{
@@ -99,17 +151,48 @@ namespace imp
 			void operator()() noexcept { engine.EngineThreadSyncFunc(); }
 		};
 	    std::barrier<BarrierFunctionObject>* m_SyncPoint;	// TODO: use polymorphism for when Single thread mode this wont do anything
+		std::vector<RenderSnapshot> m_RenderSnapshots;
+		uint64_t m_RenderSnapshotsPublished;
+		uint64_t m_FramesSynced;
+#if !BENCHMARK_MODE
+		// ImGui keeps its state in globals, so with pipelined frames main thread can't start the next UI frame
+		// until the render thread has rendered the last one
+		std::atomic<uint64_t> m_ImGuiFramesRendered;
+		uint64_t m_ImGuiFramesQueued;
+#endif
+
+		// Built for the render mode and pipelining it was built with, rebuilt when those change
+		prl::TaskGraph m_FrameGraph;
+		EngineRenderMode m_FrameGraphRenderMode;
+		bool m_FrameGraphPipelined;
+		bool m_DumpFrameGraph;
+		bool m_BenchmarkCull;
+		bool m_BenchmarkMeshProcessing;
 
 		// window stuff
 		Window m_Window;
 		UI m_UI;
 
-		BS::thread_pool* m_ThreadPool;
+		// shared by culling, draw data updates and asset import
+		prl::JobSystem* m_JobSystem;
 
 		// graphics stuff
 		Graphics m_Gfx;
 		// Used as a "staging" buffer for CPU VF culling
 		std::vector<DrawDataSingle> m_VisibleDrawData;
+		// flat copy of the renderables culling and GPU draw data go through
+		RenderProxies m_RenderProxies;
+		// only connected to the registry while enabled
+		CullingBVH m_CullingBVH;
+		OcclusionCuller m_OcclusionCuller;
+		// Draw data of GPU-driven modes. Flushed into the per-frame GPU buffers on barrier frames, into snapshots
+		// (kSnapshotDrawDataDestination) on pipelined ones
+		MirroredUploadBuffer m_ShaderDrawData;
+		MirroredUploadBuffer m_DrawCommands;
+		UploadPatch m_DrawCommandPatch;
+		// m_RenderProxies version m_ShaderDrawData and m_DrawCommands are up to date with
+		uint64_t m_DrawDataProxiesVersion;
+		static constexpr uint32_t kSnapshotDrawDataDestination = kEngineSwapchainDoubleBuffering;
 
 #if BENCHMARK_MODE
 		glm::mat4x4 m_InitialCameraTransform;
@@ -119,6 +202,7 @@ namespace imp
 #endif
 		SimpleTimer m_FrameTimer;
 		SimpleTimer m_CullTimer;
+		double m_SyncWaitTime;
 		SimpleTimer m_FullFrameTimer;
 		double m_LastFrameTime;
 #if BENCHMARK_MODE
@@ -133,22 +217,27 @@ namespace imp
 		EngineSettings m_EngineSettings;
 
 		// TODO prettier: put this into a namespace
-		void Cmd_InitGraphics(std::shared_ptr<void> rsc);
-		void Cmd_StartFrame(std::shared_ptr<void> rsc);
-		void Cmd_RenderCameras(std::shared_ptr<void> rsc);
-		void Cmd_EndFrame(std::shared_ptr<void> rsc);
-		void Cmd_SyncRenderThread(std::shared_ptr<void> rsc);
-		void Cmd_RenderImGUI(std::shared_ptr<void> rsc);
-		void Cmd_UploadMeshes(std::shared_ptr<void> rsc);
-		void Cmd_UploadMaterials(std::shared_ptr<void> rsc);
-		void Cmd_UploadComputePrograms(std::shared_ptr<void> rsc);
-		void Cmd_ChangeRenderMode(std::shared_ptr<void> rsc);
-		void Cmd_UpdateDraws(std::shared_ptr<void> rsc);
-		void Cmd_ShutDown(std::shared_ptr<void> rsc);
+		// Payloads are stored inline in the command ring, keep them small (see prl::Command::kPayloadSize)
+		void Cmd_InitGraphics(Window& window);
+		void Cmd_ApplyRenderSnapshot(RenderSnapshot* snapshot);
+		void Cmd_StartFrame();
+		void Cmd_RenderCameras();
+		void Cmd_EndFrame();
+		void Cmd_SyncRenderThread();
+		void Cmd_RenderImGUI();
+		void Cmd_UploadMeshes(std::vector<MeshCreationRequest>& reqs);
+		void Cmd_UploadMaterials(std::vector<MaterialCreationRequest>& reqs);
+		void Cmd_UploadComputePrograms(std::vector<ComputeProgramCreationRequest>& reqs);
+		void Cmd_ChangeRenderMode(EngineRenderMode newRenderMode);
+		void Cmd_SetInstancing(bool enabled);
+		void Cmd_SetGPUOcclusionCulling(bool enabled);
+		void Cmd_SetLodSettings(EngineLodSettings settings);
+		void Cmd_UpdateDraws();
+		void Cmd_ShutDown();
 
 #if BENCHMARK_MODE
-		void Cmd_StartBenchmark(std::shared_ptr<void> rsc);
-		void Cmd_StopBenchmark(std::shared_ptr<void> rsc);
+		void Cmd_StartBenchmark();
+		void Cmd_StopBenchmark();
 #endif
 	};
 }
@@ -3,10 +3,14 @@
 
 EngineSettings::EngineSettings()
 	: threadingMode(kEngineSingleThreaded)
+	, framesInFlight(0)
+	, jobWorkerCount(~0u)
 {
 }
 
 EngineSettings::EngineSettings(EngineSettingsTemplate settingsTemplate)
+	: framesInFlight(0)
+	, jobWorkerCount(~0u)
 {
 	switch (settingsTemplate)
 	{
@@ -30,7 +34,8 @@ EngineSettings::EngineSettings(EngineSettingsTemplate settingsTemplate)
 	gfxSettings.requiredDeviceExtensions = 
 	{
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-		VK_NV_MESH_SHADER_EXTENSION_NAME
+		VK_NV_MESH_SHADER_EXTENSION_NAME,
+		VK_EXT_MULTI_DRAW_EXTENSION_NAME
 	};
 	gfxSettings.swapchainImageCount = kEngineSwapchainDoubleBuffering;
 	
@@ -41,6 +46,13 @@ EngineSettings::EngineSettings(EngineSettingsTemplate settingsTemplate)
 	gfxSettings.preferredPresentModes = { kEnginePresentMailbox, kEnginePresentFifo};
 #endif
 	gfxSettings.renderMode = static_cast<EngineRenderMode>(kDefaultEngineRenderMode);
+	gfxSettings.instancingEnabled = false;
+	gfxSettings.gpuOcclusionCullingEnabled = false;
+	// one vkCmdDrawMultiIndexedEXT per run of draws, falls back to firstInstance without VK_EXT_multi_draw
+	gfxSettings.drawIdMode = kEngineDrawIdMultiDraw;
+	gfxSettings.lod.errorThreshold = 1.0f;
+	gfxSettings.lod.hysteresis = 0.25f;
+	gfxSettings.lod.minProjectedSize = 1.0f;
 }
 
 std::string EngineGraphicsSettings::RenderingModeToString(EngineRenderMode mode)
@@ -44,6 +44,26 @@ enum EngineRenderMode : uint32_t
 
 inline constexpr uint32_t kDefaultEngineRenderMode = kEngineRenderModeGPUDriven;
 
+// How Traditional draws tell basic.vert which draw data is theirs
+enum EngineDrawIdMode : uint32_t
+{
+	// draw index pushed before every draw
+	kEngineDrawIdPushConstant,
+	// draw index goes in as firstInstance and comes out as gl_InstanceIndex
+	kEngineDrawIdFirstInstance,
+	// consecutive draws go out in one vkCmdDrawMultiIndexedEXT, firstInstance + gl_DrawID. Falls back to
+	// kEngineDrawIdFirstInstance without VK_EXT_multi_draw
+	kEngineDrawIdMultiDraw
+};
+
+// Screen-space error lod selection, see Utils/LodSelection.h
+struct EngineLodSettings
+{
+	float errorThreshold;		// px, the coarsest lod whose simplification error projects under this gets drawn
+	float hysteresis;			// fraction of the threshold the error has to move past before a drawn lod changes
+	float minProjectedSize;		// px, objects whose bounding sphere projects smaller than this aren't drawn, 0 turns it off
+};
+
 struct EngineGraphicsSettings
 {
 	std::vector<const char*> requiredExtensions;
@@ -52,6 +72,10 @@ struct EngineGraphicsSettings
 	EngineSwapchainImageCount swapchainImageCount;
 	EngineRenderMode renderMode;
 	bool validationLayersEnabled;
+	bool instancingEnabled;		// draws of the same mesh and lod are merged into one instanced draw
+	bool gpuOcclusionCullingEnabled;	// two-phase Hi-Z occlusion culling in the GPU-Driven modes
+	EngineDrawIdMode drawIdMode;
+	EngineLodSettings lod;
 
 	uint32_t numberOfFramesToBenchmark;
 
@@ -66,6 +90,11 @@ struct EngineSettings
 	EngineSettings(EngineSettingsTemplate settingsTemplate);
 	
 	EngineThreadingMode threadingMode;
+	// Multi-threaded only. How many render snapshots the main thread can be ahead of the render thread.
+	// 0 keeps the old lockstep where both threads meet at a barrier every frame.
+	uint32_t framesInFlight;
+	// Job system workers, on top of main and render threads. ~0u (prl::kAutoWorkerCount) picks one per free physical core
+	uint32_t jobWorkerCount;
 	EngineGraphicsSettings gfxSettings;
 };
 
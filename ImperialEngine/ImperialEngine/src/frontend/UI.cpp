@@ -81,6 +81,22 @@ namespace imp
 				sprintf_s(overlay, "avg %.3f ms", avg.cull);
 				ImGui::PlotHistogram("Cull Time", &stats.data()->cull, stats.size(), 0, overlay, 0.0f, maxScale.cull * 2.0f, ImVec2(0, 80.0f), sizeof(FrameTimeRow));
 
+				if (engine.IsOcclusionCullingEnabled() || engine.IsGPUOcclusionCullingEnabled())
+				{
+					// the GPU doesn't count what it culled
+					if (engine.IsOcclusionCullingEnabled())
+						sprintf_s(overlay, "avg %.3f ms, %llu occluded", avg.occlusionCull, static_cast<uint64_t>(std::max(avg.occluded, 0.0f)));
+					else
+						sprintf_s(overlay, "avg %.3f ms", avg.occlusionCull);
+					ImGui::PlotHistogram("Occlusion Cull Time", &stats.data()->occlusionCull, stats.size(), 0, overlay, 0.0f, maxScale.occlusionCull * 2.0f, ImVec2(0, 80.0f), sizeof(FrameTimeRow));
+				}
+
+				sprintf_s(overlay, "avg %.3f ms", avg.syncWait);
+				ImGui::PlotHistogram("Sync Wait", &stats.data()->syncWait, stats.size(), 0, overlay, 0.0f, maxScale.syncWait * 2.0f, ImVec2(0, 80.0f), sizeof(FrameTimeRow));
+
+				if (ImGui::Button("Dump Frame Graph"))
+					engine.RequestFrameGraphDump();
+
 				ImGui::EndTabItem();
 			}
 			if (ImGui::BeginTabItem("Camera"))
@@ -103,6 +119,29 @@ namespace imp
 						showError = renderItemSelected != static_cast<int>(mode);
 					}
 
+					bool cullWithBVH = engine.IsCullingBVHEnabled();
+					if (ImGui::Checkbox("Cull With BVH (Traditional)", &cullWithBVH))
+						engine.SetCullingBVHEnabled(cullWithBVH);
+
+					bool occlusionCulling = engine.IsOcclusionCullingEnabled();
+					if (ImGui::Checkbox("CPU Occlusion Culling (Traditional)", &occlusionCulling))
+						engine.SetOcclusionCullingEnabled(occlusionCulling);
+
+					bool gpuOcclusionCulling = engine.IsGPUOcclusionCullingEnabled();
+					if (ImGui::Checkbox("Hi-Z Occlusion Culling (GPU-Driven)", &gpuOcclusionCulling))
+						engine.SetGPUOcclusionCullingEnabled(gpuOcclusionCulling);
+
+					bool instancing = engine.IsInstancingEnabled();
+					if (ImGui::Checkbox("Instancing", &instancing))
+						engine.SetInstancingEnabled(instancing);
+
+					auto lod = engine.GetLodSettings();
+					bool lodChanged = ImGui::SliderFloat("LOD Error (px)", &lod.errorThreshold, 0.1f, 16.0f, "%.2f");
+					lodChanged |= ImGui::SliderFloat("LOD Hysteresis", &lod.hysteresis, 0.0f, 0.9f, "%.2f");
+					lodChanged |= ImGui::SliderFloat("Min Projected Size (px)", &lod.minProjectedSize, 0.0f, 8.0f, "%.2f");
+					if (lodChanged)
+						engine.SetLodSettings(lod);
+
 					if (showError)
 					{
 						ImVec4 col(1.0f, 0.0f, 0.0f, 1.0f);